@@ -24,10 +24,11 @@ export { dataset } from "./dataset";
 export { experiment } from "./experiment";
 export { load } from "./npy";
 export { backend } from "./backend";
-export { sgd, minimize } from "./optimizers";
+export { adam, sgd, minimize } from "./optimizers";
 export { plot, imshow } from "./matplotlib";
-export { imread, imsave } from "./im";
+export { imread, imreadBatch, imsave } from "./im";
 export { tensor, Tensor } from "./tensor";
+export { trace } from "./trace";
 export { grad, multigrad, multigradAndVal, gradAndVal, gradParams, ParamsFn }
   from "./backprop";
 export { ones, zeros, randn } from "./ops";
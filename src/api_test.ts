@@ -1373,3 +1373,25 @@ test(async function api_stopGradientSwallowedErr() {
   // DL: Operands could not be broadcast together with shapes
   assert(error && error.message.match(/shape/i));
 });
+
+test(async function api_sgdMomentum() {
+  const params = api.params();
+  const loss = (p: api.Params) =>
+    p.define("w", () => [1, 2]).mul([3, 4]).reduceSum();
+  api.sgd({ lr: 0.1, momentum: 0.5, params }, loss);
+  assertAllClose(params.get("w"), [0.7, 1.6]);
+  // The accumulator is now [4.5, 6].
+  api.sgd({ lr: 0.1, momentum: 0.5, params }, loss);
+  assertAllClose(params.get("w"), [0.25, 1.0]);
+});
+
+test(async function api_adam() {
+  const params = api.params();
+  const loss = (p: api.Params) =>
+    p.define("w", () => [1, 2]).mul([3, 4]).reduceSum();
+  // With a constant gradient, each step moves the params by about lr.
+  api.adam({ lr: 0.1, params }, loss);
+  assertAllClose(params.get("w"), [0.9, 1.9]);
+  api.adam({ lr: 0.1, params }, loss);
+  assertAllClose(params.get("w"), [0.8, 1.8]);
+});
@@ -0,0 +1,84 @@
+// Load test for the async binding API. Simulates a server handling
+// concurrent inference requests, each running a large MatMul and reading
+// back the result, and reports the request latency distribution and how
+// long the event loop was blocked. Runs once with the synchronous API and
+// once with executeAsync/asArrayBufferAsync.
+import * as tf from "./tf";
+
+tf.loadBinding();
+const binding = tf.binding;
+const ctx = tf.ctx;
+
+const size = 512;
+const concurrency = 8;
+const numRequests = 200;
+
+const x = new binding.Handle(new Float32Array(size * size).fill(1),
+                             [size, size], binding.TF_FLOAT);
+const attrs = [
+  ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+  ["transpose_a", binding.ATTR_BOOL, false],
+  ["transpose_b", binding.ATTR_BOOL, false],
+];
+
+async function requestSync(): Promise<void> {
+  const [r] = binding.execute(ctx, "MatMul", attrs, [x, x]);
+  binding.asArrayBuffer(r);
+}
+
+async function requestAsync(): Promise<void> {
+  const [r] = await binding.executeAsync(ctx, "MatMul", attrs, [x, x]);
+  await binding.asArrayBufferAsync(r);
+}
+
+function percentile(sorted: number[], p: number): number {
+  return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+async function loadTest(name: string, request: () => Promise<void>) {
+  // Measure event loop blocking as the lateness of a 1ms interval timer.
+  let maxLag = 0;
+  let totalLag = 0;
+  let last = Date.now();
+  const timer = setInterval(() => {
+    const now = Date.now();
+    const lag = Math.max(0, now - last - 1);
+    maxLag = Math.max(maxLag, lag);
+    totalLag += lag;
+    last = now;
+  }, 1);
+
+  const latencies: number[] = [];
+  let issued = 0;
+  const start = Date.now();
+  async function worker() {
+    while (issued < numRequests) {
+      issued++;
+      const t = Date.now();
+      await request();
+      latencies.push(Date.now() - t);
+      // Yield to the event loop between requests, like a server would.
+      await new Promise((resolve) => setImmediate(resolve));
+    }
+  }
+  const workers = [];
+  for (let i = 0; i < concurrency; i++) workers.push(worker());
+  await Promise.all(workers);
+  const elapsed = Date.now() - start;
+  clearInterval(timer);
+
+  latencies.sort((a, b) => a - b);
+  const throughput = Math.round(numRequests * 1000 / elapsed);
+  console.log(`${name}  requests/s: ${throughput}` +
+              `  p50: ${percentile(latencies, 0.5)}ms` +
+              `  p90: ${percentile(latencies, 0.9)}ms` +
+              `  p99: ${percentile(latencies, 0.99)}ms` +
+              `  loop blocked: ${totalLag}ms (max ${maxLag}ms)`);
+}
+
+(async() => {
+  for (let i = 0; i < 3; i++) {
+    await loadTest("sync ", requestSync);
+    await loadTest("async", requestAsync);
+  }
+})();
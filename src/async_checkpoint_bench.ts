@@ -0,0 +1,69 @@
+// Measures how checkpointing affects training step times, with checkpoints
+// written during the step and in the background. Saves a checkpoint every
+// 20 steps, and reports the median step time, the 99th percentile and the
+// slowest step. With background saves the tail should stay close to the
+// median. Takes the size of the extra params in MB, 256 by default. Usage:
+//
+//   PROPEL=tf ts-node src/async_checkpoint_bench.ts 256
+import * as os from "os";
+import * as path from "path";
+import * as rimraf from "rimraf";
+import { randn } from "./api";
+import { benchAsync } from "./benchmark";
+import { DiskExperiment } from "./disk_experiment";
+import * as layers from "./layers";
+
+const numSteps = 200;
+const saveEvery = 20;
+const megs = Number(process.argv[2] || 256);
+
+process.env.PROPEL_ROOT = path.join(os.tmpdir(), "propel_async_bench");
+
+const x = randn([64, 784]);
+const labels = randn([64, 10]).softmax();
+
+function percentile(sorted: number[], p: number): number {
+  return sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))];
+}
+
+async function run(name: string, asyncSave: boolean): Promise<void> {
+  rimraf.sync(process.env.PROPEL_ROOT);
+  const exp = new DiskExperiment(name, {
+    asyncSave,
+    printStepSecs: 1e9,
+    saveOnExit: false,
+    saveSecs: 0,
+  });
+  await exp.createOrRestore();
+  // Params which aren't trained, so the checkpoints are big enough to be
+  // slow to write.
+  exp.params.define("ballast", () => randn([megs * (1 << 18)]));
+  let i = 0;
+  let lastSave = 0;
+  // Each repetition is a single step, so the result has every step time.
+  // The first call is the warm up.
+  const r = await benchAsync(name, async() => {
+    // saveSecs is 0, so each step saves unless it's held back here.
+    exp.opts.saveSecs = i - lastSave >= saveEvery ? 0 : 1e9;
+    if (exp.opts.saveSecs === 0) lastSave = i;
+    i++;
+    exp.sgd({ lr: 0.01 }, p => {
+      const h = layers.linear(x, p.scope("L1"), 256).relu();
+      const logits = layers.linear(h, p.scope("L2"), 10);
+      return logits.softmaxCE(labels).reduceMean();
+    });
+    // Let the promises of finished saves settle.
+    await new Promise(resolve => setImmediate(resolve));
+  }, { warmupMs: 0, repMs: 0, reps: numSteps });
+  await exp.flush();
+  const sorted = r.reps.map(ns => ns / 1e6).sort((a, b) => a - b);
+  console.log(`${name}: median ${percentile(sorted, 0.5).toFixed(2)} ms, ` +
+              `p99 ${percentile(sorted, 0.99).toFixed(2)} ms, ` +
+              `max ${sorted[sorted.length - 1].toFixed(2)} ms`);
+}
+
+(async() => {
+  await run("sync save", false);
+  await run("async save", true);
+  rimraf.sync(process.env.PROPEL_ROOT);
+})();
@@ -0,0 +1,63 @@
+// Measures binding.execute on attribute heavy ops, passing attribute names
+// as strings against passing the ids returned by binding.internAttrName.
+import { bench } from "./benchmark";
+import * as tf from "./tf";
+
+tf.loadBinding();
+const binding = tf.binding;
+const ctx = tf.ctx;
+
+function interned(attrs) {
+  return attrs.map(([name, type, value]) => {
+    return [binding.internAttrName(name), type, value];
+  });
+}
+
+const image = new binding.Handle(new Float32Array(16), [1, 4, 4, 1],
+                                 binding.TF_FLOAT);
+const filter = new binding.Handle(new Float32Array(4), [2, 2, 1, 1],
+                                  binding.TF_FLOAT);
+const axes = new binding.Handle(new Int32Array([1, 2]), [2],
+                                binding.TF_INT32);
+
+const cases = [
+  {
+    name: "Conv2D",
+    inputs: [image, filter],
+    attrs: [
+      ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+      ["strides", binding.ATTR_INT_LIST, [1, 1, 1, 1]],
+      ["use_cudnn_on_gpu", binding.ATTR_BOOL, false],
+      ["padding", binding.ATTR_STRING, "SAME"],
+      ["data_format", binding.ATTR_STRING, "NHWC"],
+      ["dilations", binding.ATTR_INT_LIST, [1, 1, 1, 1]],
+    ],
+  },
+  {
+    name: "MaxPool",
+    inputs: [image],
+    attrs: [
+      ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+      ["ksize", binding.ATTR_INT_LIST, [1, 2, 2, 1]],
+      ["strides", binding.ATTR_INT_LIST, [1, 2, 2, 1]],
+      ["padding", binding.ATTR_STRING, "VALID"],
+      ["data_format", binding.ATTR_STRING, "NHWC"],
+    ],
+  },
+  {
+    name: "Sum",
+    inputs: [image, axes],
+    attrs: [
+      ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+      ["Tidx", binding.ATTR_TYPE, binding.TF_INT32],
+      ["keep_dims", binding.ATTR_BOOL, false],
+    ],
+  },
+];
+
+for (const c of cases) {
+  const ids = interned(c.attrs);
+  bench(`${c.name} names`, () => binding.execute(ctx, c.name, c.attrs,
+                                                 c.inputs));
+  bench(`${c.name} ids`, () => binding.execute(ctx, c.name, ids, c.inputs));
+}
@@ -95,7 +95,10 @@ export function convertStorage(x: types.TensorLike,
     }
     const shape = inferShape(x);
     const data = flatten(x) as number[];
-    return create(makeTypedArray(data, dtype), shape, dtype, device);
+    // Allocated by the backend, so that it can use the data without copying.
+    const ta = bo.allocTypedArray(data.length, dtype || "float32");
+    ta.set(data);
+    return create(ta, shape, dtype, device);
   } else if (x instanceof Tensor) {
     if (x.device !== device) {
       return bo.copyToDevice(x.storage, device);
@@ -18,7 +18,7 @@
 
 import { fill, Params } from "./api";
 import { getBackwardFunc } from "./ops";
-import { NamedTensors, tensor, Tensor } from "./tensor";
+import { gc, NamedTensors, tensor, Tensor } from "./tensor";
 import * as types from "./types";
 import { assert, assertEqual, CounterMap, log } from "./util";
 import * as util from "./util";
@@ -181,6 +181,24 @@ export function gradAndVal(f, argnum = 0) {
 function imperativeGrad(target: Tensor,
                         sources: Tensor[],
                         tape: Tape): Tensor[] {
+  // If an outer tape is recording, the backward pass is part of its trace
+  // and must be kept for higher order gradients.
+  if (tapeStack.length > 0) {
+    return backpropagate(target, sources, tape);
+  }
+  // Otherwise the intermediate gradients can be freed right away instead of
+  // waiting for the garbage collector.
+  let result: Tensor[];
+  gc((keep) => {
+    result = backpropagate(target, sources, tape);
+    for (const t of result) keep(t);
+  });
+  return result;
+}
+
+function backpropagate(target: Tensor,
+                       sources: Tensor[],
+                       tape: Tape): Tensor[] {
   const readyOps: number[] = [];
   const sourceIds = new Set(sources.map((t) => t.id));
 
@@ -334,6 +352,11 @@ export function popTape(): Tape {
   return tapeStack.pop();
 }
 
+// Whether any tape is recording the ops being executed.
+export function isRecording(): boolean {
+  return tapeStack.length > 0;
+}
+
 // Marks this tensor to be watched by all tapes in the stack.
 export function watch(t: Tensor) {
   for (const tape of tapeStack) {
@@ -0,0 +1,73 @@
+// Compares an MLP forward pass executed op by op against the same ops run
+// with a single binding.executeBatch call.
+import { bench } from "./benchmark";
+import * as tf from "./tf";
+
+tf.loadBinding();
+const binding = tf.binding;
+const ctx = tf.ctx;
+
+const batchSize = 4;
+const sizes = [32, 32, 32, 32, 10];
+
+function randomHandle(shape: number[]) {
+  const size = shape.reduce((a, b) => a * b, 1);
+  const ta = new Float32Array(size);
+  for (let i = 0; i < size; i++) ta[i] = Math.random() - 0.5;
+  return new binding.Handle(ta, shape, binding.TF_FLOAT);
+}
+
+const x = randomHandle([batchSize, sizes[0]]);
+const weights = [];
+const biases = [];
+for (let i = 1; i < sizes.length; i++) {
+  weights.push(randomHandle([sizes[i - 1], sizes[i]]));
+  biases.push(randomHandle([sizes[i]]));
+}
+
+const tAttrs = [["T", binding.ATTR_TYPE, binding.TF_FLOAT]];
+const matmulAttrs = [
+  ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+  ["transpose_a", binding.ATTR_BOOL, false],
+  ["transpose_b", binding.ATTR_BOOL, false],
+];
+
+function forwardExecute() {
+  let h = x;
+  for (let i = 0; i < weights.length; i++) {
+    h = binding.execute(ctx, "MatMul", matmulAttrs, [h, weights[i]])[0];
+    h = binding.execute(ctx, "Add", tAttrs, [h, biases[i]])[0];
+    h = binding.execute(ctx, "Relu", tAttrs, [h])[0];
+  }
+  return h;
+}
+
+// The program only depends on the network shape, so build it once.
+const matmul = binding.prepareOp(ctx, "MatMul", matmulAttrs);
+const add = binding.prepareOp(ctx, "Add", tAttrs);
+const relu = binding.prepareOp(ctx, "Relu", tAttrs);
+const inputs = [x, ...weights, ...biases];
+const code = [];
+let numValues = inputs.length;
+let h = 0;
+for (let i = 0; i < weights.length; i++) {
+  const w = 1 + i;
+  const b = 1 + weights.length + i;
+  code.push(0, 2, h, w, 1);
+  code.push(1, 2, numValues++, b, 1);
+  code.push(2, 1, numValues++, 1);
+  h = numValues++;
+}
+const program = {
+  ops: [matmul, add, relu],
+  inputs,
+  code: new Int32Array(code),
+  outputs: new Int32Array([h]),
+};
+
+function forwardBatch() {
+  return binding.executeBatch(ctx, program)[0];
+}
+
+bench("execute", forwardExecute);
+bench("executeBatch", forwardBatch);
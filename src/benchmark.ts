@@ -0,0 +1,170 @@
+/*!
+   Copyright 2018 Propel http://propel.site/.  All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+// A small benchmark harness for Node. Each benchmark is warmed up, then timed
+// over several repetitions, each long enough for the timer to be accurate.
+// The results are written as JSON in the same format as build/tf_bench, the
+// C++ harness in src/tf_bench.cc, so they can be compared with each other or
+// with an earlier run.
+import * as fs from "fs";
+import { gc } from "./tensor";
+
+export interface BenchOpts {
+  warmupMs?: number;
+  repMs?: number;
+  reps?: number;
+}
+
+export interface BenchResult {
+  name: string;
+  // Mean, standard deviation and minimum over the repetitions.
+  nsPerOp: number;
+  stddev: number;
+  min: number;
+  iterations: number;
+  reps: number[];
+}
+
+export interface BenchResults {
+  runtime: string;
+  date: string;
+  results: BenchResult[];
+}
+
+function nowNs(): number {
+  const [s, ns] = process.hrtime();
+  return s * 1e9 + ns;
+}
+
+// Runs fn count times in a scope, so that tensors and handles it creates are
+// released between repetitions.
+function run(fn: () => void, count: number): number {
+  const start = nowNs();
+  gc(() => {
+    for (let i = 0; i < count; i++) fn();
+  });
+  return nowNs() - start;
+}
+
+export function bench(name: string, fn: () => void,
+                      opts: BenchOpts = {}): BenchResult {
+  const { warmupMs = 200, repMs = 200, reps = 5 } = opts;
+
+  // Warm up, doubling the count to find how many iterations fill a
+  // repetition.
+  let count = 1;
+  let elapsed = run(fn, count);
+  let warmup = elapsed;
+  while (warmup < warmupMs * 1e6) {
+    count *= 2;
+    elapsed = run(fn, count);
+    warmup += elapsed;
+  }
+  const iterations = Math.max(1, Math.round(count * repMs * 1e6 / elapsed));
+
+  const times: number[] = [];
+  for (let i = 0; i < reps; i++) {
+    times.push(run(fn, iterations) / iterations);
+  }
+  return summarize(name, iterations, times);
+}
+
+async function runAsync(fn: () => Promise<void>,
+                        count: number): Promise<number> {
+  const start = nowNs();
+  for (let i = 0; i < count; i++) await fn();
+  return nowNs() - start;
+}
+
+// Like bench, for functions which return a promise. Each call is awaited
+// before the next starts. Slow operations, like writing a checkpoint, can
+// be timed once per repetition by passing warmupMs and repMs of 0.
+export async function benchAsync(name: string, fn: () => Promise<void>,
+                                 opts: BenchOpts = {}): Promise<BenchResult> {
+  const { warmupMs = 200, repMs = 200, reps = 5 } = opts;
+
+  let count = 1;
+  let elapsed = await runAsync(fn, count);
+  let warmup = elapsed;
+  while (warmup < warmupMs * 1e6) {
+    count *= 2;
+    elapsed = await runAsync(fn, count);
+    warmup += elapsed;
+  }
+  const iterations = Math.max(1, Math.round(count * repMs * 1e6 / elapsed));
+
+  const times: number[] = [];
+  for (let i = 0; i < reps; i++) {
+    times.push(await runAsync(fn, iterations) / iterations);
+  }
+  return summarize(name, iterations, times);
+}
+
+function summarize(name: string, iterations: number,
+                   times: number[]): BenchResult {
+  const reps = times.length;
+  const mean = times.reduce((a, b) => a + b) / reps;
+  const variance = times.reduce((a, t) => a + (t - mean) * (t - mean), 0) /
+                   reps;
+  const result = {
+    name,
+    nsPerOp: mean,
+    stddev: Math.sqrt(variance),
+    min: Math.min(...times),
+    iterations,
+    reps: times,
+  };
+  printResult(result);
+  return result;
+}
+
+function pad(s: string, n: number): string {
+  return s.length >= n ? s : s + " ".repeat(n - s.length);
+}
+
+export function printResult(r: BenchResult): void {
+  const rsd = (100 * r.stddev / r.nsPerOp).toFixed(1);
+  console.log(`${pad(r.name, 40)} ${r.nsPerOp.toFixed(0)} ns/op ` +
+              `±${rsd}%  (${r.reps.length} x ${r.iterations})`);
+}
+
+export function writeResults(path: string, results: BenchResult[]): void {
+  const out: BenchResults = {
+    runtime: "node " + process.version,
+    date: new Date().toISOString(),
+    results,
+  };
+  fs.writeFileSync(path, JSON.stringify(out, null, 2));
+}
+
+export function readResults(path: string): BenchResults {
+  return JSON.parse(fs.readFileSync(path, "utf8"));
+}
+
+// Prints the ratio of each result to the one of the same name in baseline.
+// A ratio above 1 means results is slower.
+export function compareResults(results: BenchResult[],
+                               baseline: BenchResults): void {
+  console.log(`\nCompared to ${baseline.runtime} (${baseline.date}):`);
+  const byName = new Map<string, BenchResult>();
+  for (const b of baseline.results) byName.set(b.name, b);
+  for (const r of results) {
+    const b = byName.get(r.name);
+    if (!b) continue;
+    const ratio = r.nsPerOp / b.nsPerOp;
+    const diff = r.nsPerOp - b.nsPerOp;
+    console.log(`${pad(r.name, 40)} ${ratio.toFixed(2)}x ` +
+                `(${diff >= 0 ? "+" : ""}${diff.toFixed(0)} ns/op)`);
+  }
+}
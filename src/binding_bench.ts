@@ -0,0 +1,152 @@
+// Benchmark suite for the hot paths of the TensorFlow binding, from single
+// binding calls up to a training step. Usage:
+//
+//   ts-node src/binding_bench.ts [--json out.json] [--baseline base.json]
+//
+// --baseline compares against an earlier --json output, or against the
+// output of build/Release/tf_bench, which runs the same binding level cases
+// directly on the TF C API and so shows the overhead of the binding.
+import { conv2d, params, randn, sgd } from "./api";
+import { bench, BenchResult, compareResults, readResults, writeResults }
+  from "./benchmark";
+import { cases } from "./conv_testcases";
+import * as layers from "./layers";
+import * as tf from "./tf";
+
+tf.loadBinding();
+const binding = tf.binding;
+const ctx = tf.ctx;
+
+function arg(name: string): string | undefined {
+  const i = process.argv.indexOf(name);
+  return i >= 0 ? process.argv[i + 1] : undefined;
+}
+
+function floatHandle(shape: number[]) {
+  const size = shape.reduce((a, b) => a * b, 1);
+  return new binding.Handle(new Float32Array(size).fill(1), shape,
+                            binding.TF_FLOAT);
+}
+
+const results: BenchResult[] = [];
+const floatAttrs = [["T", binding.ATTR_TYPE, binding.TF_FLOAT]];
+const scalar = floatHandle([1]);
+
+// execute() latency by op and number of inputs.
+results.push(bench("execute Neg [1]", () => {
+  binding.execute(ctx, "Neg", floatAttrs, [scalar]);
+}));
+results.push(bench("execute Add [1] x2", () => {
+  binding.execute(ctx, "Add", floatAttrs, [scalar, scalar]);
+}));
+for (const n of [4, 8]) {
+  const inputs = new Array(n).fill(scalar);
+  const attrs = [...floatAttrs, ["N", binding.ATTR_INT, n]];
+  results.push(bench(`execute AddN [1] x${n}`, () => {
+    binding.execute(ctx, "AddN", attrs, inputs);
+  }));
+}
+const matrix = floatHandle([100, 100]);
+const matmulAttrs = [
+  ["transpose_a", binding.ATTR_BOOL, false],
+  ["transpose_b", binding.ATTR_BOOL, false],
+  ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+];
+results.push(bench("execute MatMul [100,100]", () => {
+  binding.execute(ctx, "MatMul", matmulAttrs, [matrix, matrix]);
+}));
+const negOp = binding.prepareOp(ctx, "Neg", floatAttrs);
+results.push(bench("executePrepared Neg [1]", () => {
+  binding.executePrepared(negOp, [scalar]);
+}));
+
+// Attribute marshalling, by name and by interned id.
+const image = floatHandle([1, 4, 4, 1]);
+const filter = floatHandle([2, 2, 1, 1]);
+const convAttrs = [
+  ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+  ["strides", binding.ATTR_INT_LIST, [1, 1, 1, 1]],
+  ["use_cudnn_on_gpu", binding.ATTR_BOOL, false],
+  ["padding", binding.ATTR_STRING, "SAME"],
+  ["data_format", binding.ATTR_STRING, "NHWC"],
+  ["dilations", binding.ATTR_INT_LIST, [1, 1, 1, 1]],
+];
+const convAttrIds = convAttrs.map(([name, type, value]) => {
+  return [binding.internAttrName(name), type, value];
+});
+results.push(bench("attrs Conv2D names", () => {
+  binding.execute(ctx, "Conv2D", convAttrs, [image, filter]);
+}));
+results.push(bench("attrs Conv2D ids", () => {
+  binding.execute(ctx, "Conv2D", convAttrIds, [image, filter]);
+}));
+
+// Handle creation, with explicit dispose and left to the scope.
+const one = new Float32Array([1]);
+results.push(bench("Handle new+dispose [1]", () => {
+  binding.dispose(new binding.Handle(one, [1], binding.TF_FLOAT));
+}));
+results.push(bench("Handle new [1]", () => {
+  // tslint:disable-next-line:no-unused-expression
+  new binding.Handle(one, [1], binding.TF_FLOAT);
+}));
+
+// createSmallHandle(), cached and too large to be cached.
+const device = binding.getDevice(scalar);
+results.push(bench("createSmallHandle scalar", () => {
+  binding.createSmallHandle(ctx, binding.TF_INT32, device, 1);
+}));
+const largeSmall = new Float32Array(32);
+results.push(bench("createSmallHandle [32]", () => {
+  binding.createSmallHandle(ctx, binding.TF_FLOAT, device, largeSmall);
+}));
+
+// Readback at several sizes.
+for (const size of [1, 1024, 1024 * 1024]) {
+  const h = floatHandle([size]);
+  results.push(bench(`asArrayBuffer [${size}]`, () => {
+    binding.asArrayBuffer(h);
+  }));
+}
+
+// copyToDevice(), to the same device and to each other device.
+for (const d of binding.listDevices(ctx)) {
+  for (const size of [1, 1024 * 1024]) {
+    const h = floatHandle([size]);
+    const name = d.name.replace(/.*device:/, "");
+    results.push(bench(`copyToDevice ${name} [${size}]`, () => {
+      binding.copyToDevice(ctx, h, d.name);
+    }));
+  }
+}
+
+// Convolutions with the shapes of the forward conv tests.
+for (const c of cases.fw) {
+  if (c.skip === "tf" || c.inputShape.some(d => d === 0)) continue;
+  const input = randn(c.inputShape);
+  const convFilter = randn(c.filterShape);
+  const opts = { stride: c.stride, padding: c.padding };
+  results.push(bench(`conv2d ${c.name}`, () => {
+    conv2d(input, convFilter, opts);
+  }));
+}
+
+// An MLP training step.
+const x = randn([64, 784]);
+const labels = randn([64, 10]).softmax();
+const lossFn = p => {
+  const h = layers.linear(x, p.scope("L1"), 200).relu();
+  const logits = layers.linear(h, p.scope("L2"), 10);
+  return logits.softmaxCE(labels).reduceMean();
+};
+const mlpParams = params();
+// The first step creates the params.
+sgd({ lr: 0.01, params: mlpParams }, lossFn);
+results.push(bench("mlp train step [64,784]", () => {
+  sgd({ lr: 0.01, params: mlpParams }, lossFn);
+}));
+
+const jsonPath = arg("--json");
+if (jsonPath) writeResults(jsonPath, results);
+const baselinePath = arg("--baseline");
+if (baselinePath) compareResults(results, readResults(baselinePath));
@@ -0,0 +1,187 @@
+/*!
+   Copyright 2018 Propel http://propel.site/.  All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+// Packed checkpoints store all params of a checkpoint in one file, which
+// the TF binding writes straight from the tensors and maps when reading.
+// The format is described in src/tf_binding.cc. Only the TF backend can
+// write them, and DiskExperiment writes a npy file per param on other
+// backends. Those read packed checkpoints with readPortable().
+
+import { bo } from "./backend";
+import { Params, params as createParams } from "./params";
+import { Tensor } from "./tensor";
+import * as tf from "./tf";
+import { CheckpointFile } from "./tf_binding";
+import * as types from "./types";
+import { nodeRequire } from "./util";
+
+/** The name of the packed checkpoint file in a checkpoint directory. */
+export const fileName = "params.ckpt";
+
+/** Writes params to a packed checkpoint at path, replacing any file there.
+ * Returns the size of the file in bytes.
+ */
+export function save(path: string, params: Params): number {
+  const [names, handles] = namesAndHandles(params);
+  return tf.binding.saveCheckpoint(path, names, handles);
+}
+
+/** Like save(), but writes the file in the background. The params are
+ * snapshotted before returning, so they may be updated straight away. The
+ * promise resolves with the size of the file once it has been renamed into
+ * place.
+ */
+export function saveAsync(path: string, params: Params): Promise<number> {
+  const [names, handles] = namesAndHandles(params);
+  return tf.binding.saveCheckpointAsync(path, names, handles);
+}
+
+/** Whether name is a file left by a save which is still in progress, or
+ * which was interrupted.
+ */
+export function isTempFile(name: string): boolean {
+  return /\.ckpt\.tmp\d*$/.test(name);
+}
+
+function namesAndHandles(params: Params): [string[], any[]] {
+  const names: string[] = [];
+  const handles = [];
+  for (const [name, t] of params) {
+    names.push(name);
+    handles.push((t.storage as tf.TensorTF).handle);
+  }
+  return [names, handles];
+}
+
+/** A packed checkpoint opened for reading. Params are read when they are
+ * asked for, and their tensors use the mapped file, so only the parts of
+ * the file that are used get loaded.
+ */
+export class PackedCheckpoint {
+  private file: CheckpointFile;
+  private indices = new Map<string, number>();
+
+  /** With verify, the checksum of each param is checked when it's read. */
+  constructor(readonly path: string, readonly verify = true) {
+    this.file = tf.binding.openCheckpoint(path);
+    this.file.entries.forEach((e, i) => this.indices.set(e.name, i));
+  }
+
+  get names(): string[] {
+    return this.file.entries.map(e => e.name);
+  }
+
+  has(name: string): boolean {
+    return this.indices.has(name);
+  }
+
+  get(name: string): Tensor {
+    const i = this.indices.get(name);
+    if (i === undefined) {
+      throw new Error(`No param "${name}" in checkpoint ${this.path}`);
+    }
+    const h = tf.binding.checkpointTensor(this.file, i, this.verify);
+    return new Tensor(new tf.TensorTF(h));
+  }
+
+  /** Reads all params. */
+  params(): Params {
+    const params = createParams();
+    for (const name of this.names) {
+      params.set(name, this.get(name));
+    }
+    return params;
+  }
+}
+
+// The dtypes of params in packed checkpoints, by their TF_DataType codes.
+const dtypes: { [code: number]: types.DType } = {
+  1: "float32",
+  3: "int32",
+  4: "uint8",
+  10: "bool",
+};
+
+let crcTable: Uint32Array;
+
+// The CRC-32 which the binding stores for the data of each param.
+function crc32(data: Uint8Array): number {
+  if (!crcTable) {
+    crcTable = new Uint32Array(256);
+    for (let i = 0; i < 256; i++) {
+      let c = i;
+      for (let k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320 ^ (c >>> 1) : c >>> 1;
+      crcTable[i] = c;
+    }
+  }
+  let crc = 0xFFFFFFFF;
+  for (let i = 0; i < data.length; i++) {
+    crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >>> 8);
+  }
+  return (crc ^ 0xFFFFFFFF) >>> 0;
+}
+
+/** Reads all params of a packed checkpoint without the TF binding, so that
+ * checkpoints written on TF can be restored on other backends. The file is
+ * read into memory, and the checksum of each param is checked.
+ */
+export function readPortable(path: string): Params {
+  const buf = nodeRequire("fs").readFileSync(path);
+  const view = new DataView(buf.buffer, buf.byteOffset, buf.byteLength);
+  const bad = () => new Error(`Bad packed checkpoint ${path}`);
+  let pos = 0;
+  // Offsets and dims are uint64 and int64, but are well below 2^53.
+  const u32 = () => {
+    if (pos + 4 > buf.length) throw bad();
+    pos += 4;
+    return view.getUint32(pos - 4, true);
+  };
+  const u64 = () => u32() + u32() * 0x100000000;
+
+  pos = 8;
+  if (buf.toString("latin1", 0, 8) !== "PROPELCK" || u32() !== 1) {
+    throw bad();
+  }
+  const count = u32();
+  const indexEnd = 64 + u64();
+  pos = 64;
+  const params = createParams();
+  for (let i = 0; i < count; i++) {
+    const nameSize = u32();
+    if (pos + nameSize > indexEnd) throw bad();
+    const name = buf.toString("utf8", pos, pos + nameSize);
+    pos += nameSize;
+    const dtype = dtypes[u32()];
+    const shape: number[] = [];
+    for (let numDims = u32(); numDims > 0; numDims--) shape.push(u64());
+    const offset = u64();
+    const size = u64();
+    const crc = u32();
+    if (pos > indexEnd || dtype === undefined ||
+        offset + size > buf.length) {
+      throw bad();
+    }
+    const data = buf.subarray(offset, offset + size);
+    if (crc32(data) !== crc) {
+      throw new Error(`Checksum mismatch of param "${name}" in ${path}`);
+    }
+    const length = shape.reduce((a, b) => a * b, 1);
+    const ta = bo.allocTypedArray(length, dtype);
+    if (ta.byteLength !== size) throw bad();
+    new Uint8Array(ta.buffer, ta.byteOffset, ta.byteLength).set(data);
+    params.set(name, new Tensor(bo.fromTypedArray(ta, shape, dtype)));
+  }
+  return params;
+}
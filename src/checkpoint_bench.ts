@@ -0,0 +1,75 @@
+// Compares saving and restoring params as a packed checkpoint with the npy
+// file per param layout. Takes the sizes to test in GB, 1 by default. Each
+// size is split into 1000 params. Usage:
+//
+//   PROPEL=tf ts-node src/checkpoint_bench.ts 1 10
+//
+// The files are written to the temp directory, which needs room for two
+// checkpoints of the largest size.
+import * as fs from "fs";
+import * as os from "os";
+import * as path from "path";
+import * as rimraf from "rimraf";
+import { fill, params as createParams } from "./api";
+import { benchAsync } from "./benchmark";
+import * as checkpoint from "./checkpoint";
+import * as npy from "./npy";
+import { Params } from "./params";
+
+const numParams = 1000;
+const dir = path.join(os.tmpdir(), "propel_checkpoint_bench");
+
+// The sizes are too big to repeat, so each is timed once after a single
+// warm up run.
+const once = { warmupMs: 0, repMs: 0, reps: 1 };
+
+async function time(name: string, fn: () => Promise<void>): Promise<void> {
+  const r = await benchAsync(name, fn, once);
+  console.log(`${name}: ${(r.nsPerOp / 1e9).toFixed(2)} s`);
+}
+
+async function saveNpy(p: Params): Promise<void> {
+  for (const [name, t] of p) {
+    const ab = await npy.serialize(t);
+    fs.writeFileSync(path.join(dir, name + ".npy"), Buffer.from(ab));
+  }
+}
+
+async function restoreNpy(): Promise<Params> {
+  const p = createParams();
+  for (const fn of fs.readdirSync(dir)) {
+    if (!fn.endsWith(".npy")) continue;
+    p.set(fn.replace(/\.npy$/, ""), await npy.load(path.join(dir, fn)));
+  }
+  return p;
+}
+
+(async() => {
+  const sizes = process.argv.slice(2).map(Number);
+  for (const gb of sizes.length > 0 ? sizes : [1]) {
+    rimraf.sync(dir);
+    fs.mkdirSync(dir);
+    const elements = Math.round(gb * (1 << 30) / 4 / numParams);
+    const p = createParams();
+    for (let i = 0; i < numParams; i++) {
+      p.set("p" + i, fill(i, [elements]));
+    }
+    const packedPath = path.join(dir, checkpoint.fileName);
+
+    await time(`save npy ${gb} GB`, () => saveNpy(p));
+    await time(`save packed ${gb} GB`, async() => {
+      checkpoint.save(packedPath, p);
+    });
+    await time(`restore npy ${gb} GB`, async() => {
+      await restoreNpy();
+    });
+    // Restoring only maps the file, reading the params is left to use.
+    await time(`restore packed ${gb} GB`, async() => {
+      new checkpoint.PackedCheckpoint(packedPath, false).params();
+    });
+    await time(`restore packed, verified ${gb} GB`, async() => {
+      new checkpoint.PackedCheckpoint(packedPath, true).params();
+    });
+  }
+  rimraf.sync(dir);
+})();
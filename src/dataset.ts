@@ -18,10 +18,12 @@
 import { TextDecoder } from "text-encoding";
 import { isUndefined } from "util";
 import { stack, tensor, Tensor } from "./api";
+import { backend } from "./backend";
 import * as cache from "./cache";
 import * as mnist from "./mnist";
 import * as npy from "./npy";
 import { NamedTensors } from "./tensor";
+import * as tf from "./tf";
 import { assertEqual, delay } from "./util";
 
 export function datasetFromSlices(tensors: NamedTensors): Dataset {
@@ -95,9 +97,44 @@ abstract class Dataset {
    * batch will contain smaller tensors of the remaining data.
    */
   batch(batchSize: number): Dataset {
+    // On TF, batches of slices, shuffled or not, are assembled natively.
+    if (backend === "tf") {
+      if (this instanceof SliceDataset) {
+        return new NativeBatchDataset(this, batchSize, 0);
+      }
+      if (this instanceof ShuffleDataset &&
+          this.parent instanceof SliceDataset) {
+        return new NativeBatchDataset(this.parent, batchSize, this.bufSize);
+      }
+    }
     return new BatchDataset(this, batchSize);
   }
 
+  /** Returns a dataset which applies fn to each item of this one. fn may
+   * return a promise, and up to numParallel calls run at once. Items are
+   * returned in order.
+   */
+  map(fn: MapFn, numParallel = 1): Dataset {
+    return new MapDataset(this, fn, numParallel);
+  }
+
+  /** Returns a dataset which reads up to bufSize items ahead of the ones
+   * asked for, so that reading them overlaps with whatever the caller does
+   * with the previous ones. Example:
+   *
+   *    import * as pr from "propel";
+   *    const ds = pr.dataset("mnist/train").batch(150).prefetch(2);
+   *    await ds.next();
+   */
+  prefetch(bufSize = 1): Dataset {
+    // Batches assembled natively are read ahead by the batcher itself.
+    if (this instanceof NativeBatchDataset) {
+      this.setPrefetch(bufSize);
+      return this;
+    }
+    return new PrefetchDataset(this, bufSize);
+  }
+
   /** Returns an iterator which runs through the parent data set 'count' number
    * of times. Example:
    *
@@ -117,6 +154,9 @@ abstract class Dataset {
   }
 }
 
+export type MapFn = (item: NamedTensors) =>
+    NamedTensors | Promise<NamedTensors>;
+
 class SliceDataset extends Dataset {
   pos = 0;
   batchDim?: number;
@@ -226,6 +266,163 @@ class BatchDataset extends Dataset {
   }
 }
 
+// Assembles batches of the rows of a SliceDataset in the TF binding, on
+// background threads. It reads the slices' tensors directly, so it doesn't
+// move the position of the SliceDataset.
+class NativeBatchDataset extends Dataset {
+  // The number of batches assembled ahead.
+  private prefetch = 1;
+  private batcher?: any;
+  private names: string[];
+  private rowsRequested = 0;
+
+  constructor(readonly source: SliceDataset, readonly batchSize: number,
+              readonly shuffleSize: number) {
+    super(null);
+  }
+
+  get done(): boolean {
+    return this.source.batchDim !== undefined &&
+           this.rowsRequested >= this.source.batchDim;
+  }
+
+  reset(): void {
+    this.rowsRequested = 0;
+    if (this.batcher) tf.binding.batcherReset(this.batcher);
+  }
+
+  setPrefetch(bufSize: number): void {
+    if (!(bufSize >= 1)) {
+      throw Error("Bad value for prefetch buffer size.");
+    }
+    this.prefetch = bufSize;
+    if (this.batcher) tf.binding.batcherSetPrefetch(this.batcher, bufSize);
+  }
+
+  async next(): Promise<NamedTensors> {
+    if (this.source.promise) await this.source.promise;
+    if (this.done) return null;
+    if (!this.batcher) {
+      this.names = Object.keys(this.source.tensors);
+      const handles = this.names.map(name =>
+        (this.source.tensors[name].storage as tf.TensorTF).handle);
+      const seed = Math.floor(Math.random() * 0x7fffffff);
+      this.batcher = tf.binding.newBatcher(handles, this.batchSize,
+                                           this.shuffleSize, seed,
+                                           this.prefetch);
+    }
+    this.rowsRequested += this.batchSize;
+    const handles = await tf.binding.batcherNext(this.batcher);
+    if (handles === null) return null;
+    const out: NamedTensors = {};
+    this.names.forEach((name, i) => {
+      out[name] = new Tensor(new tf.TensorTF(handles[i]));
+    });
+    return out;
+  }
+}
+
+class MapDataset extends Dataset {
+  // Results of fn which haven't been returned yet, in order.
+  private results: Array<Promise<NamedTensors>> = [];
+
+  constructor(parent: Dataset, readonly fn: MapFn,
+              readonly numParallel: number) {
+    super(parent);
+    if (!(numParallel >= 1)) {
+      throw Error("Bad value for map numParallel.");
+    }
+  }
+
+  get done(): boolean {
+    return this.results.length === 0 && this.parent.done;
+  }
+
+  reset(): void {
+    this.results = [];
+    this.parent.reset();
+  }
+
+  async next(): Promise<NamedTensors> {
+    // Start up to numParallel calls of fn before waiting for the first.
+    while (this.results.length < this.numParallel && !this.parent.done) {
+      const item = await this.parent.next();
+      if (item === null) break;
+      this.results.push(Promise.resolve(this.fn(item)));
+    }
+    if (this.results.length === 0) {
+      return null;
+    }
+    return this.results.shift();
+  }
+}
+
+class PrefetchDataset extends Dataset {
+  private buffer: NamedTensors[] = [];
+  // The parent's next() in progress. Calls to it aren't overlapped, since
+  // the other datasets don't expect that.
+  private fetch?: Promise<void>;
+  private error?: Error;
+  private resetPending = false;
+
+  constructor(parent: Dataset, readonly bufSize: number) {
+    super(parent);
+    if (!(bufSize >= 1)) {
+      throw Error("Bad value for prefetch buffer size.");
+    }
+  }
+
+  get done(): boolean {
+    return this.buffer.length === 0 && !this.fetch && this.parent.done;
+  }
+
+  reset(): void {
+    this.buffer = [];
+    // Reset the parent once the item being read is done with.
+    if (this.fetch) {
+      this.resetPending = true;
+    } else {
+      this.parent.reset();
+    }
+  }
+
+  async next(): Promise<NamedTensors> {
+    this.fill();
+    while (this.buffer.length === 0 && this.fetch) {
+      await this.fetch;
+    }
+    if (this.error) {
+      const e = this.error;
+      this.error = null;
+      throw e;
+    }
+    const out = this.buffer.length > 0 ? this.buffer.shift() : null;
+    this.fill();
+    return out;
+  }
+
+  private fill(): void {
+    if (this.fetch || this.error || this.buffer.length >= this.bufSize ||
+        this.parent.done) {
+      return;
+    }
+    this.fetch = this.parent.next().then((item) => {
+      this.fetch = null;
+      if (this.resetPending) {
+        this.resetPending = false;
+        this.parent.reset();
+      } else if (item !== null) {
+        this.buffer.push(item);
+      }
+      this.fill();
+    }, (e) => {
+      this.fetch = null;
+      this.resetPending = false;
+      this.error = e;
+    });
+  }
+}
+
 class RepeatDataset extends Dataset {
   epoch = 0;
 
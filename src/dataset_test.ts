@@ -182,3 +182,31 @@ test(async function dataset_cifar10() {
     assertAllEqual(labels, [6, 9, 9, 4]);
   }
 });
+
+test(async function dataset_shuffleBatch() {
+  const ds = dataset.datasetFromSlices({ x: pr.range(10) })
+    .shuffle(4).batch(3);
+  const sizes = [];
+  let rows = [];
+  while (!ds.done) {
+    const { x } = await ds.next();
+    sizes.push(x.shape[0]);
+    rows = rows.concat(Array.from(x.dataSync()));
+  }
+  assertAllEqual(sizes, [3, 3, 3, 1]);
+  assertAllEqual(rows.sort((a, b) => a - b), [0, 1, 2, 3, 4, 5, 6, 7, 8, 9]);
+});
+
+test(async function dataset_mapPrefetch() {
+  const ds = dataset.datasetFromSlices({ x: pr.range(5) })
+    .batch(2)
+    .map(async({ x }) => ({ x: x.mul(2) }), 2)
+    .prefetch(2)
+    .repeat(2);
+  const batches = [];
+  while (!ds.done) {
+    const { x } = await ds.next();
+    batches.push(Array.from(x.dataSync()));
+  }
+  assertEqual(JSON.stringify(batches), "[[0,2],[4,6],[8],[0,2],[4,6],[8]]");
+});
@@ -18,6 +18,8 @@
 // the browser bundle.
 
 import * as rimraf from "rimraf";
+import { backend } from "./backend";
+import * as checkpoint from "./checkpoint";
 import { Experiment, ExperimentOpts, print } from "./experiment";
 import * as npy from "./npy";
 import { Params, params as createParams } from "./params";
@@ -34,13 +36,19 @@ const fs = nodeRequire("fs");
 const path = nodeRequire("path");
 
 export class DiskExperiment extends Experiment {
+  // Background saves in progress, and the first of them which failed.
+  private pendingSaves = new Set<Promise<void>>();
+  private saveError?: Error;
+
   constructor(readonly name: string, opts?: ExperimentOpts) {
     super(name, opts);
     if (this.opts.saveOnExit) {
       process.on("exit", (exitCode) => {
         // If there's no error, save the checkpoint one file last time.
+        // Nothing asynchronous runs after "exit", so this can't be a
+        // background save, and background saves still in progress are lost.
         if (exitCode === 0 && this.step > 0) {
-          this.save();
+          this.saveNow();
         }
       });
     }
@@ -67,6 +75,16 @@ export class DiskExperiment extends Experiment {
 
   async restore(step: number): Promise<Params> {
     const p = this.checkpointPath(step);
+    const packedPath = path.join(p, checkpoint.fileName);
+    if (fs.existsSync(packedPath)) {
+      // Only the TF binding can map the file; other backends read it.
+      const params = backend === "tf" ?
+          new checkpoint.PackedCheckpoint(packedPath).params() :
+          checkpoint.readPortable(packedPath);
+      this.step_ = step;
+      this.currentParams = params;
+      return params;
+    }
     const npyFiles = filePatternSearch(p, /\.npy$/);
     const params = createParams();
     for (const fn of npyFiles) {
@@ -90,7 +108,7 @@ export class DiskExperiment extends Experiment {
   async checkpoints(): Promise<number[]> {
     const out: number[] = [];
     for (const fn of fs.readdirSync(this.dir)) {
-      if (fn.match(/^\d+$/)) {
+      if (fn.match(/^\d+$/) && this.isComplete(path.join(this.dir, fn))) {
         out.push(+fn);
       }
     }
@@ -107,22 +125,88 @@ export class DiskExperiment extends Experiment {
     return path.normalize(path.join(this.dir, String(step).padStart(8, "0")));
   }
 
-  // Saves a checkpoint to disk.
+  // A checkpoint whose packed file is still being written, or whose save
+  // was interrupted, only holds temporary files.
+  private isComplete(checkpointPath: string): boolean {
+    const files = fs.readdirSync(checkpointPath);
+    return files.indexOf(checkpoint.fileName) >= 0 ||
+           !files.some(checkpoint.isTempFile);
+  }
+
   async save(): Promise<void> {
+    if (this.opts.asyncSave && backend === "tf") {
+      await this.saveInBackground();
+    } else {
+      await this.saveNow();
+    }
+  }
+
+  async flush(): Promise<void> {
+    await Promise.all(Array.from(this.pendingSaves));
+    this.throwSaveError();
+  }
+
+  private throwSaveError(): void {
+    const e = this.saveError;
+    if (e) {
+      this.saveError = undefined;
+      throw e;
+    }
+  }
+
+  // Starts writing a packed checkpoint of the current params, and returns
+  // once they're snapshotted. If maxPendingSaves saves are already in
+  // progress, waits for the oldest first, so at most that many snapshots
+  // are held in memory. The snapshot is taken of the params and step as
+  // they are when the wait ends. Training carries on meanwhile, since
+  // Experiment skips periodic saves while one is waiting.
+  private async saveInBackground(): Promise<void> {
+    while (this.pendingSaves.size >= this.opts.maxPendingSaves) {
+      await this.pendingSaves.values().next().value;
+    }
+    this.throwSaveError();
+    const checkpointPath = this.checkpointPath(this.step);
+    ensureDirExists(checkpointPath);
+    const packedPath = path.join(checkpointPath, checkpoint.fileName);
+    const p = checkpoint.saveAsync(packedPath, this.currentParams).then(
+      (size) => {
+        this.pendingSaves.delete(p);
+        return printSaved(size, checkpointPath);
+      },
+      (e) => {
+        this.pendingSaves.delete(p);
+        this.saveError = this.saveError || e;
+      });
+    this.pendingSaves.add(p);
+  }
+
+  // Saves a checkpoint to disk. On TF it's a single packed file, otherwise
+  // a npy file per param.
+  private async saveNow(): Promise<void> {
     const checkpointPath = this.checkpointPath(this.step);
     let totalSize = 0;
-    for (const [name, tensor] of this.currentParams) {
-      const tensorPath = path.join(checkpointPath, name) + ".npy";
-      ensureDirExists(path.dirname(tensorPath));
-      const ab = await npy.serialize(tensor);
-      totalSize += ab.byteLength;
-      fs.writeFileSync(tensorPath, new Buffer(ab));
+    if (backend === "tf") {
+      ensureDirExists(checkpointPath);
+      totalSize = checkpoint.save(
+        path.join(checkpointPath, checkpoint.fileName), this.currentParams);
+    } else {
+      for (const [name, tensor] of this.currentParams) {
+        const tensorPath = path.join(checkpointPath, name) + ".npy";
+        ensureDirExists(path.dirname(tensorPath));
+        const ab = await npy.serialize(tensor);
+        totalSize += ab.byteLength;
+        fs.writeFileSync(tensorPath, new Buffer(ab));
+      }
     }
-    const megs = (totalSize / (1024 * 1024)).toFixed(2);
-    await print(`Checkpoint saved ${megs} mb`, checkpointPath);
+    await printSaved(totalSize, checkpointPath);
   }
 }
 
+async function printSaved(size: number, checkpointPath: string) {
+  const megs = (size / (1024 * 1024)).toFixed(2);
+  await print(`Checkpoint saved ${megs} mb`, checkpointPath);
+}
+
 function filePatternSearch(p: string, pattern: RegExp): string[] {
   if (isDir(p)) {
     let results = [];
@@ -17,6 +17,8 @@ import * as os from "os";
 import * as path from "path";
 import * as rimraf from "rimraf";
 import { test } from "../tools/tester";
+import { backend } from "./backend";
+import * as checkpoint from "./checkpoint";
 import { DiskExperiment } from "./disk_experiment";
 import { assert, assertAllEqual, assertEqual } from "./tensor_util";
 import { process } from "./util";
@@ -49,7 +51,9 @@ test(async function disk_experiment_saveRestore() {
   assertEqual(checkpointDirs.length, 1);
   const checkpointDir = path.join(expDir, checkpointDirs[0]);
   assert(isDir(checkpointDir));
-  assert(fs.existsSync(path.join(checkpointDir, "hello/world.npy")));
+  // TF packs the params into one file.
+  const file = backend === "tf" ? checkpoint.fileName : "hello/world.npy";
+  assert(fs.existsSync(path.join(checkpointDir, file)));
 
   // Try to load the checkpoint we just saved.
   const exp_ = new DiskExperiment("exp1");
@@ -58,3 +62,19 @@ test(async function disk_experiment_saveRestore() {
   const t = exp_.params.get("hello/world");
   assertAllEqual(t, [1, 2, 3]);
 });
+
+test(async function disk_experiment_asyncSave() {
+  setup();
+  const exp = new DiskExperiment("exp2", { asyncSave: true });
+  await exp.createOrRestore();
+  exp.params.define("w", () => [4, 5]);
+  await exp.save();
+  // Updating the params doesn't change the checkpoint being written.
+  exp.params.set("w", exp.params.get("w").add(1));
+  await exp.flush();
+  assertAllEqual(await exp.checkpoints(), [0]);
+
+  const exp_ = new DiskExperiment("exp2");
+  await exp_.createOrRestore();
+  assertAllEqual(exp_.params.get("w"), [4, 5]);
+});
@@ -85,6 +85,58 @@ export class OpsDL implements types.BackendOps {
     return d;
   }
 
+  // DL tensors are only freed by the GCScopes in tensor.ts.
+  beginScope(): void {}
+
+  endScope(keep: TensorDL[]): void {}
+
+  // DL has no graphs, traced functions always run op by op.
+  beginTrace(inputs: TensorDL[]): void {}
+
+  endTrace(outputs: TensorDL[] | null): null {
+    return null;
+  }
+
+  runTrace(trace: any, inputs: TensorDL[]): TensorDL[] {
+    throw new Error("Not implemented");
+  }
+
+  newVariable(init: TensorDL): null {
+    return null;
+  }
+
+  readVariable(v: types.Variable): TensorDL {
+    throw new Error("Not implemented");
+  }
+
+  assignVariable(v: types.Variable, value: TensorDL): void {
+    throw new Error("Not implemented");
+  }
+
+  assignAddVariable(v: types.Variable, delta: TensorDL): void {
+    throw new Error("Not implemented");
+  }
+
+  applyGradientDescent(v: types.Variable, lr: number, grad: TensorDL): void {
+    throw new Error("Not implemented");
+  }
+
+  applyMomentum(v: types.Variable, accum: types.Variable, lr: number,
+                grad: TensorDL, momentum: number): void {
+    throw new Error("Not implemented");
+  }
+
+  applyAdam(v: types.Variable, m: types.Variable, vhat: types.Variable,
+            beta1Power: number, beta2Power: number, lr: number,
+            beta1: number, beta2: number, epsilon: number,
+            grad: TensorDL): void {
+    throw new Error("Not implemented");
+  }
+
+  allocTypedArray(length: number, dtype: types.DType): types.TypedArray {
+    return makeTypedArray(length, dtype);
+  }
+
   fromTypedArray(values: types.TypedArray, shape: types.Shape,
                  dtype?: types.DType, device?: string): TensorDL {
     if (dtype == null) {
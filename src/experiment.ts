@@ -36,14 +36,23 @@ import { Tensor } from "./tensor";
 import { getOutputHandler, IS_NODE } from "./util";
 
 export interface ExperimentOpts {
+  // Write checkpoints in the background while training continues. Only
+  // used by DiskExperiment on the TF backend.
+  asyncSave?: boolean;
   checkpointsToKeep?: number;
+  // The number of background saves which may be in progress. save() waits
+  // for the oldest of them to finish before taking another snapshot, and
+  // training skips its periodic saves until then.
+  maxPendingSaves?: number;
   printStepSecs?: number;
   saveOnExit?: boolean;
   saveSecs?: number;
 }
 
 const defaultOpts: ExperimentOpts = {
+  asyncSave: false,
   checkpointsToKeep: 3,
+  maxPendingSaves: 1,
   printStepSecs: 1,
   saveOnExit: true,
   saveSecs: 60,
@@ -111,11 +120,12 @@ export abstract class Experiment {
   private rateHistory: RateInfo[] = [];
   protected currentParams: Params;
   protected lastSave?: Date;
+  private saving = false;
   protected step_?: number;
   readonly opts: ExperimentOpts;
 
   constructor(readonly name: string, opts?: ExperimentOpts) {
-    this.opts = Object.assign(defaultOpts, opts);
+    this.opts = Object.assign({}, defaultOpts, opts);
   }
 
   get step() {
@@ -133,22 +143,37 @@ export abstract class Experiment {
 
   abstract createOrRestore(): Promise<void>;
 
-  /** Saves a new checkpoint. */
+  /** Saves a new checkpoint. With the asyncSave option, this may return
+   * before the checkpoint is written.
+   */
   abstract async save(): Promise<void>;
 
+  /** Waits for the checkpoints being saved in the background to be
+   * written. Rejects if any of them failed.
+   */
+  async flush(): Promise<void> { }
+
   /** Gets a list of checkpoints. Most recent first. */
   abstract async checkpoints(): Promise<number[]>;
 
   abstract async deleteCheckpoint(step: number): Promise<void>;
 
   private async maybeSave(): Promise<void> {
+    // minimize() doesn't wait for this, so a save which is still waiting
+    // for its turn would otherwise be joined by one for every step.
+    if (this.saving) return;
     if (this.lastSave) {
       if (secsSince(this.lastSave) < this.opts.saveSecs) {
         // Bail out if we've saved less than saveSecs seconds ago.
         return;
       }
     }
-    await this.save();
+    this.saving = true;
+    try {
+      await this.save();
+    } finally {
+      this.saving = false;
+    }
     this.lastSave = new Date();
 
     // Delete old checkpoints.
@@ -125,15 +125,29 @@ async function fetchNodeHTTP(job: string, url: URL): Promise<ArrayBuffer> {
     b.byteOffset + b.byteLength) as ArrayBuffer;
 }
 
-async function fetchNodeFS(job: string, url: URL): Promise<ArrayBuffer> {
-  // This function is async for consistancy with fetchNodeHTTP and
-  // fetchBrowserXHR, even tho it is actually sync.
-  const fs = nodeRequire("fs");
+// Returns the file system path of a file: URL.
+function urlToPath(url: URL): string {
   let p = decodeURIComponent(url.pathname);
   if (process.platform === "win32" && p.startsWith("/")) {
     p = p.slice(1);
   }
-  const b = fs.readFileSync(p, null);
+  return p;
+}
+
+/** Returns the path of the local file that fetchArrayBuffer() would read,
+ * or null if it would download it.
+ */
+export function localPath(p: string): string | null {
+  if (IS_WEB) return null;
+  const url = resolve(p);
+  return isHTTP(url) ? null : urlToPath(url);
+}
+
+async function fetchNodeFS(job: string, url: URL): Promise<ArrayBuffer> {
+  // This function is async for consistancy with fetchNodeHTTP and
+  // fetchBrowserXHR, even tho it is actually sync.
+  const fs = nodeRequire("fs");
+  const b = fs.readFileSync(urlToPath(url), null);
   return b.buffer.slice(b.byteOffset, b.byteOffset + b.byteLength);
 }
 
@@ -0,0 +1,17 @@
+// Measures the cost of returning a 1-element tensor from the binding, from
+// execute(), createSmallHandle() and copyToDevice().
+import { bench } from "./benchmark";
+import * as tf from "./tf";
+
+tf.loadBinding();
+const binding = tf.binding;
+const ctx = tf.ctx;
+
+const x = new binding.Handle(new Float32Array([1]), [1], binding.TF_FLOAT);
+const attrs = [["T", binding.ATTR_TYPE, binding.TF_FLOAT]];
+const device = binding.getDevice(x);
+
+bench("execute", () => binding.execute(ctx, "Add", attrs, [x, x]));
+bench("createSmallHandle", () => binding.createSmallHandle(ctx,
+  binding.TF_FLOAT, device, 1));
+bench("copyToDevice", () => binding.copyToDevice(ctx, x, device));
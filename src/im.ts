@@ -16,7 +16,9 @@
 // This module allows Propel to read PNG and JPG images.
 
 import { concat, fill, Tensor, tensor } from "./api";
-import { fetchArrayBuffer } from "./fetch";
+import { backend } from "./backend";
+import { fetchArrayBuffer, localPath } from "./fetch";
+import * as tf from "./tf";
 import { createResolvable, formatImageName,
   IS_NODE, nodeRequire } from "./util";
 
@@ -28,6 +30,8 @@ import * as pngjs from "pngjs";
 
 export type ImageMode = "RGBA" | "RGB" | "L";
 
+const modeChannels = { "L": 1, "RGB": 3, "RGBA": 4 };
+
 export interface Image {
   width: number;
   height: number;
@@ -207,6 +211,9 @@ async function nodeImageDecoder(filename: string, mode: ImageMode)
  */
 export async function imread(filename: string, mode: ImageMode = "RGBA")
     : Promise<Tensor> {
+  if (IS_NODE && backend === "tf") {
+    return (await imreadBatch([filename], mode))[0];
+  }
   if (IS_NODE) {
     return await nodeImageDecoder(filename, mode);
   }
@@ -218,6 +225,30 @@ export async function imread(filename: string, mode: ImageMode = "RGBA")
   return await webImageDecoder(filename, mode);
 }
 
+/** Reads several images, like imread(), and returns a tensor for each in
+ * the same order. On the TF backend they are decoded in parallel by
+ * TensorFlow, on worker threads, without blocking the event loop.
+ *
+ *    import { imreadBatch } from "propel"
+ *    imgs = await imreadBatch(["/src/testdata/sample.png",
+ *                              "/src/testdata/sample.jpg"], "RGB")
+ */
+export async function imreadBatch(filenames: string[],
+                                  mode: ImageMode = "RGBA")
+    : Promise<Tensor[]> {
+  if (!IS_NODE || backend !== "tf") {
+    return Promise.all(filenames.map(fn => imread(fn, mode)));
+  }
+  if (!modeChannels[mode]) {
+    throw new Error("Unsupported convertion mode.");
+  }
+  // The binding reads local files itself, others are downloaded first.
+  const sources = await Promise.all(filenames.map(async(fn) =>
+    localPath(fn) || await fetchArrayBuffer(fn)));
+  const images = await tf.decodeImages(sources, modeChannels[mode]);
+  return images.map(t => new Tensor(t));
+}
+
 /** Save a 3D tensor to disk as an image
  */
 export async function imsave(tensor: Tensor,
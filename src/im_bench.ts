@@ -0,0 +1,30 @@
+// Measures image decoding throughput of imread(), one image at a time, and
+// imreadBatch(). On the TF backend imreadBatch() decodes in parallel in the
+// binding; run with PROPEL=dl to measure the JavaScript decoders, which
+// imread() used on both backends before. Takes the number of images to
+// read, 256 by default. Usage:
+//
+//   PROPEL=tf ts-node src/im_bench.ts 256
+import * as path from "path";
+import { benchAsync } from "./benchmark";
+import { imread, imreadBatch } from "./im";
+
+const count = Number(process.argv[2] || 256);
+
+async function time(name: string, fn: () => Promise<void>): Promise<void> {
+  const r = await benchAsync(name, fn, { warmupMs: 0, repMs: 0 });
+  console.log(`${name}: ${(count / r.nsPerOp * 1e9).toFixed(0)} images/s`);
+}
+
+(async() => {
+  for (const ext of ["png", "jpg"]) {
+    const filename = path.join(__dirname, "testdata", "sample." + ext);
+    const filenames = new Array(count).fill(filename);
+    await time(`imread ${ext}`, async() => {
+      for (const fn of filenames) await imread(fn, "RGB");
+    });
+    await time(`imreadBatch ${ext}`, async() => {
+      await imreadBatch(filenames, "RGB");
+    });
+  }
+})();
@@ -16,7 +16,7 @@
 import { test } from "../tools/tester";
 import { zeros } from "./api";
 import { propelURL } from "./fetch";
-import { imread, imsave, toUint8Image } from "./im";
+import { imread, imreadBatch, imsave, toUint8Image } from "./im";
 import { assertAllEqual } from "./tensor_util";
 import { assertEqual, assertShapesEqual } from "./tensor_util";
 import { assert, IS_NODE, nodeRequire, randomString, tmpdir } from "./util";
@@ -80,6 +80,19 @@ test(async function im_toGrayscale() {
   assertAllEqual(getPixel(1, data, 62, 3), [255]);
 });
 
+test(async function im_imreadBatch() {
+  const images = await imreadBatch([pngPath, jpgPath, pngPath], "RGB");
+  assertEqual(images.length, 3);
+  for (const img of images) {
+    assertShapesEqual(img.shape, [64, 64, 3]);
+  }
+  const data = images[2].dataSync();
+  assertAllEqual(getPixel(3, data, 20, 20), [242, 232, 237]);
+  assertAllEqual(getPixel(3, data, 34, 5), [120, 100, 169]);
+  const gray = (await imreadBatch([pngPath], "L"))[0];
+  assertAllEqual(getPixel(1, gray.dataSync(), 20, 20), [237]);
+});
+
 test(async function im_toUint8ImageRGBA() {
   const img = await imread(pngPath);
   const rawImage = toUint8Image(img);
@@ -0,0 +1,34 @@
+// Measures the ingest throughput of large float32 batches stored in a Node
+// Buffer, copying each batch into a new Float32Array versus importing it
+// with importBuffer.
+import { bench } from "./benchmark";
+import * as tf from "./tf";
+
+tf.loadBinding();
+const binding = tf.binding;
+
+const batchShape = [64, 224, 224, 3];
+const batchBytes = 4 * batchShape.reduce((a, b) => a * b, 1);
+const numBatches = 8;
+const data = Buffer.alloc(batchBytes * numBatches);
+
+function ingestCopy(i: number) {
+  const offset = data.byteOffset + i * batchBytes;
+  const ta = new Float32Array(data.buffer.slice(offset, offset + batchBytes));
+  return new binding.Handle(ta, batchShape, binding.TF_FLOAT);
+}
+
+function ingestImport(i: number) {
+  return binding.importBuffer(data, i * batchBytes, batchBytes,
+                              binding.TF_FLOAT, batchShape);
+}
+
+// Cycles through the batches, so that copying can't stay in cache.
+function benchIngest(name: string, fn: (i: number) => void): void {
+  let i = 0;
+  const r = bench(name, () => fn(i++ % numBatches));
+  console.log(`${name}: ${(batchBytes / r.nsPerOp).toFixed(2)} GB/s`);
+}
+
+benchIngest("copy", ingestCopy);
+benchIngest("import", ingestImport);
@@ -0,0 +1,18 @@
+// Measures reading the shape, dtype and device of a handle, with one
+// binding call each, with a single getMeta() call, and through the cache
+// in TensorTF.
+import { bench } from "./benchmark";
+import * as tf from "./tf";
+
+tf.loadBinding();
+const binding = tf.binding;
+
+const h = new binding.Handle(new Float32Array(24), [2, 3, 4],
+                             binding.TF_FLOAT);
+const t = new tf.TensorTF(h);
+
+bench("getShape", () => binding.getShape(h));
+bench("getDType", () => binding.getDType(h));
+bench("getDevice", () => binding.getDevice(h));
+bench("getMeta", () => binding.getMeta(h));
+bench("TensorTF meta", () => [t.shape, t.dtype, t.device]);
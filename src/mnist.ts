@@ -13,6 +13,7 @@
    limitations under the License.
  */
 import { tensor, Tensor } from "./api";
+import { bo } from "./backend";
 import * as cache from "./cache";
 import { assertEqual } from "./util";
 
@@ -68,16 +69,15 @@ async function loadFile2(href: string) {
   }
   const numExamples = littleEndianToBig(i32[i++]);
 
-  let t;
   if (isImages) {
     assertEqual(littleEndianToBig(i32[i++]), 28);
     assertEqual(littleEndianToBig(i32[i++]), 28);
-    const tensorData = new Int32Array(ui8.slice(4 * i));
-    t = tensor(tensorData, {dtype: "int32"});
-  } else {
-    const tensorData = new Int32Array(ui8.slice(4 * i));
-    t = tensor(tensorData, {dtype: "int32"});
   }
+  // Widen the bytes to int32, in a buffer the backend needn't copy.
+  const bytes = ui8.subarray(4 * i);
+  const tensorData = bo.allocTypedArray(bytes.length, "int32");
+  tensorData.set(bytes);
+  const t = tensor(tensorData, {dtype: "int32"});
   const shape = isImages ? [numExamples, 28, 28] : [numExamples];
 
   return t.reshape(shape);
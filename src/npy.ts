@@ -18,9 +18,10 @@
 // https://docs.scipy.org/doc/numpy/neps/npy-format.html
 
 import { TextDecoder } from "text-encoding";
-import { bo } from "./backend";
-import { fetchArrayBuffer } from "./fetch";
+import { backend, bo } from "./backend";
+import { fetchArrayBuffer, localPath } from "./fetch";
 import { Tensor } from "./tensor";
+import * as tf from "./tf";
 import * as types from "./types";
 import * as util from "./util";
 
@@ -124,29 +125,34 @@ export function parse(ab: ArrayBuffer): Tensor {
   if (header["descr"] === "<f8") {
     // 8 byte float. float64.
     util.assertEqual(bytesLeft, size * 8);
-    const s = ab.slice(pos, pos + size * 8);
-    const ta = new Float32Array(new Float64Array(s));
+    // Typed array views must be aligned to their element size.
+    const s = pos % 8 === 0 ? ab : ab.slice(pos, pos + size * 8);
+    const ta = bo.allocTypedArray(size, "float32");
+    ta.set(new Float64Array(s, s === ab ? pos : 0, size));
     return fromTypedArrayAndShape(ta, header.shape);
 
   } else if (header["descr"] === "<f4") {
     // 4 byte float. float32.
     util.assertEqual(bytesLeft, size * 4);
-    const s = ab.slice(pos, pos + size * 4);
-    const ta = new Float32Array(s);
+    const s = pos % 4 === 0 ? ab : ab.slice(pos, pos + size * 4);
+    const ta = bo.allocTypedArray(size, "float32");
+    ta.set(new Float32Array(s, s === ab ? pos : 0, size));
     return fromTypedArrayAndShape(ta, header.shape);
 
   } else if (header["descr"] === "<i8") {
     // 8 byte int. int64.
     util.assertEqual(bytesLeft, size * 8);
-    const s = ab.slice(pos, pos + size * 8);
-    const ta = new Int32Array(s).filter((val, i) => i % 2 === 0);
+    const s = pos % 4 === 0 ? new Int32Array(ab, pos, size * 2)
+                            : new Int32Array(ab.slice(pos, pos + size * 8));
+    const ta = bo.allocTypedArray(size, "int32");
+    for (let i = 0; i < size; i++) ta[i] = s[2 * i];
     return fromTypedArrayAndShape(ta, header.shape);
 
   } else if (header["descr"] === "|u1") {
     // uint8.
     util.assertEqual(bytesLeft, size);
-    const s = ab.slice(pos, pos + size);
-    const ta = new Uint8Array(s);
+    const ta = bo.allocTypedArray(size, "uint8");
+    ta.set(new Uint8Array(ab, pos, size));
     return fromTypedArrayAndShape(ta, header.shape);
 
   } else {
@@ -156,6 +162,10 @@ export function parse(ab: ArrayBuffer): Tensor {
 
 /** Loads and parses a npy file. */
 export async function load(filename: string): Promise<Tensor> {
+  // The TF backend maps local files, which is faster and uses less memory
+  // than reading them.
+  const path = backend === "tf" ? localPath(filename) : null;
+  if (path) return new Tensor(tf.loadNpy(path));
   const ab = await fetchArrayBuffer(filename);
   return parse(ab);
 }
@@ -0,0 +1,25 @@
+// Compares binding.execute, which parses the op attributes on every call,
+// against executing an op prepared once with binding.prepareOp, and against
+// tf.execute0, which looks the prepared op up in the cache in tf.ts.
+import { bench } from "./benchmark";
+import * as tf from "./tf";
+
+tf.loadBinding();
+const binding = tf.binding;
+const ctx = tf.ctx;
+
+const a = new binding.Handle(new Float32Array([1, 2, 3, 4]), [2, 2],
+                             binding.TF_FLOAT);
+const attrs = [
+  ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+  ["transpose_a", binding.ATTR_BOOL, false],
+  ["transpose_b", binding.ATTR_BOOL, false],
+];
+const inputs = [a, a];
+const op = binding.prepareOp(ctx, "MatMul", attrs);
+const t = new tf.TensorTF(a);
+const ops = new tf.OpsTF();
+
+bench("execute", () => binding.execute(ctx, "MatMul", attrs, inputs));
+bench("executePrepared", () => binding.executePrepared(op, inputs));
+bench("execute0", () => ops.matmul(t, t));
@@ -17,14 +17,24 @@
  // this module. It's undesirable to have two entry points like that.
  // this module should be favored over the old exp.sgd().
 
+import { bo } from "./backend";
 import { gradParams } from "./backprop";
 import { Params, params as createParams } from "./params";
 import { gc, NamedTensors, Tensor } from "./tensor";
+import * as types from "./types";
 import { assert } from "./util";
 
 export interface SGDOpts {
   lr: number;
-  momentum?: number; // TODO currently unused.
+  momentum?: number;
+  params?: Params;
+}
+
+export interface AdamOpts {
+  lr: number;
+  beta1?: number;
+  beta2?: number;
+  epsilon?: number;
   params?: Params;
 }
 
@@ -37,37 +47,128 @@ interface MinimizeResult {
   loss: Tensor;
 }
 
+// Optimizer state, like momentum accumulators, per params object and slot
+// name. Slots are variables if the backend has them, and otherwise tensors,
+// which are kept alive the same way params are: by assigning to them on
+// every step.
+type Slot = types.Variable | Tensor;
+const slots = new WeakMap<Params, Map<string, Slot>>();
+const steps = new WeakMap<Params, number>();
+
+function getSlot(params: Params, name: string, p: Tensor): Slot {
+  let m = slots.get(params);
+  if (!m) {
+    m = new Map();
+    slots.set(params, m);
+  }
+  let s = m.get(name);
+  if (!s) {
+    const zeros = p.zerosLike();
+    const v = bo.newVariable(zeros.storage);
+    if (v) zeros.dispose();
+    s = v || zeros;
+    m.set(name, s);
+  }
+  return s;
+}
+
 /** Performs SGD given the loss and current parameters. */
 export function sgd(opts: SGDOpts, lossFn: LossFn): MinimizeResult {
   return minimize(optimizerSGD, opts, lossFn);
 }
 
-export function optimizerSGD(opts, params: Params, grads: NamedTensors): void {
+/** Performs an Adam step given the loss and current parameters. */
+export function adam(opts: AdamOpts, lossFn: LossFn): MinimizeResult {
+  return minimize(optimizerAdam, opts, lossFn);
+}
+
+export function optimizerSGD(opts: SGDOpts, params: Params,
+                             grads: NamedTensors): void {
+  const momentum = opts.momentum || 0;
   for (const name of Object.keys(grads)) {
     const g = grads[name];
     const p = params.get(name);
-    // p -= g * lr
-    p.assign(p.sub(g.mul(opts.lr)));
+    if (momentum === 0) {
+      const done = params.updateInPlace(name,
+        v => bo.applyGradientDescent(v, opts.lr, g.storage));
+      // p -= g * lr
+      if (!done) p.assign(p.sub(g.mul(opts.lr)));
+      continue;
+    }
+    const accum = getSlot(params, name + "/accum", p);
+    if (accum instanceof Tensor) {
+      // accum = accum * momentum + g
+      // p -= accum * lr
+      accum.assign(accum.mul(momentum).add(g));
+      p.assign(p.sub(accum.mul(opts.lr)));
+    } else {
+      const done = params.updateInPlace(name,
+        v => bo.applyMomentum(v, accum, opts.lr, g.storage, momentum));
+      assert(done);
+    }
   }
   // TODO return grads.
 }
 
+export function optimizerAdam(opts: AdamOpts, params: Params,
+                              grads: NamedTensors): void {
+  const beta1 = opts.beta1 == null ? 0.9 : opts.beta1;
+  const beta2 = opts.beta2 == null ? 0.999 : opts.beta2;
+  const epsilon = opts.epsilon == null ? 1e-8 : opts.epsilon;
+  const step = (steps.get(params) || 0) + 1;
+  steps.set(params, step);
+  const beta1Power = Math.pow(beta1, step);
+  const beta2Power = Math.pow(beta2, step);
+  for (const name of Object.keys(grads)) {
+    const g = grads[name];
+    const p = params.get(name);
+    const m = getSlot(params, name + "/m", p);
+    const v = getSlot(params, name + "/v", p);
+    if (m instanceof Tensor && v instanceof Tensor) {
+      // m = beta1 * m + (1 - beta1) * g
+      // v = beta2 * v + (1 - beta2) * g^2
+      // p -= lr * sqrt(1 - beta2^t) / (1 - beta1^t) * m / (sqrt(v) + eps)
+      const lr = opts.lr * Math.sqrt(1 - beta2Power) / (1 - beta1Power);
+      m.assign(m.mul(beta1).add(g.mul(1 - beta1)));
+      v.assign(v.mul(beta2).add(g.square().mul(1 - beta2)));
+      p.assign(p.sub(m.mul(lr).div(v.sqrt().add(epsilon))));
+    } else {
+      const done = params.updateInPlace(name,
+        x => bo.applyAdam(x, m as types.Variable, v as types.Variable,
+                          beta1Power, beta2Power, opts.lr, beta1, beta2,
+                          epsilon, g.storage));
+      assert(done);
+    }
+  }
+}
+
 /** Modifies the current parameters given the loss and optimizer. */
 export function minimize(optimizer: Optimizer,
-                         opts: SGDOpts,
+                         opts: SGDOpts | AdamOpts,
                          lossFn: LossFn): MinimizeResult {
   const params = opts.params || createParams();
   let loss;
-  gc((keep) => {
-    const gradFn = gradParams(lossFn);
-    // Forward/Backward pass
-    params.isTraining = true;
-    const gradsAndLoss = gradFn(params);
-    params.isTraining = false;
-    const grads = gradsAndLoss[0];
-    loss = gradsAndLoss[1];
-    assert(loss.rank === 0);
-    keep(loss);
+  gc((keepOuter) => {
+    let grads: NamedTensors;
+    // The forward and backward pass run in their own scope, so that their
+    // intermediate values, which may share memory with the params, are
+    // released before the optimizer updates the params in place.
+    gc((keep) => {
+      const gradFn = gradParams(lossFn);
+      params.isTraining = true;
+      const gradsAndLoss = gradFn(params);
+      params.isTraining = false;
+      grads = gradsAndLoss[0];
+      loss = gradsAndLoss[1];
+      assert(loss.rank === 0);
+      keep(loss);
+      for (const name of Object.keys(grads)) {
+        if (grads[name]) keep(grads[name]);
+      }
+      // Params defined by lossFn are new in this scope.
+      for (const [_, t] of params) keep(t);
+    });
+    keepOuter(loss);
     optimizer(opts, params, grads);
   });
   return { loss };
@@ -1,5 +1,7 @@
+import { bo } from "./backend";
 import { watch } from "./backprop";
 import { Tensor, tensor as convert } from "./tensor";
+import { shapesEqual } from "./tensor_util";
 import * as types from "./types";
 
 /** Constructs a new params object.
@@ -60,12 +62,30 @@ export interface Params {
    * All tensors in the params object get automatically traced for backprop.
    */
   define(name: string, initFn: () => types.TensorLike): Tensor;
+
+  /** Updates a param in place, if the backend keeps params in variables.
+   * apply is passed the variable, and must update it with the apply ops of
+   * the backend. The param tensor is then replaced by the new value.
+   * Returns false, without calling apply, if the backend has no variables.
+   * Used by optimizers, so that a step doesn't allocate new params.
+   */
+  updateInPlace(name: string, apply: (v: types.Variable) => void): boolean;
+}
+
+// A variable holding a param, and the id of the param tensor it was last
+// synced with. If the tensor is assigned to, the ids differ. Variables are
+// created by the first updateInPlace(), as they hold a copy of the param,
+// so params that are never trained don't take twice their memory.
+interface ParamVariable {
+  variable: types.Variable;
+  id: number;
 }
 
 class RootParams implements Params {
   // Note TS doesn't allow extending Map:
   // https://github.com/Microsoft/TypeScript/issues/10853
   private store = new Map<string, Tensor>();
+  private variables = new Map<string, ParamVariable>();
   isTraining = false;  // TODO users shouldn't be able to change this.
 
   has(name: string): boolean {
@@ -83,6 +103,13 @@ class RootParams implements Params {
   set(name: string, t: types.TensorLike): Tensor {
     const tensor = convert(t);
     this.store.set(name, tensor);
+    // A variable which still fits is synced by the next updateInPlace().
+    const pv = this.variables.get(name);
+    if (pv && !(shapesEqual(pv.variable.shape, tensor.shape) &&
+                pv.variable.dtype === tensor.dtype)) {
+      pv.variable.dispose();
+      this.variables.delete(name);
+    }
     return tensor;
   }
 
@@ -106,6 +133,26 @@ class RootParams implements Params {
     }
     return t;
   }
+
+  updateInPlace(name: string, apply: (v: types.Variable) => void): boolean {
+    const t = this.store.get(name);
+    let pv = this.variables.get(name);
+    if (!pv) {
+      const variable = bo.newVariable(t.storage);
+      if (!variable) return false;
+      pv = { variable, id: t.id };
+      this.variables.set(name, pv);
+    } else if (pv.id !== t.id) {
+      // The param was assigned to since the variable was last synced.
+      bo.assignVariable(pv.variable, t.storage);
+    }
+    t.update(() => {
+      apply(pv.variable);
+      return bo.readVariable(pv.variable);
+    });
+    pv.id = t.id;
+    return true;
+  }
 }
 
 class ScopedParams implements Params {
@@ -152,4 +199,8 @@ class ScopedParams implements Params {
   define(name: string, initFn: () => types.TensorLike): Tensor {
     return this.parent.define(this.resolve(name), initFn);
   }
+
+  updateInPlace(name: string, apply: (v: types.Variable) => void): boolean {
+    return this.parent.updateInPlace(this.resolve(name), apply);
+  }
 }
@@ -0,0 +1,125 @@
+/*!
+   Copyright 2018 Propel http://propel.site/.  All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+// Profiling of the calls into the TensorFlow binding. Only available on the
+// TF backend.
+//
+//   startProfiling();
+//   trainStep();
+//   const events = stopProfiling();
+//   console.log(formatOpStats(opStats(events)));
+//   fs.writeFileSync("trace.json", JSON.stringify(chromeTrace(events)));
+import * as tf from "./tf";
+import { ProfileEvent } from "./tf_binding";
+
+export function startProfiling(): void {
+  tf.binding.setProfiling(true);
+}
+
+// Returns the events recorded since startProfiling().
+export function stopProfiling(): ProfileEvent[] {
+  tf.binding.setProfiling(false);
+  return tf.binding.profileEvents();
+}
+
+// Converts events to the Chrome trace_event format, which can be loaded in
+// chrome://tracing. The time spent in TensorFlow shows up nested in each
+// call.
+export function chromeTrace(events: ProfileEvent[]) {
+  const traceEvents = [];
+  for (const e of events) {
+    const args = { inputs: e.inputs, device: e.device };
+    traceEvents.push({
+      name: e.name, cat: e.category, ph: "X", pid: 0, tid: 0,
+      ts: e.start, dur: e.end - e.start, args,
+    });
+    traceEvents.push({
+      name: "tensorflow", cat: e.category, ph: "X", pid: 0, tid: 0,
+      ts: e.tfStart, dur: e.tfEnd - e.tfStart, args,
+    });
+  }
+  return { traceEvents, displayTimeUnit: "ns" };
+}
+
+// Times are in microseconds. total is split into tf, the time spent in
+// TensorFlow, and marshal, the overhead of the binding.
+export interface OpStats {
+  name: string;
+  category: string;
+  count: number;
+  total: number;
+  tf: number;
+  marshal: number;
+  p50: number;
+  p99: number;
+}
+
+// Nearest rank percentile of a sorted array.
+function percentile(sorted: number[], p: number): number {
+  const rank = Math.ceil(p / 100 * sorted.length);
+  return sorted[Math.max(0, rank - 1)];
+}
+
+// Aggregates events by op, sorted by total time, most expensive first.
+export function opStats(events: ProfileEvent[]): OpStats[] {
+  const groups = new Map<string, ProfileEvent[]>();
+  for (const e of events) {
+    const key = e.category + " " + e.name;
+    const group = groups.get(key);
+    if (group) {
+      group.push(e);
+    } else {
+      groups.set(key, [e]);
+    }
+  }
+  const stats: OpStats[] = [];
+  groups.forEach(group => {
+    const durations = group.map(e => e.end - e.start).sort((a, b) => a - b);
+    let total = 0;
+    let tf = 0;
+    for (const e of group) {
+      total += e.end - e.start;
+      tf += e.tfEnd - e.tfStart;
+    }
+    stats.push({
+      name: group[0].name,
+      category: group[0].category,
+      count: group.length,
+      total,
+      tf,
+      marshal: total - tf,
+      p50: percentile(durations, 50),
+      p99: percentile(durations, 99),
+    });
+  });
+  return stats.sort((a, b) => b.total - a.total);
+}
+
+function pad(s: string, n: number): string {
+  return s.length >= n ? s : " ".repeat(n - s.length) + s;
+}
+
+// Formats op stats as a table, one op per line.
+export function formatOpStats(stats: OpStats[]): string {
+  const columns = ["count", "total", "tf", "marshal", "p50", "p99"];
+  const lines = [pad("op", 24) + columns.map(c => pad(c, 12)).join("")];
+  for (const s of stats) {
+    const cells = columns.map(c => {
+      const v = s[c];
+      return pad(c === "count" ? String(v) : v.toFixed(1) + "us", 12);
+    });
+    lines.push(pad(s.name, 24) + cells.join(""));
+  }
+  return lines.join("\n");
+}
@@ -0,0 +1,50 @@
+// Compares reading tensors back with asArrayBuffer(), which allocates an
+// ArrayBuffer per read, with readInto() a preallocated buffer, for whole
+// tensors and for slices. Reports reads per second and the JS heap
+// allocated per read. Usage:
+//
+//   ts-node --expose-gc src/readback_bench.ts
+//
+// Without --expose-gc the heap numbers include garbage from earlier cases.
+import { bench } from "./benchmark";
+import * as tf from "./tf";
+
+tf.loadBinding();
+const binding = tf.binding;
+
+const gc: () => void = global.gc || (() => {});
+
+function heapPerRead(fn: () => void): number {
+  const n = 1000;
+  gc();
+  const before = process.memoryUsage().heapUsed;
+  for (let i = 0; i < n; i++) fn();
+  return (process.memoryUsage().heapUsed - before) / n;
+}
+
+function run(name: string, fn: () => void): void {
+  const r = bench(name, fn);
+  const perSec = 1e9 / r.nsPerOp;
+  const bytes = heapPerRead(fn);
+  console.log(`  ${perSec.toFixed(0)} reads/s, ` +
+              `${bytes.toFixed(0)} heap bytes/read`);
+}
+
+for (const size of [16, 1024, 1024 * 1024]) {
+  const data = new Float32Array(size).fill(1);
+  const h = new binding.Handle(data, [size], binding.TF_FLOAT);
+  const target = new Float32Array(size);
+  run(`asArrayBuffer [${size}]`, () => {
+    new Float32Array(binding.asArrayBuffer(h));
+  });
+  run(`readInto [${size}]`, () => {
+    binding.readInto(h, target);
+  });
+  // The first 8 elements, like reading the top predictions of an output.
+  run(`asArrayBuffer slice 8 of [${size}]`, () => {
+    new Float32Array(binding.asArrayBuffer(h), 0, 8).slice();
+  });
+  run(`readInto slice 8 of [${size}]`, () => {
+    binding.readInto(h, target, 0, 8);
+  });
+}
@@ -89,11 +89,34 @@ export class Tensor implements types.Storage {
     this.dispose();
     this.storage = t.storage;
     this._id = t.id;
+    // this may outlive the current scopes, so the storage must too.
+    for (const s of scopes) {
+      s.keepStorage(this.storage);
+    }
     // It would be nice to not forcably destroy the argument here, but
     // that would require reference counting storage.
     t.storage = null;
   }
 
+  /** Like assign(), but the new storage is returned by fn, which is only
+   * called once the current storage has been released. Optimizers use this
+   * to update params held in variables: the backend can only reuse the
+   * memory of a variable if no other value shares it.
+   */
+  update(fn: () => types.Storage): void {
+    const shape = this.shape;
+    const dtype = this.dtype;
+    this.dispose();
+    const storage = fn();
+    assertShapesEqual(storage.shape, shape);
+    assertEqual(storage.dtype, dtype, "Tensor.update() dtypes not equal.");
+    this.storage = storage;
+    this._id = Tensor.nextId++;
+    for (const s of scopes) {
+      s.keepStorage(this.storage);
+    }
+  }
+
   /** Returns an iterator over the values of the tensor.
    *
    *    import { range } from "propel";
@@ -991,10 +1014,16 @@ export type GCScopeFn = (keep: (t: Tensor) => void) => void;
 export function gc(fn: GCScopeFn) {
   const s = new GCScope();
   scopes.push(s);
+  // The backend scope also catches storage that never gets wrapped in a
+  // Tensor, like the intermediate results of composite ops.
+  bo.beginScope();
   const keep = (t: Tensor) => s.keep(t);
-  fn(keep);
-  assertEqual(s, scopes.pop());
-  s.clean();
+  try {
+    fn(keep);
+  } finally {
+    assertEqual(s, scopes.pop());
+    s.clean();
+  }
 }
 
 function track(t: Tensor) {
@@ -1011,6 +1040,7 @@ function untrack(t: Tensor) {
 
 class GCScope {
   private keeping = new Set<Tensor>();
+  private keepingStorage = new Set<types.Storage>();
   private tensors = new Set<Tensor>();
 
   track(t: Tensor): void {
@@ -1026,7 +1056,20 @@ class GCScope {
     this.keeping.add(t);
   }
 
+  keepStorage(s: types.Storage): void {
+    this.keepingStorage.add(s);
+  }
+
+  // Must be called after the scope is popped, so that kept tensors move to
+  // the enclosing scope.
   clean(): void {
+    const keepStorage = Array.from(this.keepingStorage);
+    this.keeping.forEach(t => {
+      if (t.storage != null) keepStorage.push(t.storage);
+      if (this.tensors.has(t)) track(t);
+    });
+    bo.endScope(keepStorage);
+
     this.tensors.forEach(t => {
       // If we're not keeping it, nor have we already
       // disposed of it (which happens with assign)
@@ -1037,6 +1080,7 @@ class GCScope {
     });
     this.tensors.clear();
     this.keeping.clear();
+    this.keepingStorage.clear();
   }
 }
 
@@ -21,33 +21,175 @@ import {
 } from "./tensor_util";
 import {
   AttrDef,
+  ContextOpts,
   DTypeCode,
+  Graph,
   Handle,
+  HandleMeta,
+  Op,
 } from "./tf_binding";
 import * as types from "./types";
-import { assertEqual } from "./util";
+import { assertEqual, process } from "./util";
 
 export let binding;
 export let ctx;
 
-export function loadBinding(): boolean {
+// Options for the auto created context. Explicitly passed options take
+// precedence over these environment variables:
+//   PROPEL_INTRA_OP_THREADS  Threads used to parallelize a single op.
+//   PROPEL_INTER_OP_THREADS  Threads used to run independent ops.
+//   PROPEL_ASYNC_EAGER       Set to 1 to enable asynchronous eager execution.
+//   PROPEL_DEVICE_PLACEMENT  One of "explicit", "warn", "silent" or
+//                            "silent_for_int32".
+function contextOpts(opts: ContextOpts): ContextOpts {
+  const env = process.env;
+  const r: ContextOpts = {};
+  if (env.PROPEL_INTRA_OP_THREADS) {
+    r.intraOpParallelism = Number(env.PROPEL_INTRA_OP_THREADS);
+  }
+  if (env.PROPEL_INTER_OP_THREADS) {
+    r.interOpParallelism = Number(env.PROPEL_INTER_OP_THREADS);
+  }
+  if (env.PROPEL_ASYNC_EAGER) {
+    r.async = Number(env.PROPEL_ASYNC_EAGER) !== 0;
+  }
+  if (env.PROPEL_DEVICE_PLACEMENT) {
+    const name = env.PROPEL_DEVICE_PLACEMENT.toUpperCase();
+    const policy = binding["TFE_DEVICE_PLACEMENT_" + name];
+    if (policy === undefined) {
+      throw Error("Bad value for env var PROPEL_DEVICE_PLACEMENT.");
+    }
+    r.devicePlacementPolicy = policy;
+  }
+  return Object.assign(r, opts);
+}
+
+export function loadBinding(opts: ContextOpts = {}): boolean {
   binding = require("./load_tf_binding");
   if (binding) {
-    ctx = new binding.Context(); // Auto create context for now.
+    // Auto create context for now.
+    ctx = new binding.Context(contextOpts(opts));
+    opCache.clear();
+    attrIds.clear();
+    deviceNames.length = 0;
     return true;
   } else {
     return false;
   }
 }
 
-// Sugar for single value ops.
-export function execute0(opName: string, inputs: TensorTF[], attrs): TensorTF {
+// Ops prepared with binding.prepareOp, keyed on op name and attributes.
+// Preparing an op parses its attributes once, so executing it again only
+// has to pass the input handles across to the binding. Each call site builds
+// its key from just the attribute values which can vary there, which is much
+// cheaper than serializing the whole attribute list on every call.
+const opCache = new Map<string, Op>();
+// Ops with attributes like random seeds would otherwise grow the cache
+// without bound.
+const opCacheLimit = 1000;
+
+// Interned attribute names, so the binding doesn't have to look up strings.
+const attrIds = new Map<string, number>();
+
+function attrId(name: string): number {
+  let id = attrIds.get(name);
+  if (id === undefined) {
+    id = binding.internAttrName(name);
+    attrIds.set(name, id);
+  }
+  return id;
+}
+
+function internAttrs(attrs: AttrDef[]): AttrDef[] {
+  return attrs.map(([name, type, value]) => {
+    return [attrId(name as string), type, value];
+  });
+}
+
+// Device names by the ids in HandleMeta.
+const deviceNames: string[] = [];
+
+function getDeviceName(id: number): string {
+  let name = deviceNames[id];
+  if (name === undefined) {
+    name = binding.deviceName(id);
+    deviceNames[id] = name;
+  }
+  return name;
+}
+
+function getOp(key: string, opName: string, attrs: AttrDef[]): Op {
+  let op = opCache.get(key);
+  if (op === undefined) {
+    if (opCache.size >= opCacheLimit) opCache.clear();
+    op = binding.prepareOp(ctx, opName, internAttrs(attrs));
+    opCache.set(key, op);
+  }
+  return op;
+}
+
+// Sugar for single value ops. key must identify attrs among the ones
+// passed with the same opName.
+export function execute0(opName: string, inputs: TensorTF[], attrs: AttrDef[],
+                         key: string): TensorTF {
   const handles = inputs.map((t) => t.handle);
-  const r = binding.execute(ctx, opName, attrs, handles);
+  const op = getOp(opName + ":" + key, opName, attrs);
+  const r = binding.executePrepared(op, handles);
   assertEqualTensor(r.length, 1);
   return new TensorTF(r[0]);
 }
 
+// Records a sequence of ops and runs them with a single call into the
+// binding. Intermediate values never leave the binding; only the values
+// passed to run() are returned.
+//
+//   const b = new Batch();
+//   const h = b.op("MatMul", matmulAttrs, "1", [b.input(x), b.input(w)]);
+//   const y = b.op("Relu", reluAttrs, "1", [h]);
+//   const [result] = b.run([y]);
+export class Batch {
+  private ops: Op[] = [];
+  private opIndices = new Map<Op, number>();
+  private inputs: Handle[] = [];
+  private code: number[] = [];
+  private numValues = 0;
+
+  // Adds a tensor as an input to the batch and returns its value index.
+  // All inputs must be added before the first op.
+  input(t: TensorTF): number {
+    assert(this.code.length === 0, "Batch inputs must precede ops.");
+    this.inputs.push(t.handle);
+    return this.numValues++;
+  }
+
+  // Adds an op and returns the value index of its first output. The other
+  // outputs follow consecutively. key is as for execute0.
+  op(opName: string, attrs: AttrDef[], key: string, inputs: number[],
+     numOutputs = 1): number {
+    const op = getOp(opName + ":" + key, opName, attrs);
+    let opIndex = this.opIndices.get(op);
+    if (opIndex === undefined) {
+      opIndex = this.ops.length;
+      this.ops.push(op);
+      this.opIndices.set(op, opIndex);
+    }
+    this.code.push(opIndex, inputs.length, ...inputs, numOutputs);
+    const first = this.numValues;
+    this.numValues += numOutputs;
+    return first;
+  }
+
+  run(outputs: number[]): TensorTF[] {
+    const r = binding.executeBatch(ctx, {
+      ops: this.ops,
+      inputs: this.inputs,
+      code: new Int32Array(this.code),
+      outputs: new Int32Array(outputs),
+    });
+    return r.map((h) => new TensorTF(h));
+  }
+}
+
 // Execute a simple op, which may have multiple inputs, but only a single
 // attribute T, and only returns a single value.
 // The returned tensor dtype will be same as first input, unless specified by
@@ -55,10 +197,11 @@ export function execute0(opName: string, inputs: TensorTF[], attrs): TensorTF {
 export function execute1(opName: string, inputs: TensorTF[],
                          dtype?: types.DType): TensorTF {
   const handles = inputs.map((t) => t.handle);
-  const dtypeTF = dtype == null ? binding.getDType(handles[0])
+  const dtypeTF = dtype == null ? inputs[0].dtypeCode
                                 : dtypePropel2TF(dtype);
-  const attrs = [["T", binding.ATTR_TYPE, dtypeTF]];
-  const r = binding.execute(ctx, opName, attrs, handles);
+  const key = opName + ":" + dtypeTF;
+  const op = getOp(key, opName, [["T", binding.ATTR_TYPE, dtypeTF]]);
+  const r = binding.executePrepared(op, handles);
   return new TensorTF(r[0]);
 }
 
@@ -92,8 +235,8 @@ function dtypePropel2TF(dtype: types.DType): number {
   }
 }
 
-function colocateDevice(colocateWith?: TensorTF): string {
-  return colocateWith ? binding.getDevice(colocateWith.handle) : defaultDevice;
+function colocateDevice(colocateWith?: TensorTF | VariableTF): string {
+  return colocateWith ? colocateWith.deviceName : defaultDevice;
 }
 
 function int32Small(v: number | number[], colocateWith?: TensorTF): TensorTF {
@@ -101,7 +244,8 @@ function int32Small(v: number | number[], colocateWith?: TensorTF): TensorTF {
     colocateDevice(colocateWith), v));
 }
 
-function floatSmall(v: number | number[], colocateWith?: TensorTF): TensorTF {
+function floatSmall(v: number | number[],
+                    colocateWith?: TensorTF | VariableTF): TensorTF {
   return new TensorTF(binding.createSmallHandle(ctx, binding.TF_FLOAT,
     colocateDevice(colocateWith), v));
 }
@@ -109,50 +253,132 @@ function floatSmall(v: number | number[], colocateWith?: TensorTF): TensorTF {
 export class TensorTF implements types.Storage {
   handle: null | Handle;
   private data_?: types.TypedArray;
+  // Fetched on first use. Handles are immutable, so it never goes stale.
+  private meta_?: HandleMeta;
 
   constructor(handle: Handle) {
     this.handle = handle;
   }
 
+  private get meta(): HandleMeta {
+    if (!this.meta_) this.meta_ = binding.getMeta(this.handle);
+    return this.meta_;
+  }
+
   get shape(): types.Shape {
-    return binding.getShape(this.handle);
+    return this.meta.shape;
   }
 
   get dtype(): types.DType {
-    return dtypeTF2Propel(binding.getDType(this.handle));
+    return dtypeTF2Propel(this.meta.dtype);
+  }
+
+  get dtypeCode(): DTypeCode {
+    return this.meta.dtype;
   }
 
   get device(): string {
-    return simplifyDeviceName(binding.getDevice(this.handle));
+    return simplifyDeviceName(this.deviceName);
+  }
+
+  // The full TensorFlow device name.
+  get deviceName(): string {
+    return getDeviceName(this.meta.device);
   }
 
   async data(): Promise<types.TypedArray> {
-    // TODO maybe we can do better than this in TF. But TF is already pretty
-    // fast, unlike webgl.
-    return this.dataSync();
+    if (!this.data_) {
+      // Resolving the tensor may have to wait for the op that produces it,
+      // or copy it from the GPU, so it's done on a worker thread.
+      const ab = await binding.asArrayBufferAsync(this.handle);
+      if (!this.data_) this.data_ = this.typedArray(ab);
+    }
+    return this.data_;
   }
 
   dataSync(): types.TypedArray {
     if (!this.data_) {
       const ab = binding.asArrayBuffer(this.handle);
-      switch (this.dtype) {
-        case "float32":
-          this.data_ = new Float32Array(ab);
-          break;
-        case "int32":
-          this.data_ = new Int32Array(ab);
-          break;
-        case "uint8":
-          this.data_ = new Uint8Array(ab);
-          break;
-        case "bool":
-          this.data_ = new Uint8Array(ab);
-          break;
-      }
+      this.data_ = this.typedArray(ab);
     }
     return this.data_;
   }
 
+  // Copies the elements offset to offset + length into target, without
+  // caching the data like dataSync() does. See binding.readInto().
+  readInto(target: types.TypedArray, offset?: number,
+           length?: number): number {
+    return binding.readInto(this.handle, target, offset, length);
+  }
+
+  private typedArray(ab: ArrayBuffer): types.TypedArray {
+    switch (this.dtype) {
+      case "float32":
+        return new Float32Array(ab);
+      case "int32":
+        return new Int32Array(ab);
+      case "uint8":
+        return new Uint8Array(ab);
+      case "bool":
+        return new Uint8Array(ab);
+    }
+  }
+
+  dispose(): void {
+    assert(this.handle != null);
+    binding.dispose(this.handle);
+    this.handle = null;
+  }
+}
+
+// Creates a CPU tensor that shares memory with a region of source. This
+// works with Node Buffers, including slices of pooled Buffers, and with
+// SharedArrayBuffers filled by worker threads. The data must be aligned to
+// the size of its dtype, and is only shared if it is 64 byte aligned;
+// otherwise TensorFlow copies it, which binding.memoryStats() counts in
+// unalignedCopies. Memory from binding.allocHostBuffer() is always aligned.
+export function importBuffer(source: ArrayBuffer | SharedArrayBuffer |
+                                     ArrayBufferView,
+                             byteOffset: number, byteLength: number,
+                             dtype: types.DType,
+                             shape: types.Shape): TensorTF {
+  if (typeof SharedArrayBuffer !== "undefined" &&
+      source instanceof SharedArrayBuffer) {
+    // The binding can only see SharedArrayBuffers through a view.
+    source = new Uint8Array(source);
+  }
+  const h = binding.importBuffer(source, byteOffset, byteLength,
+                                 dtypePropel2TF(dtype), shape);
+  return new TensorTF(h);
+}
+
+export function loadNpy(path: string): TensorTF {
+  return new TensorTF(binding.loadNpy(ctx, path));
+}
+
+export async function decodeImages(
+    sources: Array<string | ArrayBuffer | Uint8Array>,
+    channels: number): Promise<TensorTF[]> {
+  const handles = await binding.decodeImages(ctx, sources, channels);
+  return handles.map(h => new TensorTF(h));
+}
+
+// A resource variable, created with a copy of init on its device.
+export class VariableTF implements types.Variable {
+  handle: null | Handle;
+  readonly shape: types.Shape;
+  readonly dtype: types.DType;
+  readonly dtypeCode: DTypeCode;
+  readonly deviceName: string;
+
+  constructor(init: TensorTF) {
+    this.handle = binding.newVariable(ctx, init.handle);
+    this.shape = init.shape;
+    this.dtype = init.dtype;
+    this.dtypeCode = init.dtypeCode;
+    this.deviceName = init.deviceName;
+  }
+
   dispose(): void {
     assert(this.handle != null);
     binding.dispose(this.handle);
@@ -160,6 +386,14 @@ export class TensorTF implements types.Storage {
   }
 }
 
+// Runs an op on the variable v, like ReadVariableOp or ResourceApplyAdam.
+// Only the dtype of v may change the attrs of opName.
+function executeVariableOp(opName: string, v: VariableTF, attrs: AttrDef[],
+                           inputs: Handle[]): Handle[] {
+  const op = getOp(opName + ":" + v.dtypeCode, opName, attrs);
+  return binding.executePrepared(op, inputs);
+}
+
 // TF has rather verbose device names like:
 // '/job:localhost/replica:0/task:0/device:GPU:0'. Until Propel starts thinking
 // about multi-replica configurations, we simplify this string to just "GPU:0".
@@ -184,6 +418,111 @@ export class OpsTF implements types.BackendOps {
     });
   }
 
+  beginScope(): void {
+    binding.beginScope();
+  }
+
+  endScope(keep: TensorTF[]): void {
+    const handles: Handle[] = [];
+    for (const x of keep) {
+      if (x.handle) handles.push(x.handle);
+    }
+    binding.endScope(handles);
+  }
+
+  beginTrace(inputs: TensorTF[]): void {
+    binding.beginTrace(inputs.map(x => x.handle));
+  }
+
+  endTrace(outputs: TensorTF[] | null): Graph | null {
+    return binding.endTrace(outputs && outputs.map(x => x.handle));
+  }
+
+  runTrace(graph: Graph, inputs: TensorTF[]): TensorTF[] {
+    const r = binding.runGraph(graph, inputs.map(x => x.handle));
+    return r.map(h => new TensorTF(h));
+  }
+
+  newVariable(init: TensorTF): VariableTF {
+    return new VariableTF(init);
+  }
+
+  readVariable(v: VariableTF): TensorTF {
+    const r = executeVariableOp("ReadVariableOp", v, [
+      ["dtype", binding.ATTR_TYPE, v.dtypeCode],
+    ], [v.handle]);
+    return new TensorTF(r[0]);
+  }
+
+  assignVariable(v: VariableTF, value: TensorTF): void {
+    executeVariableOp("AssignVariableOp", v, [
+      ["dtype", binding.ATTR_TYPE, v.dtypeCode],
+    ], [v.handle, value.handle]);
+  }
+
+  assignAddVariable(v: VariableTF, delta: TensorTF): void {
+    executeVariableOp("AssignAddVariableOp", v, [
+      ["dtype", binding.ATTR_TYPE, v.dtypeCode],
+    ], [v.handle, delta.handle]);
+  }
+
+  applyGradientDescent(v: VariableTF, lr: number, grad: TensorTF): void {
+    executeVariableOp("ResourceApplyGradientDescent", v, [
+      ["T", binding.ATTR_TYPE, v.dtypeCode],
+      ["use_locking", binding.ATTR_BOOL, false],
+    ], [v.handle, floatSmall(lr, v).handle, grad.handle]);
+  }
+
+  applyMomentum(v: VariableTF, accum: VariableTF, lr: number, grad: TensorTF,
+                momentum: number): void {
+    executeVariableOp("ResourceApplyMomentum", v, [
+      ["T", binding.ATTR_TYPE, v.dtypeCode],
+      ["use_locking", binding.ATTR_BOOL, false],
+      ["use_nesterov", binding.ATTR_BOOL, false],
+    ], [
+      v.handle,
+      accum.handle,
+      floatSmall(lr, v).handle,
+      grad.handle,
+      floatSmall(momentum, v).handle,
+    ]);
+  }
+
+  applyAdam(v: VariableTF, m: VariableTF, vhat: VariableTF,
+            beta1Power: number, beta2Power: number, lr: number,
+            beta1: number, beta2: number, epsilon: number,
+            grad: TensorTF): void {
+    executeVariableOp("ResourceApplyAdam", v, [
+      ["T", binding.ATTR_TYPE, v.dtypeCode],
+      ["use_locking", binding.ATTR_BOOL, false],
+    ], [
+      v.handle,
+      m.handle,
+      vhat.handle,
+      floatSmall(beta1Power, v).handle,
+      floatSmall(beta2Power, v).handle,
+      floatSmall(lr, v).handle,
+      floatSmall(beta1, v).handle,
+      floatSmall(beta2, v).handle,
+      floatSmall(epsilon, v).handle,
+      grad.handle,
+    ]);
+  }
+
+  allocTypedArray(length: number, dtype: types.DType): types.TypedArray {
+    switch (dtype) {
+      case "float32":
+        return new Float32Array(binding.allocHostBuffer(4 * length));
+      case "int32":
+        return new Int32Array(binding.allocHostBuffer(4 * length));
+      case "uint8":
+      case "bool":
+        return new Uint8Array(binding.allocHostBuffer(length));
+      default:
+        throw new Error("Not implemented");
+    }
+  }
+
   fromTypedArray(data: types.TypedArray, shape: types.Shape,
                  dtype?: types.DType, device?: string): TensorTF {
     if (dtype == null) {
@@ -306,7 +645,7 @@ export class OpsTF implements types.BackendOps {
       ["seed", binding.ATTR_INT, seed],
       ["seed2", binding.ATTR_INT, seed],
     ];
-    return execute0("RandomStandardNormal", [shapeT], attrs);
+    return execute0("RandomStandardNormal", [shapeT], attrs, String(seed));
   }
 
   linspace(start: number, stop: number, num: number): TensorTF {
@@ -316,7 +655,7 @@ export class OpsTF implements types.BackendOps {
     return execute0("LinSpace", [startT, stopT, numT], [
       ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
       ["Tidx", binding.ATTR_TYPE, binding.TF_INT32],
-    ]);
+    ], "");
   }
 
   range(start: number, limit: number, delta: number): TensorTF {
@@ -326,14 +665,14 @@ export class OpsTF implements types.BackendOps {
     const args = [startT, limitT, deltaT];
     return execute0("Range", args, [
       ["Tidx", binding.ATTR_TYPE, binding.TF_INT32],
-    ]);
+    ], "");
   }
 
   transpose(x: TensorTF, perm: TensorTF): TensorTF {
     return execute0("Transpose", [x, perm], [
-      ["T", binding.ATTR_TYPE, binding.getDType(x.handle)],
-      ["Tperm", binding.ATTR_TYPE, binding.getDType(perm.handle)],
-    ]);
+      ["T", binding.ATTR_TYPE, x.dtypeCode],
+      ["Tperm", binding.ATTR_TYPE, perm.dtypeCode],
+    ], x.dtypeCode + ":" + perm.dtypeCode);
   }
 
   reverse(x: TensorTF, dims: TensorTF): TensorTF {
@@ -344,40 +683,40 @@ export class OpsTF implements types.BackendOps {
   matmul(x: TensorTF, y: TensorTF, transposeA = false,
          transposeB = false): TensorTF {
     return execute0("MatMul", [x, y], [
-      ["T", binding.ATTR_TYPE, binding.getDType(x.handle)],
+      ["T", binding.ATTR_TYPE, x.dtypeCode],
       ["transpose_a", binding.ATTR_BOOL, transposeA],
       ["transpose_b", binding.ATTR_BOOL, transposeB],
-    ]);
+    ], x.dtypeCode + ":" + transposeA + ":" + transposeB);
   }
 
   argmax(x: TensorTF, axis: number): TensorTF {
     // axisT is expected to be on CPU.
     const axisT = int32Small(axis);
     return execute0("ArgMax", [x, axisT], [
-      ["T", binding.ATTR_TYPE, binding.getDType(x.handle)],
+      ["T", binding.ATTR_TYPE, x.dtypeCode],
       ["Tidx", binding.ATTR_TYPE, binding.TF_INT32],
       ["output_type", binding.ATTR_TYPE, binding.TF_INT32],
-    ]);
+    ], String(x.dtypeCode));
   }
 
   argmin(x: TensorTF, axis: number): TensorTF {
     // axisT is expected to be on CPU.
     const axisT = int32Small(axis);
     return execute0("ArgMin", [x, axisT], [
-      ["T", binding.ATTR_TYPE, binding.getDType(x.handle)],
+      ["T", binding.ATTR_TYPE, x.dtypeCode],
       ["Tidx", binding.ATTR_TYPE, binding.TF_INT32],
       ["output_type", binding.ATTR_TYPE, binding.TF_INT32],
-    ]);
+    ], String(x.dtypeCode));
   }
 
   reduceSum(x: TensorTF, axes: number[], keepDims: boolean): TensorTF {
     // axesT is expected to be on CPU.
     const axesT = int32Small(axes);
     return execute0("Sum", [x, axesT], [
-      ["T", binding.ATTR_TYPE, binding.getDType(x.handle)],
+      ["T", binding.ATTR_TYPE, x.dtypeCode],
       ["Tidx", binding.ATTR_TYPE, binding.TF_INT32],
       ["keep_dims", binding.ATTR_BOOL, keepDims],
-    ]);
+    ], x.dtypeCode + ":" + keepDims);
   }
 
   reduceMean(x: TensorTF, axes: number[], keepDims: boolean): TensorTF {
@@ -389,30 +728,30 @@ export class OpsTF implements types.BackendOps {
     // axesT is expected to be on CPU.
     const axesT = int32Small(axes);
     return execute0("Mean", [x, axesT], [
-      ["T", binding.ATTR_TYPE, binding.getDType(x.handle)],
+      ["T", binding.ATTR_TYPE, x.dtypeCode],
       ["Tidx", binding.ATTR_TYPE, binding.TF_INT32],
       ["keep_dims", binding.ATTR_BOOL, keepDims],
-    ]);
+    ], x.dtypeCode + ":" + keepDims);
   }
 
   reduceMax(x: TensorTF, axes: number[], keepDims: boolean): TensorTF {
     // axesT is expected to be on CPU.
     const axesT = int32Small(axes);
     return execute0("Max", [x, axesT], [
-      ["T", binding.ATTR_TYPE, binding.getDType(x.handle)],
+      ["T", binding.ATTR_TYPE, x.dtypeCode],
       ["Tidx", binding.ATTR_TYPE, binding.TF_INT32],
       ["keep_dims", binding.ATTR_BOOL, keepDims],
-    ]);
+    ], x.dtypeCode + ":" + keepDims);
   }
 
   reduceMin(x: TensorTF, axes: number[], keepDims: boolean): TensorTF {
     // axesT is expected to be on CPU.
     const axesT = int32Small(axes);
     return execute0("Min", [x, axesT], [
-      ["T", binding.ATTR_TYPE, binding.getDType(x.handle)],
+      ["T", binding.ATTR_TYPE, x.dtypeCode],
       ["Tidx", binding.ATTR_TYPE, binding.TF_INT32],
       ["keep_dims", binding.ATTR_BOOL, keepDims],
-    ]);
+    ], x.dtypeCode + ":" + keepDims);
   }
 
   equal(x: TensorTF, y: TensorTF): TensorTF {
@@ -448,7 +787,7 @@ export class OpsTF implements types.BackendOps {
     // It seems that if x.dtype is int32 this must be done on CPU:
     // https://git.io/vNTSv
     if (x.dtype === "int32" &&
-        !binding.getDevice(x.handle).endsWith("CPU:0")) {
+        !x.deviceName.endsWith("CPU:0")) {
       console.warn("Slice on GPU not supported for int32. Copying to CPU.");
       handle = binding.copyToDevice(ctx, x.handle, "CPU:0");
     } else {
@@ -461,7 +800,7 @@ export class OpsTF implements types.BackendOps {
 
     const handles = [handle, beginT.handle, sizeT.handle];
     const attrs = [
-      ["T", binding.ATTR_TYPE, binding.getDType(handle)],
+      ["T", binding.ATTR_TYPE, x.dtypeCode],
       ["Index", binding.ATTR_TYPE, binding.TF_INT32],
     ];
     const r = binding.execute(ctx, "Slice", attrs, handles);
@@ -522,7 +861,7 @@ export class OpsTF implements types.BackendOps {
     // https://git.io/vNTd5
     let handle;
     if (x.dtype === "int32" &&
-        !binding.getDevice(x.handle).endsWith("CPU:0")) {
+        !x.deviceName.endsWith("CPU:0")) {
       console.warn("Reshape on GPU not supported for int32. Copying to CPU.");
       handle = binding.copyToDevice(ctx, x.handle, "CPU:0");
     } else {
@@ -534,7 +873,7 @@ export class OpsTF implements types.BackendOps {
 
     const handles = [handle, shapeT.handle];
     const attrs = [
-      ["T", binding.ATTR_TYPE, binding.getDType(handle)],
+      ["T", binding.ATTR_TYPE, x.dtypeCode],
       ["Tshape", binding.ATTR_TYPE, binding.TF_INT32],
     ];
     const r = binding.execute(ctx, "Reshape", attrs, handles);
@@ -552,9 +891,9 @@ export class OpsTF implements types.BackendOps {
 
   cast(x: TensorTF, dtype: types.DType): TensorTF {
     return execute0("Cast", [x], [
-      ["SrcT", binding.ATTR_TYPE, binding.getDType(x.handle)],
+      ["SrcT", binding.ATTR_TYPE, x.dtypeCode],
       ["DstT", binding.ATTR_TYPE, dtypePropel2TF(dtype)],
-    ]);
+    ], x.dtypeCode + ":" + dtype);
   }
 
   oneHot(x: TensorTF, depth: number, onValue: number,
@@ -568,14 +907,15 @@ export class OpsTF implements types.BackendOps {
     const onT = floatSmall(onValue, x);
     const offT = floatSmall(offValue, x);
     return execute0("OneHot", [x, depthT, onT, offT], [
-      ["T", binding.ATTR_TYPE, binding.getDType(onT.handle)],
-      ["TI", binding.ATTR_TYPE, binding.getDType(x.handle)],
+      ["T", binding.ATTR_TYPE, onT.dtypeCode],
+      ["TI", binding.ATTR_TYPE, x.dtypeCode],
       ["axis", binding.ATTR_INT, -1],
-    ]);
+    ], String(x.dtypeCode));
   }
 
   conv2d(input: TensorTF, filter: TensorTF, opts: types.ConvOpts): TensorTF {
-    return execute0("Conv2D", [input, filter], convAttrs(opts));
+    return execute0("Conv2D", [input, filter], convAttrs(opts),
+                    convKey(opts));
   }
 
   conv2dGradFilter(grad: TensorTF, input: TensorTF,
@@ -584,7 +924,7 @@ export class OpsTF implements types.BackendOps {
     const filterShapeT = int32Small(filterShape);
     return execute0("Conv2DBackpropFilter",
                     [input, filterShapeT, grad],
-                    convAttrs(opts));
+                    convAttrs(opts), convKey(opts));
   }
 
   conv2dGradInput(grad: TensorTF, inputShape: types.Shape,
@@ -592,18 +932,20 @@ export class OpsTF implements types.BackendOps {
     const inputShapeT = int32Small(inputShape);
     return execute0("Conv2DBackpropInput",
                     [inputShapeT, filter, grad],
-                    convAttrs(opts));
+                    convAttrs(opts), convKey(opts));
   }
 
   maxPool(input: TensorTF, opts: types.PoolOpts): TensorTF {
-    const attrs = poolAttrs(opts, binding.getDType(input.handle));
-    return execute0("MaxPool", [input], attrs);
+    const attrs = poolAttrs(opts, input.dtypeCode);
+    return execute0("MaxPool", [input], attrs,
+                    poolKey(opts, input.dtypeCode));
   }
 
   maxPoolGrad(grad: TensorTF, origInput: TensorTF, origOutput: TensorTF,
               opts: types.PoolOpts): TensorTF {
-    const attrs = poolAttrs(opts, binding.getDType(origInput.handle));
-    return execute0("MaxPoolGrad", [origInput, origOutput, grad], attrs);
+    const attrs = poolAttrs(opts, origInput.dtypeCode);
+    return execute0("MaxPoolGrad", [origInput, origOutput, grad], attrs,
+                    poolKey(opts, origInput.dtypeCode));
   }
 }
 
@@ -617,6 +959,14 @@ function poolAttrs(opts: types.PoolOpts, dtypeCode: DTypeCode): AttrDef[] {
   ];
 }
 
+function poolKey(opts: types.PoolOpts, dtypeCode: DTypeCode): string {
+  return dtypeCode + ":" + opts.size + ":" + opts.stride + ":" + opts.padding;
+}
+
+function convKey(opts: types.ConvOpts): string {
+  return opts.stride + ":" + opts.padding;
+}
+
 function convAttrs(opts: types.ConvOpts): AttrDef[] {
   const dilations = [1, 1, 1, 1];  // TODO
   const padding = opts.padding.toUpperCase();
@@ -0,0 +1,269 @@
+/*
+   Copyright 2018 Propel http://propel.site/.  All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+// Runs the binding level cases of src/binding_bench.ts directly on the TF C
+// API, and writes the results in the same JSON format. Passing them as the
+// baseline of binding_bench.ts shows the overhead of the binding.
+//
+//   node tools/build_tf_binding.js bench
+//   build/Release/tf_bench native.json
+//   ts-node src/binding_bench.ts --baseline native.json
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>      // NOLINT(build/c++11)
+#include <functional>  // NOLINT(build/c++11)
+#include <string>
+#include <vector>
+#include "./check.h"
+#include "deps/libtensorflow/include/tensorflow/c/c_api.h"
+#include "deps/libtensorflow/include/tensorflow/c/eager/c_api.h"
+
+struct BenchResult {
+  std::string name;
+  double ns_per_op;
+  double stddev;
+  double min;
+  int64_t iterations;
+  std::vector<double> reps;
+};
+
+static const double kWarmupNs = 200e6;
+static const double kRepNs = 200e6;
+static const int kReps = 5;
+
+static std::vector<BenchResult> results;
+
+static double Run(const std::function<void()>& fn, int64_t count) {
+  auto start = std::chrono::steady_clock::now();
+  for (int64_t i = 0; i < count; i++) fn();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+// Same procedure as bench() in src/benchmark.ts.
+static void Bench(const std::string& name, const std::function<void()>& fn) {
+  int64_t count = 1;
+  double elapsed = Run(fn, count);
+  double warmup = elapsed;
+  while (warmup < kWarmupNs) {
+    count *= 2;
+    elapsed = Run(fn, count);
+    warmup += elapsed;
+  }
+  BenchResult r;
+  r.name = name;
+  r.iterations = std::max<int64_t>(1, llround(count * kRepNs / elapsed));
+  double sum = 0;
+  for (int i = 0; i < kReps; i++) {
+    r.reps.push_back(Run(fn, r.iterations) / r.iterations);
+    sum += r.reps.back();
+  }
+  r.ns_per_op = sum / kReps;
+  double variance = 0;
+  for (double t : r.reps) {
+    variance += (t - r.ns_per_op) * (t - r.ns_per_op);
+  }
+  r.stddev = sqrt(variance / kReps);
+  r.min = *std::min_element(r.reps.begin(), r.reps.end());
+  printf("%-40s %.0f ns/op +-%.1f%%  (%d x %lld)\n",
+         name.c_str(),
+         r.ns_per_op,
+         100 * r.stddev / r.ns_per_op,
+         kReps,
+         static_cast<long long>(r.iterations));  // NOLINT(runtime/int)
+  results.push_back(r);
+}
+
+static void WriteResults(const char* path) {
+  FILE* f = fopen(path, "w");
+  check(f != NULL, "Cannot open output file");
+  char date[32];
+  time_t now = time(NULL);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+  fprintf(f, "{\n  \"runtime\": \"tensorflow %s C API\",\n", TF_Version());
+  fprintf(f, "  \"date\": \"%s\",\n  \"results\": [", date);
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchResult& r = results[i];
+    fprintf(f,
+            "%s\n    {\"name\": \"%s\", \"nsPerOp\": %f, \"stddev\": %f, "
+            "\"min\": %f, \"iterations\": %lld, \"reps\": [",
+            i == 0 ? "" : ",",
+            r.name.c_str(),
+            r.ns_per_op,
+            r.stddev,
+            r.min,
+            static_cast<long long>(r.iterations));  // NOLINT(runtime/int)
+    for (size_t j = 0; j < r.reps.size(); j++) {
+      fprintf(f, "%s%f", j == 0 ? "" : ", ", r.reps[j]);
+    }
+    fprintf(f, "]}");
+  }
+  fprintf(f, "\n  ]\n}\n");
+  fclose(f);
+}
+
+static TF_Status* status;
+static TFE_Context* ctx;
+
+static void CheckOk() {
+  if (TF_GetCode(status) != TF_OK) {
+    fprintf(stderr, "%s\n", TF_Message(status));
+    fatal("TensorFlow error");
+  }
+}
+
+static void Deallocate(void* data, size_t len, void* arg) {
+  delete[] static_cast<float*>(data);
+}
+
+static TF_Tensor* FloatTensor(const std::vector<int64_t>& dims) {
+  size_t size = 1;
+  for (int64_t d : dims) size *= d;
+  float* data = new float[size];
+  std::fill(data, data + size, 1.0f);
+  return TF_NewTensor(TF_FLOAT,
+                      dims.data(),
+                      static_cast<int>(dims.size()),
+                      data,
+                      size * sizeof(float),
+                      Deallocate,
+                      NULL);
+}
+
+// The binding keeps the TF_Tensor behind each handle it creates; so does
+// this.
+struct Handle {
+  TF_Tensor* tensor;
+  TFE_TensorHandle* h;
+
+  explicit Handle(const std::vector<int64_t>& dims) {
+    tensor = FloatTensor(dims);
+    h = TFE_NewTensorHandle(tensor, status);
+    CheckOk();
+  }
+  ~Handle() {
+    TFE_DeleteTensorHandle(h);
+    TF_DeleteTensor(tensor);
+  }
+};
+
+// Creates, runs and deletes an op, like execute() does on each call.
+static void Execute(const char* op_name,
+                    const std::function<void(TFE_Op*)>& set_attrs,
+                    const std::vector<TFE_TensorHandle*>& inputs) {
+  TFE_Op* op = TFE_NewOp(ctx, op_name, status);
+  CheckOk();
+  set_attrs(op);
+  for (auto input : inputs) {
+    TFE_OpAddInput(op, input, status);
+    CheckOk();
+  }
+  TFE_TensorHandle* retvals[16];
+  int num_retvals = 16;
+  TFE_Execute(op, retvals, &num_retvals, status);
+  CheckOk();
+  for (int i = 0; i < num_retvals; i++) TFE_DeleteTensorHandle(retvals[i]);
+  TFE_DeleteOp(op);
+}
+
+static void SetT(TFE_Op* op) {
+  TFE_OpSetAttrType(op, "T", TF_FLOAT);
+}
+
+int main(int argc, char** argv) {
+  status = TF_NewStatus();
+  TFE_ContextOptions* opts = TFE_NewContextOptions();
+  ctx = TFE_NewContext(opts, status);
+  CheckOk();
+  TFE_DeleteContextOptions(opts);
+
+  Handle scalar({1});
+  Bench("execute Neg [1]", [&] { Execute("Neg", SetT, {scalar.h}); });
+  Bench("execute Add [1] x2",
+        [&] { Execute("Add", SetT, {scalar.h, scalar.h}); });
+  for (int n : {4, 8}) {
+    std::vector<TFE_TensorHandle*> inputs(n, scalar.h);
+    auto set_attrs = [n](TFE_Op* op) {
+      SetT(op);
+      TFE_OpSetAttrInt(op, "N", n);
+    };
+    Bench("execute AddN [1] x" + std::to_string(n),
+          [&] { Execute("AddN", set_attrs, inputs); });
+  }
+  Handle matrix({100, 100});
+  auto set_matmul_attrs = [](TFE_Op* op) {
+    TFE_OpSetAttrBool(op, "transpose_a", 0);
+    TFE_OpSetAttrBool(op, "transpose_b", 0);
+    SetT(op);
+  };
+  Bench("execute MatMul [100,100]",
+        [&] { Execute("MatMul", set_matmul_attrs, {matrix.h, matrix.h}); });
+
+  Handle image({1, 4, 4, 1});
+  Handle filter({2, 2, 1, 1});
+  auto set_conv_attrs = [](TFE_Op* op) {
+    static const int64_t ones[] = {1, 1, 1, 1};
+    SetT(op);
+    TFE_OpSetAttrIntList(op, "strides", ones, 4);
+    TFE_OpSetAttrBool(op, "use_cudnn_on_gpu", 0);
+    TFE_OpSetAttrString(op, "padding", "SAME");
+    TFE_OpSetAttrString(op, "data_format", "NHWC");
+    TFE_OpSetAttrIntList(op, "dilations", ones, 4);
+  };
+  Bench("attrs Conv2D names",
+        [&] { Execute("Conv2D", set_conv_attrs, {image.h, filter.h}); });
+
+  Bench("Handle new+dispose [1]", [] { Handle h({1}); });
+
+  for (int64_t size : {1, 1024, 1024 * 1024}) {
+    Handle h({size});
+    Bench("asArrayBuffer [" + std::to_string(size) + "]", [&] {
+      TF_Tensor* t = TFE_TensorHandleResolve(h.h, status);
+      CheckOk();
+      TF_DeleteTensor(t);
+    });
+  }
+
+  TF_DeviceList* devices = TFE_ContextListDevices(ctx, status);
+  CheckOk();
+  for (int i = 0; i < TF_DeviceListCount(devices); i++) {
+    std::string device = TF_DeviceListName(devices, i, status);
+    CheckOk();
+    // Named like in binding_bench.ts.
+    size_t prefix = device.find("device:");
+    std::string name = prefix == std::string::npos
+                           ? device
+                           : device.substr(prefix + strlen("device:"));
+    for (int64_t size : {1, 1024 * 1024}) {
+      Handle h({size});
+      Bench("copyToDevice " + name + " [" + std::to_string(size) + "]", [&] {
+        TFE_TensorHandle* copy =
+            TFE_TensorHandleCopyToDevice(h.h, ctx, device.c_str(), status);
+        CheckOk();
+        TFE_DeleteTensorHandle(copy);
+      });
+    }
+  }
+  TF_DeleteDeviceList(devices);
+
+  if (argc > 1) WriteResults(argv[1]);
+  TFE_DeleteContext(ctx, status);
+  TF_DeleteStatus(status);
+  return 0;
+}
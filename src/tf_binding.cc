@@ -13,11 +13,34 @@
    limitations under the License.
  */
 #include <node_api.h>
+#include <uv.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _WIN32
+#include <malloc.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <atomic>  // NOLINT(build/c++11)
+#include <chrono>  // NOLINT(build/c++11)
+#include <condition_variable>  // NOLINT(build/c++11)
+#include <deque>
+#include <functional>
+#include <limits>
 #include <map>
+#include <mutex>  // NOLINT(build/c++11)
+#include <random>  // NOLINT(build/c++11)
+#include <set>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
 #include "./check.h"
 #include "deps/libtensorflow/include/tensorflow/c/c_api.h"
 #include "deps/libtensorflow/include/tensorflow/c/eager/c_api.h"
@@ -43,19 +66,96 @@ enum AttrType {
 };
 
 static const size_t kMaxDims = 10;
-static napi_ref handle_class_ref;
-
-struct ContextWrap {
-  napi_env env;
-  TFE_Context* tf_context;
-};
+// Ops with more outputs than this, like a Split with a large num_split, must
+// pass the number of outputs to execute(). Keep kTooManyOutputsMessage in
+// sync.
+static const int kMaxRetvals = 16;
+// An upper bound on the number of outputs a caller may ask an op for, so a
+// bad count can't make us allocate without limit.
+static const int kMaxOutputs = 1 << 16;
+// Freed HandleWraps are kept for reuse, up to this many.
+static const size_t kHandleWrapPoolSize = 4096;
+
+struct ContextWrap;
 
 struct HandleWrap {
   napi_env env;
   TF_Tensor* tf_tensor;
   TFE_TensorHandle* tf_tensor_handle;
+  // Number of async tasks still reading tf_tensor_handle on a worker thread.
+  // dispose() is deferred until they are done.
+  int pending_tasks;
+  bool dispose_pending;
+  // Depth of the scope the handle belongs to (0 if none) and its index in
+  // that scope's list of handles.
+  size_t scope_depth;
+  size_t scope_index;
+  // Metadata captured when the handle is created, so that it can be read
+  // without asking TensorFlow again. It stays valid after dispose(). dims is
+  // only filled in if num_dims <= kMaxDims.
+  TF_DataType dtype;
+  int num_dims;
+  int64_t dims[kMaxDims];
+  // Index into device_names.
+  int device_id;
+  // Shared by the small handle cache, so dispose() leaves it alone.
+  bool pinned;
+  // Set on the handle returned by newVariable(), which owns the variable
+  // and destroys it when released. The reference keeps the context alive
+  // until then.
+  ContextWrap* variable_context;
+  napi_ref variable_context_ref;
+};
+
+// A single op attribute, parsed out of its JavaScript representation so that
+// it can be applied to many TFE_Ops without touching JavaScript again.
+struct OpAttr {
+  const char* name;
+  AttrType type;
+  // ATTR_INT, ATTR_BOOL, ATTR_TYPE, and the number of dims of an ATTR_SHAPE
+  // (-1 if the rank is unknown).
+  int64_t int_value;
+  float float_value;
+  // ATTR_STRING, or the function name of an ATTR_FUNCTION.
+  std::string string_value;
+  // ATTR_INT_LIST, the dims of an ATTR_SHAPE, or the number of dims of each
+  // shape of an ATTR_SHAPE_LIST.
+  std::vector<int64_t> int_list_value;
+  std::vector<float> float_list_value;
+  std::vector<unsigned char> bool_list_value;
+  std::vector<TF_DataType> type_list_value;
+  std::vector<std::string> string_list_value;
+  std::vector<const char*> string_list_ptrs;  // Into string_list_value.
+  std::vector<std::vector<int64_t>> shape_list_value;
+};
+
+struct ContextWrap {
+  napi_env env;
+  TFE_Context* tf_context;
+  // Scratch state for the calls made on this context, so that the hot path
+  // does not allocate once it has warmed up. Those calls all run on the main
+  // thread and none of them can reenter another, so one set is enough.
+  TF_Status* tf_status;
+  std::vector<OpAttr> attrs;
+  std::vector<TFE_TensorHandle*> inputs;
+  std::vector<TFE_TensorHandle*> retvals;
+  std::string key;  // For the small handle cache.
 };
 
+// Returns the scratch status of context_wrap, cleared.
+static TF_Status* ContextStatus(ContextWrap* context_wrap) {
+  TF_SetStatus(context_wrap->tf_status, TF_OK, "");
+  return context_wrap->tf_status;
+}
+
+// The same for calls which aren't given a context, like new Handle() and
+// asArrayBuffer(). Like ContextStatus(), only for the main thread.
+static TF_Status* MainStatus() {
+  static TF_Status* tf_status = TF_NewStatus();
+  TF_SetStatus(tf_status, TF_OK, "");
+  return tf_status;
+}
+
 class JSRef {
  public:
   JSRef(napi_env env, napi_value value) : env_(env) {
@@ -85,16 +185,248 @@ static int64_t GetHandleByteSize(TFE_TensorHandle* h) {
   return size;
 }
 
-static void RegisterHandle(napi_env env, TFE_TensorHandle* h) {
+// Memory held by live handles, per device.
+struct DeviceMemoryStats {
+  int64_t live_handles;
+  int64_t live_bytes;
+  int64_t peak_bytes;
+  int64_t allocs;
+  int64_t frees;
+  // Values of allocs and frees at the previous memoryStats() call.
+  int64_t last_allocs;
+  int64_t last_frees;
+};
+
+// Where a live handle came from, recorded in leak tracking mode.
+struct LiveHandleInfo {
+  std::string device;
+  int64_t bytes;
+  std::string op;
+  std::string stack;
+};
+
+// Indexed by device id, see InternDevice().
+static std::vector<DeviceMemoryStats> device_memory_stats;
+static int64_t external_memory_total = 0;
+// Borrowed data which TF_NewTensor copied, see CountUnalignedCopy().
+static int64_t unaligned_copies = 0;
+static int64_t unaligned_copy_bytes = 0;
+static std::chrono::steady_clock::time_point last_memory_stats_time =
+    std::chrono::steady_clock::now();
+static bool leak_tracking = false;
+static std::map<TFE_TensorHandle*, LiveHandleInfo> live_handles;
+
+#ifdef LEAK_CHECK
+// Contexts and prepared ops are freed by their finalizers, which don't run
+// for objects still referenced from JavaScript at exit. LeakSanitizer can't
+// see references from the V8 heap, so in the build for tools/leak_check.js
+// the live ones are listed here, where it finds them.
+static std::set<void*> live_wraps;
+#endif
+
+static void TrackWrap(void* wrap) {
+#ifdef LEAK_CHECK
+  live_wraps.insert(wrap);
+#endif
+}
+
+static void UntrackWrap(void* wrap) {
+#ifdef LEAK_CHECK
+  live_wraps.erase(wrap);
+#endif
+}
+
+// While a trace is active, the ops executed through the binding are also
+// added to a TF_Graph, which endTrace() turns into a runnable Graph. See
+// BeginTrace.
+struct Trace {
+  TF_Graph* graph;
+  // The graph value of each live handle that the trace has seen.
+  std::map<TFE_TensorHandle*, TF_Output> values;
+  std::vector<TF_Output> inputs;
+  int next_id;
+  // The first error, after which ops are no longer recorded.
+  std::string error;
+};
+
+static Trace* current_trace = NULL;
+
+// Forgets h, whose address may be reused by an unrelated handle.
+static void TraceForget(TFE_TensorHandle* h) {
+  if (current_trace != NULL) current_trace->values.erase(h);
+}
+
+// Returns the current JavaScript stack trace.
+static std::string JSStackTrace(napi_env env) {
+  napi_value message, error, stack;
+  auto nstatus = napi_create_string_utf8(env, "", 0, &message);
+  check(nstatus == napi_ok);
+  nstatus = napi_create_error(env, NULL, message, &error);
+  check(nstatus == napi_ok);
+  nstatus = napi_get_named_property(env, error, "stack", &stack);
+  check(nstatus == napi_ok);
+  size_t length;
+  nstatus = napi_get_value_string_utf8(env, stack, NULL, 0, &length);
+  if (nstatus != napi_ok) return std::string();
+  std::string result(length, '\0');
+  nstatus = napi_get_value_string_utf8(
+      env, stack, &result[0], length + 1, &length);
+  check(nstatus == napi_ok);
+  return result;
+}
+
+// Device names are interned, so that handles can store and JavaScript can
+// cache a small integer instead of a string.
+static std::vector<std::string> device_names;
+
+static int InternDevice(const char* name) {
+  // There are only a few devices, and unlike a map lookup, comparing with
+  // each of them doesn't copy name into a std::string.
+  for (size_t i = 0; i < device_names.size(); i++) {
+    if (device_names[i] == name) return static_cast<int>(i);
+  }
+  device_names.push_back(name);
+  return static_cast<int>(device_names.size() - 1);
+}
+
+static DeviceMemoryStats& DeviceStats(const char* device) {
+  size_t id = InternDevice(device);
+  if (id >= device_memory_stats.size()) device_memory_stats.resize(id + 1);
+  return device_memory_stats[id];
+}
+
+static void CaptureHandleMeta(HandleWrap* handle_wrap) {
+  TFE_TensorHandle* h = handle_wrap->tf_tensor_handle;
+  handle_wrap->dtype = TFE_TensorHandleDataType(h);
+  handle_wrap->num_dims = TFE_TensorHandleNumDims(h);
+  if (handle_wrap->num_dims <= static_cast<int>(kMaxDims)) {
+    for (int i = 0; i < handle_wrap->num_dims; i++) {
+      handle_wrap->dims[i] = TFE_TensorHandleDim(h, i);
+    }
+  }
+  handle_wrap->device_id = InternDevice(TFE_TensorHandleDeviceName(h));
+}
+
+// Profiling, enabled with setProfiling(). Each instrumented call records a
+// ProfileEvent into a ring buffer, which overwrites the oldest events once
+// it is full. Claiming a slot is a single atomic increment. Events are only
+// recorded on the main thread. When profiling is disabled, the only cost is
+// checking the profiling flag.
+struct ProfileEvent {
+  // "execute", "read", "copy" or "handle".
+  const char* category;
+  std::string name;
+  // Dtype and shape of each input, like "float32[2,3] int32[]".
+  std::string inputs;
+  // Index into device_names, or -1 if unknown.
+  int device_id;
+  // Nanoseconds since profile_epoch. Time spent between tf_start_ns and
+  // tf_end_ns is spent in TensorFlow, the rest is N-API marshalling.
+  int64_t start_ns;
+  int64_t tf_start_ns;
+  int64_t tf_end_ns;
+  int64_t end_ns;
+};
+
+static const size_t kProfileCapacity = 1 << 16;
+static bool profiling = false;
+static std::vector<ProfileEvent> profile_events;
+static std::atomic<uint64_t> profile_count(0);
+static const std::chrono::steady_clock::time_point profile_epoch =
+    std::chrono::steady_clock::now();
+
+static int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - profile_epoch)
+      .count();
+}
+
+// Claims the next slot of the ring buffer. Only call while profiling.
+static ProfileEvent* NewProfileEvent(const char* category,
+                                     const char* name,
+                                     int64_t start_ns) {
+  uint64_t i = profile_count.fetch_add(1, std::memory_order_relaxed);
+  ProfileEvent* event = &profile_events[i % kProfileCapacity];
+  event->category = category;
+  event->name = name;
+  event->inputs.clear();
+  event->device_id = -1;
+  event->start_ns = start_ns;
+  event->tf_start_ns = event->tf_end_ns = event->end_ns = start_ns;
+  return event;
+}
+
+static const char* DTypeName(TF_DataType dtype) {
+  switch (dtype) {
+    case TF_FLOAT:
+      return "float32";
+    case TF_DOUBLE:
+      return "float64";
+    case TF_INT32:
+      return "int32";
+    case TF_INT64:
+      return "int64";
+    case TF_UINT8:
+      return "uint8";
+    case TF_BOOL:
+      return "bool";
+    default:
+      return "other";
+  }
+}
+
+// Appends the dtype and shape of a handle to a ProfileEvent's inputs.
+static void DescribeInput(const HandleWrap* handle_wrap, std::string* out) {
+  if (!out->empty()) out->push_back(' ');
+  out->append(DTypeName(handle_wrap->dtype));
+  out->push_back('[');
+  if (handle_wrap->num_dims > static_cast<int>(kMaxDims)) {
+    out->append("...");
+  } else {
+    for (int i = 0; i < handle_wrap->num_dims; i++) {
+      if (i > 0) out->push_back(',');
+      out->append(std::to_string(handle_wrap->dims[i]));
+    }
+  }
+  out->push_back(']');
+}
+
+// Every handle that is wrapped in a JavaScript Handle must be registered,
+// so V8 knows about the external memory and memoryStats() can account for
+// it. op_name is the op that produced the handle.
+static void RegisterHandle(napi_env env,
+                           TFE_TensorHandle* h,
+                           const char* op_name) {
   int64_t size = GetHandleByteSize(h);
-  int64_t total;
-  napi_adjust_external_memory(env, size, &total);
+  napi_adjust_external_memory(env, size, &external_memory_total);
+
+  const char* device = TFE_TensorHandleDeviceName(h);
+  DeviceMemoryStats& stats = DeviceStats(device);
+  stats.live_handles++;
+  stats.live_bytes += size;
+  stats.allocs++;
+  if (stats.live_bytes > stats.peak_bytes) stats.peak_bytes = stats.live_bytes;
+
+  if (leak_tracking) {
+    LiveHandleInfo& info = live_handles[h];
+    info.device = device;
+    info.bytes = size;
+    info.op = op_name;
+    info.stack = JSStackTrace(env);
+  }
 }
 
 static void UnregisterHandle(napi_env env, TFE_TensorHandle* h) {
   int64_t size = GetHandleByteSize(h);
-  int64_t total;
-  napi_adjust_external_memory(env, -size, &total);
+  napi_adjust_external_memory(env, -size, &external_memory_total);
+
+  DeviceMemoryStats& stats = DeviceStats(TFE_TensorHandleDeviceName(h));
+  stats.live_handles--;
+  stats.live_bytes -= size;
+  stats.frees++;
+
+  if (!live_handles.empty()) live_handles.erase(h);
+  TraceForget(h);
 }
 
 static void ReleaseTypedArray(void* data, size_t len, void* js_ref_ptr) {
@@ -102,9 +434,37 @@ static void ReleaseTypedArray(void* data, size_t len, void* js_ref_ptr) {
   delete js_ref;
 }
 
-static void DeleteHandle(napi_env env, void* handle_wrap_ptr, void* hint) {
-  auto handle_wrap = static_cast<HandleWrap*>(handle_wrap_ptr);
+// Destroys the variable owned by a handle from newVariable(). Other handles
+// to the same variable then fail in the ops that use them.
+static void DestroyVariable(napi_env env, HandleWrap* handle_wrap) {
+  ContextWrap* context_wrap = handle_wrap->variable_context;
+  // This may run from a finalizer in the middle of another call on the
+  // context, so it doesn't touch the context's scratch status.
+  TF_Status* tf_status = TF_NewStatus();
+  TFE_Op* op =
+      TFE_NewOp(context_wrap->tf_context, "DestroyResourceOp", tf_status);
+  check(TF_GetCode(tf_status) == TF_OK);
+  TFE_OpAddInput(op, handle_wrap->tf_tensor_handle, tf_status);
+  check(TF_GetCode(tf_status) == TF_OK);
+  TFE_OpSetAttrBool(op, "ignore_lookup_error", 1);
+  TFE_TensorHandle* retvals[1];
+  int num_retvals = 0;
+  TFE_Execute(op, retvals, &num_retvals, tf_status);
+  TFE_DeleteOp(op);
+  TF_DeleteStatus(tf_status);
+
+  auto nstatus = napi_delete_reference(env, handle_wrap->variable_context_ref);
+  check(nstatus == napi_ok);
+  handle_wrap->variable_context = NULL;
+  handle_wrap->variable_context_ref = NULL;
+}
 
+// Deletes the tensor handle and tensor held by a HandleWrap, and destroys
+// the variable it owns, but not the HandleWrap itself.
+static void ReleaseHandle(napi_env env, HandleWrap* handle_wrap) {
+  if (handle_wrap->variable_context != NULL) {
+    DestroyVariable(env, handle_wrap);
+  }
   if (handle_wrap->tf_tensor_handle != NULL) {
     UnregisterHandle(env, handle_wrap->tf_tensor_handle);
     TFE_DeleteTensorHandle(handle_wrap->tf_tensor_handle);
@@ -115,8 +475,67 @@ static void DeleteHandle(napi_env env, void* handle_wrap_ptr, void* hint) {
     TF_DeleteTensor(handle_wrap->tf_tensor);
     handle_wrap->tf_tensor = NULL;
   }
+}
+
+// Releases the handle now, or once the async tasks using it are done.
+static void DisposeHandle(napi_env env, HandleWrap* handle_wrap) {
+  if (handle_wrap->pinned) return;
+  if (handle_wrap->pending_tasks > 0) {
+    handle_wrap->dispose_pending = true;
+  } else {
+    ReleaseHandle(env, handle_wrap);
+  }
+}
+
+// Handles created between beginScope() and endScope() are appended to the
+// innermost scope, and released together when it ends. Handles that are
+// garbage collected earlier leave a NULL behind, so a scope never has to
+// be searched.
+static std::vector<std::vector<HandleWrap*>> scopes;
+
+static void AddToScope(HandleWrap* handle_wrap, size_t depth) {
+  handle_wrap->scope_depth = depth;
+  if (depth == 0) return;
+  std::vector<HandleWrap*>& scope = scopes[depth - 1];
+  handle_wrap->scope_index = scope.size();
+  scope.push_back(handle_wrap);
+}
+
+static void RemoveFromScope(HandleWrap* handle_wrap) {
+  if (handle_wrap->scope_depth == 0) return;
+  scopes[handle_wrap->scope_depth - 1][handle_wrap->scope_index] = NULL;
+  handle_wrap->scope_depth = 0;
+}
+
+// Every op result needs a HandleWrap, so they are recycled instead of
+// going through the allocator each time.
+static std::vector<HandleWrap*> handle_wrap_pool;
+
+static HandleWrap* NewHandleWrap(napi_env env) {
+  HandleWrap* handle_wrap;
+  if (handle_wrap_pool.empty()) {
+    handle_wrap = new HandleWrap();
+  } else {
+    handle_wrap = handle_wrap_pool.back();
+    handle_wrap_pool.pop_back();
+    *handle_wrap = HandleWrap();
+  }
+  handle_wrap->env = env;
+  return handle_wrap;
+}
 
-  delete handle_wrap;
+static void DeleteHandle(napi_env env, void* handle_wrap_ptr, void* hint) {
+  auto handle_wrap = static_cast<HandleWrap*>(handle_wrap_ptr);
+  // Async tasks hold a reference to the Handle, so it can't be garbage
+  // collected while they are pending.
+  check(handle_wrap->pending_tasks == 0);
+  RemoveFromScope(handle_wrap);
+  ReleaseHandle(env, handle_wrap);
+  if (handle_wrap_pool.size() < kHandleWrapPoolSize) {
+    handle_wrap_pool.push_back(handle_wrap);
+  } else {
+    delete handle_wrap;
+  }
 }
 
 void AssertConstructorCall(napi_env env, napi_callback_info info) {
@@ -130,52 +549,111 @@ void AssertConstructorCall(napi_env env, napi_callback_info info) {
 
 // TFE_OpSetAttrType, TFE_OpSetAttrBool, and friends use attr_name parameter
 // beyond the lifetime of the call. Because we are getting these strings
-// from V8, we cannot simply get a constant pointer. So, rather than trying
-// to dynamically allocate memory for these attribute names, we instead have
-// this lookup map to fixed strings.  The value (int) in the map is unused.
-// Add to this as needed.
-const std::map<std::string, int> attrNameMap = {
-    {"DstT", 0},
-    {"Index", 0},
-    {"N", 0},
-    {"SrcT", 0},
-    {"T", 0},
-    {"TI", 0},
-    {"Taxis", 0},
-    {"Tidx", 0},
-    {"Tindices", 0},
-    {"Tpaddings", 0},
-    {"Tparams", 0},
-    {"Tperm", 0},
-    {"Tshape", 0},
-    {"axis", 0},
-    {"data_format", 0},
-    {"dilations", 0},
-    {"dtype", 0},
-    {"keep_dims", 0},
-    {"ksize", 0},
-    {"output_type", 0},
-    {"padding", 0},
-    {"seed", 0},
-    {"seed2", 0},
-    {"strides", 0},
-    {"transpose_a", 0},
-    {"transpose_b", 0},
-    {"use_cudnn_on_gpu", 0},
-    {"validate_indices", 0},
-};
+// from V8, we cannot simply get a constant pointer. So attribute names are
+// interned: each distinct name is copied once into attr_name_ids, whose keys
+// never move, and given a small integer id. JavaScript can look the id up
+// once with internAttrName() and pass it instead of the name, which turns
+// the lookup into an array index.
+static std::map<std::string, int32_t> attr_name_ids;
+static std::vector<const char*> attr_names;  // Indexed by id.
+
+static int32_t InternAttrName(const std::string& name) {
+  auto it = attr_name_ids.find(name);
+  if (it == attr_name_ids.end()) {
+    auto id = static_cast<int32_t>(attr_names.size());
+    it = attr_name_ids.emplace(name, id).first;
+    attr_names.push_back(it->first.c_str());
+  }
+  return it->second;
+}
+
+// Reads a JavaScript string into *out, reusing its buffer if large enough.
+static void ReadString(napi_env env, napi_value value, std::string* out) {
+  size_t length;
+  auto nstatus = napi_get_value_string_utf8(env, value, NULL, 0, &length);
+  check(nstatus == napi_ok);
+  out->resize(length);
+  nstatus = napi_get_value_string_utf8(
+      env, value, &(*out)[0], length + 1, &length);
+  check(nstatus == napi_ok);
+}
+
+static std::string GetString(napi_env env, napi_value value) {
+  std::string result;
+  ReadString(env, value, &result);
+  return result;
+}
 
+// attr_name_js is either the name of an attribute or its interned id.
+// Throws and returns NULL if it's neither.
 const char* AttrNameLookup(napi_env env, napi_value attr_name_js) {
-  char attr_name[512];
-  auto nstatus =
-      napi_get_value_string_utf8(env, attr_name_js, attr_name, 512, NULL);
+  napi_valuetype type;
+  auto nstatus = napi_typeof(env, attr_name_js, &type);
+  check(nstatus == napi_ok);
+  if (type == napi_number) {
+    int32_t id;
+    nstatus = napi_get_value_int32(env, attr_name_js, &id);
+    check(nstatus == napi_ok);
+    if (id < 0 || static_cast<size_t>(id) >= attr_names.size()) {
+      napi_throw_range_error(env, "EINVAL", "Bad attribute id");
+      return NULL;
+    }
+    return attr_names[id];
+  }
+  if (type != napi_string) {
+    napi_throw_type_error(
+        env, "EINVAL", "Attribute name must be a string or an id");
+    return NULL;
+  }
+  // Only called on the main thread, so the name can be read into a static
+  // string, which keeps its buffer from one lookup to the next.
+  static std::string name;
+  ReadString(env, attr_name_js, &name);
+  return attr_names[InternAttrName(name)];
+}
+
+// Returns the id of an attribute name, to be passed in place of the name.
+// args[0] name: string
+static napi_value InternAttrNameJS(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 1);
+
+  napi_valuetype type;
+  nstatus = napi_typeof(env, args[0], &type);
+  check(nstatus == napi_ok);
+  if (type != napi_string) {
+    napi_throw_type_error(env, NULL, "Attribute name must be a string");
+    return NULL;
+  }
+
+  napi_value id_js;
+  nstatus = napi_create_int32(
+      env, InternAttrName(GetString(env, args[0])), &id_js);
   check(nstatus == napi_ok);
+  return id_js;
+}
 
-  auto it = attrNameMap.find(attr_name);
-  if (it != attrNameMap.end()) {
-    return it->first.c_str();
+size_t TypedArrayElementSize(napi_typedarray_type type) {
+  switch (type) {
+    case napi_int8_array:
+    case napi_uint8_array:
+    case napi_uint8_clamped_array:
+      return 1;
+    case napi_int16_array:
+    case napi_uint16_array:
+      return 2;
+    case napi_int32_array:
+    case napi_uint32_array:
+    case napi_float32_array:
+      return 4;
+    case napi_float64_array:
+      return 8;
+    default:
+      fatal("Unknown TypedArray type");
   }
-  fatal("Unreachable");
 }
 
 bool IsArray(napi_env env, napi_value val) {
@@ -206,187 +684,720 @@ napi_value GetElement(napi_env env, napi_value arr, uint32_t index) {
   return out;
 }
 
-void SetOpAttr(napi_env env, TFE_Op* op, napi_value attr) {
-  // Check that the attr is an array.
-  bool is_array;
-  auto nstatus = napi_is_array(env, attr, &is_array);
+uint32_t GetArrayLength(napi_env env, napi_value arr) {
+  check(IsArray(env, arr));
+  uint32_t len;
+  auto nstatus = napi_get_array_length(env, arr, &len);
   check(nstatus == napi_ok);
-  check(is_array);
-  // Get length.
-  uint32_t attr_len;
-  nstatus = napi_get_array_length(env, attr, &attr_len);
+  return len;
+}
+
+// Parses a shape attr value: an array of dims, where -1 is an unknown dim,
+// or null if even the rank is unknown.
+void ParseShape(napi_env env,
+                napi_value shape_js,
+                std::vector<int64_t>* dims,
+                int64_t* num_dims) {
+  napi_valuetype type;
+  auto nstatus = napi_typeof(env, shape_js, &type);
   check(nstatus == napi_ok);
-  check(attr_len >= 3);
+  if (type == napi_null) {
+    dims->clear();
+    *num_dims = -1;
+    return;
+  }
+  uint32_t len = GetArrayLength(env, shape_js);
+  dims->resize(len);
+  for (uint32_t i = 0; i < len; i++) {
+    (*dims)[i] = GetInt32Value(env, GetElement(env, shape_js, i));
+  }
+  *num_dims = len;
+}
+
+// Throws and returns false if the attr's name or type is bad.
+bool ParseOpAttr(napi_env env, napi_value attr, OpAttr* out) {
+  // Check that the attr is an array.
+  check(GetArrayLength(env, attr) >= 3);
 
   // attr[0] should be the name e.g. "transpose_a"
-  napi_value attr_name_js;
-  nstatus = napi_get_element(env, attr, 0, &attr_name_js);
-  check(nstatus == napi_ok);
-  const char* attr_name = AttrNameLookup(env, attr_name_js);
+  out->name = AttrNameLookup(env, GetElement(env, attr, 0));
+  if (out->name == NULL) return false;
 
   // attr[1] should be an integer in enum AttrType.
-  napi_value attr_type_js;
-  nstatus = napi_get_element(env, attr, 1, &attr_type_js);
-  check(nstatus == napi_ok);
-  enum AttrType attr_type;
-  nstatus = napi_get_value_int32(
-      env, attr_type_js, reinterpret_cast<int32_t*>(&attr_type));
-  check(nstatus == napi_ok);
+  out->type =
+      static_cast<AttrType>(GetInt32Value(env, GetElement(env, attr, 1)));
 
-  napi_value attr2;
-  nstatus = napi_get_element(env, attr, 2, &attr2);
-  check(nstatus == napi_ok);
+  napi_value attr2 = GetElement(env, attr, 2);
 
-  switch (attr_type) {
+  switch (out->type) {
     case ATTR_BOOL: {
       bool v;
-      nstatus = napi_get_value_bool(env, attr2, &v);
+      auto nstatus = napi_get_value_bool(env, attr2, &v);
       check(nstatus == napi_ok);
-      TFE_OpSetAttrBool(op, attr_name, v);
+      out->int_value = v;
       break;
     }
 
-    case ATTR_TYPE: {
-      TF_DataType v;
-      nstatus =
-          napi_get_value_int32(env, attr2, reinterpret_cast<int32_t*>(&v));
-      check(nstatus == napi_ok);
-      TFE_OpSetAttrType(op, attr_name, v);
+    case ATTR_TYPE:
+    case ATTR_INT:
+      out->int_value = GetInt32Value(env, attr2);
       break;
-    }
 
-    case ATTR_INT: {
-      int32_t v;
-      nstatus = napi_get_value_int32(env, attr2, &v);
-      check(nstatus == napi_ok);
-      TFE_OpSetAttrInt(op, attr_name, v);
+    case ATTR_FLOAT:
+      out->float_value = static_cast<float>(GetDoubleValue(env, attr2));
+      break;
+
+    case ATTR_STRING:
+    case ATTR_FUNCTION:
+      ReadString(env, attr2, &out->string_value);
+      break;
+
+    case ATTR_SHAPE:
+      ParseShape(env, attr2, &out->int_list_value, &out->int_value);
       break;
-    }
 
     case ATTR_INT_LIST: {
-      nstatus = napi_is_array(env, attr2, &is_array);
-      check(nstatus == napi_ok && is_array);
+      uint32_t len = GetArrayLength(env, attr2);
+      out->int_list_value.resize(len);
+      for (uint32_t i = 0; i < len; i++) {
+        out->int_list_value[i] = GetInt32Value(env, GetElement(env, attr2, i));
+      }
+      break;
+    }
 
-      uint32_t len;
-      nstatus = napi_get_array_length(env, attr2, &len);
-      check(nstatus == napi_ok);
+    case ATTR_FLOAT_LIST: {
+      uint32_t len = GetArrayLength(env, attr2);
+      out->float_list_value.resize(len);
+      for (uint32_t i = 0; i < len; i++) {
+        out->float_list_value[i] =
+            static_cast<float>(GetDoubleValue(env, GetElement(env, attr2, i)));
+      }
+      break;
+    }
 
-      auto list = new int64_t[len];
+    case ATTR_BOOL_LIST: {
+      uint32_t len = GetArrayLength(env, attr2);
+      out->bool_list_value.resize(len);
       for (uint32_t i = 0; i < len; i++) {
-        napi_value d;
-        nstatus = napi_get_element(env, attr2, i, &d);
+        bool v;
+        auto nstatus = napi_get_value_bool(env, GetElement(env, attr2, i), &v);
         check(nstatus == napi_ok);
-        int32_t val;
-        nstatus = napi_get_value_int32(env, d, &val);
-        check(nstatus == napi_ok);
-        list[i] = val;
+        out->bool_list_value[i] = v;
       }
-      TFE_OpSetAttrIntList(op, attr_name, list, static_cast<int>(len));
-      delete[] list;
       break;
     }
 
-    case ATTR_STRING: {
-      char str[512];
-      nstatus = napi_get_value_string_utf8(env, attr2, str, 512, NULL);
-      check(nstatus == napi_ok);
-      TFE_OpSetAttrString(op, attr_name, str);
+    case ATTR_TYPE_LIST: {
+      uint32_t len = GetArrayLength(env, attr2);
+      out->type_list_value.resize(len);
+      for (uint32_t i = 0; i < len; i++) {
+        out->type_list_value[i] = static_cast<TF_DataType>(
+            GetInt32Value(env, GetElement(env, attr2, i)));
+      }
+      break;
+    }
+
+    case ATTR_STRING_LIST: {
+      uint32_t len = GetArrayLength(env, attr2);
+      out->string_list_value.resize(len);
+      out->string_list_ptrs.resize(len);
+      for (uint32_t i = 0; i < len; i++) {
+        ReadString(env, GetElement(env, attr2, i), &out->string_list_value[i]);
+        out->string_list_ptrs[i] = out->string_list_value[i].c_str();
+      }
+      break;
+    }
+
+    case ATTR_SHAPE_LIST: {
+      uint32_t len = GetArrayLength(env, attr2);
+      out->shape_list_value.resize(len);
+      out->int_list_value.resize(len);
+      for (uint32_t i = 0; i < len; i++) {
+        ParseShape(env,
+                   GetElement(env, attr2, i),
+                   &out->shape_list_value[i],
+                   &out->int_list_value[i]);
+      }
+      break;
+    }
+
+    default:
+      napi_throw_range_error(env, "EINVAL", "Unknown attribute type");
+      return false;
+  }
+  return true;
+}
+
+// Sets attr on op. Returns false, with status set, if TensorFlow rejects it.
+bool ApplyOpAttr(TFE_Context* ctx,
+                 TFE_Op* op,
+                 const OpAttr& attr,
+                 TF_Status* status) {
+  switch (attr.type) {
+    case ATTR_BOOL:
+      TFE_OpSetAttrBool(op, attr.name, attr.int_value != 0);
+      break;
+
+    case ATTR_TYPE:
+      TFE_OpSetAttrType(
+          op, attr.name, static_cast<TF_DataType>(attr.int_value));
+      break;
+
+    case ATTR_INT:
+      TFE_OpSetAttrInt(op, attr.name, attr.int_value);
+      break;
+
+    case ATTR_FLOAT:
+      TFE_OpSetAttrFloat(op, attr.name, attr.float_value);
+      break;
+
+    case ATTR_STRING:
+      TFE_OpSetAttrString(op, attr.name, attr.string_value.c_str());
+      break;
+
+    case ATTR_SHAPE:
+      TFE_OpSetAttrShape(op,
+                         attr.name,
+                         attr.int_list_value.data(),
+                         static_cast<int>(attr.int_value),
+                         status);
+      if (TF_GetCode(status) != TF_OK) return false;
+      break;
+
+    case ATTR_FUNCTION: {
+      // The function is referred to by an op of the same name, which must
+      // have been registered with the context.
+      TFE_Op* function = TFE_NewOp(ctx, attr.string_value.c_str(), status);
+      if (TF_GetCode(status) != TF_OK) return false;
+      TFE_OpSetAttrFunction(op, attr.name, function);
+      TFE_DeleteOp(function);
+      break;
+    }
+
+    case ATTR_INT_LIST:
+      TFE_OpSetAttrIntList(op,
+                           attr.name,
+                           attr.int_list_value.data(),
+                           static_cast<int>(attr.int_list_value.size()));
+      break;
+
+    case ATTR_FLOAT_LIST:
+      TFE_OpSetAttrFloatList(op,
+                             attr.name,
+                             attr.float_list_value.data(),
+                             static_cast<int>(attr.float_list_value.size()));
+      break;
+
+    case ATTR_BOOL_LIST:
+      TFE_OpSetAttrBoolList(op,
+                            attr.name,
+                            attr.bool_list_value.data(),
+                            static_cast<int>(attr.bool_list_value.size()));
+      break;
+
+    case ATTR_TYPE_LIST:
+      TFE_OpSetAttrTypeList(op,
+                            attr.name,
+                            attr.type_list_value.data(),
+                            static_cast<int>(attr.type_list_value.size()));
+      break;
+
+    case ATTR_STRING_LIST:
+      TFE_OpSetAttrStringList(
+          op,
+          attr.name,
+          const_cast<const char**>(attr.string_list_ptrs.data()),
+          static_cast<int>(attr.string_list_ptrs.size()));
+      break;
+
+    case ATTR_SHAPE_LIST: {
+      size_t n = attr.shape_list_value.size();
+      // Shape lists are short, so the pointer arrays live on the stack
+      // unless there are more than kMaxDims shapes.
+      const int64_t* dims_buf[kMaxDims];
+      int num_dims_buf[kMaxDims];
+      std::vector<const int64_t*> dims_vec;
+      std::vector<int> num_dims_vec;
+      const int64_t** dims = dims_buf;
+      int* num_dims = num_dims_buf;
+      if (n > kMaxDims) {
+        dims_vec.resize(n);
+        num_dims_vec.resize(n);
+        dims = dims_vec.data();
+        num_dims = num_dims_vec.data();
+      }
+      for (size_t i = 0; i < n; i++) {
+        dims[i] = attr.shape_list_value[i].data();
+        num_dims[i] = static_cast<int>(attr.int_list_value[i]);
+      }
+      TFE_OpSetAttrShapeList(
+          op, attr.name, dims, num_dims, static_cast<int>(n), status);
+      if (TF_GetCode(status) != TF_OK) return false;
       break;
     }
 
     default:
-      fatal("implement me");
+      fatal("Unknown attribute type");
   }
+  return true;
 }
 
-/* Set attribtues from arguments. Attrs will look something like this:
+/* Parses attribtues from arguments. Attrs will look something like this:
     [
       ["transpose_a", binding.ATTR_BOOL, false],
       ["transpose_b", binding.ATTR_BOOL, false],
       ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
     ]
+   Throws and returns false if one of them is bad.
 */
-void SetOpAttrs(napi_env env, TFE_Op* op, napi_value attrs) {
-  uint32_t attrs_len;
-  auto nstatus = napi_get_array_length(env, attrs, &attrs_len);
-  check(nstatus == napi_ok);
-
+bool ParseOpAttrs(napi_env env, napi_value attrs, std::vector<OpAttr>* out) {
+  uint32_t attrs_len = GetArrayLength(env, attrs);
+  out->resize(attrs_len);
   for (uint32_t i = 0; i < attrs_len; ++i) {
     // Each element of the attrs list should be an array.
-    napi_value attr;
-    nstatus = napi_get_element(env, attrs, i, &attr);
-    check(nstatus == napi_ok);
-    SetOpAttr(env, op, attr);
+    if (!ParseOpAttr(env, GetElement(env, attrs, i), &(*out)[i])) {
+      return false;
+    }
   }
+  return true;
 }
 
-napi_value WrapHandle(napi_env env, TFE_TensorHandle* h) {
-  // Get reference to Handle class so we can call its constructor.
-  napi_value handle_class;
-  auto nstatus =
-      napi_get_reference_value(env, handle_class_ref, &handle_class);
-  check(nstatus == napi_ok);
-  napi_value handle_js;
-  // Create a new Handle object, with no constructor arguments.
-  nstatus = napi_new_instance(env, handle_class, 0, NULL, &handle_js);
-  check(nstatus == napi_ok);
-  // Unwrap
-  HandleWrap* handle_wrap;
-  nstatus =
-      napi_unwrap(env, handle_js, reinterpret_cast<void**>(&handle_wrap));
-  check(nstatus == napi_ok);
-  // Set the provided TFE_TensorHandle.
-  check(handle_wrap->env == env);
-  check(handle_wrap->tf_tensor_handle == NULL);
-  handle_wrap->tf_tensor_handle = h;
-  return handle_js;
+// Returns false, with status set, if TensorFlow rejects one of the attrs.
+bool ApplyOpAttrs(TFE_Context* ctx,
+                  TFE_Op* op,
+                  const std::vector<OpAttr>& attrs,
+                  TF_Status* status) {
+  for (const auto& attr : attrs) {
+    if (!ApplyOpAttr(ctx, op, attr, status)) return false;
+  }
+  return true;
 }
 
-static napi_value Execute(napi_env env, napi_callback_info info) {
-  // Fetch JavaScript `this` object and function arguments.
-  size_t argc = 4;
-  napi_value args[4];
-  napi_value js_this;
-  auto nstatus = napi_get_cb_info(env, info, &argc, args, &js_this, NULL);
-  check(nstatus == napi_ok);
+// Reads a protobuf varint at *p, advancing *p. Returns false if the buffer
+// ends first.
+static bool ReadProtoVarint(const uint8_t** p,
+                            const uint8_t* end,
+                            uint64_t* out) {
+  *out = 0;
+  for (int shift = 0; *p < end && shift < 64; shift += 7) {
+    uint8_t byte = *(*p)++;
+    *out |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) return true;
+  }
+  return false;
+}
 
-  // Get ContextWrap from args[0].
-  ContextWrap* context_wrap;
-  nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&context_wrap));
-  check(nstatus == napi_ok);
+struct ProtoField {
+  uint64_t number;
+  uint64_t varint;      // For varint fields.
+  const uint8_t* data;  // For length delimited fields, otherwise NULL.
+  size_t size;
+};
 
-  // Get op_name (const char*) from args[1].
-  char op_name[512];
-  nstatus = napi_get_value_string_utf8(env, args[1], op_name, 512, NULL);
+// Reads the next field of a serialized protobuf message at *p, advancing
+// *p. Returns false at the end of the message or if it is malformed.
+static bool ReadProtoField(const uint8_t** p,
+                           const uint8_t* end,
+                           ProtoField* field) {
+  uint64_t key;
+  if (*p >= end || !ReadProtoVarint(p, end, &key)) return false;
+  field->number = key >> 3;
+  field->varint = 0;
+  field->data = NULL;
+  field->size = 0;
+  switch (key & 7) {
+    case 0:
+      return ReadProtoVarint(p, end, &field->varint);
+    case 1:
+      if (end - *p < 8) return false;
+      *p += 8;
+      return true;
+    case 2: {
+      uint64_t size;
+      if (!ReadProtoVarint(p, end, &size)) return false;
+      if (size > static_cast<uint64_t>(end - *p)) return false;
+      field->data = *p;
+      field->size = size;
+      *p += size;
+      return true;
+    }
+    case 5:
+      if (end - *p < 4) return false;
+      *p += 4;
+      return true;
+    default:
+      return false;
+  }
+}
+
+// OpDef field numbers.
+const uint64_t kOpDefInputArg = 2;
+const uint64_t kArgDefNumberAttr = 5;
+const uint64_t kArgDefTypeListAttr = 6;
+
+// An input arg of an op. Eager ops take a flat list of inputs, but graph
+// ops need to know which of them form list args, whose length is given by
+// the number_attr or type_list_attr.
+struct InputArg {
+  std::string number_attr;
+  std::string type_list_attr;
+};
+
+static std::map<std::string, std::vector<InputArg>> input_args_cache;
+
+static const std::vector<InputArg>* GetInputArgs(TF_Graph* graph,
+                                                 const char* op_name,
+                                                 TF_Status* status) {
+  auto it = input_args_cache.find(op_name);
+  if (it != input_args_cache.end()) return &it->second;
+
+  TF_Buffer* op_def = TF_NewBuffer();
+  TF_GraphGetOpDef(graph, op_name, op_def, status);
+  if (TF_GetCode(status) != TF_OK) {
+    TF_DeleteBuffer(op_def);
+    return NULL;
+  }
+  std::vector<InputArg> args;
+  auto p = static_cast<const uint8_t*>(op_def->data);
+  auto end = p + op_def->length;
+  ProtoField field;
+  while (ReadProtoField(&p, end, &field)) {
+    if (field.number != kOpDefInputArg || field.data == NULL) continue;
+    InputArg arg;
+    const uint8_t* q = field.data;
+    ProtoField arg_field;
+    while (ReadProtoField(&q, field.data + field.size, &arg_field)) {
+      if (arg_field.data == NULL) continue;
+      std::string value(reinterpret_cast<const char*>(arg_field.data),
+                        arg_field.size);
+      if (arg_field.number == kArgDefNumberAttr) arg.number_attr = value;
+      if (arg_field.number == kArgDefTypeListAttr) arg.type_list_attr = value;
+    }
+    args.push_back(arg);
+  }
+  TF_DeleteBuffer(op_def);
+  return &input_args_cache.emplace(op_name, args).first->second;
+}
+
+void ApplyGraphAttr(TF_OperationDescription* desc, const OpAttr& attr) {
+  switch (attr.type) {
+    case ATTR_BOOL:
+      TF_SetAttrBool(desc, attr.name, attr.int_value != 0);
+      break;
+
+    case ATTR_TYPE:
+      TF_SetAttrType(
+          desc, attr.name, static_cast<TF_DataType>(attr.int_value));
+      break;
+
+    case ATTR_INT:
+      TF_SetAttrInt(desc, attr.name, attr.int_value);
+      break;
+
+    case ATTR_FLOAT:
+      TF_SetAttrFloat(desc, attr.name, attr.float_value);
+      break;
+
+    case ATTR_STRING:
+      TF_SetAttrString(desc,
+                       attr.name,
+                       attr.string_value.data(),
+                       attr.string_value.size());
+      break;
+
+    case ATTR_SHAPE:
+      TF_SetAttrShape(desc,
+                      attr.name,
+                      attr.int_list_value.data(),
+                      static_cast<int>(attr.int_value));
+      break;
+
+    case ATTR_FUNCTION:
+      TF_SetAttrFuncName(desc,
+                         attr.name,
+                         attr.string_value.data(),
+                         attr.string_value.size());
+      break;
+
+    case ATTR_INT_LIST:
+      TF_SetAttrIntList(desc,
+                        attr.name,
+                        attr.int_list_value.data(),
+                        static_cast<int>(attr.int_list_value.size()));
+      break;
+
+    case ATTR_FLOAT_LIST:
+      TF_SetAttrFloatList(desc,
+                          attr.name,
+                          attr.float_list_value.data(),
+                          static_cast<int>(attr.float_list_value.size()));
+      break;
+
+    case ATTR_BOOL_LIST:
+      TF_SetAttrBoolList(desc,
+                         attr.name,
+                         attr.bool_list_value.data(),
+                         static_cast<int>(attr.bool_list_value.size()));
+      break;
+
+    case ATTR_TYPE_LIST:
+      TF_SetAttrTypeList(desc,
+                         attr.name,
+                         attr.type_list_value.data(),
+                         static_cast<int>(attr.type_list_value.size()));
+      break;
+
+    case ATTR_STRING_LIST: {
+      std::vector<size_t> lengths;
+      for (const auto& str : attr.string_list_value) {
+        lengths.push_back(str.size());
+      }
+      TF_SetAttrStringList(
+          desc,
+          attr.name,
+          reinterpret_cast<const void* const*>(attr.string_list_ptrs.data()),
+          lengths.data(),
+          static_cast<int>(lengths.size()));
+      break;
+    }
+
+    case ATTR_SHAPE_LIST: {
+      std::vector<const int64_t*> dims;
+      std::vector<int> num_dims;
+      for (size_t i = 0; i < attr.shape_list_value.size(); i++) {
+        dims.push_back(attr.shape_list_value[i].data());
+        num_dims.push_back(static_cast<int>(attr.int_list_value[i]));
+      }
+      TF_SetAttrShapeList(desc,
+                          attr.name,
+                          dims.data(),
+                          num_dims.data(),
+                          static_cast<int>(dims.size()));
+      break;
+    }
+
+    default:
+      fatal("Unknown attribute type");
+  }
+}
+
+// Returns a name for a new node in the trace.
+static std::string TraceNodeName(Trace* trace, const char* op_name) {
+  return std::string(op_name) + "_" + std::to_string(trace->next_id++);
+}
+
+// Sets *out to the graph value of h. Handles that weren't produced by a
+// traced op are captured as constants.
+static bool TraceValue(Trace* trace,
+                       TFE_TensorHandle* h,
+                       TF_Output* out,
+                       TF_Status* status) {
+  auto it = trace->values.find(h);
+  if (it != trace->values.end()) {
+    *out = it->second;
+    return true;
+  }
+
+  TF_Tensor* tensor = TFE_TensorHandleResolve(h, status);
+  if (TF_GetCode(status) != TF_OK) return false;
+  std::string name = TraceNodeName(trace, "Const");
+  auto desc = TF_NewOperation(trace->graph, "Const", name.c_str());
+  TF_SetAttrType(desc, "dtype", TF_TensorType(tensor));
+  TF_SetAttrTensor(desc, "value", tensor, status);
+  TF_DeleteTensor(tensor);
+  if (TF_GetCode(status) != TF_OK) {
+    // The description must be finished even if it is broken.
+    auto ignored = TF_NewStatus();
+    TF_FinishOperation(desc, ignored);
+    TF_DeleteStatus(ignored);
+    return false;
+  }
+  TF_Operation* oper = TF_FinishOperation(desc, status);
+  if (TF_GetCode(status) != TF_OK) return false;
+  *out = {oper, 0};
+  trace->values[h] = *out;
+  return true;
+}
+
+static bool AddTracedOp(Trace* trace,
+                        const char* op_name,
+                        const std::vector<OpAttr>& attrs,
+                        const std::vector<TFE_TensorHandle*>& inputs,
+                        TFE_TensorHandle** retvals,
+                        int num_retvals,
+                        TF_Status* status) {
+  auto args = GetInputArgs(trace->graph, op_name, status);
+  if (args == NULL) return false;
+
+  // Inputs may add constants to the graph, so they are looked up before
+  // the op itself is started.
+  std::vector<TF_Output> values(inputs.size());
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (!TraceValue(trace, inputs[i], &values[i], status)) return false;
+  }
+
+  std::string name = TraceNodeName(trace, op_name);
+  auto desc = TF_NewOperation(trace->graph, op_name, name.c_str());
+  std::string error;
+  size_t next = 0;
+  for (const auto& arg : *args) {
+    // The number of inputs of a list arg, or -1 for a single input.
+    int64_t count = -1;
+    if (!arg.number_attr.empty() || !arg.type_list_attr.empty()) {
+      bool is_number = !arg.number_attr.empty();
+      const std::string& attr_name =
+          is_number ? arg.number_attr : arg.type_list_attr;
+      for (const auto& attr : attrs) {
+        if (attr_name != attr.name) continue;
+        count = is_number ? attr.int_value : attr.type_list_value.size();
+      }
+      if (count < 0) {
+        error = "attribute " + attr_name + " must be given to trace the op";
+        break;
+      }
+    }
+    size_t needed = count < 0 ? 1 : count;
+    if (values.size() - next < needed) {
+      error = "too few inputs";
+      break;
+    }
+    if (count < 0) {
+      TF_AddInput(desc, values[next]);
+    } else {
+      TF_AddInputList(desc, &values[next], static_cast<int>(count));
+    }
+    next += needed;
+  }
+  if (error.empty() && next != values.size()) error = "too many inputs";
+  for (const auto& attr : attrs) {
+    ApplyGraphAttr(desc, attr);
+  }
+
+  TF_Operation* oper = TF_FinishOperation(desc, status);
+  if (!error.empty()) {
+    TF_SetStatus(status, TF_INVALID_ARGUMENT, error.c_str());
+    return false;
+  }
+  if (TF_GetCode(status) != TF_OK) return false;
+  for (int i = 0; i < num_retvals; i++) {
+    trace->values[retvals[i]] = {oper, i};
+  }
+  return true;
+}
+
+// Adds an op that was just executed to the current trace, if any. Errors
+// are reported by endTrace(), so that the eager result is unaffected.
+static void TraceOp(const char* op_name,
+                    const std::vector<OpAttr>& attrs,
+                    const std::vector<TFE_TensorHandle*>& inputs,
+                    TFE_TensorHandle** retvals,
+                    int num_retvals) {
+  Trace* trace = current_trace;
+  if (trace == NULL || !trace->error.empty()) return;
+  auto status = TF_NewStatus();
+  if (!AddTracedOp(
+          trace, op_name, attrs, inputs, retvals, num_retvals, status)) {
+    trace->error =
+        std::string("Cannot trace ") + op_name + ": " + TF_Message(status);
+  }
+  TF_DeleteStatus(status);
+}
+
+// Records that copy holds the same value as h. The graph leaves device
+// placement to the session.
+static void TraceCopy(TFE_TensorHandle* h, TFE_TensorHandle* copy) {
+  Trace* trace = current_trace;
+  if (trace == NULL || !trace->error.empty()) return;
+  auto status = TF_NewStatus();
+  TF_Output value;
+  if (TraceValue(trace, h, &value, status)) {
+    trace->values[copy] = value;
+  } else {
+    trace->error = std::string("Cannot trace copy: ") + TF_Message(status);
+  }
+  TF_DeleteStatus(status);
+}
+
+// Makes endTrace() fail, for operations whose results can't be traced.
+static void TraceUnsupported(const char* what) {
+  Trace* trace = current_trace;
+  if (trace == NULL || !trace->error.empty()) return;
+  trace->error = std::string(what) + " is not supported while tracing";
+}
+
+// Wraps h, and optionally the TF_Tensor backing it, in a new handle object.
+// This doesn't run the Handle constructor, which would have to allocate a
+// HandleWrap only for it to be looked up again here. So unlike handles made
+// with new Handle(), the result is a plain object.
+napi_value WrapHandle(napi_env env,
+                      TFE_TensorHandle* h,
+                      TF_Tensor* tf_tensor = NULL) {
+  napi_value handle_js;
+  auto nstatus = napi_create_object(env, &handle_js);
+  check(nstatus == napi_ok);
+  HandleWrap* handle_wrap = NewHandleWrap(env);
+  handle_wrap->tf_tensor_handle = h;
+  handle_wrap->tf_tensor = tf_tensor;
+  CaptureHandleMeta(handle_wrap);
+  nstatus = napi_wrap(env, handle_js, handle_wrap, DeleteHandle, NULL, NULL);
   check(nstatus == napi_ok);
+  AddToScope(handle_wrap, scopes.size());
+  return handle_js;
+}
 
-  // Get attrs from args[2].
-  auto attrs = args[2];
-  bool is_array;
-  nstatus = napi_is_array(env, attrs, &is_array);
+// Returns the size of the retvals buffer for the optional number of outputs
+// argument of execute(), which is at least kMaxRetvals, or 0 if it wasn't
+// given. Throws a RangeError and returns -1 if it's out of range.
+static int NumOutputsArg(napi_env env,
+                         size_t argc,
+                         napi_value* args,
+                         size_t index) {
+  if (argc <= index) return 0;
+  napi_valuetype type;
+  auto nstatus = napi_typeof(env, args[index], &type);
   check(nstatus == napi_ok);
-  check(is_array);
+  if (type == napi_undefined) return 0;
+  int32_t num_outputs = GetInt32Value(env, args[index]);
+  if (num_outputs < 0 || num_outputs > kMaxOutputs) {
+    napi_throw_range_error(env, "EINVAL", "Bad number of outputs");
+    return -1;
+  }
+  return num_outputs > kMaxRetvals ? num_outputs : kMaxRetvals;
+}
+
+// TFE_Execute silently drops the outputs which don't fit in retvals. If the
+// number of outputs wasn't given and an op fills all kMaxRetvals, it may
+// have had more, so the caller must pass the count.
+static const char kTooManyOutputsMessage[] =
+    "Op has 16 or more outputs, pass numOutputs";
 
-  // Get inputs from args[3].
-  auto inputs = args[3];
-  nstatus = napi_is_array(env, inputs, &is_array);
+static bool MayHaveDroppedOutputs(int max_retvals, int num_retvals) {
+  return max_retvals == 0 && num_retvals >= kMaxRetvals;
+}
+
+static void DeleteRetvals(TFE_TensorHandle** retvals, int num_retvals) {
+  for (int i = 0; i < num_retvals; ++i) TFE_DeleteTensorHandle(retvals[i]);
+}
+
+// Adds the Handles in the inputs array to op. Throws and returns false if
+// one of the inputs is not a Handle, has been released, or is rejected by
+// the op.
+// If handles is not NULL, the input handles are appended to it. If
+// description is not NULL, the inputs are described in it for profiling.
+static bool AddOpInputs(napi_env env,
+                        TFE_Op* op,
+                        napi_value inputs,
+                        TF_Status* tf_status,
+                        std::vector<TFE_TensorHandle*>* handles = NULL,
+                        std::string* description = NULL) {
+  bool is_array;
+  auto nstatus = napi_is_array(env, inputs, &is_array);
   check(nstatus == napi_ok);
   check(is_array);
   uint32_t inputs_len;
   nstatus = napi_get_array_length(env, inputs, &inputs_len);
   check(nstatus == napi_ok);
 
-  // Create TFE_Op
-  auto tf_status = TF_NewStatus();
-  TFE_Op* op = TFE_NewOp(context_wrap->tf_context, op_name, tf_status);
-  if (TF_GetCode(tf_status) != TF_OK) {
-    napi_throw_error(env, NULL, TF_Message(tf_status));
-    TF_DeleteStatus(tf_status);
-    return NULL;
-  }
-
-  SetOpAttrs(env, op, attrs);
-
   // Loop thru inputs and add them to Op.
   for (uint32_t i = 0; i < inputs_len; ++i) {
     napi_value input;
@@ -397,638 +1408,4392 @@ static napi_value Execute(napi_env env, napi_callback_info info) {
     nstatus = napi_unwrap(env, input, reinterpret_cast<void**>(&handle_wrap));
     if (nstatus != napi_ok) {
       napi_throw_error(env, NULL, "Cannot unwrap Execute input");
-      TF_DeleteStatus(tf_status);
-      TFE_DeleteOp(op);
-      return NULL;
+      return false;
+    }
+    // Scopes release handles which JavaScript objects may still hold.
+    if (handle_wrap->tf_tensor_handle == NULL) {
+      napi_throw_error(env, NULL, "Handle has been disposed");
+      return false;
     }
 
     TFE_OpAddInput(op, handle_wrap->tf_tensor_handle, tf_status);
-    check(TF_GetCode(tf_status) == TF_OK);
-  }
-
-  // TODO(ry) only handling a single return value currently.
-  TFE_TensorHandle* retvals[1];
-  int num_retvals = 1;
-  TFE_Execute(op, retvals, &num_retvals, tf_status);
-  if (TF_GetCode(tf_status) != TF_OK) {
-    napi_throw_error(env, NULL, TF_Message(tf_status));
-    TF_DeleteStatus(tf_status);
-    TFE_DeleteOp(op);
-    return NULL;
+    if (TF_GetCode(tf_status) != TF_OK) {
+      napi_throw_error(env, NULL, TF_Message(tf_status));
+      return false;
+    }
+    if (handles != NULL) handles->push_back(handle_wrap->tf_tensor_handle);
+    if (description != NULL) DescribeInput(handle_wrap, description);
   }
+  return true;
+}
 
+// Wraps the tensor handles returned by TFE_Execute into a JavaScript array.
+static napi_value WrapRetvals(napi_env env,
+                              TFE_TensorHandle** retvals,
+                              int num_retvals,
+                              const char* op_name) {
   // Create array to be returned.
   napi_value js_retvals;
-  nstatus = napi_create_array_with_length(env, num_retvals, &js_retvals);
+  auto nstatus = napi_create_array_with_length(env, num_retvals, &js_retvals);
   check(nstatus == napi_ok);
 
   // For each retval, wrap the TensorHandle.
   for (int i = 0; i < num_retvals; ++i) {
     TFE_TensorHandle* h = retvals[i];
-    RegisterHandle(env, h);
+    RegisterHandle(env, h, op_name);
     napi_value js_retval = WrapHandle(env, h);
     // Set created js object in output array.
     nstatus = napi_set_element(env, js_retvals, (uint32_t) i, js_retval);
     check(nstatus == napi_ok);
   }
-
-  TFE_DeleteOp(op);
-  TF_DeleteStatus(tf_status);
   return js_retvals;
 }
 
-static void DeleteContext(napi_env env, void* wrap_ptr, void* hint) {
-  auto wrap = static_cast<ContextWrap*>(wrap_ptr);
-  auto tf_status = TF_NewStatus();
-  check(tf_status);
-  TFE_DeleteContext(wrap->tf_context, tf_status);
-  check(TF_GetCode(tf_status) == TF_OK);
-  delete wrap;
-  TF_DeleteStatus(tf_status);
-}
+// Adds the inputs to op, executes it and wraps the resulting tensor handles
+// into a JavaScript array. Takes ownership of op, which must have been
+// created on context_wrap. max_retvals is from NumOutputsArg(). attrs must
+// be the attributes already set on op, for tracing. start_ns is when the
+// binding was called, if profiling.
+static napi_value ExecuteOp(napi_env env,
+                            ContextWrap* context_wrap,
+                            TFE_Op* op,
+                            const char* op_name,
+                            const std::vector<OpAttr>& attrs,
+                            napi_value inputs,
+                            int max_retvals,
+                            int64_t start_ns) {
+  TF_Status* tf_status = ContextStatus(context_wrap);
+  std::vector<TFE_TensorHandle*>& input_handles = context_wrap->inputs;
+  input_handles.clear();
+  ProfileEvent* event = NULL;
+  if (profiling) event = NewProfileEvent("execute", op_name, start_ns);
+  if (!AddOpInputs(env,
+                   op,
+                   inputs,
+                   tf_status,
+                   current_trace != NULL ? &input_handles : NULL,
+                   event != NULL ? &event->inputs : NULL)) {
+    TFE_DeleteOp(op);
+    return NULL;
+  }
 
-static napi_value NewContext(napi_env env, napi_callback_info info) {
-  napi_value js_this;
+  // TFE_Execute sets num_retvals to the actual number of outputs, including
+  // the elements of list outputs. Only ops which the caller said have a lot
+  // of outputs need more than the stack buffer.
+  TFE_TensorHandle* retvals_stack[kMaxRetvals];
+  TFE_TensorHandle** retvals = retvals_stack;
+  if (max_retvals > kMaxRetvals) {
+    context_wrap->retvals.resize(max_retvals);
+    retvals = context_wrap->retvals.data();
+  }
+  int num_retvals = max_retvals > 0 ? max_retvals : kMaxRetvals;
+  if (event != NULL) event->tf_start_ns = NowNs();
+  TFE_Execute(op, retvals, &num_retvals, tf_status);
+  if (event != NULL) event->tf_end_ns = NowNs();
+  if (TF_GetCode(tf_status) != TF_OK) {
+    napi_throw_error(env, NULL, TF_Message(tf_status));
+    TFE_DeleteOp(op);
+    if (event != NULL) event->end_ns = NowNs();
+    return NULL;
+  }
+  if (MayHaveDroppedOutputs(max_retvals, num_retvals)) {
+    DeleteRetvals(retvals, num_retvals);
+    napi_throw_range_error(env, "EINVAL", kTooManyOutputsMessage);
+    TFE_DeleteOp(op);
+    if (event != NULL) event->end_ns = NowNs();
+    return NULL;
+  }
 
-  AssertConstructorCall(env, info);
+  TraceOp(op_name, attrs, input_handles, retvals, num_retvals);
+  napi_value js_retvals = WrapRetvals(env, retvals, num_retvals, op_name);
+  TFE_DeleteOp(op);
+  if (event != NULL) {
+    if (num_retvals > 0) {
+      event->device_id =
+          InternDevice(TFE_TensorHandleDeviceName(retvals[0]));
+    }
+    event->end_ns = NowNs();
+  }
+  return js_retvals;
+}
 
-  auto nstatus = napi_get_cb_info(env, info, 0, NULL, &js_this, NULL);
+// args[0] ctx: Context
+// args[1] op_name: string
+// args[2] attrs: AttrDef[]
+// args[3] inputs: Handle[]
+// args[4] num_outputs: number (optional, only needed above kMaxRetvals)
+static napi_value Execute(napi_env env, napi_callback_info info) {
+  int64_t start_ns = profiling ? NowNs() : 0;
+  // Fetch JavaScript `this` object and function arguments.
+  size_t argc = 5;
+  napi_value args[5];
+  napi_value js_this;
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, &js_this, NULL);
+  check(nstatus == napi_ok);
 
-  auto opts = TFE_NewContextOptions();
+  // Get ContextWrap from args[0].
+  ContextWrap* context_wrap;
+  nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&context_wrap));
+  check(nstatus == napi_ok);
 
-  auto tf_status = TF_NewStatus();
-  check(tf_status);
-  auto tf_context = TFE_NewContext(opts, tf_status);
-  TF_DeleteStatus(tf_status);
-  TFE_DeleteContextOptions(opts);
+  // Get op_name (const char*) from args[1].
+  char op_name[512];
+  nstatus = napi_get_value_string_utf8(env, args[1], op_name, 512, NULL);
+  check(nstatus == napi_ok);
 
-  auto context_wrap = new ContextWrap();
-  check(context_wrap);
+  // Get attrs from args[2].
+  auto attrs = args[2];
+  bool is_array;
+  nstatus = napi_is_array(env, attrs, &is_array);
+  check(nstatus == napi_ok);
+  check(is_array);
 
-  context_wrap->tf_context = tf_context;
-  context_wrap->env = env;
+  // Create TFE_Op
+  TF_Status* tf_status = ContextStatus(context_wrap);
+  TFE_Op* op = TFE_NewOp(context_wrap->tf_context, op_name, tf_status);
+  if (TF_GetCode(tf_status) != TF_OK) {
+    napi_throw_error(env, NULL, TF_Message(tf_status));
+    return NULL;
+  }
 
-  nstatus = napi_wrap(env, js_this, context_wrap, DeleteContext, NULL, NULL);
-  check(nstatus == napi_ok);
+  // The attrs are parsed into the context's scratch list, whose elements
+  // keep their buffers from one call to the next.
+  if (!ParseOpAttrs(env, attrs, &context_wrap->attrs)) {
+    TFE_DeleteOp(op);
+    return NULL;
+  }
+  if (!ApplyOpAttrs(
+          context_wrap->tf_context, op, context_wrap->attrs, tf_status)) {
+    napi_throw_error(env, NULL, TF_Message(tf_status));
+    TFE_DeleteOp(op);
+    return NULL;
+  }
 
-  return js_this;
+  // Inputs are in args[3].
+  int max_retvals = NumOutputsArg(env, argc, args, 4);
+  if (max_retvals < 0) {
+    TFE_DeleteOp(op);
+    return NULL;
+  }
+  return ExecuteOp(env,
+                   context_wrap,
+                   op,
+                   op_name,
+                   context_wrap->attrs,
+                   args[3],
+                   max_retvals,
+                   start_ns);
 }
 
-static napi_value NewHandle(napi_env env, napi_callback_info info) {
-  napi_status nstatus;
+// A prepared op: the op name and its attributes, parsed once, so that the
+// op can be executed many times by passing only the input handles.
+struct OpWrap {
+  ContextWrap* context_wrap;
+  JSRef* context_ref;  // Keeps the Context alive as long as the op.
+  std::string name;
+  std::vector<OpAttr> attrs;
+};
 
-  AssertConstructorCall(env, info);
+static void DeleteOpWrap(napi_env env, void* op_wrap_ptr, void* hint) {
+  auto op_wrap = static_cast<OpWrap*>(op_wrap_ptr);
+  UntrackWrap(op_wrap);
+  delete op_wrap->context_ref;
+  delete op_wrap;
+}
 
-  // Fetch JavaScript `this` object and function arguments.
+// args[0] ctx: Context
+// args[1] op_name: string
+// args[2] attrs: AttrDef[]
+static napi_value PrepareOp(napi_env env, napi_callback_info info) {
   size_t argc = 3;
   napi_value args[3];
-  napi_value js_this;
-  nstatus = napi_get_cb_info(env, info, &argc, args, &js_this, NULL);
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
   check(nstatus == napi_ok);
+  check(argc == 3);
 
-  // Construct the native wrap object.
-  HandleWrap* handle_wrap = new HandleWrap();
-  if (handle_wrap == NULL) {
-    napi_throw_error(env, "ENOMEM", "Out of memory");
-    return NULL;
-  }
+  ContextWrap* context_wrap;
+  nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&context_wrap));
+  check(nstatus == napi_ok);
 
-  // Attach native wrapper to the JavaScript object.
-  handle_wrap->env = env;
-  nstatus = napi_wrap(env, js_this, handle_wrap, DeleteHandle, NULL, NULL);
+  char op_name[512];
+  nstatus = napi_get_value_string_utf8(env, args[1], op_name, 512, NULL);
   check(nstatus == napi_ok);
 
-  // Execute calls the Handle constructor without any arguments.
-  if (argc == 0) {
-    handle_wrap->tf_tensor_handle = NULL;
-    handle_wrap->tf_tensor = NULL;
-    return js_this;
+  // Creating the op once up front validates the op name, so that errors are
+  // reported by prepareOp() rather than on first use.
+  TF_Status* tf_status = ContextStatus(context_wrap);
+  TFE_Op* op = TFE_NewOp(context_wrap->tf_context, op_name, tf_status);
+  if (TF_GetCode(tf_status) != TF_OK) {
+    napi_throw_error(env, NULL, TF_Message(tf_status));
+    return NULL;
   }
+  TFE_DeleteOp(op);
 
-  napi_value js_array = args[0];
-  napi_value js_dims = args[1];
-  napi_value js_dtype = args[2];
-
-  // Check whether the first argument is a typed array.
-  bool is_typed_array;
-  nstatus = napi_is_typedarray(env, js_array, &is_typed_array);
-  check(nstatus == napi_ok);
-
-  if (!is_typed_array) {
-    napi_throw_type_error(
-        env, "EINVAL", "First argument should be a TypedArray");
+  auto op_wrap = new OpWrap();
+  if (!ParseOpAttrs(env, args[2], &op_wrap->attrs)) {
+    delete op_wrap;
     return NULL;
   }
+  op_wrap->context_wrap = context_wrap;
+  op_wrap->context_ref = new JSRef(env, args[0]);
+  op_wrap->name = op_name;
 
-  // Get information about the typed array.
-  napi_typedarray_type js_array_type;
-  size_t js_array_length;
-  void* js_array_data;
-  nstatus = napi_get_typedarray_info(env,
-                                     js_array,
-                                     &js_array_type,
-                                     &js_array_length,
-                                     &js_array_data,
-                                     NULL,
-                                     NULL);
+  napi_value op_js;
+  nstatus = napi_create_object(env, &op_js);
   check(nstatus == napi_ok);
-
-  // Get the dtype argument.
-  int32_t tf_dtype_val;
-  nstatus = napi_get_value_int32(env, js_dtype, &tf_dtype_val);
+  nstatus = napi_wrap(env, op_js, op_wrap, DeleteOpWrap, NULL, NULL);
   check(nstatus == napi_ok);
-  TF_DataType tf_type = static_cast<TF_DataType>(tf_dtype_val);
+  TrackWrap(op_wrap);
+  return op_js;
+}
 
-  // Check the provided dtype matches the type of the TypedArray.
-  size_t width;
-  bool good_dtype;
-  switch (js_array_type) {
-    case napi_int8_array:
-      width = sizeof(int8_t);
-      good_dtype = (tf_type == TF_INT8);
+// Executes an op created by prepareOp().
+// args[0] op: Op
+// args[1] inputs: Handle[]
+// args[2] num_outputs: number (optional, only needed above kMaxRetvals)
+static napi_value ExecutePrepared(napi_env env, napi_callback_info info) {
+  int64_t start_ns = profiling ? NowNs() : 0;
+  size_t argc = 3;
+  napi_value args[3];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc >= 2);
+
+  OpWrap* op_wrap;
+  nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&op_wrap));
+  if (nstatus != napi_ok) {
+    napi_throw_error(env, NULL, "Cannot unwrap binding.Op");
+    return NULL;
+  }
+
+  TF_Status* tf_status = ContextStatus(op_wrap->context_wrap);
+  TFE_Context* ctx = op_wrap->context_wrap->tf_context;
+  TFE_Op* op = TFE_NewOp(ctx, op_wrap->name.c_str(), tf_status);
+  check(TF_GetCode(tf_status) == TF_OK);
+  if (!ApplyOpAttrs(ctx, op, op_wrap->attrs, tf_status)) {
+    napi_throw_error(env, NULL, TF_Message(tf_status));
+    TFE_DeleteOp(op);
+    return NULL;
+  }
+
+  int max_retvals = NumOutputsArg(env, argc, args, 2);
+  if (max_retvals < 0) {
+    TFE_DeleteOp(op);
+    return NULL;
+  }
+  return ExecuteOp(env,
+                   op_wrap->context_wrap,
+                   op,
+                   op_wrap->name.c_str(),
+                   op_wrap->attrs,
+                   args[1],
+                   max_retvals,
+                   start_ns);
+}
+
+napi_value GetNamedProperty(napi_env env, napi_value obj, const char* name) {
+  napi_value out;
+  auto nstatus = napi_get_named_property(env, obj, name, &out);
+  check(nstatus == napi_ok);
+  return out;
+}
+
+// Returns the contents of an Int32Array. Throws and returns false if val is
+// not an Int32Array.
+bool GetInt32Array(napi_env env,
+                   napi_value val,
+                   const int32_t** data,
+                   size_t* length) {
+  bool is_typed_array;
+  auto nstatus = napi_is_typedarray(env, val, &is_typed_array);
+  check(nstatus == napi_ok);
+  napi_typedarray_type type;
+  void* raw;
+  if (is_typed_array) {
+    nstatus = napi_get_typedarray_info(
+        env, val, &type, length, &raw, NULL, NULL);
+    check(nstatus == napi_ok);
+  }
+  if (!is_typed_array || type != napi_int32_array) {
+    napi_throw_type_error(env, "EINVAL", "Expected an Int32Array");
+    return false;
+  }
+  *data = static_cast<const int32_t*>(raw);
+  return true;
+}
+
+// Runs a list of prepared ops in a single call. Values are numbered: first
+// come the handles in program.inputs, followed by the outputs of each op in
+// the order they are executed. program.code is an Int32Array containing,
+// for each op:
+//
+//   op_index, num_inputs, input_value_0, ..., input_value_n, num_outputs
+//
+// where op_index refers to program.ops. Only the values listed in
+// program.outputs are wrapped and returned. All other intermediate values
+// are deleted before executeBatch() returns.
+//
+// args[0] ctx: Context
+// args[1] program: { ops: Op[], inputs: Handle[], code: Int32Array,
+//                    outputs: Int32Array }
+static napi_value ExecuteBatch(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 2);
+
+  ContextWrap* context_wrap;
+  nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&context_wrap));
+  check(nstatus == napi_ok);
+
+  napi_value program = args[1];
+  napi_value ops_js = GetNamedProperty(env, program, "ops");
+  napi_value inputs_js = GetNamedProperty(env, program, "inputs");
+  const int32_t* code;
+  size_t code_len;
+  if (!GetInt32Array(env, GetNamedProperty(env, program, "code"), &code,
+                     &code_len)) {
+    return NULL;
+  }
+  const int32_t* outputs;
+  size_t outputs_len;
+  if (!GetInt32Array(env, GetNamedProperty(env, program, "outputs"),
+                     &outputs, &outputs_len)) {
+    return NULL;
+  }
+  check(IsArray(env, ops_js));
+  check(IsArray(env, inputs_js));
+
+  uint32_t num_ops;
+  nstatus = napi_get_array_length(env, ops_js, &num_ops);
+  check(nstatus == napi_ok);
+  std::vector<OpWrap*> ops(num_ops);
+  for (uint32_t i = 0; i < num_ops; ++i) {
+    nstatus = napi_unwrap(env,
+                          GetElement(env, ops_js, i),
+                          reinterpret_cast<void**>(&ops[i]));
+    if (nstatus != napi_ok) {
+      napi_throw_error(env, NULL, "Cannot unwrap binding.Op");
+      return NULL;
+    }
+  }
+
+  // values holds every handle in the batch. Only the handles produced by the
+  // batch itself (those past num_inputs) are owned by it.
+  uint32_t num_inputs;
+  nstatus = napi_get_array_length(env, inputs_js, &num_inputs);
+  check(nstatus == napi_ok);
+  std::vector<TFE_TensorHandle*> values(num_inputs);
+  // The name of the op which produced each value, for memory accounting.
+  std::vector<const char*> value_ops(num_inputs, NULL);
+  for (uint32_t i = 0; i < num_inputs; ++i) {
+    HandleWrap* handle_wrap;
+    nstatus = napi_unwrap(env,
+                          GetElement(env, inputs_js, i),
+                          reinterpret_cast<void**>(&handle_wrap));
+    if (nstatus != napi_ok) {
+      napi_throw_error(env, NULL, "Cannot unwrap executeBatch input");
+      return NULL;
+    }
+    if (handle_wrap->tf_tensor_handle == NULL) {
+      napi_throw_error(env, NULL, "Handle has been disposed");
+      return NULL;
+    }
+    values[i] = handle_wrap->tf_tensor_handle;
+  }
+
+  TF_Status* tf_status = ContextStatus(context_wrap);
+  const char* error = NULL;
+  std::vector<TFE_TensorHandle*>& retvals = context_wrap->retvals;
+  // Only kept while tracing.
+  std::vector<TFE_TensorHandle*>& op_inputs = context_wrap->inputs;
+  size_t pc = 0;
+  while (pc < code_len && error == NULL) {
+    // Decode the next instruction.
+    if (code_len - pc < 2) {
+      error = "Truncated executeBatch program";
       break;
-    case napi_uint8_array:
-    case napi_uint8_clamped_array:
-      width = sizeof(uint8_t);
-      good_dtype = (tf_type == TF_UINT8 || tf_type == TF_BOOL);
+    }
+    int32_t op_index = code[pc++];
+    int32_t op_num_inputs = code[pc++];
+    if (op_index < 0 || static_cast<uint32_t>(op_index) >= num_ops ||
+        op_num_inputs < 0 ||
+        code_len - pc < static_cast<size_t>(op_num_inputs) + 1) {
+      error = "Invalid executeBatch program";
       break;
-    case napi_int16_array:
-      width = sizeof(int16_t);
-      good_dtype = (tf_type == TF_INT16);
+    }
+    OpWrap* op_wrap = ops[op_index];
+    op_inputs.clear();
+
+    TFE_Op* op = TFE_NewOp(
+        context_wrap->tf_context, op_wrap->name.c_str(), tf_status);
+    if (TF_GetCode(tf_status) != TF_OK) {
+      error = TF_Message(tf_status);
       break;
-    case napi_uint16_array:
-      width = sizeof(uint16_t);
-      good_dtype = (tf_type == TF_UINT16);
+    }
+    if (!ApplyOpAttrs(
+            context_wrap->tf_context, op, op_wrap->attrs, tf_status)) {
+      error = TF_Message(tf_status);
+      TFE_DeleteOp(op);
       break;
-    case napi_int32_array:
-      width = sizeof(int32_t);
-      good_dtype = (tf_type == TF_INT32);
+    }
+    for (int32_t i = 0; i < op_num_inputs; ++i) {
+      int32_t value_index = code[pc++];
+      if (value_index < 0 ||
+          static_cast<size_t>(value_index) >= values.size()) {
+        error = "executeBatch input refers to an unknown value";
+        break;
+      }
+      TFE_OpAddInput(op, values[value_index], tf_status);
+      if (TF_GetCode(tf_status) != TF_OK) {
+        error = TF_Message(tf_status);
+        break;
+      }
+      if (current_trace != NULL) op_inputs.push_back(values[value_index]);
+    }
+    if (error != NULL) {
+      TFE_DeleteOp(op);
       break;
-    case napi_uint32_array:
-      width = sizeof(uint32_t);
-      good_dtype = (tf_type == TF_UINT32);
+    }
+
+    int32_t op_num_outputs = code[pc++];
+    if (op_num_outputs < 0 || op_num_outputs > kMaxOutputs) {
+      error = "Invalid executeBatch program";
+      TFE_DeleteOp(op);
       break;
-    case napi_float32_array:
-      width = sizeof(float);
-      good_dtype = (tf_type == TF_FLOAT);
+    }
+    retvals.resize(op_num_outputs);
+    int num_retvals = op_num_outputs;
+    TFE_Execute(op, retvals.data(), &num_retvals, tf_status);
+    TFE_DeleteOp(op);
+    if (TF_GetCode(tf_status) != TF_OK) {
+      error = TF_Message(tf_status);
       break;
-    case napi_float64_array:
-      width = sizeof(double);
-      good_dtype = (tf_type == TF_DOUBLE);
+    }
+    TraceOp(op_wrap->name.c_str(),
+            op_wrap->attrs,
+            op_inputs,
+            retvals.data(),
+            num_retvals);
+    for (int i = 0; i < num_retvals; ++i) {
+      values.push_back(retvals[i]);
+      value_ops.push_back(op_wrap->name.c_str());
+    }
+    if (num_retvals != op_num_outputs) {
+      error = "executeBatch op produced an unexpected number of outputs";
       break;
-    default:
-      good_dtype = false;
+    }
+  }
+
+  // Each requested output must be produced by the batch and appear only
+  // once, because ownership of the handle moves to the returned Handle.
+  std::vector<bool> returned(values.size(), false);
+  for (size_t i = 0; i < outputs_len && error == NULL; ++i) {
+    int32_t value_index = outputs[i];
+    if (value_index < static_cast<int32_t>(num_inputs) ||
+        static_cast<size_t>(value_index) >= values.size() ||
+        returned[value_index]) {
+      error = "Invalid executeBatch output";
       break;
+    }
+    returned[value_index] = true;
   }
 
-  if (!good_dtype) {
-    napi_throw_type_error(env, "EINVAL", "Unsupported TypedArray type.");
-    return 0;
+  napi_value js_retvals = NULL;
+  if (error == NULL) {
+    nstatus = napi_create_array_with_length(env, outputs_len, &js_retvals);
+    check(nstatus == napi_ok);
+    for (size_t i = 0; i < outputs_len; ++i) {
+      TFE_TensorHandle* h = values[outputs[i]];
+      RegisterHandle(env, h, value_ops[outputs[i]]);
+      nstatus = napi_set_element(
+          env, js_retvals, (uint32_t) i, WrapHandle(env, h));
+      check(nstatus == napi_ok);
+    }
+  } else {
+    napi_throw_error(env, NULL, error);
+    returned.assign(values.size(), false);
   }
 
-  // Build the array containing the dimensions.
-  int64_t dims[kMaxDims];
-  uint32_t i, num_dims;
-  bool b;
+  // Delete the intermediate values.
+  for (size_t i = num_inputs; i < values.size(); ++i) {
+    if (returned[i]) continue;
+    TraceForget(values[i]);
+    TFE_DeleteTensorHandle(values[i]);
+  }
+  return js_retvals;
+}
 
-  nstatus = napi_is_array(env, js_dims, &b);
+// A graph built by a trace, and a session to run it.
+struct GraphWrap {
+  TF_Graph* graph;
+  TF_Session* session;
+  std::vector<TF_Output> inputs;
+  std::vector<TF_Output> outputs;
+};
+
+static void DeleteGraphWrap(napi_env env, void* graph_wrap_ptr, void* hint) {
+  auto graph_wrap = static_cast<GraphWrap*>(graph_wrap_ptr);
+  auto tf_status = TF_NewStatus();
+  TF_CloseSession(graph_wrap->session, tf_status);
+  check(TF_GetCode(tf_status) == TF_OK);
+  TF_DeleteSession(graph_wrap->session, tf_status);
+  check(TF_GetCode(tf_status) == TF_OK);
+  TF_DeleteGraph(graph_wrap->graph);
+  TF_DeleteStatus(tf_status);
+  delete graph_wrap;
+}
+
+// Discards the current trace and throws error, if it isn't empty.
+static napi_value EndTraceWithError(napi_env env, const std::string& error) {
+  TF_DeleteGraph(current_trace->graph);
+  delete current_trace;
+  current_trace = NULL;
+  if (!error.empty()) napi_throw_error(env, NULL, error.c_str());
+  return NULL;
+}
+
+// Starts a trace. Until endTrace(), every op executed with execute(),
+// executePrepared() or executeBatch() is also added to a graph, in which
+// the given inputs are placeholders. Handles that are neither inputs nor
+// produced by traced ops become constants, holding their current value.
+// args[0] inputs: Handle[]
+static napi_value BeginTrace(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
   check(nstatus == napi_ok);
-  if (!b) {
-    napi_throw_range_error(
-        env, "EINVAL", "Second argument should be an Array");
+  check(argc == 1);
+
+  if (current_trace != NULL) {
+    napi_throw_error(env, NULL, "A trace is already active");
     return NULL;
   }
+  current_trace = new Trace();
+  current_trace->graph = TF_NewGraph();
+  current_trace->next_id = 0;
 
-  nstatus = napi_get_array_length(env, js_dims, &num_dims);
+  auto tf_status = TF_NewStatus();
+  uint32_t inputs_len = GetArrayLength(env, args[0]);
+  for (uint32_t i = 0; i < inputs_len; ++i) {
+    HandleWrap* handle_wrap;
+    nstatus = napi_unwrap(env,
+                          GetElement(env, args[0], i),
+                          reinterpret_cast<void**>(&handle_wrap));
+    if (nstatus != napi_ok) {
+      TF_DeleteStatus(tf_status);
+      return EndTraceWithError(env, "Cannot unwrap beginTrace input");
+    }
+    TFE_TensorHandle* h = handle_wrap->tf_tensor_handle;
+
+    std::vector<int64_t> dims(TFE_TensorHandleNumDims(h));
+    for (size_t d = 0; d < dims.size(); d++) {
+      dims[d] = TFE_TensorHandleDim(h, static_cast<int>(d));
+    }
+    std::string name = TraceNodeName(current_trace, "Placeholder");
+    auto desc =
+        TF_NewOperation(current_trace->graph, "Placeholder", name.c_str());
+    TF_SetAttrType(desc, "dtype", TFE_TensorHandleDataType(h));
+    TF_SetAttrShape(
+        desc, "shape", dims.data(), static_cast<int>(dims.size()));
+    TF_Operation* oper = TF_FinishOperation(desc, tf_status);
+    check(TF_GetCode(tf_status) == TF_OK);
+    TF_Output input = {oper, 0};
+    current_trace->inputs.push_back(input);
+    current_trace->values[h] = input;
+  }
+  TF_DeleteStatus(tf_status);
+
+  napi_value undefined;
+  nstatus = napi_get_undefined(env, &undefined);
   check(nstatus == napi_ok);
-  if (num_dims > COUNT_OF(dims)) {
-    napi_throw_range_error(env, "ERANGE", "Invalid number of dimensions");
+  return undefined;
+}
+
+// Ends the current trace and returns a Graph computing the given outputs
+// from the inputs passed to beginTrace(). Passing null discards the trace.
+// Throws if an op could not be traced.
+// args[0] outputs: Handle[] | null
+static napi_value EndTrace(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 1);
+
+  if (current_trace == NULL) {
+    napi_throw_error(env, NULL, "endTrace() called without beginTrace()");
     return NULL;
   }
+  napi_valuetype type;
+  nstatus = napi_typeof(env, args[0], &type);
+  check(nstatus == napi_ok);
+  if (type == napi_null) return EndTraceWithError(env, "");
+  if (!current_trace->error.empty()) {
+    return EndTraceWithError(env, current_trace->error);
+  }
 
-  for (i = 0; i < num_dims; i++) {
-    napi_value element;
-    int64_t value;
+  auto graph_wrap = new GraphWrap();
+  graph_wrap->inputs = current_trace->inputs;
+  auto tf_status = TF_NewStatus();
+  uint32_t outputs_len = GetArrayLength(env, args[0]);
+  for (uint32_t i = 0; i < outputs_len; ++i) {
+    HandleWrap* handle_wrap;
+    nstatus = napi_unwrap(env,
+                          GetElement(env, args[0], i),
+                          reinterpret_cast<void**>(&handle_wrap));
+    TF_Output output;
+    std::string error;
+    if (nstatus != napi_ok) {
+      error = "Cannot unwrap endTrace output";
+    } else if (!TraceValue(current_trace,
+                           handle_wrap->tf_tensor_handle,
+                           &output,
+                           tf_status)) {
+      error = TF_Message(tf_status);
+    }
+    if (!error.empty()) {
+      delete graph_wrap;
+      TF_DeleteStatus(tf_status);
+      return EndTraceWithError(env, error);
+    }
+    graph_wrap->outputs.push_back(output);
+  }
 
-    nstatus = napi_get_element(env, js_dims, i, &element);
+  auto opts = TF_NewSessionOptions();
+  graph_wrap->session = TF_NewSession(current_trace->graph, opts, tf_status);
+  TF_DeleteSessionOptions(opts);
+  if (TF_GetCode(tf_status) != TF_OK) {
+    std::string error = TF_Message(tf_status);
+    delete graph_wrap;
+    TF_DeleteStatus(tf_status);
+    return EndTraceWithError(env, error);
+  }
+  TF_DeleteStatus(tf_status);
+  graph_wrap->graph = current_trace->graph;
+  delete current_trace;
+  current_trace = NULL;
+
+  napi_value graph_js;
+  nstatus = napi_create_object(env, &graph_js);
+  check(nstatus == napi_ok);
+  nstatus = napi_wrap(env, graph_js, graph_wrap, DeleteGraphWrap, NULL, NULL);
+  check(nstatus == napi_ok);
+  return graph_js;
+}
+
+// Runs a Graph returned by endTrace() with a single TF_SessionRun.
+// args[0] graph: Graph
+// args[1] inputs: Handle[]
+static napi_value RunGraph(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 2);
+
+  GraphWrap* graph_wrap;
+  nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&graph_wrap));
+  if (nstatus != napi_ok) {
+    napi_throw_error(env, NULL, "Cannot unwrap binding.Graph");
+    return NULL;
+  }
+  uint32_t inputs_len = GetArrayLength(env, args[1]);
+  if (inputs_len != graph_wrap->inputs.size()) {
+    napi_throw_error(env, NULL, "runGraph() got the wrong number of inputs");
+    return NULL;
+  }
+  // The results are not known to the trace.
+  TraceUnsupported("runGraph()");
+
+  auto tf_status = TF_NewStatus();
+  std::vector<TF_Tensor*> input_values;
+  for (uint32_t i = 0; i < inputs_len; ++i) {
+    HandleWrap* handle_wrap;
+    nstatus = napi_unwrap(env,
+                          GetElement(env, args[1], i),
+                          reinterpret_cast<void**>(&handle_wrap));
+    if (nstatus == napi_ok) {
+      TF_Tensor* t =
+          TFE_TensorHandleResolve(handle_wrap->tf_tensor_handle, tf_status);
+      if (TF_GetCode(tf_status) == TF_OK) input_values.push_back(t);
+    } else {
+      TF_SetStatus(tf_status, TF_INVALID_ARGUMENT, "Cannot unwrap input");
+    }
+    if (TF_GetCode(tf_status) != TF_OK) break;
+  }
+
+  size_t num_outputs = graph_wrap->outputs.size();
+  std::vector<TF_Tensor*> output_values(num_outputs, NULL);
+  if (TF_GetCode(tf_status) == TF_OK) {
+    TF_SessionRun(graph_wrap->session,
+                  NULL,
+                  graph_wrap->inputs.data(),
+                  input_values.data(),
+                  static_cast<int>(inputs_len),
+                  graph_wrap->outputs.data(),
+                  output_values.data(),
+                  static_cast<int>(num_outputs),
+                  NULL,
+                  0,
+                  NULL,
+                  tf_status);
+  }
+  for (auto t : input_values) TF_DeleteTensor(t);
+  if (TF_GetCode(tf_status) != TF_OK) {
+    napi_throw_error(env, NULL, TF_Message(tf_status));
+    TF_DeleteStatus(tf_status);
+    return NULL;
+  }
+
+  napi_value js_retvals;
+  nstatus = napi_create_array_with_length(env, num_outputs, &js_retvals);
+  check(nstatus == napi_ok);
+  for (size_t i = 0; i < num_outputs; ++i) {
+    TFE_TensorHandle* h = TFE_NewTensorHandle(output_values[i], tf_status);
+    check(TF_GetCode(tf_status) == TF_OK);
+    RegisterHandle(env, h, "runGraph");
+    nstatus = napi_set_element(env,
+                               js_retvals,
+                               static_cast<uint32_t>(i),
+                               WrapHandle(env, h, output_values[i]));
     check(nstatus == napi_ok);
+  }
+  TF_DeleteStatus(tf_status);
+  return js_retvals;
+}
 
-    nstatus = napi_get_value_int64(env, element, &value);
-    if (nstatus == napi_number_expected) {
-      napi_throw_range_error(
-          env, "ERANGE", "Dimension size should be a number");
-      return NULL;
-    } else if (value < 0) {
-      napi_throw_range_error(env, "ERANGE", "Dimension size out of range");
-      return NULL;
+// Small constants like axes, shapes and scalar operands are requested over
+// and over, so createSmallHandle() returns a shared, pinned handle for
+// each (context, dtype, device, value). Like the op cache in tf.ts, the
+// cache is cleared when it gets too large.
+struct SmallHandleCacheEntry {
+  napi_ref handle_ref;
+  HandleWrap* handle_wrap;
+  ContextWrap* context_wrap;
+};
+
+static const size_t kSmallHandleCacheSize = 1024;
+static std::map<std::string, SmallHandleCacheEntry> small_handle_cache;
+
+// Drops the cached handles of context_wrap, or of all contexts if it's NULL.
+// Unpinned handles are garbage collected like any other.
+static void ClearSmallHandleCache(napi_env env, ContextWrap* context_wrap) {
+  auto it = small_handle_cache.begin();
+  while (it != small_handle_cache.end()) {
+    SmallHandleCacheEntry& entry = it->second;
+    if (context_wrap != NULL && entry.context_wrap != context_wrap) {
+      ++it;
+      continue;
     }
+    entry.handle_wrap->pinned = false;
+    auto nstatus = napi_delete_reference(env, entry.handle_ref);
     check(nstatus == napi_ok);
+    it = small_handle_cache.erase(it);
+  }
+}
 
-    dims[i] = value;
+static void DeleteContext(napi_env env, void* wrap_ptr, void* hint) {
+  auto wrap = static_cast<ContextWrap*>(wrap_ptr);
+  UntrackWrap(wrap);
+  ClearSmallHandleCache(env, wrap);
+  TFE_DeleteContext(wrap->tf_context, ContextStatus(wrap));
+  check(TF_GetCode(wrap->tf_status) == TF_OK);
+  TF_DeleteStatus(wrap->tf_status);
+  delete wrap;
+}
+
+// Looks up an optional property of a JavaScript object. Returns false if it
+// is missing or undefined.
+static bool GetOptionalProperty(napi_env env,
+                                napi_value obj,
+                                const char* name,
+                                napi_value* out) {
+  auto nstatus = napi_get_named_property(env, obj, name, out);
+  check(nstatus == napi_ok);
+  napi_valuetype type;
+  nstatus = napi_typeof(env, *out, &type);
+  check(nstatus == napi_ok);
+  return type != napi_undefined;
+}
+
+// Appends a varint field to a serialized protocol buffer message.
+static void AppendProtoVarint(std::string* proto, int field, uint64_t value) {
+  uint64_t words[2] = {static_cast<uint64_t>(field) << 3, value};
+  for (uint64_t v : words) {
+    while (v >= 0x80) {
+      proto->push_back(static_cast<char>((v & 0x7f) | 0x80));
+      v >>= 7;
+    }
+    proto->push_back(static_cast<char>(v));
   }
+}
 
-  // Create a strong reference to the TypedArray; this reference will be
-  // deleted when tensorflow calls the ReleaseTypedArray callback. Note that
-  // this callback may be called at *any* time, it might be invoked recursively
-  // from TF_NewTensor(), but it may also be called *after* we call
-  // TF_DeleteTensor().
-  auto js_array_ref = new JSRef(env, js_array);
+// Field numbers in tensorflow.ConfigProto.
+static const int kConfigIntraOpParallelismThreads = 2;
+static const int kConfigInterOpParallelismThreads = 5;
+
+// Applies the JavaScript context options to opts. Throws and returns false
+// if they are invalid. Recognized options:
+//   config: Uint8Array, a serialized tensorflow.ConfigProto.
+//   intraOpParallelism: number, threads used within a single op.
+//   interOpParallelism: number, threads used to run independent ops.
+//   async: boolean, enables asynchronous eager execution.
+//   devicePlacementPolicy: number, a TFE_DEVICE_PLACEMENT_* value.
+static bool SetContextOptions(napi_env env,
+                              napi_value opts_js,
+                              TFE_ContextOptions* opts) {
+  napi_value val;
+  napi_status nstatus;
 
-  // Construct the TF_Tensor object.
-  size_t byte_length = js_array_length * width;
-  TF_Tensor* tf_tensor = TF_NewTensor(tf_type,
-                                      dims,
-                                      num_dims,
-                                      js_array_data,
-                                      byte_length,
-                                      ReleaseTypedArray,
-                                      js_array_ref);
-  if (tf_tensor == NULL) {
-    ReleaseTypedArray(js_array_data, byte_length, js_array_ref);
-    napi_throw_error(env, "ENOMEM", "Out of memory");
+  // Thread counts are appended to the serialized config, so that they
+  // override the same fields in it.
+  std::string config;
+  if (GetOptionalProperty(env, opts_js, "config", &val)) {
+    bool is_typed_array;
+    nstatus = napi_is_typedarray(env, val, &is_typed_array);
+    check(nstatus == napi_ok);
+    napi_typedarray_type type;
+    size_t length;
+    void* data;
+    if (is_typed_array) {
+      nstatus = napi_get_typedarray_info(
+          env, val, &type, &length, &data, NULL, NULL);
+      check(nstatus == napi_ok);
+    }
+    if (!is_typed_array || type != napi_uint8_array) {
+      napi_throw_type_error(env, "EINVAL", "config should be a Uint8Array");
+      return false;
+    }
+    config.assign(static_cast<char*>(data), length);
+  }
+  if (GetOptionalProperty(env, opts_js, "intraOpParallelism", &val)) {
+    AppendProtoVarint(
+        &config, kConfigIntraOpParallelismThreads, GetInt32Value(env, val));
+  }
+  if (GetOptionalProperty(env, opts_js, "interOpParallelism", &val)) {
+    AppendProtoVarint(
+        &config, kConfigInterOpParallelismThreads, GetInt32Value(env, val));
+  }
+  if (!config.empty()) {
+    auto tf_status = TF_NewStatus();
+    TFE_ContextOptionsSetConfig(opts, config.data(), config.size(), tf_status);
+    if (TF_GetCode(tf_status) != TF_OK) {
+      napi_throw_error(env, NULL, TF_Message(tf_status));
+      TF_DeleteStatus(tf_status);
+      return false;
+    }
+    TF_DeleteStatus(tf_status);
+  }
+
+  if (GetOptionalProperty(env, opts_js, "async", &val)) {
+    bool async;
+    nstatus = napi_get_value_bool(env, val, &async);
+    check(nstatus == napi_ok);
+    TFE_ContextOptionsSetAsync(opts, async);
+  }
+
+  if (GetOptionalProperty(env, opts_js, "devicePlacementPolicy", &val)) {
+    int32_t policy = GetInt32Value(env, val);
+    if (policy < TFE_DEVICE_PLACEMENT_EXPLICIT ||
+        policy > TFE_DEVICE_PLACEMENT_SILENT_FOR_INT32) {
+      napi_throw_range_error(
+          env, "ERANGE", "Invalid devicePlacementPolicy");
+      return false;
+    }
+    TFE_ContextOptionsSetDevicePlacementPolicy(
+        opts, static_cast<TFE_ContextDevicePlacementPolicy>(policy));
+  }
+
+  return true;
+}
+
+// args[0] opts: object (optional), see SetContextOptions.
+static napi_value NewContext(napi_env env, napi_callback_info info) {
+  napi_value js_this;
+
+  AssertConstructorCall(env, info);
+
+  size_t argc = 1;
+  napi_value args[1];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, &js_this, NULL);
+  check(nstatus == napi_ok);
+
+  auto opts = TFE_NewContextOptions();
+
+  if (argc >= 1) {
+    napi_valuetype type;
+    nstatus = napi_typeof(env, args[0], &type);
+    check(nstatus == napi_ok);
+    if (type == napi_object && !SetContextOptions(env, args[0], opts)) {
+      TFE_DeleteContextOptions(opts);
+      return NULL;
+    }
+  }
+
+  auto tf_status = TF_NewStatus();
+  check(tf_status);
+  auto tf_context = TFE_NewContext(opts, tf_status);
+  TFE_DeleteContextOptions(opts);
+  if (TF_GetCode(tf_status) != TF_OK) {
+    napi_throw_error(env, NULL, TF_Message(tf_status));
+    TF_DeleteStatus(tf_status);
+    return NULL;
+  }
+
+  auto context_wrap = new ContextWrap();
+  check(context_wrap);
+
+  context_wrap->tf_context = tf_context;
+  context_wrap->env = env;
+  // The status is kept for reuse by the calls made on the context.
+  context_wrap->tf_status = tf_status;
+
+  nstatus = napi_wrap(env, js_this, context_wrap, DeleteContext, NULL, NULL);
+  check(nstatus == napi_ok);
+  TrackWrap(context_wrap);
+
+  return js_this;
+}
+
+// Reads a JavaScript array of dimensions into dims, which must have room for
+// kMaxDims entries. Throws and returns false if js_dims isn't valid.
+static bool GetDims(napi_env env,
+                    napi_value js_dims,
+                    int64_t* dims,
+                    uint32_t* num_dims_out) {
+  napi_status nstatus;
+  uint32_t i, num_dims;
+  bool b;
+
+  nstatus = napi_is_array(env, js_dims, &b);
+  check(nstatus == napi_ok);
+  if (!b) {
+    napi_throw_range_error(env, "EINVAL", "Shape should be an Array");
+    return false;
+  }
+
+  nstatus = napi_get_array_length(env, js_dims, &num_dims);
+  check(nstatus == napi_ok);
+  if (num_dims > kMaxDims) {
+    napi_throw_range_error(env, "ERANGE", "Invalid number of dimensions");
+    return false;
+  }
+
+  for (i = 0; i < num_dims; i++) {
+    napi_value element;
+    int64_t value;
+
+    nstatus = napi_get_element(env, js_dims, i, &element);
+    check(nstatus == napi_ok);
+
+    nstatus = napi_get_value_int64(env, element, &value);
+    if (nstatus == napi_number_expected) {
+      napi_throw_range_error(
+          env, "ERANGE", "Dimension size should be a number");
+      return false;
+    } else if (value < 0) {
+      napi_throw_range_error(env, "ERANGE", "Dimension size out of range");
+      return false;
+    }
+    check(nstatus == napi_ok);
+
+    dims[i] = value;
+  }
+
+  *num_dims_out = num_dims;
+  return true;
+}
+
+// TF_NewTensor copies data which isn't aligned to what Eigen asks for, 64
+// bytes at most, and releases the original at once. The copies are counted
+// for memoryStats(), as borrowing memory is usually done to avoid them.
+static void CountUnalignedCopy(TF_Tensor* tf_tensor,
+                               const void* data,
+                               size_t byte_length) {
+  if (byte_length == 0 || TF_TensorData(tf_tensor) == data) return;
+  unaligned_copies++;
+  unaligned_copy_bytes += byte_length;
+}
+
+// Sets *num_bytes to the size of a tensor of the given dims and element
+// width. Returns false if a dim is negative or the size doesn't fit in an
+// int64_t, as for shapes read from untrusted input.
+static bool CheckedByteSize(const int64_t* dims,
+                            size_t num_dims,
+                            size_t width,
+                            int64_t* num_bytes) {
+  const int64_t max = std::numeric_limits<int64_t>::max();
+  int64_t n = static_cast<int64_t>(width);
+  bool overflow = false;
+  for (size_t i = 0; i < num_dims; i++) {
+    if (dims[i] < 0) return false;
+    // An empty tensor is fine whatever its other dims.
+    if (dims[i] == 0) {
+      *num_bytes = 0;
+      return true;
+    }
+    if (n > max / dims[i]) {
+      overflow = true;
+    } else {
+      n *= dims[i];
+    }
+  }
+  if (overflow) return false;
+  *num_bytes = n;
+  return true;
+}
+
+// Creates a TF_Tensor and TFE_TensorHandle that use memory owned by a
+// JavaScript object. js_owner is kept alive until TensorFlow releases the
+// tensor. The memory is used without copying if it is 64 byte aligned, see
+// CountUnalignedCopy(). Throws and returns false on failure.
+static bool NewBorrowedTensor(napi_env env,
+                              const char* op_name,
+                              napi_value js_owner,
+                              TF_DataType tf_type,
+                              const int64_t* dims,
+                              uint32_t num_dims,
+                              void* data,
+                              size_t byte_length,
+                              TF_Tensor** tf_tensor_out,
+                              TFE_TensorHandle** tf_tensor_handle_out) {
+  size_t width = TF_DataTypeSize(tf_type);
+  int64_t num_bytes;
+  if (!CheckedByteSize(dims, num_dims, width, &num_bytes)) {
+    napi_throw_range_error(env, "ERANGE", "Bad shape");
+    return false;
+  }
+  if (byte_length < static_cast<uint64_t>(num_bytes)) {
+    napi_throw_range_error(env, "ERANGE", "Data is too small for shape");
+    return false;
+  }
+  // Kernels may use aligned loads, so at least the element size alignment
+  // is required. TF_NewTensor copies data with less than its alignment.
+  if (reinterpret_cast<uintptr_t>(data) % width != 0) {
+    napi_throw_range_error(
+        env, "ERANGE", "Data is not aligned to its element size");
+    return false;
+  }
+
+  // Create a strong reference to the owner; this reference will be deleted
+  // when tensorflow calls the ReleaseTypedArray callback. Note that this
+  // callback may be called at *any* time, it might be invoked recursively
+  // from TF_NewTensor(), but it may also be called *after* we call
+  // TF_DeleteTensor().
+  auto js_ref = new JSRef(env, js_owner);
+
+  // Construct the TF_Tensor object.
+  TF_Tensor* tf_tensor = TF_NewTensor(tf_type,
+                                      dims,
+                                      num_dims,
+                                      data,
+                                      byte_length,
+                                      ReleaseTypedArray,
+                                      js_ref);
+  if (tf_tensor == NULL) {
+    ReleaseTypedArray(data, byte_length, js_ref);
+    napi_throw_error(env, "ENOMEM", "Out of memory");
+    return false;
+  }
+  CountUnalignedCopy(tf_tensor, data, byte_length);
+
+  // Create the TFE_TensorHandle object.
+  TF_Status* tf_status = MainStatus();
+  TFE_TensorHandle* tf_tensor_handle =
+      TFE_NewTensorHandle(tf_tensor, tf_status);
+  if (TF_GetCode(tf_status) != TF_OK) {
+    napi_throw_error(env, NULL, TF_Message(tf_status));
+    TF_DeleteTensor(tf_tensor);
+    return false;
+  }
+  RegisterHandle(env, tf_tensor_handle, op_name);
+
+  *tf_tensor_out = tf_tensor;
+  *tf_tensor_handle_out = tf_tensor_handle;
+  return true;
+}
+
+static napi_value NewHandle(napi_env env, napi_callback_info info) {
+  napi_status nstatus;
+
+  AssertConstructorCall(env, info);
+  int64_t start_ns = profiling ? NowNs() : 0;
+
+  // Fetch JavaScript `this` object and function arguments.
+  size_t argc = 3;
+  napi_value args[3];
+  napi_value js_this;
+  nstatus = napi_get_cb_info(env, info, &argc, args, &js_this, NULL);
+  check(nstatus == napi_ok);
+
+  if (argc < 3) {
+    napi_throw_type_error(env, "EINVAL", "Handle expects 3 arguments");
+    return NULL;
+  }
+
+  // Construct the native wrap object.
+  HandleWrap* handle_wrap = NewHandleWrap(env);
+
+  // Attach native wrapper to the JavaScript object.
+  nstatus = napi_wrap(env, js_this, handle_wrap, DeleteHandle, NULL, NULL);
+  check(nstatus == napi_ok);
+  AddToScope(handle_wrap, scopes.size());
+
+  napi_value js_array = args[0];
+  napi_value js_dims = args[1];
+  napi_value js_dtype = args[2];
+
+  // Get the dtype argument.
+  int32_t tf_dtype_val;
+  nstatus = napi_get_value_int32(env, js_dtype, &tf_dtype_val);
+  check(nstatus == napi_ok);
+  TF_DataType tf_type = static_cast<TF_DataType>(tf_dtype_val);
+
+  // The first argument should be a typed array or a DataView.
+  bool is_typed_array, is_dataview;
+  nstatus = napi_is_typedarray(env, js_array, &is_typed_array);
+  check(nstatus == napi_ok);
+  nstatus = napi_is_dataview(env, js_array, &is_dataview);
+  check(nstatus == napi_ok);
+
+  void* js_array_data;
+  size_t byte_length;
+  bool good_dtype;
+
+  if (is_dataview) {
+    // A DataView is untyped, so any fixed size dtype will do.
+    nstatus = napi_get_dataview_info(
+        env, js_array, &byte_length, &js_array_data, NULL, NULL);
+    check(nstatus == napi_ok);
+    good_dtype = tf_type != TF_STRING && TF_DataTypeSize(tf_type) > 0;
+  } else if (is_typed_array) {
+    // Get information about the typed array.
+    napi_typedarray_type js_array_type;
+    size_t js_array_length;
+    nstatus = napi_get_typedarray_info(env,
+                                       js_array,
+                                       &js_array_type,
+                                       &js_array_length,
+                                       &js_array_data,
+                                       NULL,
+                                       NULL);
+    check(nstatus == napi_ok);
+
+    // Check the provided dtype matches the type of the TypedArray.
+    size_t width = 0;
+    switch (js_array_type) {
+      case napi_int8_array:
+        width = sizeof(int8_t);
+        good_dtype = (tf_type == TF_INT8);
+        break;
+      case napi_uint8_array:
+      case napi_uint8_clamped_array:
+        width = sizeof(uint8_t);
+        good_dtype = (tf_type == TF_UINT8 || tf_type == TF_BOOL);
+        break;
+      case napi_int16_array:
+        width = sizeof(int16_t);
+        good_dtype = (tf_type == TF_INT16);
+        break;
+      case napi_uint16_array:
+        width = sizeof(uint16_t);
+        good_dtype = (tf_type == TF_UINT16);
+        break;
+      case napi_int32_array:
+        width = sizeof(int32_t);
+        good_dtype = (tf_type == TF_INT32);
+        break;
+      case napi_uint32_array:
+        width = sizeof(uint32_t);
+        good_dtype = (tf_type == TF_UINT32);
+        break;
+      case napi_float32_array:
+        width = sizeof(float);
+        good_dtype = (tf_type == TF_FLOAT);
+        break;
+      case napi_float64_array:
+        width = sizeof(double);
+        good_dtype = (tf_type == TF_DOUBLE);
+        break;
+      default:
+        good_dtype = false;
+        break;
+    }
+    byte_length = js_array_length * width;
+  } else {
+    napi_throw_type_error(
+        env, "EINVAL", "First argument should be a TypedArray");
+    return NULL;
+  }
+
+  if (!good_dtype) {
+    napi_throw_type_error(env, "EINVAL", "Unsupported TypedArray type.");
+    return 0;
+  }
+
+  // Build the array containing the dimensions.
+  int64_t dims[kMaxDims];
+  uint32_t num_dims;
+  if (!GetDims(env, js_dims, dims, &num_dims)) return NULL;
+
+  ProfileEvent* event = NULL;
+  if (profiling) {
+    event = NewProfileEvent("handle", "Handle", start_ns);
+    event->tf_start_ns = NowNs();
+  }
+  if (!NewBorrowedTensor(env,
+                         "Handle",
+                         js_array,
+                         tf_type,
+                         dims,
+                         num_dims,
+                         js_array_data,
+                         byte_length,
+                         &handle_wrap->tf_tensor,
+                         &handle_wrap->tf_tensor_handle)) {
+    return NULL;
+  }
+  CaptureHandleMeta(handle_wrap);
+  if (event != NULL) {
+    event->tf_end_ns = NowNs();
+    event->device_id = handle_wrap->device_id;
+    DescribeInput(handle_wrap, &event->inputs);
+    event->end_ns = NowNs();
+  }
+
+  return js_this;
+}
+
+// Creates a Handle from a region of an ArrayBuffer or ArrayBufferView
+// (TypedArray, Buffer or DataView), without copying if the region is 64 byte
+// aligned. To import a SharedArrayBuffer, pass a Uint8Array view of it. The
+// source is kept alive as long as TensorFlow uses the memory.
+// args[0] source: ArrayBuffer | ArrayBufferView
+// args[1] byte_offset: number, relative to the start of source
+// args[2] byte_length: number
+// args[3] dtype: number
+// args[4] shape: number[]
+static napi_value ImportBuffer(napi_env env, napi_callback_info info) {
+  size_t argc = 5;
+  napi_value args[5];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 5);
+
+  napi_value source = args[0];
+  void* data;
+  size_t source_length;
+  bool is_arraybuffer, is_typed_array, is_dataview;
+  nstatus = napi_is_arraybuffer(env, source, &is_arraybuffer);
+  check(nstatus == napi_ok);
+  nstatus = napi_is_typedarray(env, source, &is_typed_array);
+  check(nstatus == napi_ok);
+  nstatus = napi_is_dataview(env, source, &is_dataview);
+  check(nstatus == napi_ok);
+  if (is_arraybuffer) {
+    nstatus = napi_get_arraybuffer_info(env, source, &data, &source_length);
+    check(nstatus == napi_ok);
+  } else if (is_typed_array) {
+    napi_typedarray_type type;
+    size_t length;
+    nstatus = napi_get_typedarray_info(
+        env, source, &type, &length, &data, NULL, NULL);
+    check(nstatus == napi_ok);
+    source_length = length * TypedArrayElementSize(type);
+  } else if (is_dataview) {
+    nstatus = napi_get_dataview_info(
+        env, source, &source_length, &data, NULL, NULL);
+    check(nstatus == napi_ok);
+  } else {
+    napi_throw_type_error(
+        env, "EINVAL", "Source should be an ArrayBuffer or ArrayBufferView");
+    return NULL;
+  }
+
+  int64_t byte_offset, byte_length;
+  nstatus = napi_get_value_int64(env, args[1], &byte_offset);
+  check(nstatus == napi_ok);
+  nstatus = napi_get_value_int64(env, args[2], &byte_length);
+  check(nstatus == napi_ok);
+  if (byte_offset < 0 || byte_length < 0 ||
+      static_cast<uint64_t>(byte_offset + byte_length) > source_length) {
+    napi_throw_range_error(env, "ERANGE", "Region is out of bounds");
+    return NULL;
+  }
+
+  auto tf_type = static_cast<TF_DataType>(GetInt32Value(env, args[3]));
+  if (tf_type == TF_STRING || TF_DataTypeSize(tf_type) == 0) {
+    napi_throw_type_error(env, "EINVAL", "Unsupported dtype");
+    return NULL;
+  }
+
+  int64_t dims[kMaxDims];
+  uint32_t num_dims;
+  if (!GetDims(env, args[4], dims, &num_dims)) return NULL;
+
+  TF_Tensor* tf_tensor;
+  TFE_TensorHandle* tf_tensor_handle;
+  if (!NewBorrowedTensor(env,
+                         "importBuffer",
+                         source,
+                         tf_type,
+                         dims,
+                         num_dims,
+                         static_cast<char*>(data) + byte_offset,
+                         byte_length,
+                         &tf_tensor,
+                         &tf_tensor_handle)) {
+    return NULL;
+  }
+  return WrapHandle(env, tf_tensor_handle, tf_tensor);
+}
+
+// TF_NewTensor copies data which isn't aligned to what Eigen asks for.
+static const size_t kHostBufferAlignment = 64;
+
+static void* AlignedAlloc(size_t size) {
+#ifdef _WIN32
+  return _aligned_malloc(size, kHostBufferAlignment);
+#else
+  void* data;
+  if (posix_memalign(&data, kHostBufferAlignment, size) != 0) return NULL;
+  return data;
+#endif
+}
+
+static void AlignedFree(void* data) {
+#ifdef _WIN32
+  _aligned_free(data);
+#else
+  free(data);
+#endif
+}
+
+// A whole file in memory, read only. It is mapped, except on Windows where
+// it is read into an aligned buffer.
+struct FileView {
+  char* data;
+  size_t size;
+};
+
+// Returns false and sets errno on failure.
+static bool OpenFileView(const char* path, FileView* view) {
+#ifdef _WIN32
+  FILE* f = fopen(path, "rb");
+  if (f == NULL) return false;
+  bool ok = _fseeki64(f, 0, SEEK_END) == 0;
+  int64_t size = ok ? _ftelli64(f) : -1;
+  ok = size >= 0 && _fseeki64(f, 0, SEEK_SET) == 0;
+  view->size = ok ? size : 0;
+  view->data = ok ? static_cast<char*>(AlignedAlloc(view->size + 1)) : NULL;
+  ok = view->data != NULL &&
+       fread(view->data, 1, view->size, f) == view->size;
+  fclose(f);
+  if (!ok && view->data != NULL) AlignedFree(view->data);
+  return ok;
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  if (st.st_size == 0) {
+    // Can't be mapped, nor is it a npy file.
+    close(fd);
+    errno = EINVAL;
+    return false;
+  }
+  view->size = st.st_size;
+  // Private and writable, so that TensorFlow can't change the file even if
+  // it reuses the buffer of a tensor in place.
+  void* data = mmap(
+      NULL, view->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return false;
+  view->data = static_cast<char*>(data);
+  return true;
+#endif
+}
+
+static void CloseFileView(const FileView& view) {
+#ifdef _WIN32
+  AlignedFree(view.data);
+#else
+  munmap(view.data, view.size);
+#endif
+}
+
+// Deallocator of tensors whose data is in a FileView.
+static void ReleaseFileView(void* data, size_t len, void* arg) {
+  auto view = static_cast<FileView*>(arg);
+  CloseFileView(*view);
+  delete view;
+}
+
+struct NpyHeader {
+  std::string descr;
+  bool fortran_order;
+  std::vector<int64_t> shape;
+  // Offset of the data in the file.
+  size_t data_offset;
+};
+
+// Finds the value of key in the header dict, like {'descr': '<f4', ...}.
+static const char* NpyHeaderValue(const std::string& dict, const char* key) {
+  size_t pos = dict.find(std::string("'") + key + "'");
+  if (pos == std::string::npos) return NULL;
+  pos = dict.find(':', pos);
+  if (pos == std::string::npos) return NULL;
+  pos = dict.find_first_not_of(" ", pos + 1);
+  return pos == std::string::npos ? NULL : dict.c_str() + pos;
+}
+
+// Parses the header of a npy file, see
+// https://docs.scipy.org/doc/numpy/neps/npy-format.html
+static bool ParseNpyHeader(const FileView& view, NpyHeader* header) {
+  static const char kMagic[] = "\x93NUMPY";
+  if (view.size < 10 || memcmp(view.data, kMagic, 6) != 0) return false;
+  auto bytes = reinterpret_cast<const uint8_t*>(view.data);
+  size_t header_len;
+  size_t start;
+  if (bytes[6] == 1) {
+    header_len = bytes[8] | bytes[9] << 8;
+    start = 10;
+  } else if ((bytes[6] == 2 || bytes[6] == 3) && view.size >= 12) {
+    header_len = bytes[8] | bytes[9] << 8 | bytes[10] << 16 |
+                 static_cast<size_t>(bytes[11]) << 24;
+    start = 12;
+  } else {
+    return false;
+  }
+  if (start + header_len > view.size) return false;
+  std::string dict(view.data + start, header_len);
+  header->data_offset = start + header_len;
+
+  const char* descr = NpyHeaderValue(dict, "descr");
+  if (descr == NULL || *descr != '\'') return false;
+  const char* descr_end = strchr(descr + 1, '\'');
+  if (descr_end == NULL) return false;
+  header->descr.assign(descr + 1, descr_end);
+
+  const char* fortran_order = NpyHeaderValue(dict, "fortran_order");
+  if (fortran_order == NULL) return false;
+  header->fortran_order = strncmp(fortran_order, "True", 4) == 0;
+
+  const char* shape = NpyHeaderValue(dict, "shape");
+  if (shape == NULL || *shape != '(') return false;
+  header->shape.clear();
+  const char* p = shape + 1;
+  while (true) {
+    while (*p == ' ' || *p == ',') p++;
+    if (*p == ')') break;
+    char* end;
+    long long dim = strtoll(p, &end, 10);  // NOLINT(runtime/int)
+    if (end == p || dim < 0) return false;
+    header->shape.push_back(dim);
+    p = end;
+  }
+  return true;
+}
+
+// Narrowing conversions for npy dtypes which Propel doesn't have. Simple
+// loops, so that the compiler vectorizes them.
+static void ConvertF64ToF32(const double* src, float* dst, int64_t n) {
+  for (int64_t i = 0; i < n; i++) dst[i] = static_cast<float>(src[i]);
+}
+
+static void ConvertI64ToI32(const int64_t* src, int32_t* dst, int64_t n) {
+  for (int64_t i = 0; i < n; i++) dst[i] = static_cast<int32_t>(src[i]);
+}
+
+// Reverses the dimensions of h, which turns the Fortran order data of a npy
+// file read as C order into the array it stores. Takes ownership of h.
+static TFE_TensorHandle* ReverseDims(ContextWrap* context_wrap,
+                                     TFE_TensorHandle* h,
+                                     int num_dims,
+                                     TF_Status* tf_status) {
+  int64_t perm_dims[] = {num_dims};
+  TF_Tensor* perm = TF_AllocateTensor(TF_INT32, perm_dims, 1, 4 * num_dims);
+  auto perm_data = static_cast<int32_t*>(TF_TensorData(perm));
+  for (int i = 0; i < num_dims; i++) perm_data[i] = num_dims - 1 - i;
+  TFE_TensorHandle* perm_h = TFE_NewTensorHandle(perm, tf_status);
+  TF_DeleteTensor(perm);
+  check(TF_GetCode(tf_status) == TF_OK);
+
+  TFE_TensorHandle* result = NULL;
+  TFE_Op* op = TFE_NewOp(context_wrap->tf_context, "Transpose", tf_status);
+  check(TF_GetCode(tf_status) == TF_OK);
+  TFE_OpSetAttrType(op, "T", TFE_TensorHandleDataType(h));
+  TFE_OpSetAttrType(op, "Tperm", TF_INT32);
+  TFE_OpAddInput(op, h, tf_status);
+  if (TF_GetCode(tf_status) == TF_OK) TFE_OpAddInput(op, perm_h, tf_status);
+  int num_retvals = 1;
+  if (TF_GetCode(tf_status) == TF_OK) {
+    TFE_Execute(op, &result, &num_retvals, tf_status);
+  }
+  TFE_DeleteOp(op);
+  TFE_DeleteTensorHandle(perm_h);
+  TFE_DeleteTensorHandle(h);
+  return TF_GetCode(tf_status) == TF_OK ? result : NULL;
+}
+
+// loadNpy(ctx, path) returns a handle with the array stored in a npy file.
+// float32, int32, uint8 and bool data is used where it is mapped, without
+// copying it, if it is 64 byte aligned in the file. numpy since 1.14 pads
+// the header so that it is; older files are copied by TF_NewTensor. float64
+// and int64 data is converted to float32 and int32.
+static napi_value LoadNpy(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 2);
+  ContextWrap* context_wrap;
+  nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&context_wrap));
+  check(nstatus == napi_ok);
+  std::string path = GetString(env, args[1]);
+
+  FileView view;
+  if (!OpenFileView(path.c_str(), &view)) {
+    std::string message = path + ": " + strerror(errno);
+    napi_throw_error(env, "EIO", message.c_str());
+    return NULL;
+  }
+  NpyHeader header;
+  if (!ParseNpyHeader(view, &header)) {
+    CloseFileView(view);
+    std::string message = path + ": Bad npy header";
+    napi_throw_error(env, "EINVAL", message.c_str());
+    return NULL;
+  }
+
+  TF_DataType dtype;
+  size_t src_width;
+  const std::string& descr = header.descr;
+  if (descr == "<f4") {
+    dtype = TF_FLOAT;
+    src_width = 4;
+  } else if (descr == "<f8") {
+    dtype = TF_FLOAT;
+    src_width = 8;
+  } else if (descr == "<i4") {
+    dtype = TF_INT32;
+    src_width = 4;
+  } else if (descr == "<i8") {
+    dtype = TF_INT32;
+    src_width = 8;
+  } else if (descr == "|u1" || descr == "<u1") {
+    dtype = TF_UINT8;
+    src_width = 1;
+  } else if (descr == "|b1") {
+    dtype = TF_BOOL;
+    src_width = 1;
+  } else {
+    CloseFileView(view);
+    std::string message = path + ": Unsupported npy dtype " + descr;
+    napi_throw_type_error(env, "EINVAL", message.c_str());
+    return NULL;
+  }
+
+  if (header.shape.size() > kMaxDims) {
+    CloseFileView(view);
+    napi_throw_range_error(env, "ERANGE", "Too many dimensions");
+    return NULL;
+  }
+  int num_dims = static_cast<int>(header.shape.size());
+  // Fortran order data is C order data of the reversed shape.
+  std::vector<int64_t> dims(header.shape);
+  if (header.fortran_order) std::reverse(dims.begin(), dims.end());
+  // The shape comes from the file, so its size may overflow.
+  int64_t src_bytes = 0;
+  bool valid_shape =
+      CheckedByteSize(dims.data(), dims.size(), src_width, &src_bytes);
+  int64_t num_elements = valid_shape ? src_bytes / src_width : 0;
+  char* src = view.data + header.data_offset;
+  if (!valid_shape || header.data_offset > view.size ||
+      static_cast<uint64_t>(src_bytes) > view.size - header.data_offset ||
+      reinterpret_cast<uintptr_t>(src) % src_width != 0) {
+    CloseFileView(view);
+    std::string message = path + ": Bad npy data";
+    napi_throw_error(env, "EINVAL", message.c_str());
+    return NULL;
+  }
+
+  TF_Tensor* tensor;
+  size_t dst_width = TF_DataTypeSize(dtype);
+  if (src_width == dst_width) {
+    tensor = TF_NewTensor(dtype,
+                          dims.data(),
+                          num_dims,
+                          src,
+                          num_elements * dst_width,
+                          ReleaseFileView,
+                          new FileView(view));
+    CountUnalignedCopy(tensor, src, num_elements * dst_width);
+  } else {
+    tensor = TF_AllocateTensor(
+        dtype, dims.data(), num_dims, num_elements * dst_width);
+    if (dtype == TF_FLOAT) {
+      ConvertF64ToF32(reinterpret_cast<const double*>(src),
+                      static_cast<float*>(TF_TensorData(tensor)),
+                      num_elements);
+    } else {
+      ConvertI64ToI32(reinterpret_cast<const int64_t*>(src),
+                      static_cast<int32_t*>(TF_TensorData(tensor)),
+                      num_elements);
+    }
+    CloseFileView(view);
+  }
+
+  TF_Status* tf_status = ContextStatus(context_wrap);
+  TFE_TensorHandle* h = TFE_NewTensorHandle(tensor, tf_status);
+  if (TF_GetCode(tf_status) != TF_OK) {
+    TF_DeleteTensor(tensor);
+    napi_throw_error(env, NULL, TF_Message(tf_status));
+    return NULL;
+  }
+  if (header.fortran_order && num_dims > 1) {
+    // The transposed result has its own buffer.
+    TF_DeleteTensor(tensor);
+    tensor = NULL;
+    h = ReverseDims(context_wrap, h, num_dims, tf_status);
+    if (h == NULL) {
+      napi_throw_error(env, NULL, TF_Message(tf_status));
+      return NULL;
+    }
+  }
+  RegisterHandle(env, h, "loadNpy");
+  return WrapHandle(env, h, tensor);
+}
+
+// Packed checkpoints hold many tensors in one file:
+//
+//   header   magic "PROPELCK", uint32 version, uint32 number of tensors,
+//            uint64 index size, padded to kCheckpointAlignment bytes
+//   index    per tensor: uint32 name size, name, int32 dtype,
+//            uint32 number of dims, int64 dims, uint64 offset,
+//            uint64 size, uint32 CRC-32 of the data
+//   data     each tensor at an offset aligned to kCheckpointAlignment
+//
+// Integers are little endian, like the hosts we run on. The alignment lets
+// tensors be used where they are mapped.
+static const char kCheckpointMagic[] = "PROPELCK";
+static const uint32_t kCheckpointVersion = 1;
+static const uint64_t kCheckpointAlignment = 64;
+static const size_t kCheckpointHeaderSize = 64;
+
+static uint64_t AlignCheckpointOffset(uint64_t offset) {
+  return (offset + kCheckpointAlignment - 1) & ~(kCheckpointAlignment - 1);
+}
+
+static uint32_t Crc32(const void* data, size_t size) {
+  static uint32_t table[256];
+  static std::once_flag table_once;
+  std::call_once(table_once, [] {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      table[i] = c;
+    }
+  });
+  auto p = static_cast<const uint8_t*>(data);
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < size; i++) crc = table[(crc ^ p[i]) & 0xFF] ^ crc >> 8;
+  return crc ^ 0xFFFFFFFF;
+}
+
+struct CheckpointEntry {
+  std::string name;
+  TF_DataType dtype;
+  std::vector<int64_t> dims;
+  uint64_t offset;
+  uint64_t size;
+  uint32_t crc;
+};
+
+template <typename T>
+static void AppendValue(std::string* out, T value) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static bool ReadValue(const char** p, const char* end, T* value) {
+  if (static_cast<size_t>(end - *p) < sizeof(T)) return false;
+  memcpy(value, *p, sizeof(T));
+  *p += sizeof(T);
+  return true;
+}
+
+static std::string SerializeCheckpointIndex(
+    const std::vector<CheckpointEntry>& entries) {
+  std::string index;
+  for (const CheckpointEntry& e : entries) {
+    AppendValue<uint32_t>(&index, e.name.size());
+    index.append(e.name);
+    AppendValue<int32_t>(&index, e.dtype);
+    AppendValue<uint32_t>(&index, e.dims.size());
+    for (int64_t d : e.dims) AppendValue<int64_t>(&index, d);
+    AppendValue<uint64_t>(&index, e.offset);
+    AppendValue<uint64_t>(&index, e.size);
+    AppendValue<uint32_t>(&index, e.crc);
+  }
+  return index;
+}
+
+static bool ParseCheckpoint(const FileView& view,
+                            std::vector<CheckpointEntry>* entries) {
+  const char* p = view.data;
+  const char* end = view.data + view.size;
+  if (view.size < kCheckpointHeaderSize ||
+      memcmp(p, kCheckpointMagic, 8) != 0) {
+    return false;
+  }
+  p += 8;
+  uint32_t version, count;
+  uint64_t index_size;
+  if (!ReadValue(&p, end, &version) || version != kCheckpointVersion ||
+      !ReadValue(&p, end, &count) || !ReadValue(&p, end, &index_size) ||
+      index_size > view.size - kCheckpointHeaderSize) {
+    return false;
+  }
+  p = view.data + kCheckpointHeaderSize;
+  end = p + index_size;
+  entries->resize(count);
+  for (CheckpointEntry& e : *entries) {
+    uint32_t name_size, num_dims;
+    int32_t dtype;
+    if (!ReadValue(&p, end, &name_size) ||
+        static_cast<size_t>(end - p) < name_size) {
+      return false;
+    }
+    e.name.assign(p, name_size);
+    p += name_size;
+    if (!ReadValue(&p, end, &dtype) || !ReadValue(&p, end, &num_dims) ||
+        num_dims > kMaxDims) {
+      return false;
+    }
+    e.dtype = static_cast<TF_DataType>(dtype);
+    e.dims.resize(num_dims);
+    for (int64_t& d : e.dims) {
+      if (!ReadValue(&p, end, &d)) return false;
+    }
+    if (!ReadValue(&p, end, &e.offset) || !ReadValue(&p, end, &e.size) ||
+        !ReadValue(&p, end, &e.crc) || e.offset > view.size ||
+        e.size > view.size - e.offset ||
+        e.offset % kCheckpointAlignment != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Writes size bytes at offset of the file. Safe to call from several
+// threads at once. Returns false and sets errno on failure.
+static bool WriteAt(int fd, const char* data, uint64_t size, uint64_t offset) {
+#ifdef _WIN32
+  static std::mutex write_mutex;
+  std::lock_guard<std::mutex> lock(write_mutex);
+  if (_lseeki64(fd, offset, SEEK_SET) < 0) return false;
+#endif
+  while (size > 0) {
+    // Large writes are split, some systems fail writes over 2 GB.
+    unsigned int chunk = static_cast<unsigned int>(
+        std::min<uint64_t>(size, 1 << 30));
+#ifdef _WIN32
+    int n = _write(fd, data, chunk);
+#else
+    ssize_t n = pwrite(fd, data, chunk, offset);
+#endif
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    size -= n;
+    offset += n;
+  }
+  return true;
+}
+
+// Writes a packed checkpoint of the resolved tensors to path. The tensor
+// data is written straight from the tensors, by up to kCheckpointThreads
+// threads in parallel, each of which also computes the checksums of the
+// tensors it writes. The file is written under a temporary name and then
+// renamed, so path is never left half written. The temporary name is unique,
+// so concurrent saves to the same path each leave a complete file. Doesn't
+// call into N-API, so it can run on a worker thread. Returns the size of the
+// file, or -1 and sets error on failure.
+static const unsigned kCheckpointThreads = 8;
+static std::atomic<unsigned> checkpoint_tmp_counter(0);
+
+static int64_t WriteCheckpoint(const std::string& path,
+                               const std::vector<std::string>& names,
+                               const std::vector<TF_Tensor*>& tensors,
+                               std::string* error) {
+  std::vector<CheckpointEntry> entries(tensors.size());
+  for (size_t i = 0; i < tensors.size(); i++) {
+    CheckpointEntry& e = entries[i];
+    e.name = names[i];
+    e.dtype = TF_TensorType(tensors[i]);
+    e.dims.resize(TF_NumDims(tensors[i]));
+    for (size_t d = 0; d < e.dims.size(); d++) {
+      e.dims[d] = TF_Dim(tensors[i], d);
+    }
+    e.size = TF_TensorByteSize(tensors[i]);
+    e.crc = 0;
+  }
+  // Offsets don't depend on the checksums, so the index has its final size
+  // before the data is written.
+  uint64_t index_size = SerializeCheckpointIndex(entries).size();
+  uint64_t offset = AlignCheckpointOffset(kCheckpointHeaderSize + index_size);
+  for (CheckpointEntry& e : entries) {
+    e.offset = offset;
+    offset = AlignCheckpointOffset(offset + e.size);
+  }
+  uint64_t file_size = offset;
+
+  std::string tmp_path =
+      path + ".tmp" + std::to_string(checkpoint_tmp_counter++);
+#ifdef _WIN32
+  int fd = _open(tmp_path.c_str(),
+                 _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY,
+                 _S_IREAD | _S_IWRITE);
+#else
+  int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+  // Sizing the file up front also covers the padding after the last tensor.
+#ifdef _WIN32
+  bool sized = fd >= 0 && _chsize_s(fd, file_size) == 0;
+#else
+  bool sized = fd >= 0 && ftruncate(fd, file_size) == 0;
+#endif
+  if (!sized) {
+    *error = tmp_path + ": " + strerror(errno);
+    if (fd >= 0) {
+#ifdef _WIN32
+      _close(fd);
+#else
+      close(fd);
+#endif
+      remove(tmp_path.c_str());
+    }
+    return -1;
+  }
+
+  std::atomic<size_t> next(0);
+  std::atomic<int> write_errno(0);
+  auto work = [&] {
+    for (size_t i = next++; i < entries.size(); i = next++) {
+      auto data = static_cast<const char*>(TF_TensorData(tensors[i]));
+      entries[i].crc = Crc32(data, entries[i].size);
+      if (!WriteAt(fd, data, entries[i].size, entries[i].offset)) {
+        write_errno = errno;
+        return;
+      }
+    }
+  };
+#ifdef _WIN32
+  // Writes are serialized anyway.
+  unsigned num_threads = 1;
+#else
+  unsigned num_threads = std::min<unsigned>(
+      std::max(1u, std::thread::hardware_concurrency()), kCheckpointThreads);
+#endif
+  num_threads = std::min<unsigned>(num_threads, entries.size());
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < num_threads; i++) threads.emplace_back(work);
+  work();
+  for (std::thread& t : threads) t.join();
+
+  std::string header(kCheckpointMagic, 8);
+  AppendValue<uint32_t>(&header, kCheckpointVersion);
+  AppendValue<uint32_t>(&header, entries.size());
+  AppendValue<uint64_t>(&header, index_size);
+  header.resize(kCheckpointHeaderSize, '\0');
+  header.append(SerializeCheckpointIndex(entries));
+  bool ok = write_errno == 0 &&
+            WriteAt(fd, header.data(), header.size(), 0);
+  if (!ok && write_errno == 0) write_errno = errno;
+#ifdef _WIN32
+  ok = _close(fd) == 0 && ok;
+#else
+  ok = close(fd) == 0 && ok;
+#endif
+  if (ok) {
+#ifdef _WIN32
+    remove(path.c_str());
+#endif
+    ok = rename(tmp_path.c_str(), path.c_str()) == 0;
+  }
+  if (!ok) {
+    int err = write_errno;
+    *error = path + ": " + strerror(err != 0 ? err : errno);
+    remove(tmp_path.c_str());
+    return -1;
+  }
+  return file_size;
+}
+
+// Resolves the handles in the array handles_js to tensors in host memory.
+// Throws and returns false on failure, after deleting the tensors resolved
+// so far.
+static bool ResolveHandles(napi_env env,
+                           napi_value handles_js,
+                           std::vector<TF_Tensor*>* tensors) {
+  uint32_t count = GetArrayLength(env, handles_js);
+  for (uint32_t i = 0; i < count; i++) {
+    HandleWrap* handle_wrap;
+    auto nstatus = napi_unwrap(env,
+                               GetElement(env, handles_js, i),
+                               reinterpret_cast<void**>(&handle_wrap));
+    TF_Status* tf_status = MainStatus();
+    TF_Tensor* tensor = NULL;
+    if (nstatus != napi_ok) {
+      napi_throw_error(env, NULL, "Cannot unwrap binding.Handle");
+    } else if (handle_wrap->dtype == TF_STRING ||
+               handle_wrap->dtype == TF_RESOURCE) {
+      napi_throw_type_error(env, "EINVAL", "Unsupported dtype");
+    } else {
+      tensor =
+          TFE_TensorHandleResolve(handle_wrap->tf_tensor_handle, tf_status);
+      if (TF_GetCode(tf_status) != TF_OK) {
+        napi_throw_error(env, NULL, TF_Message(tf_status));
+      }
+    }
+    if (tensor == NULL) {
+      for (TF_Tensor* t : *tensors) TF_DeleteTensor(t);
+      tensors->clear();
+      return false;
+    }
+    tensors->push_back(tensor);
+  }
+  return true;
+}
+
+// Parses the (path, names, handles) arguments of saveCheckpoint() and
+// saveCheckpointAsync(), resolving the handles. Throws and returns false on
+// failure.
+static bool SaveCheckpointArgs(napi_env env,
+                               napi_callback_info info,
+                               std::string* path,
+                               std::vector<std::string>* names,
+                               std::vector<TF_Tensor*>* tensors) {
+  size_t argc = 3;
+  napi_value args[3];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 3);
+  *path = GetString(env, args[0]);
+  uint32_t count = GetArrayLength(env, args[1]);
+  if (GetArrayLength(env, args[2]) != count) {
+    napi_throw_range_error(env, "EINVAL", "Expected a handle per name");
+    return false;
+  }
+  names->resize(count);
+  for (uint32_t i = 0; i < count; i++) {
+    (*names)[i] = GetString(env, GetElement(env, args[1], i));
+  }
+  return ResolveHandles(env, args[2], tensors);
+}
+
+// saveCheckpoint(path, names, handles) writes a packed checkpoint and
+// returns its size in bytes.
+static napi_value SaveCheckpoint(napi_env env, napi_callback_info info) {
+  std::string path;
+  std::vector<std::string> names;
+  std::vector<TF_Tensor*> tensors;
+  if (!SaveCheckpointArgs(env, info, &path, &names, &tensors)) return NULL;
+
+  std::string error;
+  int64_t size = WriteCheckpoint(path, names, tensors, &error);
+  for (TF_Tensor* t : tensors) TF_DeleteTensor(t);
+  if (size < 0) {
+    napi_throw_error(env, "EIO", error.c_str());
+    return NULL;
+  }
+  napi_value size_js;
+  auto nstatus = napi_create_int64(env, size, &size_js);
+  check(nstatus == napi_ok);
+  return size_js;
+}
+
+// A mapped packed checkpoint. Shared by the JavaScript object returned by
+// openCheckpoint() and the tensors read from it; unmapped when the last
+// of them is released.
+struct CheckpointFile {
+  FileView view;
+  std::vector<CheckpointEntry> entries;
+  std::atomic<int> refs;
+};
+
+static void UnrefCheckpointFile(CheckpointFile* file) {
+  if (--file->refs == 0) {
+    CloseFileView(file->view);
+    delete file;
+  }
+}
+
+static void DeleteCheckpointFile(napi_env env, void* data, void* hint) {
+  UnrefCheckpointFile(static_cast<CheckpointFile*>(data));
+}
+
+static void ReleaseCheckpointTensor(void* data, size_t len, void* arg) {
+  UnrefCheckpointFile(static_cast<CheckpointFile*>(arg));
+}
+
+// openCheckpoint(path) maps a packed checkpoint and returns an object with
+// its index as entries: [{name, dtype, shape, byteLength}]. Pass the object
+// to checkpointTensor() to read a tensor.
+static napi_value OpenCheckpoint(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 1);
+  std::string path = GetString(env, args[0]);
+
+  auto file = new CheckpointFile();
+  file->refs = 1;
+  if (!OpenFileView(path.c_str(), &file->view)) {
+    delete file;
+    std::string message = path + ": " + strerror(errno);
+    napi_throw_error(env, "EIO", message.c_str());
+    return NULL;
+  }
+  if (!ParseCheckpoint(file->view, &file->entries)) {
+    UnrefCheckpointFile(file);
+    std::string message = path + ": Bad checkpoint";
+    napi_throw_error(env, "EINVAL", message.c_str());
+    return NULL;
+  }
+
+  napi_value out, entries;
+  nstatus = napi_create_object(env, &out);
+  check(nstatus == napi_ok);
+  nstatus = napi_wrap(env, out, file, DeleteCheckpointFile, NULL, NULL);
+  check(nstatus == napi_ok);
+  nstatus = napi_create_array_with_length(env, file->entries.size(), &entries);
+  check(nstatus == napi_ok);
+  for (size_t i = 0; i < file->entries.size(); i++) {
+    const CheckpointEntry& e = file->entries[i];
+    napi_value entry, name, dtype, shape;
+    nstatus = napi_create_object(env, &entry);
+    check(nstatus == napi_ok);
+    nstatus = napi_create_string_utf8(
+        env, e.name.data(), e.name.size(), &name);
+    check(nstatus == napi_ok);
+    nstatus = napi_set_named_property(env, entry, "name", name);
+    check(nstatus == napi_ok);
+    nstatus = napi_create_int32(env, e.dtype, &dtype);
+    check(nstatus == napi_ok);
+    nstatus = napi_set_named_property(env, entry, "dtype", dtype);
+    check(nstatus == napi_ok);
+    nstatus = napi_create_array_with_length(env, e.dims.size(), &shape);
+    check(nstatus == napi_ok);
+    for (size_t d = 0; d < e.dims.size(); d++) {
+      napi_value dim;
+      nstatus = napi_create_int64(env, e.dims[d], &dim);
+      check(nstatus == napi_ok);
+      nstatus = napi_set_element(env, shape, d, dim);
+      check(nstatus == napi_ok);
+    }
+    nstatus = napi_set_named_property(env, entry, "shape", shape);
+    check(nstatus == napi_ok);
+    napi_value byte_length;
+    nstatus = napi_create_double(env, e.size, &byte_length);
+    check(nstatus == napi_ok);
+    nstatus = napi_set_named_property(env, entry, "byteLength", byte_length);
+    check(nstatus == napi_ok);
+    nstatus = napi_set_element(env, entries, i, entry);
+    check(nstatus == napi_ok);
+  }
+  nstatus = napi_set_named_property(env, out, "entries", entries);
+  check(nstatus == napi_ok);
+  return out;
+}
+
+// checkpointTensor(checkpoint, index, verify) returns a handle of the
+// index-th tensor of a checkpoint from openCheckpoint(). The handle uses the
+// mapped data. If verify is true the checksum is checked first, which reads
+// all of the data.
+static napi_value CheckpointTensor(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value args[3];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 3);
+  CheckpointFile* file;
+  nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&file));
+  if (nstatus != napi_ok) {
+    napi_throw_type_error(env, "EINVAL", "Expected a checkpoint");
+    return NULL;
+  }
+  int32_t index = GetInt32Value(env, args[1]);
+  if (index < 0 || static_cast<size_t>(index) >= file->entries.size()) {
+    napi_throw_range_error(env, "ERANGE", "No such checkpoint entry");
+    return NULL;
+  }
+  bool verify;
+  nstatus = napi_get_value_bool(env, args[2], &verify);
+  check(nstatus == napi_ok);
+
+  const CheckpointEntry& e = file->entries[index];
+  char* data = file->view.data + e.offset;
+  if (verify && Crc32(data, e.size) != e.crc) {
+    std::string message = "Checksum mismatch in checkpoint: " + e.name;
+    napi_throw_error(env, "EINVAL", message.c_str());
+    return NULL;
+  }
+  // The dims come from the file, so their product may overflow.
+  size_t width = TF_DataTypeSize(e.dtype);
+  int64_t num_bytes;
+  if (width == 0 ||
+      !CheckedByteSize(e.dims.data(), e.dims.size(), width, &num_bytes) ||
+      static_cast<uint64_t>(num_bytes) != e.size) {
+    napi_throw_error(env, "EINVAL", "Bad checkpoint entry");
+    return NULL;
+  }
+
+  file->refs++;
+  TF_Tensor* tensor = TF_NewTensor(e.dtype,
+                                   e.dims.data(),
+                                   static_cast<int>(e.dims.size()),
+                                   data,
+                                   e.size,
+                                   ReleaseCheckpointTensor,
+                                   file);
+  TF_Status* tf_status = MainStatus();
+  TFE_TensorHandle* h = TFE_NewTensorHandle(tensor, tf_status);
+  if (TF_GetCode(tf_status) != TF_OK) {
+    TF_DeleteTensor(tensor);
+    napi_throw_error(env, NULL, TF_Message(tf_status));
+    return NULL;
+  }
+  RegisterHandle(env, h, "checkpointTensor");
+  return WrapHandle(env, h, tensor);
+}
+
+static void DeleteTensorArrayBuffer(napi_env env,
+                                    void* handle_wrap_ptr,
+                                    void* hint) {
+  auto tensor = reinterpret_cast<TF_Tensor*>(hint);
+  TF_DeleteTensor(tensor);
+}
+
+static napi_status NewTensorArrayBuffer(napi_env env,
+                                        TF_Tensor* tensor,
+                                        napi_value* array_buffer_out) {
+  void* external_data = TF_TensorData(tensor);
+  size_t byte_length = TF_TensorByteSize(tensor);
+  return napi_create_external_arraybuffer(env,
+                                          external_data,
+                                          byte_length,
+                                          DeleteTensorArrayBuffer,
+                                          tensor,
+                                          array_buffer_out);
+}
+
+// Returns a HandleWrap from the first and only argument of a bound function.
+// The program crashes if there isn't exactly one argument.
+HandleWrap* HandleFromFirstArg(napi_env env, napi_callback_info info) {
+  napi_status nstatus;
+  size_t argc = 1;
+  napi_value args[1];
+  nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 1);
+  HandleWrap* handle_wrap;
+  nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&handle_wrap));
+  if (nstatus != napi_ok) {
+    napi_throw_error(env, NULL, "Cannot unwrap binding.Handle");
+    return NULL;
+  }
+  return handle_wrap;
+}
+
+static napi_value HandleAsArrayBuffer(napi_env env, napi_callback_info info) {
+  napi_status nstatus;
+  ProfileEvent* event = NULL;
+  if (profiling) event = NewProfileEvent("read", "asArrayBuffer", NowNs());
+
+  auto handle_wrap = HandleFromFirstArg(env, info);
+  if (handle_wrap == NULL) return NULL;
+  // The memory of a resource handle isn't tensor data.
+  if (handle_wrap->dtype == TF_RESOURCE) {
+    napi_throw_type_error(env, "EINVAL", "Cannot read a resource handle");
+    return NULL;
+  }
+  if (event != NULL) {
+    DescribeInput(handle_wrap, &event->inputs);
+    event->device_id = handle_wrap->device_id;
+    event->tf_start_ns = NowNs();
+  }
+
+  // Resolve TFE_TensorHandle into TF_Tensor
+  TF_Status* tf_status = MainStatus();
+  auto tensor =
+      TFE_TensorHandleResolve(handle_wrap->tf_tensor_handle, tf_status);
+  if (event != NULL) event->tf_end_ns = NowNs();
+  if (TF_GetCode(tf_status) != TF_OK) {
+    napi_throw_error(env, NULL, TF_Message(tf_status));
+    return NULL;
+  }
+
+  check(handle_wrap->tf_tensor != tensor);
+
+  napi_value array_buffer;
+  nstatus = NewTensorArrayBuffer(env, tensor, &array_buffer);
+  check(nstatus == napi_ok);
+
+  if (event != NULL) event->end_ns = NowNs();
+  return array_buffer;
+}
+
+// Whether a TypedArray of the given type can hold tensor data of dtype.
+static bool TypedArrayHoldsDType(napi_typedarray_type type,
+                                 TF_DataType dtype) {
+  switch (type) {
+    case napi_int8_array:
+      return dtype == TF_INT8;
+    case napi_uint8_array:
+    case napi_uint8_clamped_array:
+      return dtype == TF_UINT8 || dtype == TF_BOOL;
+    case napi_int16_array:
+      return dtype == TF_INT16;
+    case napi_uint16_array:
+      return dtype == TF_UINT16;
+    case napi_int32_array:
+      return dtype == TF_INT32;
+    case napi_uint32_array:
+      return dtype == TF_UINT32;
+    case napi_float32_array:
+      return dtype == TF_FLOAT;
+    case napi_float64_array:
+      return dtype == TF_DOUBLE;
+    default:
+      return false;
+  }
+}
+
+// Returns the optional element count argument at index, or def if it
+// wasn't given. Throws and returns -1 if it isn't a count.
+static int64_t CountArg(napi_env env,
+                        size_t argc,
+                        napi_value* args,
+                        size_t index,
+                        int64_t def) {
+  if (argc <= index) return def;
+  napi_valuetype type;
+  auto nstatus = napi_typeof(env, args[index], &type);
+  check(nstatus == napi_ok);
+  if (type == napi_undefined) return def;
+  int64_t count = -1;
+  if (type == napi_number) {
+    nstatus = napi_get_value_int64(env, args[index], &count);
+    check(nstatus == napi_ok);
+  }
+  if (count < 0) {
+    napi_throw_range_error(env, "EINVAL", "Expected a non-negative count");
+    return -1;
+  }
+  return count;
+}
+
+// readInto(h, target, offset, length) copies length elements of the tensor,
+// starting at element offset, to the start of target, which is a TypedArray
+// of the tensor's dtype. Unlike asArrayBuffer(), it doesn't allocate an
+// ArrayBuffer. offset defaults to 0 and length to the rest of the tensor.
+// Returns length.
+static napi_value ReadInto(napi_env env, napi_callback_info info) {
+  napi_status nstatus;
+  ProfileEvent* event = NULL;
+  if (profiling) event = NewProfileEvent("read", "readInto", NowNs());
+
+  size_t argc = 4;
+  napi_value args[4];
+  nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  if (argc < 2) {
+    napi_throw_error(env, "EINVAL", "Expected at least two arguments");
+    return NULL;
+  }
+  HandleWrap* handle_wrap;
+  nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&handle_wrap));
+  if (nstatus != napi_ok) {
+    napi_throw_error(env, NULL, "Cannot unwrap binding.Handle");
+    return NULL;
+  }
+  TF_DataType dtype = handle_wrap->dtype;
+  size_t width = TF_DataTypeSize(dtype);
+  if (dtype == TF_STRING || dtype == TF_RESOURCE || width == 0) {
+    napi_throw_type_error(env, "EINVAL", "Cannot read handle into a buffer");
+    return NULL;
+  }
+
+  bool is_typed_array;
+  nstatus = napi_is_typedarray(env, args[1], &is_typed_array);
+  check(nstatus == napi_ok);
+  if (!is_typed_array) {
+    napi_throw_type_error(
+        env, "EINVAL", "Second argument should be a TypedArray");
+    return NULL;
+  }
+  napi_typedarray_type type;
+  size_t target_length;
+  void* target;
+  nstatus = napi_get_typedarray_info(
+      env, args[1], &type, &target_length, &target, NULL, NULL);
+  check(nstatus == napi_ok);
+  if (!TypedArrayHoldsDType(type, dtype)) {
+    napi_throw_type_error(env, "EINVAL", "TypedArray doesn't match dtype");
+    return NULL;
+  }
+
+  if (event != NULL) {
+    DescribeInput(handle_wrap, &event->inputs);
+    event->device_id = handle_wrap->device_id;
+    event->tf_start_ns = NowNs();
+  }
+  // On the CPU this doesn't copy, the TF_Tensor shares the handle's buffer.
+  TF_Status* tf_status = MainStatus();
+  auto tensor =
+      TFE_TensorHandleResolve(handle_wrap->tf_tensor_handle, tf_status);
+  if (event != NULL) event->tf_end_ns = NowNs();
+  if (TF_GetCode(tf_status) != TF_OK) {
+    napi_throw_error(env, NULL, TF_Message(tf_status));
+    return NULL;
+  }
+  int64_t num_elements = TF_TensorByteSize(tensor) / width;
+
+  int64_t offset = CountArg(env, argc, args, 2, 0);
+  int64_t length = offset < 0 ? -1 : CountArg(
+      env, argc, args, 3, std::max<int64_t>(0, num_elements - offset));
+  if (length >= 0) {
+    if (offset + length > num_elements) {
+      napi_throw_range_error(env, "EINVAL", "Range is outside the tensor");
+      length = -1;
+    } else if (static_cast<size_t>(length) > target_length) {
+      napi_throw_range_error(env, "EINVAL", "TypedArray is too small");
+      length = -1;
+    }
+  }
+  if (length > 0) {
+    auto data = static_cast<const char*>(TF_TensorData(tensor));
+    memcpy(target, data + offset * width, length * width);
+  }
+  TF_DeleteTensor(tensor);
+  if (length < 0) return NULL;
+
+  napi_value length_js;
+  nstatus = napi_create_int64(env, length, &length_js);
+  check(nstatus == napi_ok);
+  if (event != NULL) event->end_ns = NowNs();
+  return length_js;
+}
+
+static napi_value HandleGetDevice(napi_env env, napi_callback_info info) {
+  napi_status nstatus;
+
+  auto handle_wrap = HandleFromFirstArg(env, info);
+  if (handle_wrap == NULL) return NULL;
+
+  // Build JavaScript string containing the device name.
+  const std::string& device = device_names[handle_wrap->device_id];
+  napi_value js_device;
+  nstatus = napi_create_string_utf8(
+      env, device.c_str(), device.size(), &js_device);
+  check(nstatus == napi_ok);
+
+  return js_device;
+}
+
+static napi_value HandleGetDType(napi_env env, napi_callback_info info) {
+  napi_status nstatus;
+
+  auto handle_wrap = HandleFromFirstArg(env, info);
+  if (handle_wrap == NULL) return NULL;
+
+  napi_value js_dtype;
+  nstatus = napi_create_int32(env, handle_wrap->dtype, &js_dtype);
+  check(nstatus == napi_ok);
+
+  return js_dtype;
+}
+
+// Data of small tensors is carved out of slabs and recycled through a
+// freelist rather than allocated one by one. Buffers are aligned so that
+// TF_NewTensor doesn't copy them. TensorFlow may release a tensor on any
+// thread, hence the mutex.
+static const size_t kSmallBufferSize = 64;
+static const size_t kSmallBuffersPerSlab = 256;
+static std::mutex small_buffer_mutex;
+static std::vector<void*> small_buffer_freelist;
+
+static void* AllocSmallBuffer() {
+  std::lock_guard<std::mutex> lock(small_buffer_mutex);
+  if (small_buffer_freelist.empty()) {
+    // Slabs are never freed, the freelist owns their buffers.
+    auto slab = new char[(kSmallBuffersPerSlab + 1) * kSmallBufferSize];
+    auto offset = reinterpret_cast<uintptr_t>(slab) % kSmallBufferSize;
+    char* start = slab + (offset == 0 ? 0 : kSmallBufferSize - offset);
+    for (size_t i = 0; i < kSmallBuffersPerSlab; i++) {
+      small_buffer_freelist.push_back(start + i * kSmallBufferSize);
+    }
+  }
+  void* buffer = small_buffer_freelist.back();
+  small_buffer_freelist.pop_back();
+  return buffer;
+}
+
+static void ReleaseSmallBuffer(void* data, size_t len, void* arg) {
+  std::lock_guard<std::mutex> lock(small_buffer_mutex);
+  small_buffer_freelist.push_back(data);
+}
+
+// Host buffers back the ArrayBuffers returned by allocHostBuffer(). They
+// come from AlignedAlloc(), so TF_NewTensor doesn't copy them, and are
+// recycled through a freelist per power of two size class, up to
+// kMaxPooledHostBytes in total. Larger buffers aren't pooled.
+static const int kMinHostBufferClass = 6;   // 64 bytes.
+static const int kMaxHostBufferClass = 26;  // 64 MB.
+static const size_t kMaxPooledHostBytes = 256 << 20;
+static std::mutex host_buffer_mutex;
+static std::vector<void*> host_buffer_freelists[kMaxHostBufferClass + 1];
+static size_t pooled_host_bytes = 0;
+
+struct HostBufferStats {
+  int64_t allocs;
+  int64_t reuses;
+  int64_t live_bytes;
+};
+static HostBufferStats host_buffer_stats;
+
+// Returns the size of the buffer that holds byte_length bytes.
+static size_t HostBufferSize(size_t byte_length) {
+  size_t size = static_cast<size_t>(1) << kMinHostBufferClass;
+  for (int c = kMinHostBufferClass; c < kMaxHostBufferClass; c++) {
+    if (size >= byte_length) return size;
+    size <<= 1;
+  }
+  return size >= byte_length ? size : byte_length;
+}
+
+// Returns the size class of a buffer of HostBufferSize() bytes, or -1 if
+// it isn't pooled.
+static int HostBufferClass(size_t size) {
+  for (int c = kMinHostBufferClass; c <= kMaxHostBufferClass; c++) {
+    if (size == static_cast<size_t>(1) << c) return c;
+  }
+  return -1;
+}
+
+static void* AllocHostBuffer(size_t size) {
+  int size_class = HostBufferClass(size);
+  void* data = NULL;
+  {
+    std::lock_guard<std::mutex> lock(host_buffer_mutex);
+    if (size_class >= 0 && !host_buffer_freelists[size_class].empty()) {
+      data = host_buffer_freelists[size_class].back();
+      host_buffer_freelists[size_class].pop_back();
+      pooled_host_bytes -= size;
+      host_buffer_stats.reuses++;
+    }
+  }
+  if (data == NULL) data = AlignedAlloc(size);
+  if (data == NULL) return NULL;
+  std::lock_guard<std::mutex> lock(host_buffer_mutex);
+  host_buffer_stats.allocs++;
+  host_buffer_stats.live_bytes += size;
+  return data;
+}
+
+// The finalizer of an ArrayBuffer from allocHostBuffer(). The hint is the
+// size of the buffer.
+static void ReleaseHostBuffer(napi_env env, void* data, void* hint) {
+  size_t size = reinterpret_cast<size_t>(hint);
+  napi_adjust_external_memory(
+      env, -static_cast<int64_t>(size), &external_memory_total);
+  int size_class = HostBufferClass(size);
+  std::lock_guard<std::mutex> lock(host_buffer_mutex);
+  host_buffer_stats.live_bytes -= size;
+  if (size_class >= 0 && pooled_host_bytes + size <= kMaxPooledHostBytes) {
+    host_buffer_freelists[size_class].push_back(data);
+    pooled_host_bytes += size;
+    return;
+  }
+  AlignedFree(data);
+}
+
+// allocHostBuffer(byteLength) returns a zeroed ArrayBuffer of byteLength
+// bytes, which new Handle() passes to TensorFlow without copying.
+static napi_value AllocHostBufferJS(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  int64_t byte_length = CountArg(env, argc, args, 0, -1);
+  if (byte_length < 0) {
+    bool pending;
+    nstatus = napi_is_exception_pending(env, &pending);
+    check(nstatus == napi_ok);
+    if (!pending) {
+      napi_throw_type_error(env, "EINVAL", "Expected a byte length");
+    }
+    return NULL;
+  }
+
+  size_t size = HostBufferSize(byte_length);
+  void* data = AllocHostBuffer(size);
+  if (data == NULL) {
+    napi_throw_error(env, "ENOMEM", "Out of memory");
+    return NULL;
+  }
+  // Recycled buffers hold old data, and fresh ones garbage.
+  memset(data, 0, byte_length);
+  napi_adjust_external_memory(env, size, &external_memory_total);
+
+  napi_value array_buffer;
+  nstatus = napi_create_external_arraybuffer(env,
+                                             data,
+                                             byte_length,
+                                             ReleaseHostBuffer,
+                                             reinterpret_cast<void*>(size),
+                                             &array_buffer);
+  check(nstatus == napi_ok);
+  return array_buffer;
+}
+
+// Reads a number, number[] or matching TypedArray into dst, which must hold
+// num_elements values of dtype. Only TF_FLOAT and TF_INT32 are supported.
+// dst may be any char buffer, so values are stored with memcpy rather than
+// through a float or int32_t pointer, which would assume its alignment.
+static void ReadSmallData(napi_env env,
+                          napi_value data_js,
+                          TF_DataType dtype,
+                          bool is_typed_array,
+                          uint32_t num_elements,
+                          void* dst) {
+  if (is_typed_array) {
+    void* src;
+    auto nstatus = napi_get_typedarray_info(
+        env, data_js, NULL, NULL, &src, NULL, NULL);
+    check(nstatus == napi_ok);
+    memcpy(dst, src, num_elements * TF_DataTypeSize(dtype));
+    return;
+  }
+  bool is_array = IsArray(env, data_js);
+  size_t width = TF_DataTypeSize(dtype);
+  for (uint32_t i = 0; i < num_elements; ++i) {
+    napi_value val = is_array ? GetElement(env, data_js, i) : data_js;
+    char* p = static_cast<char*>(dst) + i * width;
+    if (dtype == TF_FLOAT) {
+      float value = static_cast<float>(GetDoubleValue(env, val));
+      memcpy(p, &value, sizeof(value));
+    } else {
+      int32_t value = GetInt32Value(env, val);
+      memcpy(p, &value, sizeof(value));
+    }
+  }
+}
+
+// Creates a small CPU tensor from a javascript number, number array or
+// TypedArray, already read into data when it fits in a small buffer.
+static TF_Tensor* CreateSmallTensor(napi_env env,
+                                    napi_value data_js,
+                                    TF_DataType dtype,
+                                    bool is_scalar,
+                                    bool is_typed_array,
+                                    uint32_t num_elements,
+                                    const void* data) {
+  // We only support rank zero and one tensors here.
+  int64_t shape[1] = {num_elements};
+  int num_dims = is_scalar ? 0 : 1;
+  size_t byte_size = num_elements * TF_DataTypeSize(dtype);
+  if (data != NULL) {
+    void* buffer = AllocSmallBuffer();
+    memcpy(buffer, data, byte_size);
+    return TF_NewTensor(dtype,
+                        shape,
+                        num_dims,
+                        buffer,
+                        byte_size,
+                        ReleaseSmallBuffer,
+                        NULL);
+  }
+  TF_Tensor* tensor = TF_AllocateTensor(dtype, shape, num_dims, byte_size);
+  ReadSmallData(env,
+                data_js,
+                dtype,
+                is_typed_array,
+                num_elements,
+                TF_TensorData(tensor));
+  return tensor;
+}
+
+// This is an optimization for creating small tensor handles on a specific
+// device. Ops like Slice, Reshape, and Fill take small tensor arguments
+// which are passed to the op as javascript objects. The returned handle may
+// be shared with other callers; dispose() has no effect on it.
+// args[0] ctx: Context
+// args[1] dtype: number
+// args[2] device: string
+// args[3] data: number | number[] | Float32Array | Int32Array
+static napi_value CreateSmallHandle(napi_env env, napi_callback_info info) {
+  size_t argc = 4;
+  napi_value args[4];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 4);
+
+  ContextWrap* context_wrap;
+  nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&context_wrap));
+  check(nstatus == napi_ok);
+
+  auto dtype = static_cast<TF_DataType>(GetInt32Value(env, args[1]));
+  if (dtype != TF_FLOAT && dtype != TF_INT32) {
+    napi_throw_type_error(env, "EINVAL", "Unsupported dtype");
+    return NULL;
+  }
+
+  char device[BUFSIZE];
+  size_t device_length;
+  nstatus = napi_get_value_string_utf8(
+      env, args[2], device, BUFSIZE, &device_length);
+  check(nstatus == napi_ok);
+
+  napi_value data_js = args[3];
+  bool is_typed_array;
+  nstatus = napi_is_typedarray(env, data_js, &is_typed_array);
+  check(nstatus == napi_ok);
+  bool is_scalar = false;
+  uint32_t num_elements;
+  if (is_typed_array) {
+    napi_typedarray_type type;
+    size_t length;
+    nstatus = napi_get_typedarray_info(
+        env, data_js, &type, &length, NULL, NULL, NULL);
+    check(nstatus == napi_ok);
+    if (type != (dtype == TF_FLOAT ? napi_float32_array : napi_int32_array)) {
+      napi_throw_type_error(env, "EINVAL", "TypedArray doesn't match dtype");
+      return NULL;
+    }
+    num_elements = static_cast<uint32_t>(length);
+  } else if (IsArray(env, data_js)) {
+    nstatus = napi_get_array_length(env, data_js, &num_elements);
+    check(nstatus == napi_ok);
+  } else {
+    is_scalar = true;
+    num_elements = 1;
+  }
+
+  // Values that fit in a small buffer are read up front, so they can be
+  // looked up in the cache.
+  char data[kSmallBufferSize];
+  size_t byte_size = num_elements * TF_DataTypeSize(dtype);
+  bool cacheable = byte_size <= kSmallBufferSize;
+  // The key is built in the context's scratch string, and only copied when
+  // a new entry is added.
+  std::string& key = context_wrap->key;
+  key.clear();
+  if (cacheable) {
+    ReadSmallData(env, data_js, dtype, is_typed_array, num_elements, data);
+    key.append(reinterpret_cast<const char*>(&context_wrap),
+               sizeof(context_wrap));
+    key.push_back(static_cast<char>(dtype));
+    key.push_back(is_scalar ? 's' : 'v');
+    key.append(device, device_length + 1);
+    key.append(data, byte_size);
+    auto it = small_handle_cache.find(key);
+    if (it != small_handle_cache.end()) {
+      napi_value handle_js;
+      nstatus =
+          napi_get_reference_value(env, it->second.handle_ref, &handle_js);
+      check(nstatus == napi_ok);
+      return handle_js;
+    }
+  }
+
+  auto tensor = CreateSmallTensor(env,
+                                  data_js,
+                                  dtype,
+                                  is_scalar,
+                                  is_typed_array,
+                                  num_elements,
+                                  cacheable ? data : NULL);
+
+  TF_Status* tf_status = ContextStatus(context_wrap);
+  auto cpu_handle = TFE_NewTensorHandle(tensor, tf_status);
+  check(TF_GetCode(tf_status) == TF_OK);
+
+  napi_value handle_js;
+  if (strcmp(device, "CPU:0") == 0) {
+    RegisterHandle(env, cpu_handle, "createSmallHandle");
+    handle_js = WrapHandle(env, cpu_handle, tensor);
+  } else {
+    auto device_handle = TFE_TensorHandleCopyToDevice(
+        cpu_handle, context_wrap->tf_context, device, tf_status);
+    TFE_DeleteTensorHandle(cpu_handle);
+    TF_DeleteTensor(tensor);
+    if (TF_GetCode(tf_status) != TF_OK) {
+      napi_throw_error(env, NULL, TF_Message(tf_status));
+      return NULL;
+    }
+    RegisterHandle(env, device_handle, "createSmallHandle");
+    handle_js = WrapHandle(env, device_handle);
+  }
+
+  if (cacheable) {
+    if (small_handle_cache.size() >= kSmallHandleCacheSize) {
+      ClearSmallHandleCache(env, NULL);
+    }
+    SmallHandleCacheEntry entry;
+    nstatus = napi_unwrap(
+        env, handle_js, reinterpret_cast<void**>(&entry.handle_wrap));
+    check(nstatus == napi_ok);
+    // Shared handles belong to no scope.
+    RemoveFromScope(entry.handle_wrap);
+    entry.handle_wrap->pinned = true;
+    entry.context_wrap = context_wrap;
+    nstatus = napi_create_reference(env, handle_js, 1, &entry.handle_ref);
+    check(nstatus == napi_ok);
+    small_handle_cache[key] = entry;
+  }
+  return handle_js;
+}
+
+static napi_value ListDevices(napi_env env, napi_callback_info info) {
+  napi_status nstatus;
+
+  // Get ContextWrap from args[0].
+  size_t argc = 1;
+  napi_value args[1];
+  nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 1);
+  ContextWrap* context_wrap;
+  nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&context_wrap));
+  check(nstatus == napi_ok);
+
+  // Get the device_list.
+  TF_Status* tf_status = ContextStatus(context_wrap);
+  auto device_list =
+      TFE_ContextListDevices(context_wrap->tf_context, tf_status);
+  check(TF_GetCode(tf_status) == TF_OK);
+
+  int device_count = TF_DeviceListCount(device_list);
+
+  napi_value out;
+  nstatus = napi_create_array_with_length(env, device_count, &out);
+  check(nstatus == napi_ok);
+
+  for (int i = 0; i < device_count; ++i) {
+    const char* device_name = TF_DeviceListName(device_list, i, tf_status);
+    check(TF_GetCode(tf_status) == TF_OK);
+    const char* device_type = TF_DeviceListType(device_list, i, tf_status);
+    check(TF_GetCode(tf_status) == TF_OK);
+    int64_t memory_bytes = TF_DeviceListMemoryBytes(device_list, i, tf_status);
+    check(TF_GetCode(tf_status) == TF_OK);
+
+    napi_value device_obj;
+    nstatus = napi_create_object(env, &device_obj);
+    check(nstatus == napi_ok);
+
+    napi_value name_js;
+    nstatus = napi_create_string_utf8(
+        env, device_name, strlen(device_name), &name_js);
+    check(nstatus == napi_ok);
+    nstatus = napi_set_named_property(env, device_obj, "name", name_js);
+    check(nstatus == napi_ok);
+
+    napi_value type_js;
+    nstatus = napi_create_string_utf8(
+        env, device_type, strlen(device_type), &type_js);
+    check(nstatus == napi_ok);
+    nstatus = napi_set_named_property(env, device_obj, "deviceType", type_js);
+    check(nstatus == napi_ok);
+
+    napi_value memory_js;
+    nstatus =
+        napi_create_double(env, static_cast<double>(memory_bytes), &memory_js);
+    check(nstatus == napi_ok);
+    nstatus =
+        napi_set_named_property(env, device_obj, "memoryBytes", memory_js);
+    check(nstatus == napi_ok);
+
+    nstatus = napi_set_element(env, out, (uint32_t) i, device_obj);
+    check(nstatus == napi_ok);
+  }
+
+  TF_DeleteDeviceList(device_list);
+  return out;
+}
+
+void SetNamedDouble(napi_env env,
+                    napi_value obj,
+                    const char* name,
+                    double value) {
+  napi_value value_js;
+  auto nstatus = napi_create_double(env, value, &value_js);
+  check(nstatus == napi_ok);
+  nstatus = napi_set_named_property(env, obj, name, value_js);
+  check(nstatus == napi_ok);
+}
+
+void SetNamedString(napi_env env,
+                    napi_value obj,
+                    const char* name,
+                    const std::string& value) {
+  napi_value value_js;
+  auto nstatus =
+      napi_create_string_utf8(env, value.data(), value.size(), &value_js);
+  check(nstatus == napi_ok);
+  nstatus = napi_set_named_property(env, obj, name, value_js);
+  check(nstatus == napi_ok);
+}
+
+// Returns memory statistics of the handles wrapped by the binding:
+//   {
+//     externalMemory: number,  // As reported to V8.
+//     unalignedCopies, unalignedCopyBytes,  // See CountUnalignedCopy().
+//     devices: {
+//       [deviceName]: {
+//         liveHandles, liveBytes, peakBytes, allocs, frees,
+//         allocsPerSec, freesPerSec
+//       }
+//     }
+//   }
+// The rates are averaged over the time since the previous call.
+static napi_value MemoryStats(napi_env env, napi_callback_info info) {
+  auto now = std::chrono::steady_clock::now();
+  double elapsed =
+      std::chrono::duration<double>(now - last_memory_stats_time).count();
+  last_memory_stats_time = now;
+
+  napi_value out, devices;
+  auto nstatus = napi_create_object(env, &out);
+  check(nstatus == napi_ok);
+  nstatus = napi_create_object(env, &devices);
+  check(nstatus == napi_ok);
+  SetNamedDouble(env, out, "externalMemory", external_memory_total);
+  SetNamedDouble(env, out, "unalignedCopies", unaligned_copies);
+  SetNamedDouble(env, out, "unalignedCopyBytes", unaligned_copy_bytes);
+  nstatus = napi_set_named_property(env, out, "devices", devices);
+  check(nstatus == napi_ok);
+
+  napi_value host_buffers;
+  nstatus = napi_create_object(env, &host_buffers);
+  check(nstatus == napi_ok);
+  {
+    std::lock_guard<std::mutex> lock(host_buffer_mutex);
+    SetNamedDouble(env, host_buffers, "allocs", host_buffer_stats.allocs);
+    SetNamedDouble(env, host_buffers, "reuses", host_buffer_stats.reuses);
+    SetNamedDouble(
+        env, host_buffers, "liveBytes", host_buffer_stats.live_bytes);
+    SetNamedDouble(env, host_buffers, "pooledBytes", pooled_host_bytes);
+  }
+  nstatus = napi_set_named_property(env, out, "hostBuffers", host_buffers);
+  check(nstatus == napi_ok);
+
+  for (size_t i = 0; i < device_memory_stats.size(); i++) {
+    DeviceMemoryStats& stats = device_memory_stats[i];
+    if (stats.allocs == 0) continue;
+    napi_value device_obj;
+    nstatus = napi_create_object(env, &device_obj);
+    check(nstatus == napi_ok);
+    SetNamedDouble(env, device_obj, "liveHandles", stats.live_handles);
+    SetNamedDouble(env, device_obj, "liveBytes", stats.live_bytes);
+    SetNamedDouble(env, device_obj, "peakBytes", stats.peak_bytes);
+    SetNamedDouble(env, device_obj, "allocs", stats.allocs);
+    SetNamedDouble(env, device_obj, "frees", stats.frees);
+    double allocs_per_sec = 0;
+    double frees_per_sec = 0;
+    if (elapsed > 0) {
+      allocs_per_sec = (stats.allocs - stats.last_allocs) / elapsed;
+      frees_per_sec = (stats.frees - stats.last_frees) / elapsed;
+    }
+    SetNamedDouble(env, device_obj, "allocsPerSec", allocs_per_sec);
+    SetNamedDouble(env, device_obj, "freesPerSec", frees_per_sec);
+    stats.last_allocs = stats.allocs;
+    stats.last_frees = stats.frees;
+    nstatus = napi_set_named_property(
+        env, devices, device_names[i].c_str(), device_obj);
+    check(nstatus == napi_ok);
+  }
+
+  return out;
+}
+
+// Enables or disables recording the origin of every live handle. Only
+// handles created while it is enabled are recorded.
+// args[0] enabled: boolean
+static napi_value SetLeakTracking(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 1);
+  nstatus = napi_get_value_bool(env, args[0], &leak_tracking);
+  check(nstatus == napi_ok);
+  if (!leak_tracking) live_handles.clear();
+
+  napi_value undefined;
+  nstatus = napi_get_undefined(env, &undefined);
+  check(nstatus == napi_ok);
+  return undefined;
+}
+
+// Enabling profiling discards the events recorded so far. Disabling it
+// keeps them for profileEvents().
+// args[0] enabled: boolean
+static napi_value SetProfiling(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 1);
+  bool enabled;
+  nstatus = napi_get_value_bool(env, args[0], &enabled);
+  check(nstatus == napi_ok);
+  if (enabled && !profiling) {
+    profile_events.resize(kProfileCapacity);
+    profile_count = 0;
+  }
+  profiling = enabled;
+
+  napi_value undefined;
+  nstatus = napi_get_undefined(env, &undefined);
+  check(nstatus == napi_ok);
+  return undefined;
+}
+
+// Returns the recorded events, oldest first, as an array of
+// { category, name, inputs, device, start, tfStart, tfEnd, end } objects.
+// Times are in microseconds.
+static napi_value ProfileEvents(napi_env env, napi_callback_info info) {
+  uint64_t count = profile_count;
+  uint64_t first = count > kProfileCapacity ? count - kProfileCapacity : 0;
+  napi_value out;
+  auto nstatus = napi_create_array_with_length(env, count - first, &out);
+  check(nstatus == napi_ok);
+  for (uint64_t i = first; i < count; i++) {
+    const ProfileEvent& event = profile_events[i % kProfileCapacity];
+    napi_value event_obj;
+    nstatus = napi_create_object(env, &event_obj);
+    check(nstatus == napi_ok);
+    SetNamedString(env, event_obj, "category", event.category);
+    SetNamedString(env, event_obj, "name", event.name);
+    SetNamedString(env, event_obj, "inputs", event.inputs);
+    SetNamedString(env,
+                   event_obj,
+                   "device",
+                   event.device_id < 0 ? "" : device_names[event.device_id]);
+    SetNamedDouble(env, event_obj, "start", event.start_ns / 1e3);
+    SetNamedDouble(env, event_obj, "tfStart", event.tf_start_ns / 1e3);
+    SetNamedDouble(env, event_obj, "tfEnd", event.tf_end_ns / 1e3);
+    SetNamedDouble(env, event_obj, "end", event.end_ns / 1e3);
+    nstatus = napi_set_element(
+        env, out, static_cast<uint32_t>(i - first), event_obj);
+    check(nstatus == napi_ok);
+  }
+  return out;
+}
+
+// Returns the live handles recorded in leak tracking mode, as an array of
+// { device, bytes, op, stack } objects.
+static napi_value LiveHandles(napi_env env, napi_callback_info info) {
+  napi_value out;
+  auto nstatus = napi_create_array_with_length(env, live_handles.size(), &out);
+  check(nstatus == napi_ok);
+  uint32_t i = 0;
+  for (auto& it : live_handles) {
+    const LiveHandleInfo& handle_info = it.second;
+    napi_value obj;
+    nstatus = napi_create_object(env, &obj);
+    check(nstatus == napi_ok);
+    SetNamedString(env, obj, "device", handle_info.device);
+    SetNamedDouble(env, obj, "bytes", handle_info.bytes);
+    SetNamedString(env, obj, "op", handle_info.op);
+    SetNamedString(env, obj, "stack", handle_info.stack);
+    nstatus = napi_set_element(env, out, i++, obj);
+    check(nstatus == napi_ok);
+  }
+  return out;
+}
+
+// Opens a new scope. Every Handle created until the matching endScope() is
+// disposed by it, unless it is kept.
+static napi_value BeginScope(napi_env env, napi_callback_info info) {
+  scopes.emplace_back();
+
+  napi_value undefined;
+  auto nstatus = napi_get_undefined(env, &undefined);
+  check(nstatus == napi_ok);
+  return undefined;
+}
+
+// Closes the innermost scope, disposing all handles created in it except
+// the kept ones, which move to the enclosing scope.
+// args[0] keep: Handle[]
+static napi_value EndScope(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 1);
+
+  if (scopes.empty()) {
+    napi_throw_error(env, NULL, "endScope() called without beginScope()");
+    return NULL;
+  }
+  size_t depth = scopes.size();
+
+  if (!IsArray(env, args[0])) {
+    napi_throw_type_error(env, NULL, "keep must be an array");
+    return NULL;
+  }
+  uint32_t keep_length;
+  nstatus = napi_get_array_length(env, args[0], &keep_length);
+  check(nstatus == napi_ok);
+  for (uint32_t i = 0; i < keep_length; i++) {
+    napi_value handle_js = GetElement(env, args[0], i);
+    HandleWrap* handle_wrap;
+    nstatus =
+        napi_unwrap(env, handle_js, reinterpret_cast<void**>(&handle_wrap));
+    if (nstatus != napi_ok) {
+      napi_throw_type_error(env, NULL, "Cannot unwrap binding.Handle");
+      return NULL;
+    }
+    if (handle_wrap->scope_depth == depth) {
+      RemoveFromScope(handle_wrap);
+      AddToScope(handle_wrap, depth - 1);
+    }
+  }
+
+  // Index instead of iterating, as releasing a handle may run finalizers
+  // that clear other entries of the scope.
+  std::vector<HandleWrap*>& scope = scopes.back();
+  for (size_t i = 0; i < scope.size(); i++) {
+    HandleWrap* handle_wrap = scope[i];
+    if (handle_wrap == NULL) continue;
+    handle_wrap->scope_depth = 0;
+    scope[i] = NULL;
+    DisposeHandle(env, handle_wrap);
+  }
+  scopes.pop_back();
+
+  napi_value undefined;
+  nstatus = napi_get_undefined(env, &undefined);
+  check(nstatus == napi_ok);
+  return undefined;
+}
+
+napi_value Dispose(napi_env env, napi_callback_info info) {
+  auto handle_wrap = HandleFromFirstArg(env, info);
+  if (handle_wrap == NULL) return NULL;
+
+  DisposeHandle(env, handle_wrap);
+
+  napi_value undefined;
+  auto nstatus = napi_get_undefined(env, &undefined);
+  check(nstatus == napi_ok);
+  return undefined;
+}
+
+static napi_value CopyToDevice(napi_env env, napi_callback_info info) {
+  napi_status nstatus;
+  ProfileEvent* event = NULL;
+  if (profiling) event = NewProfileEvent("copy", "copyToDevice", NowNs());
+  // Expect exactly three arguments.
+  size_t argc = 3;
+  napi_value args[3];
+  nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 3);
+  // Get ContextWrap from args[0].
+  ContextWrap* context_wrap;
+  nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&context_wrap));
+  check(nstatus == napi_ok);
+  // Get HandleWrap from args[1].
+  HandleWrap* handle_wrap;
+  nstatus = napi_unwrap(env, args[1], reinterpret_cast<void**>(&handle_wrap));
+  check(nstatus == napi_ok);
+  // Get device name from args[2].
+  char device_name[BUFSIZE];
+  nstatus =
+      napi_get_value_string_utf8(env, args[2], device_name, BUFSIZE, NULL);
+  check(nstatus == napi_ok);
+
+  if (event != NULL) {
+    DescribeInput(handle_wrap, &event->inputs);
+    event->device_id = InternDevice(device_name);
+    event->tf_start_ns = NowNs();
+  }
+  TF_Status* tf_status = ContextStatus(context_wrap);
+  TFE_TensorHandle* new_handle =
+      TFE_TensorHandleCopyToDevice(handle_wrap->tf_tensor_handle,
+                                   context_wrap->tf_context,
+                                   device_name,
+                                   tf_status);
+  if (event != NULL) event->tf_end_ns = NowNs();
+  if (TF_GetCode(tf_status) != TF_OK) {
+    napi_throw_error(env, NULL, TF_Message(tf_status));
+    return NULL;
+  }
+
+  TraceCopy(handle_wrap->tf_tensor_handle, new_handle);
+  RegisterHandle(env, new_handle, "copyToDevice");
+  napi_value handle_js = WrapHandle(env, new_handle);
+  if (event != NULL) event->end_ns = NowNs();
+  return handle_js;
+}
+
+// Assigns value to the variable resource on device. Returns false, with
+// tf_status set, if it fails.
+static bool AssignVariable(TFE_Context* ctx,
+                           const char* device,
+                           TF_DataType dtype,
+                           TFE_TensorHandle* resource,
+                           TFE_TensorHandle* value,
+                           TF_Status* tf_status) {
+  TFE_Op* op = TFE_NewOp(ctx, "AssignVariableOp", tf_status);
+  if (TF_GetCode(tf_status) != TF_OK) return false;
+  TFE_OpSetDevice(op, device, tf_status);
+  if (TF_GetCode(tf_status) == TF_OK) {
+    TFE_OpSetAttrType(op, "dtype", dtype);
+    TFE_OpAddInput(op, resource, tf_status);
+  }
+  if (TF_GetCode(tf_status) == TF_OK) TFE_OpAddInput(op, value, tf_status);
+  if (TF_GetCode(tf_status) == TF_OK) {
+    TFE_TensorHandle* retvals[1];
+    int num_retvals = 0;
+    TFE_Execute(op, retvals, &num_retvals, tf_status);
+  }
+  TFE_DeleteOp(op);
+  return TF_GetCode(tf_status) == TF_OK;
+}
+
+// Creates a resource variable on the device of init, holding a copy of its
+// value. The result is a TF_RESOURCE handle for ReadVariableOp,
+// AssignVariableOp, AssignAddVariableOp and the ResourceApply* ops, which
+// update the variable in place. Unlike other handles it belongs to no
+// scope, and the variable is destroyed when the handle is released.
+// args[0] ctx: Context
+// args[1] init: Handle
+static napi_value NewVariable(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 2);
+
+  ContextWrap* context_wrap;
+  nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&context_wrap));
+  check(nstatus == napi_ok);
+  HandleWrap* init_wrap;
+  nstatus = napi_unwrap(env, args[1], reinterpret_cast<void**>(&init_wrap));
+  if (nstatus != napi_ok || init_wrap->tf_tensor_handle == NULL) {
+    napi_throw_error(env, NULL, "Cannot unwrap binding.Handle");
+    return NULL;
+  }
+  TraceUnsupported("newVariable()");
+
+  TFE_TensorHandle* init = init_wrap->tf_tensor_handle;
+  TFE_Context* ctx = context_wrap->tf_context;
+  const char* device = TFE_TensorHandleDeviceName(init);
+  TF_DataType dtype = TFE_TensorHandleDataType(init);
+  int num_dims = TFE_TensorHandleNumDims(init);
+  std::vector<int64_t> dims(num_dims);
+  for (int i = 0; i < num_dims; i++) dims[i] = TFE_TensorHandleDim(init, i);
+
+  // Variables with the same shared_name are the same variable, so each
+  // gets its own.
+  static uint64_t variable_count = 0;
+  char shared_name[64];
+  snprintf(shared_name,
+           sizeof(shared_name),
+           "propel_variable_%llu",
+           static_cast<unsigned long long>(  // NOLINT(runtime/int)
+               variable_count++));
+
+  TF_Status* tf_status = ContextStatus(context_wrap);
+  TFE_Op* op = TFE_NewOp(ctx, "VarHandleOp", tf_status);
+  check(TF_GetCode(tf_status) == TF_OK);
+  TFE_OpSetDevice(op, device, tf_status);
+  check(TF_GetCode(tf_status) == TF_OK);
+  TFE_OpSetAttrType(op, "dtype", dtype);
+  TFE_OpSetAttrShape(op, "shape", dims.data(), num_dims, tf_status);
+  check(TF_GetCode(tf_status) == TF_OK);
+  TFE_OpSetAttrString(op, "container", "");
+  TFE_OpSetAttrString(op, "shared_name", shared_name);
+  TFE_TensorHandle* resource;
+  int num_retvals = 1;
+  TFE_Execute(op, &resource, &num_retvals, tf_status);
+  TFE_DeleteOp(op);
+  if (TF_GetCode(tf_status) != TF_OK) {
+    napi_throw_error(env, NULL, TF_Message(tf_status));
+    return NULL;
+  }
+
+  RegisterHandle(env, resource, "newVariable");
+  napi_value handle_js = WrapHandle(env, resource);
+  HandleWrap* handle_wrap;
+  nstatus = napi_unwrap(env, handle_js, reinterpret_cast<void**>(&handle_wrap));
+  check(nstatus == napi_ok);
+  RemoveFromScope(handle_wrap);
+  handle_wrap->variable_context = context_wrap;
+  nstatus = napi_create_reference(
+      env, args[0], 1, &handle_wrap->variable_context_ref);
+  check(nstatus == napi_ok);
+
+  tf_status = ContextStatus(context_wrap);
+  if (!AssignVariable(ctx, device, dtype, resource, init, tf_status)) {
+    napi_throw_error(env, NULL, TF_Message(tf_status));
+    ReleaseHandle(env, handle_wrap);
+    return NULL;
+  }
+  return handle_js;
+}
+
+static napi_value NewShapeArray(napi_env env, HandleWrap* handle_wrap) {
+  int rank = handle_wrap->num_dims;
+  napi_value shape;
+  auto nstatus = napi_create_array_with_length(env, rank, &shape);
+  check(nstatus == napi_ok);
+
+  for (int i = 0; i < rank; i++) {
+    // Dims of very high rank handles aren't cached.
+    int64_t dim = rank <= static_cast<int>(kMaxDims)
+                      ? handle_wrap->dims[i]
+                      : TFE_TensorHandleDim(handle_wrap->tf_tensor_handle, i);
+
+    napi_value dim_js;
+    nstatus = napi_create_int32(env, static_cast<int32_t>(dim), &dim_js);
+    check(nstatus == napi_ok);
+
+    nstatus = napi_set_element(env, shape, (uint32_t) i, dim_js);
+    check(nstatus == napi_ok);
+  }
+
+  return shape;
+}
+
+static napi_value HandleGetShape(napi_env env, napi_callback_info info) {
+  auto handle_wrap = HandleFromFirstArg(env, info);
+  if (handle_wrap == NULL) return NULL;
+  return NewShapeArray(env, handle_wrap);
+}
+
+// Returns {dtype, device, shape} in one call, where device is an id that
+// deviceName() turns into the device name.
+static napi_value HandleGetMeta(napi_env env, napi_callback_info info) {
+  auto handle_wrap = HandleFromFirstArg(env, info);
+  if (handle_wrap == NULL) return NULL;
+
+  napi_value meta;
+  auto nstatus = napi_create_object(env, &meta);
+  check(nstatus == napi_ok);
+  SetNamedDouble(env, meta, "dtype", handle_wrap->dtype);
+  SetNamedDouble(env, meta, "device", handle_wrap->device_id);
+  nstatus = napi_set_named_property(
+      env, meta, "shape", NewShapeArray(env, handle_wrap));
+  check(nstatus == napi_ok);
+  return meta;
+}
+
+// args[0] device_id: number, from getMeta()
+static napi_value DeviceName(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 1);
+
+  int32_t id = GetInt32Value(env, args[0]);
+  if (id < 0 || static_cast<size_t>(id) >= device_names.size()) {
+    napi_throw_range_error(env, "ERANGE", "Unknown device id");
+    return NULL;
+  }
+  const std::string& device = device_names[id];
+  napi_value js_device;
+  nstatus = napi_create_string_utf8(
+      env, device.c_str(), device.size(), &js_device);
+  check(nstatus == napi_ok);
+  return js_device;
+}
+
+// Base class for work that runs on a libuv worker thread so that slow
+// kernels and device transfers don't block the event loop. Queue() returns
+// a Promise which is resolved with the value returned by Result(), or
+// rejected if Run() leaves an error in tf_status_.
+class AsyncTask {
+ public:
+  AsyncTask() : tf_status_(TF_NewStatus()) {}
+  virtual ~AsyncTask() {
+    TF_DeleteStatus(tf_status_);
+  }
+
+  AsyncTask(const AsyncTask&) = delete;   // Disallow copy.
+  AsyncTask(const AsyncTask&&) = delete;  // Disallow assign.
+
+  // Called on a worker thread. Must not call into N-API.
+  virtual void Run() = 0;
+  // Called on the main thread after Run() succeeded.
+  virtual napi_value Result(napi_env env) = 0;
+  // Called on the main thread after Run(), whether it succeeded or not.
+  virtual void Cleanup(napi_env env) {}
+
+  napi_value Queue(napi_env env, const char* name) {
+    napi_value promise;
+    auto nstatus = napi_create_promise(env, &deferred_, &promise);
+    check(nstatus == napi_ok);
+    napi_value name_js;
+    nstatus = napi_create_string_utf8(env, name, NAPI_AUTO_LENGTH, &name_js);
+    check(nstatus == napi_ok);
+    nstatus = napi_create_async_work(
+        env, NULL, name_js, Execute, Complete, this, &work_);
+    check(nstatus == napi_ok);
+    nstatus = napi_queue_async_work(env, work_);
+    check(nstatus == napi_ok);
+    return promise;
+  }
+
+ protected:
+  TF_Status* tf_status_;
+
+ private:
+  static void Execute(napi_env env, void* data) {
+    static_cast<AsyncTask*>(data)->Run();
+  }
+
+  static void Complete(napi_env env, napi_status status, void* data) {
+    auto task = static_cast<AsyncTask*>(data);
+    napi_status nstatus;
+    if (status == napi_ok && TF_GetCode(task->tf_status_) == TF_OK) {
+      nstatus = napi_resolve_deferred(env, task->deferred_, task->Result(env));
+      check(nstatus == napi_ok);
+    } else {
+      const char* message = status == napi_ok ? TF_Message(task->tf_status_)
+                                              : "Async task cancelled";
+      napi_value message_js, error;
+      nstatus = napi_create_string_utf8(
+          env, message, NAPI_AUTO_LENGTH, &message_js);
+      check(nstatus == napi_ok);
+      nstatus = napi_create_error(env, NULL, message_js, &error);
+      check(nstatus == napi_ok);
+      nstatus = napi_reject_deferred(env, task->deferred_, error);
+      check(nstatus == napi_ok);
+    }
+    task->Cleanup(env);
+    nstatus = napi_delete_async_work(env, task->work_);
+    check(nstatus == napi_ok);
+    delete task;
+  }
+
+  napi_async_work work_;
+  napi_deferred deferred_;
+};
+
+// Marks a Handle as being read by an async task, which keeps it alive and
+// defers binding.dispose() until the task calls Done().
+class PendingHandle {
+ public:
+  PendingHandle(napi_env env, napi_value handle_js, HandleWrap* handle_wrap)
+      : ref_(env, handle_js), handle_wrap_(handle_wrap) {
+    handle_wrap_->pending_tasks++;
+  }
+
+  TFE_TensorHandle* tf_tensor_handle() {
+    return handle_wrap_->tf_tensor_handle;
+  }
+
+  void Done(napi_env env) {
+    if (--handle_wrap_->pending_tasks == 0 && handle_wrap_->dispose_pending) {
+      ReleaseHandle(env, handle_wrap_);
+    }
+  }
+
+ private:
+  JSRef ref_;
+  HandleWrap* handle_wrap_;
+};
+
+class ExecuteTask : public AsyncTask {
+ public:
+  ExecuteTask(napi_env env,
+              napi_value context_js,
+              TFE_Op* op,
+              const char* op_name,
+              int max_retvals)
+      : context_ref_(env, context_js),
+        op_(op),
+        op_name_(op_name),
+        max_retvals_(max_retvals),
+        retvals_(max_retvals > 0 ? max_retvals : kMaxRetvals) {}
+
+  ~ExecuteTask() {
+    TFE_DeleteOp(op_);
+  }
+
+  void Run() {
+    num_retvals_ = static_cast<int>(retvals_.size());
+    TFE_Execute(op_, retvals_.data(), &num_retvals_, tf_status_);
+    if (TF_GetCode(tf_status_) == TF_OK &&
+        MayHaveDroppedOutputs(max_retvals_, num_retvals_)) {
+      DeleteRetvals(retvals_.data(), num_retvals_);
+      TF_SetStatus(tf_status_, TF_OUT_OF_RANGE, kTooManyOutputsMessage);
+    }
+  }
+
+  napi_value Result(napi_env env) {
+    return WrapRetvals(env, retvals_.data(), num_retvals_, op_name_.c_str());
+  }
+
+ private:
+  JSRef context_ref_;
+  TFE_Op* op_;
+  std::string op_name_;
+  int max_retvals_;
+  std::vector<TFE_TensorHandle*> retvals_;
+  int num_retvals_;
+};
+
+// Like execute(), but runs the op on a worker thread. The inputs are added
+// to the op immediately, so they may be disposed before the promise settles.
+// args[0] ctx: Context
+// args[1] op_name: string
+// args[2] attrs: AttrDef[]
+// args[3] inputs: Handle[]
+// args[4] num_outputs: number (optional, only needed above kMaxRetvals)
+static napi_value ExecuteAsync(napi_env env, napi_callback_info info) {
+  size_t argc = 5;
+  napi_value args[5];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc >= 4);
+
+  ContextWrap* context_wrap;
+  nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&context_wrap));
+  check(nstatus == napi_ok);
+
+  char op_name[512];
+  nstatus = napi_get_value_string_utf8(env, args[1], op_name, 512, NULL);
+  check(nstatus == napi_ok);
+
+  check(IsArray(env, args[2]));
+
+  TF_Status* tf_status = ContextStatus(context_wrap);
+  TFE_Op* op = TFE_NewOp(context_wrap->tf_context, op_name, tf_status);
+  if (TF_GetCode(tf_status) != TF_OK) {
+    napi_throw_error(env, NULL, TF_Message(tf_status));
     return NULL;
   }
-  handle_wrap->tf_tensor = tf_tensor;
-
-  // Create the TFE_TensorHandle object.
-  TF_Status* tf_status = TF_NewStatus();
-  if (tf_status == NULL) {
-    napi_throw_error(env, "ENOMEM", "Out of memory");
+  if (!ParseOpAttrs(env, args[2], &context_wrap->attrs)) {
+    TFE_DeleteOp(op);
     return NULL;
   }
-  TFE_TensorHandle* tf_tensor_handle =
-      TFE_NewTensorHandle(tf_tensor, tf_status);
-  if (TF_GetCode(tf_status) != TF_OK) {
+  if (!ApplyOpAttrs(
+          context_wrap->tf_context, op, context_wrap->attrs, tf_status)) {
     napi_throw_error(env, NULL, TF_Message(tf_status));
-    TF_DeleteStatus(tf_status);
+    TFE_DeleteOp(op);
+    return NULL;
+  }
+  if (!AddOpInputs(env, op, args[3], tf_status)) {
+    TFE_DeleteOp(op);
     return NULL;
   }
-  TF_DeleteStatus(tf_status);
-  RegisterHandle(env, tf_tensor_handle);
-  handle_wrap->tf_tensor_handle = tf_tensor_handle;
 
-  return js_this;
+  int max_retvals = NumOutputsArg(env, argc, args, 4);
+  if (max_retvals < 0) {
+    TFE_DeleteOp(op);
+    return NULL;
+  }
+  TraceUnsupported("executeAsync()");
+  auto task = new ExecuteTask(env, args[0], op, op_name, max_retvals);
+  return task->Queue(env, "executeAsync");
 }
 
-static void DeleteTensorArrayBuffer(napi_env env,
-                                    void* handle_wrap_ptr,
-                                    void* hint) {
-  auto tensor = reinterpret_cast<TF_Tensor*>(hint);
-  TF_DeleteTensor(tensor);
-}
+class ResolveTask : public AsyncTask {
+ public:
+  ResolveTask(napi_env env, napi_value handle_js, HandleWrap* handle_wrap)
+      : handle_(env, handle_js, handle_wrap), tensor_(NULL) {}
 
-static napi_status NewTensorArrayBuffer(napi_env env,
-                                        TF_Tensor* tensor,
-                                        napi_value* array_buffer_out) {
-  void* external_data = TF_TensorData(tensor);
-  size_t byte_length = TF_TensorByteSize(tensor);
-  return napi_create_external_arraybuffer(env,
-                                          external_data,
-                                          byte_length,
-                                          DeleteTensorArrayBuffer,
-                                          tensor,
-                                          array_buffer_out);
-}
+  void Run() {
+    tensor_ = TFE_TensorHandleResolve(handle_.tf_tensor_handle(), tf_status_);
+  }
 
-// Returns a HandleWrap from the first and only argument of a bound function.
-// The program crashes if there isn't exactly one argument.
-HandleWrap* HandleFromFirstArg(napi_env env, napi_callback_info info) {
-  napi_status nstatus;
+  napi_value Result(napi_env env) {
+    napi_value array_buffer;
+    auto nstatus = NewTensorArrayBuffer(env, tensor_, &array_buffer);
+    check(nstatus == napi_ok);
+    return array_buffer;
+  }
+
+  void Cleanup(napi_env env) {
+    handle_.Done(env);
+  }
+
+ private:
+  PendingHandle handle_;
+  TF_Tensor* tensor_;
+};
+
+// Like asArrayBuffer(), but resolves the tensor on a worker thread.
+static napi_value HandleAsArrayBufferAsync(napi_env env,
+                                           napi_callback_info info) {
   size_t argc = 1;
   napi_value args[1];
-  nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
   check(nstatus == napi_ok);
   check(argc == 1);
   HandleWrap* handle_wrap;
   nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&handle_wrap));
-  if (nstatus != napi_ok) {
+  if (nstatus != napi_ok || handle_wrap->tf_tensor_handle == NULL) {
     napi_throw_error(env, NULL, "Cannot unwrap binding.Handle");
     return NULL;
   }
-  return handle_wrap;
-}
+  if (handle_wrap->dtype == TF_RESOURCE) {
+    napi_throw_type_error(env, "EINVAL", "Cannot read a resource handle");
+    return NULL;
+  }
 
-static napi_value HandleAsArrayBuffer(napi_env env, napi_callback_info info) {
-  napi_status nstatus;
+  auto task = new ResolveTask(env, args[0], handle_wrap);
+  return task->Queue(env, "asArrayBufferAsync");
+}
 
-  auto handle_wrap = HandleFromFirstArg(env, info);
-  if (handle_wrap == NULL) return NULL;
+class SaveCheckpointTask : public AsyncTask {
+ public:
+  SaveCheckpointTask(const std::string& path,
+                     const std::vector<std::string>& names,
+                     const std::vector<TF_Tensor*>& tensors)
+      : path_(path), names_(names), tensors_(tensors), size_(-1) {}
+
+  void Run() {
+    std::string error;
+    size_ = WriteCheckpoint(path_, names_, tensors_, &error);
+    if (size_ < 0) TF_SetStatus(tf_status_, TF_INTERNAL, error.c_str());
+  }
 
-  // Resolve TFE_TensorHandle into TF_Tensor
-  auto tf_status = TF_NewStatus();
-  auto tensor =
-      TFE_TensorHandleResolve(handle_wrap->tf_tensor_handle, tf_status);
-  if (TF_GetCode(tf_status) != TF_OK) {
-    napi_throw_error(env, NULL, TF_Message(tf_status));
-    TF_DeleteStatus(tf_status);
-    return NULL;
+  napi_value Result(napi_env env) {
+    napi_value size_js;
+    auto nstatus = napi_create_int64(env, size_, &size_js);
+    check(nstatus == napi_ok);
+    return size_js;
   }
-  TF_DeleteStatus(tf_status);
 
-  check(handle_wrap->tf_tensor != tensor);
+  void Cleanup(napi_env env) {
+    for (TF_Tensor* t : tensors_) TF_DeleteTensor(t);
+  }
 
-  napi_value array_buffer;
-  nstatus = NewTensorArrayBuffer(env, tensor, &array_buffer);
-  check(nstatus == napi_ok);
+ private:
+  std::string path_;
+  std::vector<std::string> names_;
+  std::vector<TF_Tensor*> tensors_;
+  int64_t size_;
+};
 
-  return array_buffer;
+// Like saveCheckpoint(), but writes the file on a worker thread and returns
+// a promise of its size. The handles are resolved before returning, which
+// on the CPU only takes a reference to their buffers. Ops which update a
+// variable copy its buffer while it's referenced, so the file holds the
+// values the handles had when this was called, and they may be disposed or
+// updated straight away.
+static napi_value SaveCheckpointAsync(napi_env env, napi_callback_info info) {
+  std::string path;
+  std::vector<std::string> names;
+  std::vector<TF_Tensor*> tensors;
+  if (!SaveCheckpointArgs(env, info, &path, &names, &tensors)) return NULL;
+  auto task = new SaveCheckpointTask(path, names, tensors);
+  return task->Queue(env, "saveCheckpointAsync");
 }
 
-static napi_value HandleGetDevice(napi_env env, napi_callback_info info) {
-  napi_status nstatus;
-
-  auto handle_wrap = HandleFromFirstArg(env, info);
-  if (handle_wrap == NULL) return NULL;
+// A Batcher assembles batches of the rows of a set of tensors on background
+// threads, for the native input pipeline in src/dataset.ts. Each batch is
+// copied into one new tensor per source, with a memcpy per run of adjacent
+// rows, so the JavaScript side neither slices nor stacks. Rows are taken in
+// order, or from a shuffle buffer of row indices which works like the
+// buffer of tf.data's shuffle(). Up to prefetch batches are assembled ahead
+// of the batches asked for, by up to kBatcherThreads threads.
+//
+// Batches are numbered within an epoch. Claim() numbers the next batch on
+// the main thread, which fixes the order in which batches are returned,
+// and TryTake() returns that batch once it has been assembled. The workers
+// call on_ready after each batch. Reset() starts a new epoch; batches of
+// the old one are dropped.
+static const unsigned kBatcherThreads = 4;
+
+class Batcher {
+ public:
+  struct Ticket {
+    uint64_t generation;
+    int64_t index;
+  };
+
+  enum TakeResult { kTaken, kPending, kEnd };
+
+  Batcher(const std::vector<TF_Tensor*>& sources,
+          int64_t batch_size,
+          int64_t shuffle_size,
+          uint64_t seed,
+          int64_t prefetch,
+          std::function<void()> on_ready)
+      : sources_(sources),
+        num_rows_(TF_Dim(sources[0], 0)),
+        batch_size_(batch_size),
+        shuffle_size_(shuffle_size),
+        prefetch_(prefetch),
+        on_ready_(on_ready),
+        rng_(seed),
+        generation_(0),
+        stop_(false) {
+    for (TF_Tensor* t : sources_) {
+      row_bytes_.push_back(num_rows_ == 0 ? 0
+                                          : TF_TensorByteSize(t) / num_rows_);
+    }
+    StartEpoch();
+    unsigned num_threads = std::min<unsigned>(
+        std::max(1u, std::thread::hardware_concurrency()), kBatcherThreads);
+    for (unsigned i = 0; i < num_threads; i++) {
+      threads_.emplace_back([this] { Work(); });
+    }
+  }
 
-  // Ask tensorflow for the device name.
-  const char* device =
-      TFE_TensorHandleDeviceName(handle_wrap->tf_tensor_handle);
+  ~Batcher() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    for (std::thread& t : threads_) t.join();
+    DropReady();
+    for (TF_Tensor* t : sources_) TF_DeleteTensor(t);
+  }
 
-  // Build JavaScript string containing the device name.
-  napi_value js_device;
-  nstatus = napi_create_string_utf8(env, device, NAPI_AUTO_LENGTH, &js_device);
-  check(nstatus == napi_ok);
+  Ticket Claim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Ticket ticket = {generation_, claimed_++};
+    cv_.notify_all();
+    return ticket;
+  }
 
-  return js_device;
-}
+  // Moves the batch of ticket into batch if it's ready. Returns kEnd if the
+  // batch is past the end of the epoch or the epoch was reset since it was
+  // claimed, and kPending if it hasn't been assembled yet.
+  TakeResult TryTake(Ticket ticket, std::vector<TF_Tensor*>* batch) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stop_ || ticket.generation != generation_) return kEnd;
+    auto it = ready_.find(ticket.index);
+    if (it != ready_.end()) {
+      batch->swap(it->second);
+      ready_.erase(it);
+      return kTaken;
+    }
+    if (Exhausted() && ticket.index >= next_index_) return kEnd;
+    return kPending;
+  }
 
-static napi_value HandleGetDType(napi_env env, napi_callback_info info) {
-  napi_status nstatus;
+  void SetPrefetch(int64_t prefetch) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      prefetch_ = prefetch;
+    }
+    cv_.notify_all();
+  }
 
-  auto handle_wrap = HandleFromFirstArg(env, info);
-  if (handle_wrap == NULL) return NULL;
+  void Reset() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      generation_++;
+      DropReady();
+      StartEpoch();
+    }
+    cv_.notify_all();
+  }
 
-  // Ask tensorflow for the dtype.
-  TF_DataType dtype = TFE_TensorHandleDataType(handle_wrap->tf_tensor_handle);
+ private:
+  // Must hold mutex_.
+  void StartEpoch() {
+    claimed_ = 0;
+    next_index_ = 0;
+    next_row_ = 0;
+    shuffle_buffer_.clear();
+  }
 
-  napi_value js_dtype;
-  nstatus = napi_create_int32(env, dtype, &js_dtype);
-  check(nstatus == napi_ok);
+  // Must hold mutex_.
+  bool Exhausted() {
+    return next_row_ >= num_rows_ && shuffle_buffer_.empty();
+  }
 
-  return js_dtype;
-}
+  // Must hold mutex_.
+  void DropReady() {
+    for (auto& it : ready_) {
+      for (TF_Tensor* t : it.second) TF_DeleteTensor(t);
+    }
+    ready_.clear();
+  }
 
-void ReleaseSmallHandle(void* data, size_t len, void* _) {
-  delete static_cast<char*>(data);
-}
+  // Returns the next row of the epoch. Must hold mutex_, and the epoch must
+  // not be exhausted.
+  int64_t NextRow() {
+    if (shuffle_size_ <= 1) return next_row_++;
+    while (next_row_ < num_rows_ &&
+           static_cast<int64_t>(shuffle_buffer_.size()) < shuffle_size_) {
+      shuffle_buffer_.push_back(next_row_++);
+    }
+    std::uniform_int_distribution<size_t> pick(0, shuffle_buffer_.size() - 1);
+    size_t i = pick(rng_);
+    int64_t row = shuffle_buffer_[i];
+    shuffle_buffer_[i] = shuffle_buffer_.back();
+    shuffle_buffer_.pop_back();
+    return row;
+  }
 
-// Creates a small CPU tensor from a javascript number or number array.
-// data_js: number | number[]
-TF_Tensor* CreateSmallTensor(napi_env env,
-                             napi_value data_js,
-                             TF_DataType dtype) {
-  if (!IsArray(env, data_js)) {
-    // Scalar
-    switch (dtype) {
-      case TF_FLOAT: {
-        float* data = new float[1];
-        data[0] = static_cast<float>(GetDoubleValue(env, data_js));
-        return TF_NewTensor(dtype, NULL, 0, data, 4, ReleaseSmallHandle, NULL);
+  void Work() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      cv_.wait(lock, [this] {
+        return stop_ || (!Exhausted() && next_index_ < claimed_ + prefetch_);
+      });
+      if (stop_) return;
+      uint64_t generation = generation_;
+      int64_t index = next_index_++;
+      std::vector<int64_t> rows;
+      while (static_cast<int64_t>(rows.size()) < batch_size_ && !Exhausted()) {
+        rows.push_back(NextRow());
       }
-
-      case TF_INT32: {
-        int32_t* data = new int32_t[1];
-        data[0] = GetInt32Value(env, data_js);
-        return TF_NewTensor(dtype, NULL, 0, data, 4, ReleaseSmallHandle, NULL);
+      lock.unlock();
+      std::vector<TF_Tensor*> batch = Assemble(rows);
+      lock.lock();
+      if (generation == generation_) {
+        ready_[index].swap(batch);
+        on_ready_();
+      } else {
+        for (TF_Tensor* t : batch) TF_DeleteTensor(t);
       }
+    }
+  }
 
-      default:
-        check(false && "Not implemented.");
-        return NULL;
+  std::vector<TF_Tensor*> Assemble(const std::vector<int64_t>& rows) {
+    std::vector<TF_Tensor*> batch;
+    for (size_t s = 0; s < sources_.size(); s++) {
+      TF_Tensor* source = sources_[s];
+      std::vector<int64_t> dims(TF_NumDims(source));
+      dims[0] = rows.size();
+      for (size_t d = 1; d < dims.size(); d++) dims[d] = TF_Dim(source, d);
+      size_t row_bytes = row_bytes_[s];
+      TF_Tensor* t = TF_AllocateTensor(TF_TensorType(source),
+                                       dims.data(),
+                                       static_cast<int>(dims.size()),
+                                       rows.size() * row_bytes);
+      auto src = static_cast<const char*>(TF_TensorData(source));
+      auto dst = static_cast<char*>(TF_TensorData(t));
+      for (size_t i = 0; i < rows.size();) {
+        // Copy runs of adjacent rows at once.
+        size_t n = 1;
+        while (i + n < rows.size() &&
+               rows[i + n] == rows[i] + static_cast<int64_t>(n)) {
+          n++;
+        }
+        memcpy(dst + i * row_bytes, src + rows[i] * row_bytes, n * row_bytes);
+        i += n;
+      }
+      batch.push_back(t);
     }
-  } else {
-    // Array
-    uint32_t data_length;
-    auto nstatus = napi_get_array_length(env, data_js, &data_length);
-    check(nstatus == napi_ok);
+    return batch;
+  }
 
-    // We only support rank one tensors here.
-    int64_t shape[1] = {data_length};
+  std::vector<TF_Tensor*> sources_;
+  std::vector<size_t> row_bytes_;
+  const int64_t num_rows_;
+  const int64_t batch_size_;
+  const int64_t shuffle_size_;
+  int64_t prefetch_;
+  std::function<void()> on_ready_;
+  std::mt19937_64 rng_;
+  std::vector<std::thread> threads_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  uint64_t generation_;
+  bool stop_;
+  int64_t claimed_;     // Batches of the epoch claimed by Claim().
+  int64_t next_index_;  // The next batch of the epoch to assemble.
+  int64_t next_row_;    // The next row of the epoch not yet taken.
+  std::vector<int64_t> shuffle_buffer_;
+  std::map<int64_t, std::vector<TF_Tensor*>> ready_;
+};
 
-    if (dtype == TF_FLOAT) {
-      auto data = new float[data_length];
-      for (uint32_t i = 0; i < data_length; ++i) {
-        napi_value val = GetElement(env, data_js, i);
-        data[i] = static_cast<float>(GetDoubleValue(env, val));
-      }
-      return TF_NewTensor(
-          dtype, shape, 1, data, 4 * data_length, ReleaseSmallHandle, NULL);
-
-    } else if (dtype == TF_INT32) {
-      auto data = new int32_t[data_length];
-      for (uint32_t i = 0; i < data_length; ++i) {
-        napi_value val = GetElement(env, data_js, i);
-        data[i] = GetInt32Value(env, val);
-      }
-      return TF_NewTensor(
-          dtype, shape, 1, data, 4 * data_length, ReleaseSmallHandle, NULL);
+// The main thread side of a Batcher. Promises from batcherNext() wait in
+// waiters until their batch is ready. The workers wake the main thread
+// through async when a batch is done, so no thread blocks waiting for one.
+struct BatcherWrap {
+  struct Waiter {
+    Batcher::Ticket ticket;
+    napi_deferred deferred;
+  };
 
-    } else {
-      check(false && "Not implemented.");
-      return NULL;
+  napi_env env;
+  // A weak reference to the JavaScript object, made strong while promises
+  // wait, so that the batcher outlives them.
+  napi_ref ref;
+  napi_async_context async_context;
+  uv_async_t async;
+  Batcher* batcher;
+  std::deque<Waiter> waiters;
+};
+
+static void DeleteBatcher(napi_env env, void* data, void* hint) {
+  auto wrap = static_cast<BatcherWrap*>(data);
+  // Joins the workers, so async isn't used after it's closed.
+  delete wrap->batcher;
+  auto nstatus = napi_delete_reference(env, wrap->ref);
+  check(nstatus == napi_ok);
+  nstatus = napi_async_destroy(env, wrap->async_context);
+  check(nstatus == napi_ok);
+  uv_close(reinterpret_cast<uv_handle_t*>(&wrap->async), [](uv_handle_t* h) {
+    delete static_cast<BatcherWrap*>(h->data);
+  });
+}
+
+// Returns an array of new handles of batch, or null if it's empty. The
+// handles take ownership of the tensors.
+static napi_value BatchHandles(napi_env env, std::vector<TF_Tensor*>* batch) {
+  napi_value out;
+  napi_status nstatus;
+  if (batch->empty()) {
+    nstatus = napi_get_null(env, &out);
+    check(nstatus == napi_ok);
+    return out;
+  }
+  nstatus = napi_create_array_with_length(env, batch->size(), &out);
+  check(nstatus == napi_ok);
+  TF_Status* tf_status = MainStatus();
+  for (size_t i = 0; i < batch->size(); i++) {
+    TF_Tensor* t = (*batch)[i];
+    TFE_TensorHandle* h = TFE_NewTensorHandle(t, tf_status);
+    check(TF_GetCode(tf_status) == TF_OK);
+    RegisterHandle(env, h, "batcherNext");
+    nstatus = napi_set_element(env, out, i, WrapHandle(env, h, t));
+    check(nstatus == napi_ok);
+  }
+  batch->clear();
+  return out;
+}
+
+// Resolves the promises of the waiters whose batches are ready, or past the
+// end of the epoch.
+static void ResolveWaiters(napi_env env, BatcherWrap* wrap) {
+  if (wrap->waiters.empty()) return;
+  auto it = wrap->waiters.begin();
+  while (it != wrap->waiters.end()) {
+    std::vector<TF_Tensor*> batch;
+    if (wrap->batcher->TryTake(it->ticket, &batch) == Batcher::kPending) {
+      ++it;
+      continue;
     }
+    auto nstatus =
+        napi_resolve_deferred(env, it->deferred, BatchHandles(env, &batch));
+    check(nstatus == napi_ok);
+    it = wrap->waiters.erase(it);
+  }
+  if (wrap->waiters.empty()) {
+    uv_unref(reinterpret_cast<uv_handle_t*>(&wrap->async));
+    uint32_t count;
+    auto nstatus = napi_reference_unref(env, wrap->ref, &count);
+    check(nstatus == napi_ok);
   }
-  check(false && "Unreachable");
+}
+
+static napi_value ResolveWaitersJS(napi_env env, napi_callback_info info) {
+  void* data;
+  auto nstatus = napi_get_cb_info(env, info, NULL, NULL, NULL, &data);
+  check(nstatus == napi_ok);
+  ResolveWaiters(env, static_cast<BatcherWrap*>(data));
   return NULL;
 }
 
-// This is an optimization for creating small tensor handles on a specific
-// device. Ops like Slice, Reshape, and Fill take small tensor arguments
-// which are passed to the op as javascript objects.
-// args[0] ctx: Context
-// args[1] dtype: number
-// args[2] device: string
-// args[3] data: number | number[]
-static napi_value CreateSmallHandle(napi_env env, napi_callback_info info) {
-  size_t argc = 4;
-  napi_value args[4];
+// Runs on the main thread after a worker finished a batch. The promises are
+// resolved in a callback scope, like the completions of async work, so
+// that their reactions run right after.
+static void OnBatchReady(uv_async_t* async) {
+  auto wrap = static_cast<BatcherWrap*>(async->data);
+  napi_env env = wrap->env;
+  napi_handle_scope scope;
+  auto nstatus = napi_open_handle_scope(env, &scope);
+  check(nstatus == napi_ok);
+  napi_value batcher_js, fn;
+  nstatus = napi_get_reference_value(env, wrap->ref, &batcher_js);
+  check(nstatus == napi_ok);
+  // Without waiters the object may have been collected; there's nothing to
+  // resolve then.
+  if (batcher_js != NULL) {
+    nstatus = napi_create_function(
+        env, "batcherReady", NAPI_AUTO_LENGTH, ResolveWaitersJS, wrap, &fn);
+    check(nstatus == napi_ok);
+    nstatus = napi_make_callback(
+        env, wrap->async_context, batcher_js, fn, 0, NULL, NULL);
+    check(nstatus == napi_ok);
+  }
+  nstatus = napi_close_handle_scope(env, scope);
+  check(nstatus == napi_ok);
+}
+
+// newBatcher(handles, batchSize, shuffleSize, seed, prefetch) returns a
+// batcher of the rows of handles, which must all have the same number of
+// rows. A shuffleSize of 0 or 1 keeps the rows in order.
+static napi_value NewBatcher(napi_env env, napi_callback_info info) {
+  size_t argc = 5;
+  napi_value args[5];
   auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
   check(nstatus == napi_ok);
-  check(argc == 4);
+  check(argc == 5);
+  int64_t batch_size = CountArg(env, argc, args, 1, -1);
+  if (batch_size < 0) return NULL;
+  int64_t shuffle_size = CountArg(env, argc, args, 2, -1);
+  if (shuffle_size < 0) return NULL;
+  int64_t seed = CountArg(env, argc, args, 3, -1);
+  if (seed < 0) return NULL;
+  int64_t prefetch = CountArg(env, argc, args, 4, -1);
+  if (prefetch < 0) return NULL;
+  if (batch_size == 0 || prefetch == 0) {
+    napi_throw_range_error(env, "EINVAL", "Expected a positive count");
+    return NULL;
+  }
 
-  ContextWrap* context_wrap;
-  nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&context_wrap));
+  std::vector<TF_Tensor*> sources;
+  if (!ResolveHandles(env, args[0], &sources)) return NULL;
+  const char* error = NULL;
+  if (sources.empty()) {
+    error = "Expected at least one handle";
+  } else {
+    for (TF_Tensor* t : sources) {
+      if (TF_NumDims(t) < 1 || TF_Dim(t, 0) != TF_Dim(sources[0], 0)) {
+        error = "Expected handles with the same number of rows";
+      }
+    }
+  }
+  if (error != NULL) {
+    for (TF_Tensor* t : sources) TF_DeleteTensor(t);
+    napi_throw_range_error(env, "EINVAL", error);
+    return NULL;
+  }
+
+  napi_value out, name_js;
+  nstatus = napi_create_object(env, &out);
+  check(nstatus == napi_ok);
+  auto wrap = new BatcherWrap();
+  wrap->env = env;
+  nstatus = napi_create_string_utf8(
+      env, "batcherNext", NAPI_AUTO_LENGTH, &name_js);
   check(nstatus == napi_ok);
+  nstatus = napi_async_init(env, out, name_js, &wrap->async_context);
+  check(nstatus == napi_ok);
+  // The binding only runs on the main thread, whose loop is the default one.
+  int r = uv_async_init(uv_default_loop(), &wrap->async, OnBatchReady);
+  check(r == 0);
+  wrap->async.data = wrap;
+  // Only pending promises keep the process alive.
+  uv_unref(reinterpret_cast<uv_handle_t*>(&wrap->async));
+  wrap->batcher =
+      new Batcher(sources, batch_size, shuffle_size, seed, prefetch,
+                  [wrap] { uv_async_send(&wrap->async); });
+  nstatus = napi_wrap(env, out, wrap, DeleteBatcher, NULL, &wrap->ref);
+  check(nstatus == napi_ok);
+  return out;
+}
 
-  auto dtype = static_cast<TF_DataType>(GetInt32Value(env, args[1]));
+static BatcherWrap* UnwrapBatcher(napi_env env, napi_value batcher_js) {
+  BatcherWrap* wrap;
+  auto nstatus = napi_unwrap(env, batcher_js, reinterpret_cast<void**>(&wrap));
+  if (nstatus != napi_ok) {
+    napi_throw_type_error(env, "EINVAL", "Expected a batcher");
+    return NULL;
+  }
+  return wrap;
+}
 
-  char device[BUFSIZE];
-  nstatus = napi_get_value_string_utf8(env, args[2], device, BUFSIZE, NULL);
+// batcherNext(batcher) returns a promise of the handles of the next batch,
+// in the order of the handles given to newBatcher(), or null at the end of
+// the epoch. It resolves at once if the batch is ready.
+static napi_value BatcherNext(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 1);
+  BatcherWrap* wrap = UnwrapBatcher(env, args[0]);
+  if (wrap == NULL) return NULL;
+  BatcherWrap::Waiter waiter;
+  waiter.ticket = wrap->batcher->Claim();
+  napi_value promise;
+  nstatus = napi_create_promise(env, &waiter.deferred, &promise);
   check(nstatus == napi_ok);
+  if (wrap->waiters.empty()) {
+    uv_ref(reinterpret_cast<uv_handle_t*>(&wrap->async));
+    uint32_t count;
+    nstatus = napi_reference_ref(env, wrap->ref, &count);
+    check(nstatus == napi_ok);
+  }
+  wrap->waiters.push_back(waiter);
+  ResolveWaiters(env, wrap);
+  return promise;
+}
 
-  auto tensor = CreateSmallTensor(env, args[3], dtype);
+// batcherReset(batcher) starts a new epoch. Batches of the old epoch which
+// haven't been returned yet resolve to null.
+static napi_value BatcherReset(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 1);
+  BatcherWrap* wrap = UnwrapBatcher(env, args[0]);
+  if (wrap == NULL) return NULL;
+  wrap->batcher->Reset();
+  ResolveWaiters(env, wrap);
+  return NULL;
+}
 
-  TF_Status* tf_status = TF_NewStatus();
-  auto cpu_handle = TFE_NewTensorHandle(tensor, tf_status);
-  check(TF_GetCode(tf_status) == TF_OK);
-  RegisterHandle(env, cpu_handle);
+// batcherSetPrefetch(batcher, prefetch) changes how many batches are
+// assembled ahead of the ones asked for.
+static napi_value BatcherSetPrefetch(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  check(nstatus == napi_ok);
+  check(argc == 2);
+  BatcherWrap* wrap = UnwrapBatcher(env, args[0]);
+  if (wrap == NULL) return NULL;
+  int64_t prefetch = CountArg(env, argc, args, 1, -1);
+  if (prefetch < 0) return NULL;
+  if (prefetch == 0) {
+    napi_throw_range_error(env, "EINVAL", "Expected a positive count");
+    return NULL;
+  }
+  wrap->batcher->SetPrefetch(prefetch);
+  return NULL;
+}
+
+// Images are decoded by TensorFlow's DecodePng and DecodeJpeg kernels, on
+// up to kDecodeThreads threads at once, each decoding whole images. The
+// kernels give RGB or RGBA, and the other modes are converted here the way
+// imread() in src/im.ts converts them: L is the mean of R, G and B rounded
+// down, and the alpha channel added to a JPEG is opaque.
+static const unsigned kDecodeThreads = 8;
+
+enum ImageFormat { kImageUnknown, kImagePng, kImageJpeg };
+
+static ImageFormat SniffImageFormat(const char* data, size_t size) {
+  static const char kPngSignature[] = "\x89PNG\r\n\x1a\n";
+  if (size >= 8 && memcmp(data, kPngSignature, 8) == 0) return kImagePng;
+  if (size >= 2 && data[0] == '\xff' && data[1] == '\xd8') return kImageJpeg;
+  return kImageUnknown;
+}
+
+// Decodes the PNG or JPEG image in data to a uint8 tensor of shape [height,
+// width, channels], where channels is 1 (L), 3 (RGB) or 4 (RGBA). Can be
+// called from any thread. Returns NULL and sets tf_status on failure.
+static TF_Tensor* DecodeImage(TFE_Context* tf_context,
+                              const char* data,
+                              size_t size,
+                              int channels,
+                              TF_Status* tf_status) {
+  ImageFormat format = SniffImageFormat(data, size);
+  if (format == kImageUnknown) {
+    TF_SetStatus(
+        tf_status, TF_INVALID_ARGUMENT, "Not a valid PNG/JPEG image");
+    return NULL;
+  }
+  // DecodeJpeg has no alpha channel, and L is converted below.
+  int decode_channels = channels == 4 && format == kImagePng ? 4 : 3;
+
+  // A scalar string tensor is an offset followed by the encoded string.
+  size_t encoded_size = TF_StringEncodedSize(size);
+  TF_Tensor* contents =
+      TF_AllocateTensor(TF_STRING, NULL, 0, 8 + encoded_size);
+  auto contents_data = static_cast<char*>(TF_TensorData(contents));
+  memset(contents_data, 0, 8);
+  TF_StringEncode(data, size, contents_data + 8, encoded_size, tf_status);
+  TFE_TensorHandle* contents_h = NULL;
+  if (TF_GetCode(tf_status) == TF_OK) {
+    contents_h = TFE_NewTensorHandle(contents, tf_status);
+  }
+  TF_DeleteTensor(contents);
+  if (TF_GetCode(tf_status) != TF_OK) return NULL;
+
+  TFE_TensorHandle* image_h = NULL;
+  TFE_Op* op = TFE_NewOp(tf_context,
+                         format == kImagePng ? "DecodePng" : "DecodeJpeg",
+                         tf_status);
+  if (TF_GetCode(tf_status) == TF_OK) {
+    TFE_OpSetAttrInt(op, "channels", decode_channels);
+    TFE_OpAddInput(op, contents_h, tf_status);
+    int num_retvals = 1;
+    if (TF_GetCode(tf_status) == TF_OK) {
+      TFE_Execute(op, &image_h, &num_retvals, tf_status);
+    }
+    TFE_DeleteOp(op);
+  }
+  TFE_DeleteTensorHandle(contents_h);
+  if (TF_GetCode(tf_status) != TF_OK) return NULL;
+  TF_Tensor* image = TFE_TensorHandleResolve(image_h, tf_status);
+  TFE_DeleteTensorHandle(image_h);
+  if (TF_GetCode(tf_status) != TF_OK) return NULL;
+  if (channels == decode_channels) return image;
+
+  int64_t dims[] = {TF_Dim(image, 0), TF_Dim(image, 1), channels};
+  int64_t num_pixels = dims[0] * dims[1];
+  TF_Tensor* out =
+      TF_AllocateTensor(TF_UINT8, dims, 3, num_pixels * channels);
+  auto src = static_cast<const uint8_t*>(TF_TensorData(image));
+  auto dst = static_cast<uint8_t*>(TF_TensorData(out));
+  if (channels == 1) {
+    for (int64_t i = 0; i < num_pixels; i++, src += 3) {
+      dst[i] = (src[0] + src[1] + src[2]) / 3;
+    }
+  } else {
+    for (int64_t i = 0; i < num_pixels; i++, src += 3, dst += 4) {
+      dst[0] = src[0];
+      dst[1] = src[1];
+      dst[2] = src[2];
+      dst[3] = 255;
+    }
+  }
+  TF_DeleteTensor(image);
+  return out;
+}
+
+class DecodeImagesTask : public AsyncTask {
+ public:
+  // An image to decode, either the file at path or the bytes at data.
+  struct Source {
+    std::string path;
+    const char* data;
+    size_t size;
+  };
+
+  DecodeImagesTask(napi_env env,
+                   napi_value context_js,
+                   napi_value sources_js,
+                   TFE_Context* tf_context,
+                   const std::vector<Source>& sources,
+                   int channels)
+      : context_ref_(env, context_js),
+        sources_ref_(env, sources_js),
+        tf_context_(tf_context),
+        sources_(sources),
+        channels_(channels),
+        images_(sources.size(), NULL) {}
+
+  void Run() {
+    std::atomic<size_t> next(0);
+    std::mutex error_mutex;
+    std::string error;
+    auto work = [&] {
+      TF_Status* tf_status = TF_NewStatus();
+      for (size_t i = next++; i < sources_.size(); i = next++) {
+        const Source& source = sources_[i];
+        const char* message = NULL;
+        if (source.path.empty()) {
+          images_[i] = DecodeImage(
+              tf_context_, source.data, source.size, channels_, tf_status);
+        } else {
+          FileView view;
+          if (OpenFileView(source.path.c_str(), &view)) {
+            images_[i] = DecodeImage(
+                tf_context_, view.data, view.size, channels_, tf_status);
+            CloseFileView(view);
+          } else {
+            message = strerror(errno);
+          }
+        }
+        if (images_[i] == NULL) {
+          if (message == NULL) message = TF_Message(tf_status);
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if (error.empty()) {
+            error = message;
+            if (!source.path.empty()) error = source.path + ": " + error;
+          }
+        }
+        TF_SetStatus(tf_status, TF_OK, "");
+      }
+      TF_DeleteStatus(tf_status);
+    };
+    unsigned num_threads = std::min<unsigned>(
+        std::max(1u, std::thread::hardware_concurrency()), kDecodeThreads);
+    num_threads = std::min<size_t>(num_threads, sources_.size());
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < num_threads; i++) threads.emplace_back(work);
+    work();
+    for (std::thread& t : threads) t.join();
+    if (!error.empty()) {
+      TF_SetStatus(tf_status_, TF_INVALID_ARGUMENT, error.c_str());
+    }
+  }
+
+  napi_value Result(napi_env env) {
+    napi_value out;
+    auto nstatus = napi_create_array_with_length(env, images_.size(), &out);
+    check(nstatus == napi_ok);
+    TF_Status* tf_status = MainStatus();
+    for (size_t i = 0; i < images_.size(); i++) {
+      TFE_TensorHandle* h = TFE_NewTensorHandle(images_[i], tf_status);
+      check(TF_GetCode(tf_status) == TF_OK);
+      RegisterHandle(env, h, "decodeImages");
+      // The handle owns the tensor from here on.
+      nstatus = napi_set_element(env, out, i, WrapHandle(env, h, images_[i]));
+      check(nstatus == napi_ok);
+      images_[i] = NULL;
+    }
+    return out;
+  }
 
-  if (strcmp(device, "CPU:0") == 0) {
-    TF_DeleteStatus(tf_status);
-    return WrapHandle(env, cpu_handle);
-  } else {
-    auto gpu_handle = TFE_TensorHandleCopyToDevice(
-        cpu_handle, context_wrap->tf_context, device, tf_status);
-    check(TF_GetCode(tf_status) == TF_OK);
-    UnregisterHandle(env, cpu_handle);
-    TFE_DeleteTensorHandle(cpu_handle);
-    TF_DeleteTensor(tensor);
-    TF_DeleteStatus(tf_status);
-    return WrapHandle(env, gpu_handle);
+  void Cleanup(napi_env env) {
+    for (TF_Tensor* t : images_) {
+      if (t != NULL) TF_DeleteTensor(t);
+    }
   }
-}
 
-static napi_value ListDevices(napi_env env, napi_callback_info info) {
-  napi_status nstatus;
+ private:
+  JSRef context_ref_;
+  JSRef sources_ref_;
+  TFE_Context* tf_context_;
+  std::vector<Source> sources_;
+  int channels_;
+  std::vector<TF_Tensor*> images_;
+};
 
-  // Get ContextWrap from args[0].
-  size_t argc = 1;
-  napi_value args[1];
-  nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+// decodeImages(ctx, sources, channels) decodes PNG and JPEG images on worker
+// threads, and returns a promise of a uint8 handle of shape [height, width,
+// channels] for each. A source is a file name, or an ArrayBuffer or
+// Uint8Array holding the encoded image. channels is 1 (L), 3 (RGB) or 4
+// (RGBA).
+static napi_value DecodeImages(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value args[3];
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
   check(nstatus == napi_ok);
-  check(argc == 1);
+  check(argc == 3);
   ContextWrap* context_wrap;
   nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&context_wrap));
   check(nstatus == napi_ok);
+  int32_t channels = GetInt32Value(env, args[2]);
+  if (channels != 1 && channels != 3 && channels != 4) {
+    napi_throw_range_error(env, "EINVAL", "Expected 1, 3 or 4 channels");
+    return NULL;
+  }
 
-  // Get the device_list.
-  TF_Status* tf_status = TF_NewStatus();
-  auto device_list =
-      TFE_ContextListDevices(context_wrap->tf_context, tf_status);
-  check(TF_GetCode(tf_status) == TF_OK);
-
-  int device_count = TF_DeviceListCount(device_list);
-
-  napi_value out;
-  nstatus = napi_create_array_with_length(env, device_count, &out);
-  check(nstatus == napi_ok);
-
-  for (int i = 0; i < device_count; ++i) {
-    const char* device_name = TF_DeviceListName(device_list, i, tf_status);
-    check(TF_GetCode(tf_status) == TF_OK);
-    const char* device_type = TF_DeviceListType(device_list, i, tf_status);
-    check(TF_GetCode(tf_status) == TF_OK);
-    int64_t memory_bytes = TF_DeviceListMemoryBytes(device_list, i, tf_status);
-    check(TF_GetCode(tf_status) == TF_OK);
-
-    napi_value device_obj;
-    nstatus = napi_create_object(env, &device_obj);
-    check(nstatus == napi_ok);
-
-    napi_value name_js;
-    nstatus = napi_create_string_utf8(
-        env, device_name, strlen(device_name), &name_js);
-    check(nstatus == napi_ok);
-    nstatus = napi_set_named_property(env, device_obj, "name", name_js);
-    check(nstatus == napi_ok);
-
-    napi_value type_js;
-    nstatus = napi_create_string_utf8(
-        env, device_type, strlen(device_type), &type_js);
-    check(nstatus == napi_ok);
-    nstatus = napi_set_named_property(env, device_obj, "deviceType", type_js);
-    check(nstatus == napi_ok);
-
-    napi_value memory_js;
-    nstatus =
-        napi_create_double(env, static_cast<double>(memory_bytes), &memory_js);
+  uint32_t count = GetArrayLength(env, args[1]);
+  std::vector<DecodeImagesTask::Source> sources(count);
+  for (uint32_t i = 0; i < count; i++) {
+    napi_value source = GetElement(env, args[1], i);
+    DecodeImagesTask::Source& s = sources[i];
+    napi_valuetype type;
+    nstatus = napi_typeof(env, source, &type);
     check(nstatus == napi_ok);
-    nstatus =
-        napi_set_named_property(env, device_obj, "memoryBytes", memory_js);
+    bool is_arraybuffer, is_typed_array;
+    nstatus = napi_is_arraybuffer(env, source, &is_arraybuffer);
     check(nstatus == napi_ok);
-
-    nstatus = napi_set_element(env, out, (uint32_t) i, device_obj);
+    nstatus = napi_is_typedarray(env, source, &is_typed_array);
     check(nstatus == napi_ok);
+    void* data = NULL;
+    napi_typedarray_type typed_array_type = napi_uint8_array;
+    if (type == napi_string) {
+      s.path = GetString(env, source);
+    } else if (is_arraybuffer) {
+      nstatus = napi_get_arraybuffer_info(env, source, &data, &s.size);
+      check(nstatus == napi_ok);
+    } else if (is_typed_array) {
+      nstatus = napi_get_typedarray_info(
+          env, source, &typed_array_type, &s.size, &data, NULL, NULL);
+      check(nstatus == napi_ok);
+    }
+    if (s.path.empty() &&
+        (data == NULL || typed_array_type != napi_uint8_array)) {
+      napi_throw_type_error(
+          env, "EINVAL", "Expected a file name, ArrayBuffer or Uint8Array");
+      return NULL;
+    }
+    s.data = static_cast<const char*>(data);
   }
 
-  TF_DeleteStatus(tf_status);
-
-  return out;
+  TraceUnsupported("decodeImages()");
+  auto task = new DecodeImagesTask(
+      env, args[0], args[1], context_wrap->tf_context, sources, channels);
+  return task->Queue(env, "decodeImages");
 }
 
-napi_value Dispose(napi_env env, napi_callback_info info) {
-  auto handle_wrap = HandleFromFirstArg(env, info);
-  if (handle_wrap == NULL) return NULL;
+class CopyToDeviceTask : public AsyncTask {
+ public:
+  CopyToDeviceTask(napi_env env,
+                   napi_value context_js,
+                   TFE_Context* tf_context,
+                   napi_value handle_js,
+                   HandleWrap* handle_wrap,
+                   const char* device_name)
+      : context_ref_(env, context_js),
+        tf_context_(tf_context),
+        handle_(env, handle_js, handle_wrap),
+        device_name_(device_name),
+        new_handle_(NULL) {}
+
+  void Run() {
+    new_handle_ = TFE_TensorHandleCopyToDevice(handle_.tf_tensor_handle(),
+                                               tf_context_,
+                                               device_name_.c_str(),
+                                               tf_status_);
+  }
 
-  if (handle_wrap->tf_tensor_handle != NULL) {
-    UnregisterHandle(env, handle_wrap->tf_tensor_handle);
-    TFE_DeleteTensorHandle(handle_wrap->tf_tensor_handle);
-    handle_wrap->tf_tensor_handle = NULL;
+  napi_value Result(napi_env env) {
+    RegisterHandle(env, new_handle_, "copyToDevice");
+    return WrapHandle(env, new_handle_);
   }
 
-  if (handle_wrap->tf_tensor != NULL) {
-    TF_DeleteTensor(handle_wrap->tf_tensor);
-    handle_wrap->tf_tensor = NULL;
+  void Cleanup(napi_env env) {
+    handle_.Done(env);
   }
 
-  napi_value undefined;
-  auto nstatus = napi_get_undefined(env, &undefined);
-  check(nstatus == napi_ok);
-  return undefined;
-}
+ private:
+  JSRef context_ref_;
+  TFE_Context* tf_context_;
+  PendingHandle handle_;
+  std::string device_name_;
+  TFE_TensorHandle* new_handle_;
+};
 
-static napi_value CopyToDevice(napi_env env, napi_callback_info info) {
-  napi_status nstatus;
-  // Expect exactly three arguments.
+// Like copyToDevice(), but copies on a worker thread.
+// args[0] ctx: Context
+// args[1] handle: Handle
+// args[2] device: string
+static napi_value CopyToDeviceAsync(napi_env env, napi_callback_info info) {
   size_t argc = 3;
   napi_value args[3];
-  nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
+  auto nstatus = napi_get_cb_info(env, info, &argc, args, NULL, NULL);
   check(nstatus == napi_ok);
   check(argc == 3);
-  // Get ContextWrap from args[0].
   ContextWrap* context_wrap;
   nstatus = napi_unwrap(env, args[0], reinterpret_cast<void**>(&context_wrap));
   check(nstatus == napi_ok);
-  // Get HandleWrap from args[1].
   HandleWrap* handle_wrap;
   nstatus = napi_unwrap(env, args[1], reinterpret_cast<void**>(&handle_wrap));
-  check(nstatus == napi_ok);
-  // Get device name from args[2].
+  if (nstatus != napi_ok || handle_wrap->tf_tensor_handle == NULL) {
+    napi_throw_error(env, NULL, "Cannot unwrap binding.Handle");
+    return NULL;
+  }
   char device_name[BUFSIZE];
   nstatus =
       napi_get_value_string_utf8(env, args[2], device_name, BUFSIZE, NULL);
   check(nstatus == napi_ok);
 
-  auto tf_status = TF_NewStatus();
-  TFE_TensorHandle* new_handle =
-      TFE_TensorHandleCopyToDevice(handle_wrap->tf_tensor_handle,
+  auto task = new CopyToDeviceTask(env,
+                                   args[0],
                                    context_wrap->tf_context,
-                                   device_name,
-                                   tf_status);
-  if (TF_GetCode(tf_status) != TF_OK) {
-    napi_throw_error(env, NULL, TF_Message(tf_status));
-    TF_DeleteStatus(tf_status);
-    return NULL;
-  }
-
-  TF_DeleteStatus(tf_status);
-  return WrapHandle(env, new_handle);
-}
-
-static napi_value HandleGetShape(napi_env env, napi_callback_info info) {
-  napi_status nstatus;
-
-  auto handle_wrap = HandleFromFirstArg(env, info);
-  if (handle_wrap == NULL) return NULL;
-
-  auto th = handle_wrap->tf_tensor_handle;
-  int rank = TFE_TensorHandleNumDims(th);
-  napi_value shape;
-  nstatus = napi_create_array_with_length(env, rank, &shape);
-  check(nstatus == napi_ok);
-
-  for (int i = 0; i < rank; i++) {
-    auto dim = static_cast<int32_t>(TFE_TensorHandleDim(th, i));
-
-    napi_value dim_js;
-    nstatus = napi_create_int32(env, dim, &dim_js);
-    check(nstatus == napi_ok);
-
-    nstatus = napi_set_element(env, shape, (uint32_t) i, dim_js);
-    check(nstatus == napi_ok);
-  }
-
-  return shape;
+                                   args[1],
+                                   handle_wrap,
+                                   device_name);
+  TraceUnsupported("copyToDeviceAsync()");
+  return task->Queue(env, "copyToDeviceAsync");
 }
 
 void AssignIntProperty(napi_env env,
@@ -1073,11 +5838,6 @@ static napi_value InitBinding(napi_env env, napi_value exports) {
       &handle_class);    // Out: js value representing the class
   check(nstatus == napi_ok);
 
-  // handle_class is used Execute() to instanciate resulting Handles. Thus
-  // create a reference.
-  nstatus = napi_create_reference(env, handle_class, 1, &handle_class_ref);
-  check(nstatus == napi_ok);
-
   napi_value tensorflowVersion;
   nstatus =
       napi_create_string_latin1(env, TF_Version(), -1, &tensorflowVersion);
@@ -1087,6 +5847,31 @@ static napi_value InitBinding(napi_env env, napi_value exports) {
   napi_property_descriptor exports_properties[] = {
       {"Context", NULL, NULL, NULL, NULL, context_class, napi_default, NULL},
       {"execute", NULL, Execute, NULL, NULL, NULL, napi_default, NULL},
+      {"prepareOp", NULL, PrepareOp, NULL, NULL, NULL, napi_default, NULL},
+      {"executeBatch",
+       NULL,
+       ExecuteBatch,
+       NULL,
+       NULL,
+       NULL,
+       napi_default,
+       NULL},
+      {"executeAsync",
+       NULL,
+       ExecuteAsync,
+       NULL,
+       NULL,
+       NULL,
+       napi_default,
+       NULL},
+      {"executePrepared",
+       NULL,
+       ExecutePrepared,
+       NULL,
+       NULL,
+       NULL,
+       napi_default,
+       NULL},
       {"Handle", NULL, NULL, NULL, NULL, handle_class, napi_default, NULL},
       {"asArrayBuffer",
        NULL,
@@ -1096,6 +5881,82 @@ static napi_value InitBinding(napi_env env, napi_value exports) {
        NULL,
        napi_default,
        NULL},
+      {"asArrayBufferAsync",
+       NULL,
+       HandleAsArrayBufferAsync,
+       NULL,
+       NULL,
+       NULL,
+       napi_default,
+       NULL},
+      {"readInto", NULL, ReadInto, NULL, NULL, NULL, napi_default, NULL},
+      {"loadNpy", NULL, LoadNpy, NULL, NULL, NULL, napi_default, NULL},
+      {"saveCheckpoint",
+       NULL,
+       SaveCheckpoint,
+       NULL,
+       NULL,
+       NULL,
+       napi_default,
+       NULL},
+      {"saveCheckpointAsync",
+       NULL,
+       SaveCheckpointAsync,
+       NULL,
+       NULL,
+       NULL,
+       napi_default,
+       NULL},
+      {"decodeImages",
+       NULL,
+       DecodeImages,
+       NULL,
+       NULL,
+       NULL,
+       napi_default,
+       NULL},
+      {"newBatcher", NULL, NewBatcher, NULL, NULL, NULL, napi_default, NULL},
+      {"batcherNext", NULL, BatcherNext, NULL, NULL, NULL, napi_default, NULL},
+      {"batcherReset",
+       NULL,
+       BatcherReset,
+       NULL,
+       NULL,
+       NULL,
+       napi_default,
+       NULL},
+      {"batcherSetPrefetch",
+       NULL,
+       BatcherSetPrefetch,
+       NULL,
+       NULL,
+       NULL,
+       napi_default,
+       NULL},
+      {"openCheckpoint",
+       NULL,
+       OpenCheckpoint,
+       NULL,
+       NULL,
+       NULL,
+       napi_default,
+       NULL},
+      {"checkpointTensor",
+       NULL,
+       CheckpointTensor,
+       NULL,
+       NULL,
+       NULL,
+       napi_default,
+       NULL},
+      {"allocHostBuffer",
+       NULL,
+       AllocHostBufferJS,
+       NULL,
+       NULL,
+       NULL,
+       napi_default,
+       NULL},
       {"getDevice",
        NULL,
        HandleGetDevice,
@@ -1106,8 +5967,58 @@ static napi_value InitBinding(napi_env env, napi_value exports) {
        NULL},
       {"getDType", NULL, HandleGetDType, NULL, NULL, NULL, napi_default, NULL},
       {"getShape", NULL, HandleGetShape, NULL, NULL, NULL, napi_default, NULL},
+      {"getMeta", NULL, HandleGetMeta, NULL, NULL, NULL, napi_default, NULL},
+      {"deviceName", NULL, DeviceName, NULL, NULL, NULL, napi_default, NULL},
       {"listDevices", NULL, ListDevices, NULL, NULL, NULL, napi_default, NULL},
+      {"importBuffer",
+       NULL,
+       ImportBuffer,
+       NULL,
+       NULL,
+       NULL,
+       napi_default,
+       NULL},
       {"dispose", NULL, Dispose, NULL, NULL, NULL, napi_default, NULL},
+      {"newVariable", NULL, NewVariable, NULL, NULL, NULL, napi_default, NULL},
+      {"beginTrace", NULL, BeginTrace, NULL, NULL, NULL, napi_default, NULL},
+      {"endTrace", NULL, EndTrace, NULL, NULL, NULL, napi_default, NULL},
+      {"runGraph", NULL, RunGraph, NULL, NULL, NULL, napi_default, NULL},
+      {"internAttrName",
+       NULL,
+       InternAttrNameJS,
+       NULL,
+       NULL,
+       NULL,
+       napi_default,
+       NULL},
+      {"beginScope", NULL, BeginScope, NULL, NULL, NULL, napi_default, NULL},
+      {"endScope", NULL, EndScope, NULL, NULL, NULL, napi_default, NULL},
+      {"memoryStats", NULL, MemoryStats, NULL, NULL, NULL, napi_default, NULL},
+      {"setLeakTracking",
+       NULL,
+       SetLeakTracking,
+       NULL,
+       NULL,
+       NULL,
+       napi_default,
+       NULL},
+      {"liveHandles", NULL, LiveHandles, NULL, NULL, NULL, napi_default, NULL},
+      {"setProfiling",
+       NULL,
+       SetProfiling,
+       NULL,
+       NULL,
+       NULL,
+       napi_default,
+       NULL},
+      {"profileEvents",
+       NULL,
+       ProfileEvents,
+       NULL,
+       NULL,
+       NULL,
+       napi_default,
+       NULL},
       {"createSmallHandle",
        NULL,
        CreateSmallHandle,
@@ -1124,6 +6035,14 @@ static napi_value InitBinding(napi_env env, napi_value exports) {
        NULL,
        napi_default,
        NULL},
+      {"copyToDeviceAsync",
+       NULL,
+       CopyToDeviceAsync,
+       NULL,
+       NULL,
+       NULL,
+       napi_default,
+       NULL},
       {"tensorflowVersion",
        NULL,
        NULL,
@@ -1176,6 +6095,11 @@ static napi_value InitBinding(napi_env env, napi_value exports) {
   EXPORT_ENUM(ATTR_BOOL_LIST);
   EXPORT_ENUM(ATTR_TYPE_LIST);
   EXPORT_ENUM(ATTR_SHAPE_LIST);
+  // TFE_ContextDevicePlacementPolicy
+  EXPORT_ENUM(TFE_DEVICE_PLACEMENT_EXPLICIT);
+  EXPORT_ENUM(TFE_DEVICE_PLACEMENT_WARN);
+  EXPORT_ENUM(TFE_DEVICE_PLACEMENT_SILENT);
+  EXPORT_ENUM(TFE_DEVICE_PLACEMENT_SILENT_FOR_INT32);
 #undef EXPORT_ENUM
 
   return exports;
@@ -14,20 +14,129 @@
  */
 import * as types from "./types";
 
+export interface ContextOpts {
+  // A serialized tensorflow.ConfigProto.
+  config?: Uint8Array;
+  intraOpParallelism?: number;
+  interOpParallelism?: number;
+  async?: boolean;
+  // One of the TFE_DEVICE_PLACEMENT_* values.
+  devicePlacementPolicy?: number;
+}
+
 declare class Context {
-  constructor();
+  constructor(opts?: ContextOpts);
 }
 
 export type DTypeCode = number;
 export type AttrType = number;
 
+// Handles returned by the binding are wrapped natively without running the
+// constructor, so they aren't instances of this class.
 declare class Handle {
   constructor(ta: types.TypedArray, shape: types.Shape, dtype: DTypeCode);
 }
 
+// An op with its attributes already parsed, created by prepareOp().
+declare class Op {
+  private constructor();
+}
+
+// A native input pipeline stage, created by newBatcher().
+declare class Batcher {
+  private constructor();
+}
+
+// Ops recorded by a trace, created by endTrace().
+declare class Graph {
+  private constructor();
+}
+
+// A list of prepared ops for executeBatch(). See ExecuteBatch in
+// tf_binding.cc for the encoding of code.
+interface Program {
+  ops: Op[];
+  inputs: Handle[];
+  code: Int32Array;
+  outputs: Int32Array;
+}
+
+// [name or interned id, ATTR_* type, value]. An ATTR_SHAPE value is an
+// array of dims, where -1 is an unknown dim, or null if the rank is unknown.
+// An ATTR_FUNCTION value is the name of a function known to the context.
 // TODO this could be improved:
 export type AttrDef = Array<string | number | boolean>;
 
+interface DeviceMemoryStats {
+  liveHandles: number;
+  liveBytes: number;
+  peakBytes: number;
+  allocs: number;
+  frees: number;
+  // Averaged over the time since the previous memoryStats() call.
+  allocsPerSec: number;
+  freesPerSec: number;
+}
+
+// A mapped packed checkpoint, see openCheckpoint().
+export interface CheckpointFile {
+  readonly entries: Array<{
+    name: string;
+    dtype: DTypeCode;
+    shape: types.Shape;
+    byteLength: number;
+  }>;
+}
+
+// Buffers from allocHostBuffer(). Released buffers are pooled for reuse.
+interface HostBufferStats {
+  allocs: number;
+  // Allocations served from the pool.
+  reuses: number;
+  liveBytes: number;
+  pooledBytes: number;
+}
+
+interface MemoryStats {
+  externalMemory: number;
+  // Data passed to the binding to be used without copying, which TensorFlow
+  // copied because it wasn't 64 byte aligned. See importBuffer().
+  unalignedCopies: number;
+  unalignedCopyBytes: number;
+  devices: { [device: string]: DeviceMemoryStats };
+  hostBuffers: HostBufferStats;
+}
+
+interface LiveHandle {
+  device: string;
+  bytes: number;
+  op: string;
+  stack: string;
+}
+
+// Captured when the handle is created, so it is cheap to get and stays
+// valid after dispose().
+interface HandleMeta {
+  dtype: DTypeCode;
+  // Pass to deviceName() for the device name.
+  device: number;
+  shape: types.Shape;
+}
+
+// Times are in microseconds. tfStart to tfEnd is the time spent in
+// TensorFlow, the rest of start to end is marshalling.
+export interface ProfileEvent {
+  category: "execute" | "read" | "copy" | "handle";
+  name: string;
+  // Dtype and shape of each input, like "float32[2,3] int32[]".
+  inputs: string;
+  device: string;
+  start: number;
+  tfStart: number;
+  tfEnd: number;
+  end: number;
+}
+
 interface DeviceDesc {
   name: string;
   deviceType: types.DeviceType;
@@ -39,16 +148,106 @@ export interface BindingInterface {
   Context: typeof Context;
 
   asArrayBuffer(h: Handle): ArrayBuffer;
+  asArrayBufferAsync(h: Handle): Promise<ArrayBuffer>;
+  // Copies length elements of h, starting at element offset, to the start
+  // of target, which must be a TypedArray of the dtype of h. No ArrayBuffer
+  // is allocated. offset defaults to 0 and length to the rest of h. Returns
+  // the number of elements copied.
+  readInto(h: Handle, target: types.TypedArray, offset?: number,
+           length?: number): number;
+  // Returns a zeroed ArrayBuffer backed by native memory which is aligned
+  // so that TensorFlow can use it without copying. Handles created from it
+  // share its memory.
+  allocHostBuffer(byteLength: number): ArrayBuffer;
+  // Reads a npy file. The data is mapped rather than read, and used without
+  // copying if its dtype is float32, int32, uint8 or bool and it is 64 byte
+  // aligned in the file, as numpy 1.14 and later write it. Otherwise it's
+  // copied, see MemoryStats. float64 and int64 are converted to float32 and
+  // int32.
+  loadNpy(ctx: Context, path: string): Handle;
+  // Decodes PNG and JPEG images in parallel on worker threads, to uint8
+  // handles of shape [height, width, channels]. A source is a file name or
+  // the encoded image. channels is 1, 3 or 4.
+  decodeImages(ctx: Context,
+               sources: Array<string | ArrayBuffer | Uint8Array>,
+               channels: number): Promise<Handle[]>;
+  // Packed checkpoints hold many tensors in one file. saveCheckpoint()
+  // writes the data of the handles straight to the file, and returns its
+  // size. checkpointTensor() returns a handle of the tensor at index of the
+  // entries, which uses the mapped file. If verify is true, its checksum is
+  // checked first. saveCheckpointAsync() snapshots the handles when called
+  // and writes the file on a worker thread.
+  saveCheckpoint(path: string, names: string[], handles: Handle[]): number;
+  saveCheckpointAsync(path: string, names: string[],
+                      handles: Handle[]): Promise<number>;
+  openCheckpoint(path: string): CheckpointFile;
+  checkpointTensor(file: CheckpointFile, index: number,
+                   verify: boolean): Handle;
+  // A batcher assembles batches of the rows of handles on background
+  // threads, each into one new handle per source. A shuffleSize above 1
+  // draws the rows from a shuffle buffer of that many rows. batcherNext()
+  // resolves to null at the end of the epoch, and batcherReset() starts
+  // the next one. prefetch is the number of batches assembled ahead, and
+  // can be changed with batcherSetPrefetch().
+  newBatcher(handles: Handle[], batchSize: number, shuffleSize: number,
+             seed: number, prefetch: number): Batcher;
+  batcherNext(batcher: Batcher): Promise<Handle[] | null>;
+  batcherReset(batcher: Batcher): void;
+  batcherSetPrefetch(batcher: Batcher, prefetch: number): void;
   getDType(h: Handle): DTypeCode;
   getShape(h: Handle): types.Shape;
   getDevice(h: Handle): string;
+  getMeta(h: Handle): HandleMeta;
+  deviceName(id: number): string;
   listDevices(ctx: Context): DeviceDesc[];
+  // Wraps a region of memory, without copying if it is 64 byte aligned.
+  // Unaligned regions are copied and counted in MemoryStats. See
+  // ImportBuffer.
+  importBuffer(source: ArrayBuffer | ArrayBufferView, byteOffset: number,
+               byteLength: number, dtype: DTypeCode,
+               shape: types.Shape): Handle;
+  // Small constants are cached, so the result may be shared; dispose() has
+  // no effect on it.
   createSmallHandle(ctx: Context, dtype: DTypeCode, device: string,
-                    data: number | number[]): Handle;
+                    data: number | number[] | Float32Array | Int32Array):
+                    Handle;
   copyToDevice(ctx: Context, h: Handle, device: string): Handle;
+  copyToDeviceAsync(ctx: Context, h: Handle, device: string): Promise<Handle>;
+  // numOutputs is required for ops with 16 or more outputs, which throw a
+  // RangeError without it.
   execute(ctx: Context, op: string, attrs: AttrDef[],
-          inputs: Handle[]): Handle[];
+          inputs: Handle[], numOutputs?: number): Handle[];
+  executeAsync(ctx: Context, op: string, attrs: AttrDef[],
+               inputs: Handle[], numOutputs?: number): Promise<Handle[]>;
+  prepareOp(ctx: Context, op: string, attrs: AttrDef[]): Op;
+  // Returns an id that can be used in place of the attribute name in an
+  // AttrDef.
+  internAttrName(name: string): number;
+  executePrepared(op: Op, inputs: Handle[], numOutputs?: number): Handle[];
+  executeBatch(ctx: Context, program: Program): Handle[];
   dispose(h: Handle): void;
+  // Creates a resource variable holding a copy of init, on its device. The
+  // result is a TF_RESOURCE handle, which asArrayBuffer() rejects; ops like
+  // ReadVariableOp and ResourceApplyAdam take it as input. It belongs to no
+  // scope, and releasing it destroys the variable.
+  newVariable(ctx: Context, init: Handle): Handle;
+  // Handles created until the matching endScope() are disposed by it,
+  // except the kept ones. Scopes nest.
+  beginScope(): void;
+  endScope(keep: Handle[]): void;
+  // Ops executed until endTrace() are also added to a graph, in which the
+  // inputs are placeholders. See BeginTrace.
+  beginTrace(inputs: Handle[]): void;
+  endTrace(outputs: Handle[] | null): Graph | null;
+  runGraph(graph: Graph, inputs: Handle[]): Handle[];
+  memoryStats(): MemoryStats;
+  // Handles are only recorded while leak tracking is enabled.
+  setLeakTracking(enabled: boolean): void;
+  liveHandles(): LiveHandle[];
+  // Records execute(), executePrepared(), asArrayBuffer(), copyToDevice()
+  // and new Handle() calls, keeping the last 65536.
+  setProfiling(enabled: boolean): void;
+  profileEvents(): ProfileEvent[];
 
   TF_FLOAT: DTypeCode;
   TF_DOUBLE: DTypeCode;
@@ -88,4 +287,9 @@ export interface BindingInterface {
   ATTR_BOOL_LIST: AttrType;
   ATTR_TYPE_LIST: AttrType;
   ATTR_SHAPE_LIST: AttrType;
+
+  TFE_DEVICE_PLACEMENT_EXPLICIT: number;
+  TFE_DEVICE_PLACEMENT_WARN: number;
+  TFE_DEVICE_PLACEMENT_SILENT: number;
+  TFE_DEVICE_PLACEMENT_SILENT_FOR_INT32: number;
 }
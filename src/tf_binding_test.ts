@@ -13,9 +13,11 @@
    limitations under the License.
  */
 import { test } from "../tools/tester";
-import { assert, assertAllEqual } from "./tensor_util";
+import { readPortable } from "./checkpoint";
+import * as profile from "./profile";
+import { assert, assertAllClose, assertAllEqual } from "./tensor_util";
 import * as tf from "./tf";
-import { assertEqual } from "./util";
+import { assertEqual, Buffer, randomString, tmpdir } from "./util";
 
 assert(tf.loadBinding());
 const binding = tf.binding;
@@ -88,6 +90,189 @@ test(async function binding_mul() {
   assertAllEqual(result, [4, 25]);
 });
 
+test(async function binding_prepareOp() {
+  const typedArray = new Float32Array([1, 2, 3, 4, 5, 6]);
+  const a = new binding.Handle(typedArray, [2, 3], binding.TF_FLOAT);
+  const b = new binding.Handle(typedArray, [3, 2], binding.TF_FLOAT);
+
+  const op = binding.prepareOp(ctx, "MatMul", [
+    ["transpose_a", binding.ATTR_BOOL, false],
+    ["transpose_b", binding.ATTR_BOOL, false],
+    ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+  ]);
+  // A prepared op can be executed more than once.
+  for (let i = 0; i < 3; i++) {
+    const r = binding.executePrepared(op, [a, b])[0];
+    assertAllEqual(binding.getShape(r), [2, 2]);
+    const result = Array.from(new Float32Array(binding.asArrayBuffer(r)));
+    assertAllEqual(result, [22, 28, 49, 64]);
+  }
+
+  let didThrow = false;
+  try {
+    binding.prepareOp(ctx, "NoSuchOp", []);
+  } catch (e) {
+    didThrow = true;
+  }
+  assert(didThrow);
+});
+
+test(async function binding_multipleOutputs() {
+  const t = new binding.Handle(new Float32Array([1, 2, 3, 4, 5, 6]), [3, 2],
+                               binding.TF_FLOAT);
+  const axis = binding.createSmallHandle(ctx, binding.TF_INT32, "CPU:0", 0);
+  const r = binding.execute(ctx, "Split", [
+    ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+    ["num_split", binding.ATTR_INT, 3],
+  ], [axis, t]);
+  assertEqual(r.length, 3);
+  for (let i = 0; i < 3; i++) {
+    assertAllEqual(binding.getShape(r[i]), [1, 2]);
+    const result = Array.from(new Float32Array(binding.asArrayBuffer(r[i])));
+    assertAllEqual(result, [2 * i + 1, 2 * i + 2]);
+  }
+
+  // More outputs than fit in the default retval buffer.
+  const n = 20;
+  const big = new binding.Handle(new Float32Array(n), [n], binding.TF_FLOAT);
+  const r2 = binding.execute(ctx, "Unpack", [
+    ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+    ["num", binding.ATTR_INT, n],
+    ["axis", binding.ATTR_INT, 0],
+  ], [big], n);
+  assertEqual(r2.length, n);
+  assertEqual(binding.getShape(r2[n - 1]).length, 0);
+
+  // Without the count, the outputs past 16 would be dropped, so it throws.
+  const [handles0] = liveMemory();
+  let didThrow = false;
+  try {
+    binding.execute(ctx, "Unpack", [
+      ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+      ["num", binding.ATTR_INT, n],
+      ["axis", binding.ATTR_INT, 0],
+    ], [big]);
+  } catch (e) {
+    didThrow = e instanceof RangeError;
+  }
+  assert(didThrow);
+  assertEqual(liveMemory()[0], handles0);
+
+  didThrow = false;
+  try {
+    binding.execute(ctx, "Unpack", [
+      ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+      ["num", binding.ATTR_INT, n],
+      ["axis", binding.ATTR_INT, 0],
+    ], [big], -1);
+  } catch (e) {
+    didThrow = e instanceof RangeError;
+  }
+  assert(didThrow);
+
+  const k = binding.createSmallHandle(ctx, binding.TF_INT32, "CPU:0", 2);
+  const x = new binding.Handle(new Float32Array([3, 1, 4, 1, 5]), [5],
+                               binding.TF_FLOAT);
+  const [values, indices] = binding.execute(ctx, "TopKV2", [
+    ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+    ["sorted", binding.ATTR_BOOL, true],
+  ], [x, k]);
+  assertAllEqual(Array.from(new Float32Array(binding.asArrayBuffer(values))),
+                 [5, 4]);
+  assertAllEqual(Array.from(new Int32Array(binding.asArrayBuffer(indices))),
+                 [4, 2]);
+});
+
+test(async function binding_executeBatch() {
+  const a = new binding.Handle(new Float32Array([-1, 2]), [2],
+                               binding.TF_FLOAT);
+  const b = new binding.Handle(new Float32Array([3, -4]), [2],
+                               binding.TF_FLOAT);
+  const tAttrs = [["T", binding.ATTR_TYPE, binding.TF_FLOAT]];
+  const add = binding.prepareOp(ctx, "Add", tAttrs);
+  const relu = binding.prepareOp(ctx, "Relu", tAttrs);
+  // Values: 0 = a, 1 = b, 2 = a + b, 3 = relu(2), 4 = 3 + b.
+  const code = new Int32Array([
+    0, 2, 0, 1, 1,
+    1, 1, 2, 1,
+    0, 2, 3, 1, 1,
+  ]);
+  const r = binding.executeBatch(ctx, {
+    ops: [add, relu],
+    inputs: [a, b],
+    code,
+    outputs: new Int32Array([3, 4]),
+  });
+  assertEqual(r.length, 2);
+  assertAllEqual(Array.from(new Float32Array(binding.asArrayBuffer(r[0]))),
+                 [2, 0]);
+  assertAllEqual(Array.from(new Float32Array(binding.asArrayBuffer(r[1]))),
+                 [5, -4]);
+
+  // Inputs cannot be returned, because the batch doesn't own them.
+  let didThrow = false;
+  try {
+    binding.executeBatch(ctx, {
+      ops: [add, relu],
+      inputs: [a, b],
+      code,
+      outputs: new Int32Array([0]),
+    });
+  } catch (e) {
+    didThrow = true;
+  }
+  assert(didThrow);
+
+  // Bad output counts throw rather than abort.
+  for (const numOutputs of [-1, 1 << 30]) {
+    didThrow = false;
+    try {
+      binding.executeBatch(ctx, {
+        ops: [add],
+        inputs: [a, b],
+        code: new Int32Array([0, 2, 0, 1, numOutputs]),
+        outputs: new Int32Array([2]),
+      });
+    } catch (e) {
+      didThrow = true;
+    }
+    assert(didThrow);
+  }
+});
+
+test(async function binding_executeAsync() {
+  const typedArray = new Float32Array([1, 2, 3, 4, 5, 6]);
+  const a = new binding.Handle(typedArray, [2, 3], binding.TF_FLOAT);
+  const b = new binding.Handle(typedArray, [3, 2], binding.TF_FLOAT);
+  const opAttrs = [
+    ["transpose_a", binding.ATTR_BOOL, false],
+    ["transpose_b", binding.ATTR_BOOL, false],
+    ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+  ];
+  const promise = binding.executeAsync(ctx, "MatMul", opAttrs, [a, b]);
+  // Inputs may be disposed while the op is in flight.
+  binding.dispose(a);
+  const [r] = await promise;
+  assertAllEqual(binding.getShape(r), [2, 2]);
+
+  const abPromise = binding.asArrayBufferAsync(r);
+  // Disposing a handle that is being resolved is deferred.
+  binding.dispose(r);
+  const result = Array.from(new Float32Array(await abPromise));
+  assertAllEqual(result, [22, 28, 49, 64]);
+
+  const c = await binding.copyToDeviceAsync(ctx, b, "CPU:0");
+  assertAllEqual(binding.getShape(c), [3, 2]);
+
+  let didThrow = false;
+  try {
+    await binding.executeAsync(ctx, "MatMul", opAttrs, [b, b]);
+  } catch (e) {
+    didThrow = true;
+  }
+  assert(didThrow);
+});
+
 test(async function binding_chaining() {
   // Do an Equal followed by ReduceAll.
   const a = new binding.Handle(new Float32Array([2, 5]), [2], binding.TF_FLOAT);
@@ -133,6 +318,91 @@ test(async function binding_boolean() {
   assertAllEqual(result, [0, 1, 0, 1]);
 });
 
+test(async function binding_contextOpts() {
+  const c = new binding.Context({
+    async: false,
+    devicePlacementPolicy: binding.TFE_DEVICE_PLACEMENT_SILENT,
+    interOpParallelism: 1,
+    intraOpParallelism: 2,
+  });
+  const a = new binding.Handle(new Float32Array([2, 5]), [2], binding.TF_FLOAT);
+  const opAttrs = [
+    ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+  ];
+  const r = binding.execute(c, "Mul", opAttrs, [a, a])[0];
+  const result = Array.from(new Float32Array(binding.asArrayBuffer(r)));
+  assertAllEqual(result, [4, 25]);
+
+  let didThrow = false;
+  try {
+    const bad = new binding.Context({ devicePlacementPolicy: 42 });
+    binding.listDevices(bad);
+  } catch (e) {
+    didThrow = true;
+  }
+  assert(didThrow);
+});
+
+test(async function binding_importBuffer() {
+  const buf = Buffer.alloc(64);
+  const view = new Float32Array(buf.buffer, buf.byteOffset, 16);
+  for (let i = 0; i < 16; i++) view[i] = i;
+
+  // Import elements 4..9 as a 2x3 matrix.
+  const h = binding.importBuffer(buf, 16, 24, binding.TF_FLOAT, [2, 3]);
+  assertAllEqual(binding.getShape(h), [2, 3]);
+  let result = Array.from(new Float32Array(binding.asArrayBuffer(h)));
+  assertAllEqual(result, [4, 5, 6, 7, 8, 9]);
+
+  // The tensor shares memory with the buffer.
+  view[4] = 42;
+  result = Array.from(new Float32Array(binding.asArrayBuffer(h)));
+  assertEqual(result[0], 42);
+
+  // Only 64 byte aligned data is shared, other data is copied.
+  const host = binding.allocHostBuffer(128);
+  let copies = binding.memoryStats().unalignedCopies;
+  binding.importBuffer(host, 64, 16, binding.TF_FLOAT, [4]);
+  assertEqual(binding.memoryStats().unalignedCopies, copies);
+  binding.importBuffer(host, 4, 16, binding.TF_FLOAT, [4]);
+  copies++;
+  assertEqual(binding.memoryStats().unalignedCopies, copies);
+
+  const dv = new DataView(buf.buffer, buf.byteOffset, 8);
+  const h2 = new binding.Handle(dv, [2], binding.TF_INT32);
+  assertAllEqual(binding.getShape(h2), [2]);
+
+  if (typeof SharedArrayBuffer !== "undefined") {
+    const sab = new SharedArrayBuffer(16);
+    new Int32Array(sab).set([1, 2, 3, 4]);
+    const h3 = binding.importBuffer(new Uint8Array(sab), 8, 8,
+                                    binding.TF_INT32, [2]);
+    result = Array.from(new Int32Array(binding.asArrayBuffer(h3)));
+    assertAllEqual(result, [3, 4]);
+  }
+
+  const badInputs = [
+    // Misaligned.
+    [buf, 2, 8, binding.TF_FLOAT, [2]],
+    // Out of bounds.
+    [buf, 32, 64, binding.TF_FLOAT, [16]],
+    // Too small for the shape.
+    [buf, 0, 8, binding.TF_FLOAT, [3]],
+    // A shape whose size overflows, and would wrap around to 0 bytes.
+    [buf, 0, 8, binding.TF_FLOAT, [2 ** 33, 2 ** 33]],
+    [buf, 0, 8, binding.TF_FLOAT, [-1]],
+  ];
+  for (const args of badInputs) {
+    let didThrow = false;
+    try {
+      binding.importBuffer(...args);
+    } catch (e) {
+      didThrow = true;
+    }
+    assert(didThrow);
+  }
+});
+
 test(async function binding_listDevices() {
   const devices = binding.listDevices(ctx);
   assert(devices.length >= 1);
@@ -214,6 +484,228 @@ test(async function binding_createSmallHandle() {
   }
 });
 
+function liveMemory(): [number, number] {
+  const devices = binding.memoryStats().devices;
+  let handles = 0;
+  let bytes = 0;
+  for (const name of Object.keys(devices)) {
+    handles += devices[name].liveHandles;
+    bytes += devices[name].liveBytes;
+  }
+  return [handles, bytes];
+}
+
+test(async function binding_memoryStats() {
+  const [handles0, bytes0] = liveMemory();
+  const a = new binding.Handle(new Float32Array([1, 2, 3, 4]), [2, 2],
+                               binding.TF_FLOAT);
+  assertAllEqual(liveMemory(), [handles0 + 1, bytes0 + 16]);
+
+  binding.setLeakTracking(true);
+  const opAttrs = [
+    ["transpose_a", binding.ATTR_BOOL, false],
+    ["transpose_b", binding.ATTR_BOOL, false],
+    ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+  ];
+  const [r] = binding.execute(ctx, "MatMul", opAttrs, [a, a]);
+  const live = binding.liveHandles();
+  binding.setLeakTracking(false);
+  assertEqual(live.length, 1);
+  assertEqual(live[0].op, "MatMul");
+  assertEqual(live[0].bytes, 16);
+  assert(live[0].stack.includes("binding_memoryStats"));
+  assertEqual(binding.liveHandles().length, 0);
+
+  binding.dispose(a);
+  binding.dispose(r);
+  assertAllEqual(liveMemory(), [handles0, bytes0]);
+
+  const stats = binding.memoryStats();
+  assert(stats.externalMemory >= 0);
+  for (const name of Object.keys(stats.devices)) {
+    const d = stats.devices[name];
+    assert(d.peakBytes >= d.liveBytes);
+    assertEqual(d.allocs - d.frees, d.liveHandles);
+  }
+});
+
+test(async function binding_scopes() {
+  const [handles0] = liveMemory();
+  const opAttrs = [
+    ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+  ];
+  binding.beginScope();
+  const a = new binding.Handle(new Float32Array([1, 2]), [2], binding.TF_FLOAT);
+  const [b] = binding.execute(ctx, "Neg", opAttrs, [a]);
+  binding.beginScope();
+  const [c] = binding.execute(ctx, "Neg", opAttrs, [b]);
+  const [d] = binding.execute(ctx, "Neg", opAttrs, [c]);
+  // c is released, d moves to the outer scope.
+  binding.endScope([d]);
+  assertEqual(liveMemory()[0], handles0 + 3);
+  const result = Array.from(new Float32Array(binding.asArrayBuffer(d)));
+  assertAllEqual(result, [1, 2]);
+  binding.endScope([b]);
+  // Only b survives both scopes.
+  assertEqual(liveMemory()[0], handles0 + 1);
+  binding.dispose(b);
+  assertEqual(liveMemory()[0], handles0);
+
+  let didThrow = false;
+  try {
+    binding.endScope([]);
+  } catch (e) {
+    didThrow = true;
+  }
+  assert(didThrow);
+
+  // Executing on handles released by a scope throws rather than crashes.
+  const neg = binding.prepareOp(ctx, "Neg", opAttrs);
+  const calls = [
+    () => binding.execute(ctx, "Neg", opAttrs, [c]),
+    () => binding.executePrepared(neg, [c]),
+    () => binding.executeBatch(ctx, {
+      ops: [neg],
+      inputs: [c],
+      code: new Int32Array([0, 1, 0, 1]),
+      outputs: new Int32Array([1]),
+    }),
+  ];
+  for (const call of calls) {
+    didThrow = false;
+    try {
+      call();
+    } catch (e) {
+      assert(e.message.includes("disposed"));
+      didThrow = true;
+    }
+    assert(didThrow);
+  }
+});
+
+test(async function binding_internAttrName() {
+  const id = binding.internAttrName("transpose_a");
+  assertEqual(binding.internAttrName("transpose_a"), id);
+  assert(binding.internAttrName("transpose_b") !== id);
+
+  const a = new binding.Handle(new Float32Array([1, 2, 3, 4]), [2, 2],
+                               binding.TF_FLOAT);
+  const [r] = binding.execute(ctx, "MatMul", [
+    [id, binding.ATTR_BOOL, true],
+    [binding.internAttrName("transpose_b"), binding.ATTR_BOOL, false],
+    [binding.internAttrName("T"), binding.ATTR_TYPE, binding.TF_FLOAT],
+  ], [a, a]);
+  let result = Array.from(new Float32Array(binding.asArrayBuffer(r)));
+  assertAllEqual(result, [10, 14, 14, 20]);
+
+  // Attribute names are not limited to a fixed list.
+  const axis = new binding.Handle(new Int32Array([0]), [], binding.TF_INT32);
+  const [c] = binding.execute(ctx, "Cumsum", [
+    ["exclusive", binding.ATTR_BOOL, true],
+    ["reverse", binding.ATTR_BOOL, false],
+    ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+    ["Tidx", binding.ATTR_TYPE, binding.TF_INT32],
+  ], [a, axis]);
+  result = Array.from(new Float32Array(binding.asArrayBuffer(c)));
+  assertAllEqual(result, [0, 0, 1, 2]);
+
+  // Unknown ids and names which are neither strings nor ids throw.
+  const badAttrs: any[] = [
+    [[9999, binding.ATTR_BOOL, true]],
+    [[{}, binding.ATTR_BOOL, true]],
+  ];
+  for (const attrs of badAttrs) {
+    const calls = [
+      () => binding.execute(ctx, "MatMul", attrs, [a, a]),
+      () => binding.executeAsync(ctx, "MatMul", attrs, [a, a]),
+      () => binding.prepareOp(ctx, "MatMul", attrs),
+    ];
+    for (const call of calls) {
+      let didThrow = false;
+      try {
+        call();
+      } catch (e) {
+        didThrow = e instanceof RangeError || e instanceof TypeError;
+      }
+      assert(didThrow);
+    }
+  }
+});
+
+function floatHandle(values: number[], shape: number[]) {
+  return new binding.Handle(new Float32Array(values), shape, binding.TF_FLOAT);
+}
+
+function values(h): number[] {
+  const ab = binding.asArrayBuffer(h);
+  switch (binding.getDType(h)) {
+    case binding.TF_FLOAT:
+      return Array.from(new Float32Array(ab));
+    case binding.TF_INT32:
+      return Array.from(new Int32Array(ab));
+  }
+  throw Error("Unexpected dtype");
+}
+
+test(async function binding_attrFloat() {
+  const x = floatHandle([1, 3], [1, 1, 2, 1]);
+  const scale = floatHandle([1], [1]);
+  const offset = floatHandle([0], [1]);
+  const empty = floatHandle([], [0]);
+  // The batch mean is 2 and the variance 1, so with an epsilon of 3 the
+  // result is (x - 2) / 2.
+  const r = binding.execute(ctx, "FusedBatchNorm", [
+    ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+    ["epsilon", binding.ATTR_FLOAT, 3],
+    ["data_format", binding.ATTR_STRING, "NHWC"],
+    ["is_training", binding.ATTR_BOOL, true],
+  ], [x, scale, offset, empty, empty]);
+  assertAllClose(values(r[0]), [-0.5, 0.5]);
+});
+
+test(async function binding_attrShape() {
+  const x = floatHandle([1, 2, 3], [3]);
+  for (const shape of [[3], [-1], null]) {
+    const [r] = binding.execute(ctx, "PlaceholderWithDefault", [
+      ["dtype", binding.ATTR_TYPE, binding.TF_FLOAT],
+      ["shape", binding.ATTR_SHAPE, shape],
+    ], [x]);
+    assertAllEqual(values(r), [1, 2, 3]);
+  }
+});
+
+test(async function binding_attrLists() {
+  const x = floatHandle([-5, 5, 50, 500], [4]);
+  const [b] = binding.execute(ctx, "Bucketize", [
+    ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+    ["boundaries", binding.ATTR_FLOAT_LIST, [0, 10, 100]],
+  ], [x]);
+  assertAllEqual(values(b), [0, 1, 2, 3]);
+
+  const r = binding.execute(ctx, "IdentityN", [
+    ["T", binding.ATTR_TYPE_LIST, [binding.TF_FLOAT, binding.TF_INT32]],
+  ], [x, b]);
+  assertEqual(r.length, 2);
+  assertAllEqual(values(r[0]), [-5, 5, 50, 500]);
+  assertAllEqual(values(r[1]), [0, 1, 2, 3]);
+});
+
+test(async function binding_attrFunction() {
+  // Unknown functions are reported as errors.
+  const x = floatHandle([1], [1]);
+  let didThrow = false;
+  try {
+    binding.execute(ctx, "SymbolicGradient", [
+      ["Tin", binding.ATTR_TYPE_LIST, [binding.TF_FLOAT]],
+      ["Tout", binding.ATTR_TYPE_LIST, [binding.TF_FLOAT]],
+      ["f", binding.ATTR_FUNCTION, "no_such_function"],
+    ], [x]);
+  } catch (e) {
+    didThrow = true;
+  }
+  assert(didThrow);
+});
+
 test(async function testDispose() {
   const a = new binding.Handle(new Float32Array([2, 5]), [2], binding.TF_FLOAT);
   binding.dispose(a);
@@ -226,3 +718,518 @@ test(async function testDispose() {
   }
   assert(didThrow);
 });
+
+test(async function binding_getMeta() {
+  const a = floatHandle([1, 2, 3, 4, 5, 6], [2, 3]);
+  const r = binding.execute(ctx, "Sum", [
+    ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+    ["Tidx", binding.ATTR_TYPE, binding.TF_INT32],
+    ["keep_dims", binding.ATTR_BOOL, true],
+  ], [a, new binding.Handle(new Int32Array([1]), [1], binding.TF_INT32)])[0];
+  for (const h of [a, r]) {
+    const meta = binding.getMeta(h);
+    assertEqual(meta.dtype, binding.getDType(h));
+    assertAllEqual(meta.shape, binding.getShape(h));
+    assertEqual(binding.deviceName(meta.device), binding.getDevice(h));
+  }
+  assertAllEqual(binding.getMeta(r).shape, [2, 1]);
+  // Handles on the same device share the id.
+  assertEqual(binding.getMeta(a).device, binding.getMeta(r).device);
+  // Metadata outlives the tensor.
+  binding.dispose(r);
+  assertAllEqual(binding.getMeta(r).shape, [2, 1]);
+});
+
+test(async function binding_handleReuse() {
+  // Results are recycled HandleWraps; their state must not leak between
+  // handles.
+  const x = floatHandle([1, 2], [2]);
+  binding.beginScope();
+  for (let i = 0; i < 100; i++) {
+    binding.execute(ctx, "Neg", [["T", binding.ATTR_TYPE, binding.TF_FLOAT]],
+                    [x]);
+  }
+  binding.endScope([]);
+  const r = binding.execute(ctx, "Add", [
+    ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+  ], [x, x])[0];
+  assertAllEqual(binding.getShape(r), [2]);
+  assertAllEqual(values(r), [2, 4]);
+
+  let didThrow = false;
+  try {
+    // tslint:disable-next-line:no-unused-expression
+    new (binding.Handle as any)();
+  } catch (e) {
+    didThrow = true;
+  }
+  assert(didThrow);
+});
+
+test(async function binding_smallHandleCache() {
+  const a = binding.createSmallHandle(ctx, binding.TF_INT32, "CPU:0", [0, 1]);
+  const b = binding.createSmallHandle(ctx, binding.TF_INT32, "CPU:0",
+                                      new Int32Array([0, 1]));
+  // Equal constants share a handle, which dispose() doesn't release.
+  assert(a === b);
+  binding.dispose(a);
+  assertAllEqual(values(b), [0, 1]);
+
+  const c = binding.createSmallHandle(ctx, binding.TF_FLOAT, "CPU:0", [0, 1]);
+  const scalar = binding.createSmallHandle(ctx, binding.TF_INT32, "CPU:0", 0);
+  const vector = binding.createSmallHandle(ctx, binding.TF_INT32, "CPU:0", [0]);
+  assert(a !== c && a !== scalar && scalar !== vector);
+  assertEqual(binding.getDType(c), binding.TF_FLOAT);
+  assertAllEqual(binding.getShape(scalar), []);
+  assertAllEqual(binding.getShape(vector), [1]);
+
+  // Larger constants aren't cached, but may still be TypedArrays.
+  const big = new Float32Array(100).fill(2);
+  const f = binding.createSmallHandle(ctx, binding.TF_FLOAT, "CPU:0", big);
+  assert(f !== binding.createSmallHandle(ctx, binding.TF_FLOAT, "CPU:0", big));
+  assertAllEqual(values(f), Array.from(big));
+
+  let didThrow = false;
+  try {
+    binding.createSmallHandle(ctx, binding.TF_INT32, "CPU:0", big);
+  } catch (e) {
+    didThrow = true;
+  }
+  assert(didThrow);
+});
+
+test(async function binding_scratchState() {
+  // Calls on a context share a status and attr buffers. A failed call must
+  // not affect the next one, and attrs must not carry over between ops.
+  const x = floatHandle([1, 2, 3, 4], [2, 2]);
+  const floatAttrs = [["T", binding.ATTR_TYPE, binding.TF_FLOAT]];
+  const failures = [
+    () => binding.execute(ctx, "NoSuchOp", floatAttrs, [x]),
+    () => binding.execute(ctx, "MatMul", floatAttrs, [x]),
+    () => binding.execute(ctx, "Reshape", [
+      ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+      ["Tshape", binding.ATTR_TYPE, binding.TF_INT32],
+    ], [x, new binding.Handle(new Int32Array([3]), [1], binding.TF_INT32)]),
+    () => binding.copyToDevice(ctx, x, "NoSuchDevice:0"),
+    () => new binding.Handle(new Float32Array(3), [2, 2], binding.TF_FLOAT),
+  ];
+  for (const fail of failures) {
+    let didThrow = false;
+    try {
+      fail();
+    } catch (e) {
+      didThrow = true;
+    }
+    assert(didThrow);
+    const r = binding.execute(ctx, "MatMul", [
+      ["transpose_a", binding.ATTR_BOOL, true],
+      ["transpose_b", binding.ATTR_BOOL, false],
+      ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+    ], [x, x])[0];
+    assertAllEqual(values(r), [10, 14, 14, 20]);
+    const neg = binding.execute(ctx, "Neg", floatAttrs, [x])[0];
+    assertAllEqual(values(neg), [-1, -2, -3, -4]);
+  }
+});
+
+test(async function binding_profile() {
+  const a = floatHandle([1, 2, 3, 4], [2, 2]);
+  const opAttrs = [
+    ["transpose_a", binding.ATTR_BOOL, false],
+    ["transpose_b", binding.ATTR_BOOL, false],
+    ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+  ];
+  profile.startProfiling();
+  for (let i = 0; i < 3; i++) {
+    const [r] = binding.execute(ctx, "MatMul", opAttrs, [a, a]);
+    binding.asArrayBuffer(r);
+  }
+  const events = profile.stopProfiling();
+  // Nothing is recorded after stopping.
+  binding.execute(ctx, "MatMul", opAttrs, [a, a]);
+  assertEqual(binding.profileEvents().length, 6);
+
+  assertEqual(events.length, 6);
+  const e = events[0];
+  assertEqual(e.category, "execute");
+  assertEqual(e.name, "MatMul");
+  assertEqual(e.inputs, "float32[2,2] float32[2,2]");
+  assertEqual(e.device, binding.getDevice(a));
+  assert(e.start <= e.tfStart && e.tfStart <= e.tfEnd && e.tfEnd <= e.end);
+  assertEqual(events[1].name, "asArrayBuffer");
+
+  const stats = profile.opStats(events);
+  assertEqual(stats.length, 2);
+  for (const s of stats) {
+    assertEqual(s.count, 3);
+    assert(s.p50 <= s.p99);
+    assertAllClose(s.tf + s.marshal, s.total);
+  }
+  assert(profile.formatOpStats(stats).includes("MatMul"));
+
+  const trace = profile.chromeTrace(events);
+  assertEqual(trace.traceEvents.length, 12);
+  assertEqual(trace.traceEvents[0].ph, "X");
+});
+
+test(async function binding_variables() {
+  const init = floatHandle([1, 2, 3, 4], [2, 2]);
+  const v = binding.newVariable(ctx, init);
+  assertEqual(binding.getDType(v), binding.TF_RESOURCE);
+  let didThrow = false;
+  try {
+    binding.asArrayBuffer(v);
+  } catch (e) {
+    didThrow = true;
+  }
+  assert(didThrow);
+
+  const dtypeAttrs = [["dtype", binding.ATTR_TYPE, binding.TF_FLOAT]];
+  const read = () => binding.execute(ctx, "ReadVariableOp", dtypeAttrs, [v])[0];
+  const before = read();
+  assertAllEqual(values(before), [1, 2, 3, 4]);
+
+  binding.execute(ctx, "AssignAddVariableOp", dtypeAttrs,
+                  [v, floatHandle([1, 1, 1, 1], [2, 2])]);
+  assertAllEqual(values(read()), [2, 3, 4, 5]);
+  // Values read before an update don't change.
+  assertAllEqual(values(before), [1, 2, 3, 4]);
+
+  binding.execute(ctx, "ResourceApplyGradientDescent", [
+    ["T", binding.ATTR_TYPE, binding.TF_FLOAT],
+    ["use_locking", binding.ATTR_BOOL, false],
+  ], [v, floatHandle([0.5], []), floatHandle([2, 2, 2, 2], [2, 2])]);
+  assertAllEqual(values(read()), [1, 2, 3, 4]);
+
+  binding.execute(ctx, "AssignVariableOp", dtypeAttrs,
+                  [v, floatHandle([0, 0, 0, 0], [2, 2])]);
+  assertAllEqual(values(read()), [0, 0, 0, 0]);
+
+  // Variables don't share state.
+  const w = binding.newVariable(ctx, init);
+  assertAllEqual(
+    values(binding.execute(ctx, "ReadVariableOp", dtypeAttrs, [w])[0]),
+    [1, 2, 3, 4]);
+  binding.dispose(v);
+  binding.dispose(w);
+});
+
+test(async function binding_readInto() {
+  const h = floatHandle([1, 2, 3, 4, 5, 6], [2, 3]);
+  const target = new Float32Array(6);
+  assertEqual(binding.readInto(h, target), 6);
+  assertAllEqual(Array.from(target), [1, 2, 3, 4, 5, 6]);
+
+  // A slice, written to the start of the target.
+  target.fill(0);
+  assertEqual(binding.readInto(h, target, 2, 3), 3);
+  assertAllEqual(Array.from(target), [3, 4, 5, 0, 0, 0]);
+  // The rest of the tensor, written at an offset of the target.
+  assertEqual(binding.readInto(h, target.subarray(4), 4), 2);
+  assertAllEqual(Array.from(target), [3, 4, 5, 0, 5, 6]);
+  assertEqual(binding.readInto(h, target, 6, 0), 0);
+
+  const i = new binding.Handle(new Int32Array([7, 8]), [2], binding.TF_INT32);
+  const ints = new Int32Array(2);
+  binding.readInto(i, ints);
+  assertAllEqual(Array.from(ints), [7, 8]);
+
+  const failures = [
+    () => binding.readInto(h, new Int32Array(6)),
+    () => binding.readInto(h, new Float32Array(5)),
+    () => binding.readInto(h, target, 5, 2),
+    () => binding.readInto(h, target, -1),
+    () => binding.readInto(h, new ArrayBuffer(24) as any),
+  ];
+  for (const fail of failures) {
+    let didThrow = false;
+    try {
+      fail();
+    } catch (e) {
+      didThrow = true;
+    }
+    assert(didThrow);
+  }
+});
+
+test(async function binding_allocHostBuffer() {
+  const ab = binding.allocHostBuffer(16);
+  assertEqual(ab.byteLength, 16);
+  const data = new Float32Array(ab);
+  assertAllEqual(Array.from(data), [0, 0, 0, 0]);
+
+  // TensorFlow uses the buffer without copying it, so writes to the buffer
+  // show through. Handles must not be changed this way outside of tests.
+  const copies = binding.memoryStats().unalignedCopies;
+  data.set([1, 2, 3, 4]);
+  const h = new binding.Handle(data, [4], binding.TF_FLOAT);
+  assertEqual(binding.memoryStats().unalignedCopies, copies);
+  data[0] = 10;
+  assertAllEqual(values(h), [10, 2, 3, 4]);
+
+  // A buffer is recycled once it's garbage collected. Garbage from earlier
+  // tests is collected first, so that only the buffer allocated here is
+  // released below.
+  require("v8").setFlagsFromString("--expose-gc");
+  const gc = require("vm").runInNewContext("gc");
+  const collect = async() => {
+    gc();
+    // Finalizers run from the event loop after the collection.
+    await new Promise(resolve => setImmediate(resolve));
+  };
+  await collect();
+  await collect();
+  const size = 1 << 21;
+  const before = binding.memoryStats().hostBuffers;
+  binding.allocHostBuffer(size);
+  let stats = binding.memoryStats().hostBuffers;
+  assertEqual(stats.allocs, before.allocs + 1);
+  assertEqual(stats.liveBytes, before.liveBytes + size);
+  for (let i = 0; i < 100 && stats.liveBytes > before.liveBytes; i++) {
+    await collect();
+    stats = binding.memoryStats().hostBuffers;
+  }
+  assertEqual(stats.liveBytes, before.liveBytes);
+  assertEqual(stats.pooledBytes, before.pooledBytes + size);
+
+  const b = new Uint8Array(binding.allocHostBuffer(size));
+  const after = binding.memoryStats().hostBuffers;
+  assertEqual(after.reuses, before.reuses + 1);
+  assertEqual(after.allocs, before.allocs + 2);
+  assertEqual(after.liveBytes, before.liveBytes + size);
+  assertEqual(after.pooledBytes, before.pooledBytes);
+  // Recycled buffers are zeroed too.
+  assertEqual(b.reduce((a, x) => a + x, 0), 0);
+});
+
+// Returns the path of a file in a new directory in the temp directory, so
+// that concurrent test runs don't share files.
+function tempPath(name: string): string {
+  const path = require("path");
+  const dir = path.join(tmpdir(), randomString());
+  require("fs").mkdirSync(dir);
+  return path.join(dir, name);
+}
+
+// Writes a npy file to a new temp directory and returns its path.
+function writeNpy(name: string, descr: string, fortranOrder: boolean,
+                  shape: number[], data: ArrayBufferView): string {
+  const fs = require("fs");
+  const path = tempPath(name + ".npy");
+  const dims = shape.length === 1 ? `${shape[0]},` : shape.join(", ");
+  const fortran = fortranOrder ? "True" : "False";
+  let dict = `{'descr': '${descr}', 'fortran_order': ${fortran}, ` +
+             `'shape': (${dims}), }`;
+  // Pad the header, so that the data is aligned to 64 bytes.
+  while ((10 + dict.length + 1) % 64 !== 0) dict += " ";
+  const header = Buffer.alloc(10);
+  header.write("\x93NUMPY\x01\x00", 0, 8, "latin1");
+  header.writeUInt16LE(dict.length + 1, 8);
+  const bytes = Buffer.from(data.buffer, data.byteOffset, data.byteLength);
+  fs.writeFileSync(path, Buffer.concat([
+    header, Buffer.from(dict + "\n", "latin1"), bytes]));
+  return path;
+}
+
+test(async function binding_loadNpy() {
+  let h = binding.loadNpy(ctx, writeNpy("f4", "<f4", false, [2, 3],
+    new Float32Array([1, 2, 3, 4, 5, 6])));
+  assertEqual(binding.getDType(h), binding.TF_FLOAT);
+  assertAllEqual(binding.getShape(h), [2, 3]);
+  assertAllEqual(values(h), [1, 2, 3, 4, 5, 6]);
+
+  h = binding.loadNpy(ctx, writeNpy("f8", "<f8", false, [4],
+    new Float64Array([0.5, -1, 1e10, 3])));
+  assertEqual(binding.getDType(h), binding.TF_FLOAT);
+  assertAllEqual(values(h), [0.5, -1, 1e10, 3]);
+
+  h = binding.loadNpy(ctx, writeNpy("i8", "<i8", false, [3],
+    new Int32Array([7, 0, -2, -1, 1 << 30, 0])));
+  assertEqual(binding.getDType(h), binding.TF_INT32);
+  assertAllEqual(values(h), [7, -2, 1 << 30]);
+
+  // The columns of [[1, 2, 3], [4, 5, 6]].
+  h = binding.loadNpy(ctx, writeNpy("fortran", "<f8", true, [2, 3],
+    new Float64Array([1, 4, 2, 5, 3, 6])));
+  assertAllEqual(binding.getShape(h), [2, 3]);
+  assertAllEqual(values(h), [1, 2, 3, 4, 5, 6]);
+
+  h = binding.loadNpy(ctx, writeNpy("bool", "|b1", false, [2],
+    new Uint8Array([1, 0])));
+  assertEqual(binding.getDType(h), binding.TF_BOOL);
+  assertAllEqual(Array.from(new Uint8Array(binding.asArrayBuffer(h))),
+                 [1, 0]);
+
+  h = binding.loadNpy(ctx, writeNpy("scalar", "<i4", false, [],
+    new Int32Array([42])));
+  assertAllEqual(binding.getShape(h), []);
+  assertAllEqual(values(h), [42]);
+
+  const failures = [
+    () => binding.loadNpy(ctx, "/no/such/file.npy"),
+    () => binding.loadNpy(ctx, writeNpy("f2", "<f2", false, [1],
+                                        new Uint16Array([0]))),
+    () => binding.loadNpy(ctx, writeNpy("short", "<f4", false, [3],
+                                        new Float32Array([1, 2]))),
+    // The size of the shape overflows, which must not pass the size check.
+    () => binding.loadNpy(ctx, writeNpy("huge", "<f4", false,
+                                        [2 ** 40, 2 ** 40],
+                                        new Float32Array([1, 2]))),
+  ];
+  for (const fail of failures) {
+    let didThrow = false;
+    try {
+      fail();
+    } catch (e) {
+      didThrow = true;
+    }
+    assert(didThrow);
+  }
+});
+
+test(async function binding_checkpoint() {
+  const fs = require("fs");
+  const path = tempPath("test.ckpt");
+  const names = ["a", "dir/b", "empty", "scalar"];
+  const handles = [
+    floatHandle([1, 2, 3, 4, 5, 6], [2, 3]),
+    new binding.Handle(new Int32Array([-1, 7]), [2], binding.TF_INT32),
+    floatHandle([], [0, 4]),
+    floatHandle([42], []),
+  ];
+  const size = binding.saveCheckpoint(path, names, handles);
+  assertEqual(fs.statSync(path).size, size);
+  assertEqual(size % 64, 0);
+
+  const file = binding.openCheckpoint(path);
+  assertAllEqual(file.entries.map(e => e.name), names);
+  assertEqual(file.entries[1].dtype, binding.TF_INT32);
+  assertAllEqual(file.entries[0].shape, [2, 3]);
+  assertEqual(file.entries[0].byteLength, 24);
+  for (let i = 0; i < names.length; i++) {
+    const h = binding.checkpointTensor(file, i, true);
+    assertEqual(binding.getDType(h), binding.getDType(handles[i]));
+    assertAllEqual(binding.getShape(h), binding.getShape(handles[i]));
+    assertAllEqual(values(h), values(handles[i]));
+  }
+
+  // The portable reader, which other backends use, reads the same params.
+  const portable = readPortable(path);
+  for (let i = 0; i < names.length; i++) {
+    const t = portable.get(names[i]);
+    assertAllEqual(t.shape, binding.getShape(handles[i]));
+    assertAllEqual(Array.from(t.dataSync()), values(handles[i]));
+  }
+
+  // Corrupt the last byte of "a", which the checksum catches.
+  const data = fs.readFileSync(path);
+  const a = data.indexOf(Buffer.from(new Float32Array([6]).buffer));
+  assert(a > 0);
+  data[a + 3] ^= 1;
+  fs.writeFileSync(path, data);
+  const corrupt = binding.openCheckpoint(path);
+  let didThrow = false;
+  try {
+    binding.checkpointTensor(corrupt, 0, true);
+  } catch (e) {
+    didThrow = true;
+  }
+  assert(didThrow);
+  binding.checkpointTensor(corrupt, 0, false);
+  didThrow = false;
+  try {
+    readPortable(path);
+  } catch (e) {
+    didThrow = true;
+  }
+  assert(didThrow);
+
+  fs.writeFileSync(path, "not a checkpoint");
+  didThrow = false;
+  try {
+    binding.openCheckpoint(path);
+  } catch (e) {
+    didThrow = true;
+  }
+  assert(didThrow);
+});
+
+test(async function binding_saveCheckpointAsync() {
+  const fs = require("fs");
+  const path = tempPath("async.ckpt");
+  const a = floatHandle([1, 2, 3], [3]);
+  const b = floatHandle([4], []);
+  const promise = binding.saveCheckpointAsync(path, ["a", "b"], [a, b]);
+  // The handles are snapshotted, so they may be disposed straight away.
+  binding.dispose(a);
+  binding.dispose(b);
+  const size = await promise;
+  assertEqual(fs.statSync(path).size, size);
+  const file = binding.openCheckpoint(path);
+  assertAllEqual(values(binding.checkpointTensor(file, 0, true)), [1, 2, 3]);
+  assertAllEqual(values(binding.checkpointTensor(file, 1, true)), [4]);
+  // The temporary file was renamed.
+  const dir = require("path").dirname(path);
+  assert(!fs.readdirSync(dir).some(fn => fn.startsWith("async.ckpt.tmp")));
+
+  let didThrow = false;
+  try {
+    await binding.saveCheckpointAsync("/nonexistent/dir/x.ckpt", ["c"],
+                                      [floatHandle([1], [1])]);
+  } catch (e) {
+    didThrow = true;
+  }
+  assert(didThrow);
+});
+
+test(async function binding_batcher() {
+  const x = floatHandle([0, 1, 2, 3, 4, 5, 6, 7, 8, 9], [5, 2]);
+  const y = new binding.Handle(new Int32Array([10, 11, 12, 13, 14]), [5],
+                               binding.TF_INT32);
+  const b = binding.newBatcher([x, y], 2, 0, 0, 2);
+  // Batches are returned in the order they're asked for.
+  const batches = await Promise.all([
+    binding.batcherNext(b),
+    binding.batcherNext(b),
+    binding.batcherNext(b),
+    binding.batcherNext(b),
+  ]);
+  assertAllEqual(binding.getShape(batches[0][0]), [2, 2]);
+  assertAllEqual(values(batches[0][0]), [0, 1, 2, 3]);
+  assertAllEqual(values(batches[1][1]), [12, 13]);
+  assertAllEqual(binding.getShape(batches[2][0]), [1, 2]);
+  assertAllEqual(values(batches[2][1]), [14]);
+  assertEqual(batches[3], null);
+
+  binding.batcherReset(b);
+  assertAllEqual(values((await binding.batcherNext(b))[1]), [10, 11]);
+  // Prefetch can be changed while the epoch is read.
+  binding.batcherSetPrefetch(b, 3);
+  assertAllEqual(values((await binding.batcherNext(b))[1]), [12, 13]);
+
+  // Shuffled, each row is returned once per epoch.
+  const s = binding.newBatcher([y], 3, 5, 42, 1);
+  for (let epoch = 0; epoch < 2; epoch++) {
+    let rows = [];
+    let batch;
+    while ((batch = await binding.batcherNext(s)) !== null) {
+      rows = rows.concat(values(batch[0]));
+    }
+    assertAllEqual(rows.sort(), [10, 11, 12, 13, 14]);
+    binding.batcherReset(s);
+  }
+
+  const badCalls = [
+    () => binding.newBatcher([x, floatHandle([1], [1])], 2, 0, 0, 1),
+    () => binding.batcherSetPrefetch(b, 0),
+  ];
+  for (const call of badCalls) {
+    let didThrow = false;
+    try {
+      call();
+    } catch (e) {
+      didThrow = true;
+    }
+    assert(didThrow);
+  }
+});
@@ -0,0 +1,38 @@
+// Sweeps TF thread pool sizes over MatMul and Conv2D workloads. TF thread
+// pools are created once per process, so each setting runs in a child
+// process configured with PROPEL_INTRA_OP_THREADS and
+// PROPEL_INTER_OP_THREADS.
+import { spawnSync } from "child_process";
+import * as os from "os";
+import { conv2d, ones } from "./api";
+import { bench } from "./benchmark";
+
+const threadCounts = [1, 2, 4, 8, 16, 32, 64].filter(
+  (n) => n <= os.cpus().length);
+
+if (process.env.PROPEL_INTRA_OP_THREADS) {
+  const threads = `intra ${process.env.PROPEL_INTRA_OP_THREADS} ` +
+                  `inter ${process.env.PROPEL_INTER_OP_THREADS}`;
+  const a = ones([512, 512]);
+  const b = ones([512, 512]).add(1);
+  bench(`matmul 512x512 ${threads}`, () => a.matmul(b).dataSync());
+
+  const img = ones([16, 64, 64, 32]);
+  const filter = ones([3, 3, 32, 32]);
+  bench(`conv2d 16x64x64x32 ${threads}`, () => {
+    conv2d(img, filter, { padding: "same" }).dataSync();
+  });
+} else {
+  for (const intra of threadCounts) {
+    for (const inter of [1, 2]) {
+      const env = Object.assign({}, process.env, {
+        PROPEL: "tf",
+        PROPEL_INTER_OP_THREADS: String(inter),
+        PROPEL_INTRA_OP_THREADS: String(intra),
+      });
+      spawnSync(process.execPath,
+                ["./node_modules/ts-node/dist/bin.js", __filename],
+                { env, stdio: "inherit" });
+    }
+  }
+}
@@ -0,0 +1,75 @@
+/*!
+   Copyright 2018 Propel http://propel.site/.  All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import { bo } from "./backend";
+import { isRecording } from "./backprop";
+import { tensor, Tensor } from "./tensor";
+import * as types from "./types";
+
+export type TracedFn<T extends Tensor | Tensor[]> =
+  (...args: types.TensorLike[]) => T;
+
+// Set while a traced function runs for the first time. Traced functions
+// called by it are inlined into its trace.
+let tracing = false;
+
+/** Compiles a function from tensors to tensors. The first call for each
+ * combination of input shapes and dtypes runs fn as usual, while recording
+ * the ops it executes. Later calls run the recorded ops all at once, which
+ * lets the backend optimize them as a whole.
+ *
+ * fn must only depend on its arguments: any other tensor it uses is
+ * recorded with the value it had during the first call. While gradients
+ * are being recorded, and on the DL backend, fn is always called directly,
+ * because the recorded ops can't be differentiated.
+ *
+ *    import { trace } from "propel";
+ *    const f = trace((x, y) => x.mul(y).add(1));
+ *    f([1, 2], [3, 4]);
+ *    f([5, 6], [7, 8]);
+ */
+export function trace<T extends Tensor | Tensor[]>(
+    fn: (...args: Tensor[]) => T): TracedFn<T> {
+  const traces = new Map<string, any>();
+  let returnsArray: boolean;
+  return (...args: types.TensorLike[]): T => {
+    const inputs = args.map(a => tensor(a));
+    if (tracing || isRecording()) return fn(...inputs);
+
+    const storage = inputs.map(t => t.storage);
+    const key = inputs.map(t => t.dtype + JSON.stringify(t.shape)).join(" ");
+    const recorded = traces.get(key);
+    if (recorded !== undefined) {
+      const r = bo.runTrace(recorded, storage).map(s => new Tensor(s));
+      return (returnsArray ? r : r[0]) as T;
+    }
+
+    bo.beginTrace(storage);
+    tracing = true;
+    let result: T;
+    try {
+      result = fn(...inputs);
+    } catch (e) {
+      bo.endTrace(null);
+      throw e;
+    } finally {
+      tracing = false;
+    }
+    returnsArray = Array.isArray(result);
+    const outputs = (returnsArray ? result : [result]) as Tensor[];
+    const t = bo.endTrace(outputs.map(o => o.storage));
+    if (t != null) traces.set(key, t);
+    return result;
+  };
+}
@@ -0,0 +1,103 @@
+/*!
+   Copyright 2018 Propel http://propel.site/.  All rights reserved.
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+import { test } from "../tools/tester";
+import { concat, grad, tensor, Tensor, trace } from "./api";
+import { backend } from "./backend";
+import { assertAllClose, assertAllEqual } from "./tensor_util";
+import { assert, assertEqual } from "./util";
+
+test(async function trace_inputsArePlaceholders() {
+  let calls = 0;
+  const f = trace((x: Tensor, y: Tensor) => {
+    calls++;
+    return x.mul(y).add(1);
+  });
+  assertAllEqual(f([1, 2], [3, 4]), [4, 9]);
+  assertAllEqual(f([5, 6], [7, 8]), [36, 49]);
+  assertAllEqual(f(tensor([0, 1]), [2, 2]), [1, 3]);
+  // Only TF traces; elsewhere fn runs on every call.
+  assertEqual(calls, backend === "tf" ? 1 : 3);
+});
+
+test(async function trace_capturesOtherTensors() {
+  const w = tensor([[1, 2], [3, 4]]);
+  const f = trace((x: Tensor) => x.matmul(w).relu());
+  assertAllClose(f([[1, -1]]), [[0, 0]]);
+  assertAllClose(f([[1, 1]]), [[4, 6]]);
+  assertAllClose(f([[-1, 0]]), [[0, 0]]);
+});
+
+test(async function trace_multipleOutputs() {
+  const f = trace((x: Tensor, y: Tensor) => {
+    const sum = concat([x, y, x]).reduceSum();
+    return [sum, x.sub(y)];
+  });
+  for (let i = 0; i < 2; i++) {
+    const [sum, diff] = f([i, 1], [2, 3]);
+    assertAllEqual(sum, 2 * i + 7);
+    assertAllEqual(diff, [i - 2, -2]);
+  }
+});
+
+test(async function trace_retracesNewShapes() {
+  let calls = 0;
+  const f = trace((x: Tensor) => {
+    calls++;
+    return x.square().reduceSum();
+  });
+  assertAllEqual(f([1, 2]), 5);
+  assertAllEqual(f([[1, 2], [3, 4]]), 30);
+  assertAllEqual(f([3, 4]), 25);
+  assertAllEqual(f([[0, 1], [1, 0]]), 2);
+  assertAllEqual(f(tensor([1, 2], {dtype: "int32"})), 5);
+  assertEqual(calls, backend === "tf" ? 3 : 5);
+});
+
+test(async function trace_nested() {
+  const inner = trace((x: Tensor) => x.add(1));
+  const outer = trace((x: Tensor) => inner(x).mul(2));
+  assertAllEqual(outer([1, 2]), [4, 6]);
+  assertAllEqual(outer([3, 4]), [8, 10]);
+  // The inner function was never traced on its own.
+  assertAllEqual(inner([3, 4]), [4, 5]);
+});
+
+test(async function trace_throws() {
+  const f = trace((x: Tensor) => {
+    if (x.shape[0] > 2) throw Error("too long");
+    return x.neg();
+  });
+  let threw = false;
+  try {
+    f([1, 2, 3]);
+  } catch (e) {
+    threw = true;
+  }
+  assert(threw);
+  // The failed call must not leave a trace open.
+  assertAllEqual(f([1, 2]), [-1, -2]);
+  assertAllEqual(f([3, 4]), [-3, -4]);
+});
+
+test(async function trace_grad() {
+  const f = trace((x: Tensor) => x.square().reduceSum());
+  // The first call records the trace, so grad runs on a traced shape.
+  assertAllEqual(f([1, 2]), 5);
+  const g = grad(f);
+  assertAllClose(g([1, 2]), [2, 4]);
+  assertAllClose(g([3, 4]), [6, 8]);
+  // Without a tape the trace is still used.
+  assertAllEqual(f([3, 4]), 25);
+});
@@ -43,13 +43,49 @@ export interface Storage {
   dispose(): void;
 }
 
+// A mutable tensor, which the apply ops of BackendOps update in place.
+export interface Variable {
+  readonly shape: Shape;
+  readonly dtype: DType;
+  dispose(): void;
+}
+
 // BackendOps do not use backprop.
 export interface BackendOps {
   copyToDevice(x: Storage, device: string): Storage;
   getDevice(x: Storage): string;
   listDevices(): string[];
+  // Storage created between beginScope() and endScope() is disposed by
+  // endScope(), except the kept ones, which belong to the enclosing scope.
+  beginScope(): void;
+  endScope(keep: Storage[]): void;
+  // Ops run between beginTrace() and endTrace() are also recorded, with the
+  // inputs as parameters, so that runTrace() can run them all at once.
+  // endTrace() returns null if outputs is null or tracing is unsupported.
+  beginTrace(inputs: Storage[]): void;
+  endTrace(outputs: Storage[] | null): any;
+  runTrace(trace: any, inputs: Storage[]): Storage[];
+  // newVariable() returns null if the backend has no variables, in which
+  // case the other variable ops must not be called. A value returned by
+  // readVariable() doesn't change when the variable is updated.
+  newVariable(init: Storage): Variable | null;
+  readVariable(v: Variable): Storage;
+  assignVariable(v: Variable, value: Storage): void;
+  assignAddVariable(v: Variable, delta: Storage): void;
+  // The fused optimizer updates, with the semantics of TensorFlow's
+  // ResourceApplyGradientDescent, ResourceApplyMomentum and
+  // ResourceApplyAdam.
+  applyGradientDescent(v: Variable, lr: number, grad: Storage): void;
+  applyMomentum(v: Variable, accum: Variable, lr: number, grad: Storage,
+                momentum: number): void;
+  applyAdam(v: Variable, m: Variable, vhat: Variable, beta1Power: number,
+            beta2Power: number, lr: number, beta1: number, beta2: number,
+            epsilon: number, grad: Storage): void;
   fromTypedArray(data: TypedArray, shape: Shape, dtype?: DType,
                  device?: string): Storage;
+  // Returns a zeroed TypedArray which fromTypedArray() can use without
+  // copying it.
+  allocTypedArray(length: number, dtype: DType): TypedArray;
   add(x: Storage, y: Storage): Storage;
   sub(x: Storage, y: Storage): Storage;
   mul(x: Storage, y: Storage): Storage;
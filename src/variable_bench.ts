@@ -0,0 +1,68 @@
+// Compares training steps which update the params in place, in TensorFlow
+// resource variables, with steps which assign new tensors to the params.
+// Reports the step time and the RSS high-water mark of each. Memory isn't
+// returned to the OS reliably, so each variant runs in its own child
+// process, selected with PROPEL_VARIABLE_BENCH. Usage:
+//
+//   PROPEL=tf ts-node src/variable_bench.ts
+import { spawnSync } from "child_process";
+import { minimize, params, randn, sgd } from "./api";
+import { bench } from "./benchmark";
+import * as layers from "./layers";
+import { Params } from "./params";
+import { NamedTensors } from "./tensor";
+
+// The optimizer sgd() used before params were held in variables.
+function assignSGD(opts, p: Params, grads: NamedTensors): void {
+  for (const name of Object.keys(grads)) {
+    const t = p.get(name);
+    t.assign(t.sub(grads[name].mul(opts.lr)));
+  }
+}
+
+const x = randn([64, 784]);
+const labels = randn([64, 10]).softmax();
+const lossFn = p => {
+  const h = layers.linear(x, p.scope("L1"), 1024).relu();
+  const h2 = layers.linear(h, p.scope("L2"), 1024).relu();
+  const logits = layers.linear(h2, p.scope("L3"), 10);
+  return logits.softmaxCE(labels).reduceMean();
+};
+
+function peakRSS(step: () => void): number {
+  let peak = 0;
+  for (let i = 0; i < 50; i++) {
+    step();
+    peak = Math.max(peak, process.memoryUsage().rss);
+  }
+  return peak;
+}
+
+const variants = {
+  "assign": (p: Params) => minimize(assignSGD, { lr: 0.01, params: p },
+                                    lossFn),
+  "in place": (p: Params) => sgd({ lr: 0.01, params: p }, lossFn),
+  "in place momentum": (p: Params) =>
+    sgd({ lr: 0.01, momentum: 0.9, params: p }, lossFn),
+};
+
+const variant = process.env.PROPEL_VARIABLE_BENCH;
+if (variant) {
+  const p = params();
+  const step = () => variants[variant](p);
+  // The first step creates the params.
+  step();
+  bench(`mlp train step ${variant}`, step);
+  const mb = peakRSS(step) / (1 << 20);
+  console.log(`mlp train step ${variant} peak RSS ${mb.toFixed(1)} MB`);
+} else {
+  for (const name of Object.keys(variants)) {
+    const env = Object.assign({}, process.env, {
+      PROPEL: "tf",
+      PROPEL_VARIABLE_BENCH: name,
+    });
+    spawnSync(process.execPath,
+              ["./node_modules/ts-node/dist/bin.js", __filename],
+              { env, stdio: "inherit" });
+  }
+}
@@ -73,8 +73,25 @@ if (process.platform === "darwin" || process.platform === "linux") {
       -shared -pthread -rdynamic
     `;
   }
+  // An AddressSanitizer build, for tools/leak_check.js. Node itself isn't
+  // instrumented, so the ASan runtime has to be preloaded to load it.
+  if (process.argv.includes("asan")) {
+    cflags += `
+      -g -O1 -fsanitize=address -fno-omit-frame-pointer -DLEAK_CHECK
+    `;
+    ldflags += `
+      -fsanitize=address -shared-libasan
+    `;
+  }
   run.sh(`clang ${cflags}`);
   run.sh(`clang ${ldflags}`);
+
+  // The C++ benchmark harness, see src/tf_bench.cc.
+  if (process.argv.includes("bench")) {
+    run.sh(`clang++ -O2 -std=gnu++0x -o Release/tf_bench ../src/tf_bench.cc
+      -I${run.root} -I${run.root}/deps/libtensorflow/include -L./Release
+      -ltensorflow -Wl,-rpath,${buildDir}/Release`);
+  }
 } else if (process.platform === "win32") {
   execSync("node-gyp rebuild", { cwd: `${__dirname}/..`, stdio: "inherit" });
 }
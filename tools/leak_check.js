@@ -0,0 +1,82 @@
+#!/usr/bin/env node
+// Runs the binding tests with the binding built with AddressSanitizer, and
+// fails if LeakSanitizer finds memory allocated through src/tf_binding.cc
+// which was never freed. Node and libtensorflow leak a little on exit by
+// themselves; those reports are ignored. Linux only.
+//
+//   node tools/leak_check.js
+//
+// The normal binding is rebuilt afterwards.
+const { execSync, spawnSync } = require("child_process");
+const fs = require("fs");
+
+if (require.main !== module) {
+  // Preloaded into the test process. Handles are only freed by their
+  // finalizers, so collect garbage before exiting, or every handle the
+  // tests left to the garbage collector would be reported.
+  let collected = false;
+  process.on("beforeExit", () => {
+    if (collected) return;
+    collected = true;
+    global.gc();
+    // Finalizers run from the event loop after the collection.
+    setImmediate(() => global.gc());
+  });
+  return;
+}
+
+const run = require("./run");
+
+run.sh("node tools/build_tf_binding.js asan");
+
+const runtime = execSync("clang -print-file-name=libclang_rt.asan-x86_64.so")
+  .toString().trim();
+const logPrefix = run.root + "/build/lsan";
+for (const f of fs.readdirSync(run.root + "/build")) {
+  if (f.startsWith("lsan.")) fs.unlinkSync(run.root + "/build/" + f);
+}
+
+const r = spawnSync(process.execPath, [
+  "--expose-gc",
+  "-r", "./tools/leak_check.js",
+  "./node_modules/ts-node/dist/bin.js",
+  "src/tf_binding_test.ts",
+], {
+  stdio: "inherit",
+  env: {
+    ...process.env,
+    "PROPEL": "tf",
+    "LD_PRELOAD": runtime,
+    // Stacks through libtensorflow need the slow unwinder.
+    "ASAN_OPTIONS": `detect_leaks=1:fast_unwind_on_malloc=0:` +
+                    `malloc_context_size=30:log_path=${logPrefix}`,
+    "LSAN_OPTIONS": "exitcode=0:suppressions=tools/lsan_suppressions.txt",
+  }
+});
+
+run.sh("node tools/build_tf_binding.js");
+
+if (r.error) throw r.error;
+if (r.status) {
+  console.log("Error: tests failed under AddressSanitizer");
+  process.exit(r.status);
+}
+
+// Each report is a paragraph starting with "Direct leak" or "Indirect leak"
+// followed by the stack of the allocation.
+let leaks = 0;
+for (const f of fs.readdirSync(run.root + "/build")) {
+  if (!f.startsWith("lsan.")) continue;
+  const log = fs.readFileSync(run.root + "/build/" + f, "utf8");
+  for (const report of log.split(/\n\s*\n/)) {
+    if (!/(Direct|Indirect) leak/.test(report)) continue;
+    if (!report.includes("tf_binding.cc")) continue;
+    console.log(report.trim() + "\n");
+    leaks++;
+  }
+}
+if (leaks > 0) {
+  console.log(`Error: ${leaks} leaks from tf_binding.cc`);
+  process.exit(1);
+}
+console.log("No leaks from tf_binding.cc");
@@ -10,5 +10,6 @@ import "../src/mnist_test";
 import "../src/npy_test";
 import "../src/params_test";
 import "../src/tensor_util_test";
+import "../src/trace_test";
 import "../src/util_test";
 import "../website/rpc_test";